@@ -0,0 +1,431 @@
+/*************************************************************************
+
+   Program:    topscan
+   File:       kernels.c
+
+   Version:    V3.13
+   Date:       17.10.26
+   Function:   Run time selection of the alignment kernels
+
+   Copyright:  (c) UCL, Reading, Dr. Andrew C. R. Martin 1998-2026
+   Author:     agent, for topscan by Dr. Andrew C. R. Martin
+   Address:    Biomolecular Structure & Modelling Unit,
+               Department of Biochemistry & Molecular Biology,
+               University College,
+               Gower Street,
+               London.
+               WC1E 6BT.
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If someone
+   else breaks this code, I don't want to be blamed for code that does not
+   work!
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   simdalign.c is compiled once for each instruction set (see the
+   Makefile). This file holds the table of those variants and the
+   SIMDLanes() etc. functions called by topscan.c, which pass the call
+   on to the selected variant. By default the best variant the CPU
+   supports is used, found with cpuid. The scalar kernel has no vector
+   code at all, so topscan uses NumericAlignScore().
+
+   If the variants are not available (non-x86 machines), build with
+   -DNOSIMDKERNELS and only the scalar kernel exists.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.7  17.10.26 Original   By: agent
+   V3.9  17.10.26 Pass on the band width   By: agent
+   V3.13 17.10.26 Topology strings are TOPCODE arrays   By: agent
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "topscan.h"
+
+#if !defined(NOSIMDKERNELS) && (defined(__x86_64__) || defined(__i386__))
+#  define SIMDKERNELS
+#  include <cpuid.h>
+#endif
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define DECLAREKERNEL(k)                                                 \
+   int SIMDLanes_##k(void);                                              \
+   SIMDPROFILE *BuildSIMDProfile_##k(TOPCODE *top, int length,           \
+                                     int nrot);                          \
+   void FreeSIMDProfile_##k(SIMDPROFILE *profile);                       \
+   BOOL SIMDAlignScores_##k(SIMDPROFILE *profile, TOPCODE *seq2,         \
+                            int length2, int band, int *scores);         \
+   int SIMDBatchLanes_##k(void);                                         \
+   SIMDBATCHPROFILE *BuildSIMDBatchProfile_##k(TOPCODE *top, int length, \
+                                               int nrot);                \
+   void FreeSIMDBatchProfile_##k(SIMDBATCHPROFILE *profile);             \
+   BOOL SIMDBatchAlignScores_##k(SIMDBATCHPROFILE *profile,              \
+                                 TOPCODE **seqs, int *lengths,           \
+                                 int nseqs, int band, int *scores);
+#define KERNELENTRY(k, supported)                                        \
+   { #k, supported, SIMDLanes_##k, BuildSIMDProfile_##k,                 \
+     FreeSIMDProfile_##k, SIMDAlignScores_##k, SIMDBatchLanes_##k,       \
+     BuildSIMDBatchProfile_##k, FreeSIMDBatchProfile_##k,                \
+     SIMDBatchAlignScores_##k }
+
+/* cpuid bits                                                           */
+#define CPUID1_ECX_SSE41      (1 << 19)
+#define CPUID1_ECX_OSXSAVE    (1 << 27)
+#define CPUID1_ECX_AVX        (1 << 28)
+#define CPUID7_EBX_AVX2       (1 << 5)
+#define CPUID7_EBX_AVX512F    (1 << 16)
+#define CPUID7_EBX_AVX512BW   (1 << 30)
+/* XCR0 bits for register state saved by the OS                         */
+#define XCR0_AVX              0x06   /* SSE and AVX state                */
+#define XCR0_AVX512           0xe6   /* ...plus opmask and ZMM state     */
+
+/************************************************************************/
+/* Type definitions
+*/
+typedef struct                  /* One variant of the alignment kernels */
+{
+   char *name;
+   BOOL (*Supported)(void);
+   int  (*Lanes)(void);
+   SIMDPROFILE *(*BuildProfile)(TOPCODE *top, int length, int nrot);
+   void (*FreeProfile)(SIMDPROFILE *profile);
+   BOOL (*AlignScores)(SIMDPROFILE *profile, TOPCODE *seq2, int length2,
+                       int band, int *scores);
+   int  (*BatchLanes)(void);
+   SIMDBATCHPROFILE *(*BuildBatchProfile)(TOPCODE *top, int length,
+                                          int nrot);
+   void (*FreeBatchProfile)(SIMDBATCHPROFILE *profile);
+   BOOL (*BatchAlignScores)(SIMDBATCHPROFILE *profile, TOPCODE **seqs,
+                            int *lengths, int nseqs, int band,
+                            int *scores);
+}  SIMDKERNEL;
+
+/************************************************************************/
+/* Prototypes
+*/
+#ifdef SIMDKERNELS
+static BOOL CPUHasSSE41(void);
+static BOOL CPUHasAVX2(void);
+static BOOL CPUHasAVX512BW(void);
+static unsigned int ReadXCR0(void);
+DECLAREKERNEL(sse41)
+DECLAREKERNEL(avx2)
+DECLAREKERNEL(avx512bw)
+#endif
+
+/************************************************************************/
+/* Globals
+*/
+static SIMDKERNEL sKernels[] =  /* Best first                           */
+{
+#ifdef SIMDKERNELS
+   KERNELENTRY(avx512bw, CPUHasAVX512BW),
+   KERNELENTRY(avx2,     CPUHasAVX2),
+   KERNELENTRY(sse41,    CPUHasSSE41),
+#endif
+   { "scalar", NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+};
+#define NKERNELS ((int)(sizeof(sKernels) / sizeof(SIMDKERNEL)))
+
+static SIMDKERNEL *sKernel = &(sKernels[NKERNELS-1]);
+
+
+/************************************************************************/
+/*>BOOL SelectKernel(char *name)
+   -----------------------------
+   Input:   char   *name     Name of the kernel, or "auto" (or an empty
+                             string) for the best one the CPU supports
+   Returns: BOOL             Success?
+
+   Chooses the variant of the alignment kernels to use. Prints a message
+   and fails if the named kernel is not known or not supported by this
+   CPU.
+
+   17.10.26 Original   By: agent
+*/
+BOOL SelectKernel(char *name)
+{
+   int i;
+
+   for(i=0; i<NKERNELS; i++)
+   {
+      if((name[0] == '\0') || !strcmp(name, "auto"))
+      {
+         if((sKernels[i].Supported == NULL) || (*sKernels[i].Supported)())
+         {
+            sKernel = &(sKernels[i]);
+            return(TRUE);
+         }
+      }
+      else if(!strcmp(name, sKernels[i].name))
+      {
+         if((sKernels[i].Supported != NULL) &&
+            !(*sKernels[i].Supported)())
+         {
+            fprintf(stderr,"The %s kernel is not supported by this \
+CPU\n", name);
+            return(FALSE);
+         }
+         sKernel = &(sKernels[i]);
+         return(TRUE);
+      }
+   }
+
+   fprintf(stderr,"Unknown kernel: %s. Kernels are:", name);
+   for(i=0; i<NKERNELS; i++)
+      fprintf(stderr," %s", sKernels[i].name);
+   fprintf(stderr,"\n");
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>char *KernelName(void)
+   ----------------------
+   Returns: char *    Name of the kernel in use
+
+   17.10.26 Original   By: agent
+*/
+char *KernelName(void)
+{
+   return(sKernel->name);
+}
+
+
+/************************************************************************/
+/*>int SIMDLanes(void)
+   -------------------
+   Returns: int     16-bit lanes in the selected kernel (0 for scalar)
+
+   17.10.26 Original   By: agent
+*/
+int SIMDLanes(void)
+{
+   return((sKernel->Lanes == NULL) ? 0 : (*sKernel->Lanes)());
+}
+
+
+/************************************************************************/
+/*>SIMDPROFILE *BuildSIMDProfile(TOPCODE *top, int length, int nrot)
+   -------------------------------------------------------------
+   Builds a profile with the selected kernel. NULL for scalar.
+
+   17.10.26 Original   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+SIMDPROFILE *BuildSIMDProfile(TOPCODE *top, int length, int nrot)
+{
+   if(sKernel->BuildProfile == NULL)
+      return(NULL);
+   return((*sKernel->BuildProfile)(top, length, nrot));
+}
+
+
+/************************************************************************/
+/*>void FreeSIMDProfile(SIMDPROFILE *profile)
+   ------------------------------------------
+   Frees a profile built with the selected kernel
+
+   17.10.26 Original   By: agent
+*/
+void FreeSIMDProfile(SIMDPROFILE *profile)
+{
+   if(sKernel->FreeProfile != NULL)
+      (*sKernel->FreeProfile)(profile);
+}
+
+
+/************************************************************************/
+/*>BOOL SIMDAlignScores(SIMDPROFILE *profile, TOPCODE *seq2, int length2,
+                        int band, int *scores)
+   ------------------------------------------------------------------
+   Scores every orientation with the selected kernel
+
+   17.10.26 Original   By: agent
+   17.10.26 Added band   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+BOOL SIMDAlignScores(SIMDPROFILE *profile, TOPCODE *seq2, int length2,
+                     int band, int *scores)
+{
+   if(sKernel->AlignScores == NULL)
+      return(FALSE);
+   return((*sKernel->AlignScores)(profile, seq2, length2, band, scores));
+}
+
+
+/************************************************************************/
+/*>int SIMDBatchLanes(void)
+   ------------------------
+   Returns: int     Entries in a batch for the selected kernel (0 for 
+                    scalar)
+
+   17.10.26 Original   By: agent
+*/
+int SIMDBatchLanes(void)
+{
+   return((sKernel->BatchLanes == NULL) ? 0 : (*sKernel->BatchLanes)());
+}
+
+
+/************************************************************************/
+/*>SIMDBATCHPROFILE *BuildSIMDBatchProfile(TOPCODE *top, int length, 
+                                           int nrot)
+   ---------------------------------------------------------------
+   Builds a batch profile with the selected kernel. NULL for scalar.
+
+   17.10.26 Original   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+SIMDBATCHPROFILE *BuildSIMDBatchProfile(TOPCODE *top, int length, int nrot)
+{
+   if(sKernel->BuildBatchProfile == NULL)
+      return(NULL);
+   return((*sKernel->BuildBatchProfile)(top, length, nrot));
+}
+
+
+/************************************************************************/
+/*>void FreeSIMDBatchProfile(SIMDBATCHPROFILE *profile)
+   ----------------------------------------------------
+   Frees a batch profile built with the selected kernel
+
+   17.10.26 Original   By: agent
+*/
+void FreeSIMDBatchProfile(SIMDBATCHPROFILE *profile)
+{
+   if(sKernel->FreeBatchProfile != NULL)
+      (*sKernel->FreeBatchProfile)(profile);
+}
+
+
+/************************************************************************/
+/*>BOOL SIMDBatchAlignScores(SIMDBATCHPROFILE *profile, TOPCODE **seqs,
+                             int *lengths, int nseqs, int band, 
+                             int *scores)
+   ----------------------------------------------------------------
+   Aligns a batch with the selected kernel
+
+   17.10.26 Original   By: agent
+   17.10.26 Added band   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+BOOL SIMDBatchAlignScores(SIMDBATCHPROFILE *profile, TOPCODE **seqs,
+                          int *lengths, int nseqs, int band, 
+                          int *scores)
+{
+   if(sKernel->BatchAlignScores == NULL)
+      return(FALSE);
+   return((*sKernel->BatchAlignScores)(profile, seqs, lengths, nseqs,
+                                       band, scores));
+}
+
+
+#ifdef SIMDKERNELS
+/************************************************************************/
+/*>static BOOL CPUHasSSE41(void)
+   -----------------------------
+   Returns: BOOL    Does the CPU support SSE4.1?
+
+   17.10.26 Original   By: agent
+*/
+static BOOL CPUHasSSE41(void)
+{
+   unsigned int eax, ebx, ecx, edx;
+
+   if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+      return(FALSE);
+   return((ecx & CPUID1_ECX_SSE41) ? TRUE : FALSE);
+}
+
+
+/************************************************************************/
+/*>static BOOL CPUHasAVX2(void)
+   ----------------------------
+   Returns: BOOL    Does the CPU support AVX2 (and does the OS save the
+                    AVX registers)?
+
+   17.10.26 Original   By: agent
+*/
+static BOOL CPUHasAVX2(void)
+{
+   unsigned int eax, ebx, ecx, edx;
+
+   if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+      return(FALSE);
+   if(!(ecx & CPUID1_ECX_OSXSAVE) || !(ecx & CPUID1_ECX_AVX))
+      return(FALSE);
+   if((ReadXCR0() & XCR0_AVX) != XCR0_AVX)
+      return(FALSE);
+   if(__get_cpuid_max(0, NULL) < 7)
+      return(FALSE);
+   __cpuid_count(7, 0, eax, ebx, ecx, edx);
+   return((ebx & CPUID7_EBX_AVX2) ? TRUE : FALSE);
+}
+
+
+/************************************************************************/
+/*>static BOOL CPUHasAVX512BW(void)
+   --------------------------------
+   Returns: BOOL    Does the CPU support AVX-512F and AVX-512BW (and does
+                    the OS save the AVX-512 registers)?
+
+   17.10.26 Original   By: agent
+*/
+static BOOL CPUHasAVX512BW(void)
+{
+   unsigned int eax, ebx, ecx, edx;
+
+   if(!CPUHasAVX2())
+      return(FALSE);
+   if((ReadXCR0() & XCR0_AVX512) != XCR0_AVX512)
+      return(FALSE);
+   __cpuid_count(7, 0, eax, ebx, ecx, edx);
+   return(((ebx & CPUID7_EBX_AVX512F) && (ebx & CPUID7_EBX_AVX512BW)) ?
+          TRUE : FALSE);
+}
+
+
+/************************************************************************/
+/*>static unsigned int ReadXCR0(void)
+   ----------------------------------
+   Returns: unsigned int    Low word of extended control register 0
+
+   Only call if cpuid says OSXSAVE is set
+
+   17.10.26 Original   By: agent
+*/
+static unsigned int ReadXCR0(void)
+{
+   unsigned int eax, edx;
+
+   __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+   return(eax);
+}
+#endif
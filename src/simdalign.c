@@ -0,0 +1,1129 @@
+/*************************************************************************
+
+   Program:    topscan
+   File:       simdalign.c
+
+   Version:    V3.13
+   Date:       17.10.26
+   Function:   Vectorised scoring of topology string alignments
+
+   Copyright:  (c) UCL, Reading, Dr. Andrew C. R. Martin 1998-2026
+   Author:     agent, for topscan by Dr. Andrew C. R. Martin
+   Address:    Biomolecular Structure & Modelling Unit,
+               Department of Biochemistry & Molecular Biology,
+               University College,
+               Gower Street,
+               London.
+               WC1E 6BT.
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If someone
+   else breaks this code, I don't want to be blamed for code that does not
+   work!
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   Striped (Farrar-style) alignment scoring using 16-bit lanes. This
+   gives exactly the score of NumericAlignScore() in topscan.c for a
+   scoring matrix with no negative values, as long as the score fits in
+   16 bits. The caller is responsible for checking both.
+
+   NumericAlignScore() fills the matrix from the bottom right, but with
+   no negative scores the result is just the best value anywhere in the
+   matrix, which is the same as filling from the top left:
+      H[i][j] = s(i,j) + G[i-1][j-1]
+      G[i][j] = max(H[i][j], E[i][j], F[i][j])
+      E[i][j] = max(H[i][l], l<j) - GAPPEN
+      F[i][j] = max(H[k][j], k<i) - GAPPEN
+   with G 0 outside the matrix. F only feeds into G, not into H in the
+   same column, so after the first pass down a column F just has to be
+   carried from each lane into the following lanes. That second pass
+   stops as soon as the carried value can no longer change anything.
+
+   The probe is held in a profile built once for each orientation so
+   the library entry is never rotated.
+
+   When all 24 orientations are wanted, it is better still to give each
+   orientation its own lane: the 24 matrices differ only in their
+   scores, so one pass over the two strings fills them all, with the
+   scores for a probe element against a library code being a single
+   load of 32 lanes (24 used). There is no striping so the gap terms are
+   just carried along as in the scalar code.
+
+   For short library entries most of those lanes would be wasted, so
+   there is also a batch kernel which aligns the probe against one
+   library entry in each lane using 8-bit unsigned saturating
+   arithmetic. Here the scores for each lane have to be looked up
+   separately; they are read a vector at a time from the probe's byte
+   profile and transposed into place 16 probe elements at a time. A
+   lane whose best score reaches 255 may have saturated and is flagged
+   so that the caller can redo it with the 16-bit kernel.
+
+   With primary topology only (-1), the topology strings only contain
+   the strand and helix codes (and 0 for unassigned). A batch made up
+   only of those needs no look-up at all: the probe's scores against a
+   strand and against a helix are held ready in a vector for each probe
+   element, and the score for a cell is chosen by comparing the lanes'
+   codes with the two codes once per column.
+
+   The batch and rotation-parallel kernels may be given a band width, in
+   which case only the cells with |i-j| <= band are filled. The cells
+   outside the band are treated just as those past the edge of the
+   matrix.
+
+   The same code is written for AVX-512BW, AVX2 or SSE2/SSE4.1 
+   depending on which the compiler is generating code for. The Makefile
+   compiles this file once for each with -DKERNEL=name, which appends
+   _name to the public functions (e.g. SIMDLanes_avx2()), and kernels.c
+   picks one at run time. If there is no SIMD support, SIMDLanes() 
+   returns 0 and no profile is built so topscan uses the scalar code.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.4  17.10.26 Original   By: agent
+   V3.5  17.10.26 Added the 8-bit batch kernel   By: agent
+   V3.6  17.10.26 Added the rotation-parallel kernel   By: agent
+   V3.7  17.10.26 Added AVX-512BW. Built as named variants for run time
+                  selection   By: agent
+   V3.8  17.10.26 Added the batch kernel for the primary topology codes
+                  By: agent
+   V3.9  17.10.26 The batch and rotation-parallel kernels can be
+                  restricted to a band around the diagonal   By: agent
+   V3.13 17.10.26 Topology strings are TOPCODE arrays   By: agent
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Name the public functions after this variant                        */
+#ifndef KERNEL
+#  error "Compile with -DKERNEL=name (see the Makefile)"
+#endif
+#define KERNELFN2(f,k)          f##_##k
+#define KERNELFN(f,k)           KERNELFN2(f,k)
+#define SIMDLanes               KERNELFN(SIMDLanes,KERNEL)
+#define BuildSIMDProfile        KERNELFN(BuildSIMDProfile,KERNEL)
+#define FreeSIMDProfile         KERNELFN(FreeSIMDProfile,KERNEL)
+#define SIMDAlignScores         KERNELFN(SIMDAlignScores,KERNEL)
+#define SIMDBatchLanes          KERNELFN(SIMDBatchLanes,KERNEL)
+#define BuildSIMDBatchProfile   KERNELFN(BuildSIMDBatchProfile,KERNEL)
+#define FreeSIMDBatchProfile    KERNELFN(FreeSIMDBatchProfile,KERNEL)
+#define SIMDBatchAlignScores    KERNELFN(SIMDBatchAlignScores,KERNEL)
+
+#include "topscan.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#if defined(__AVX512BW__)
+#  include <immintrin.h>
+#  define SIMD_SUPPORT
+typedef __m512i VEC;
+#  define VLANES            32
+#  define VLANES8           64
+#  define VZERO()           _mm512_setzero_si512()
+#  define VSET1(x)          _mm512_set1_epi16(x)
+#  define VADDS(a,b)        _mm512_adds_epi16((a),(b))
+#  define VSUBS(a,b)        _mm512_subs_epi16((a),(b))
+#  define VMAX(a,b)         _mm512_max_epi16((a),(b))
+#  define VCMPGT(a,b)       _mm512_movm_epi16(_mm512_cmpgt_epi16_mask((a),(b)))
+#  define VAND(a,b)         _mm512_and_si512((a),(b))
+#  define VANY(v)           (_mm512_test_epi16_mask((v),(v)) != 0)
+   /* Shift up by n lanes: lane i takes lane i-n, lanes below n are 0   */
+#  define VSHIFT(v,n)       _mm512_maskz_permutexvar_epi16(             \
+                               (__mmask32)(0xffffffffUL << (n)),        \
+                               _mm512_sub_epi16(                        \
+                                  _mm512_loadu_si512(sLaneIndex),       \
+                                  _mm512_set1_epi16(n)), (v))
+#  define VPREFIXMAX(v)     (v) = VMAX((v), VSHIFT((v),1));             \
+                            (v) = VMAX((v), VSHIFT((v),2));             \
+                            (v) = VMAX((v), VSHIFT((v),4));             \
+                            (v) = VMAX((v), VSHIFT((v),8));             \
+                            (v) = VMAX((v), VSHIFT((v),16))
+#  define VADDS8(a,b)       _mm512_adds_epu8((a),(b))
+#  define VSUBS8(a,b)       _mm512_subs_epu8((a),(b))
+#  define VMAX8(a,b)        _mm512_max_epu8((a),(b))
+#  define VSET18(x)         _mm512_set1_epi8(x)
+#  define VUNPACKLO8(a,b)   _mm512_unpacklo_epi8((a),(b))
+#  define VUNPACKHI8(a,b)   _mm512_unpackhi_epi8((a),(b))
+#  define VCMPEQ8(a,b)      _mm512_movm_epi8(_mm512_cmpeq_epi8_mask((a),(b)))
+#  define VOR(a,b)          _mm512_or_si512((a),(b))
+   /* 16 bytes from each of four rows, one in each 128-bit quarter      */
+#  define VLOADROW(r,k,o)   _mm_load_si128((__m128i *)((r)[k]+(o)))
+#  define VLOADROWS(r,k,o)  _mm512_inserti32x4(_mm512_inserti32x4(      \
+                               _mm512_inserti32x4(                      \
+                                  _mm512_castsi128_si512(               \
+                                     VLOADROW(r,k,o)),                  \
+                                  VLOADROW(r,(k)+16,o), 1),             \
+                               VLOADROW(r,(k)+32,o), 2),                \
+                               VLOADROW(r,(k)+48,o), 3)
+static const short sLaneIndex[32] = { 0,  1,  2,  3,  4,  5,  6,  7,
+                                      8,  9, 10, 11, 12, 13, 14, 15,
+                                     16, 17, 18, 19, 20, 21, 22, 23,
+                                     24, 25, 26, 27, 28, 29, 30, 31};
+#elif defined(__AVX2__)
+#  include <immintrin.h>
+#  define SIMD_SUPPORT
+typedef __m256i VEC;
+#  define VLANES            16
+#  define VLANES8           32
+#  define VZERO()           _mm256_setzero_si256()
+#  define VSET1(x)          _mm256_set1_epi16(x)
+#  define VADDS(a,b)        _mm256_adds_epi16((a),(b))
+#  define VSUBS(a,b)        _mm256_subs_epi16((a),(b))
+#  define VMAX(a,b)         _mm256_max_epi16((a),(b))
+#  define VCMPGT(a,b)       _mm256_cmpgt_epi16((a),(b))
+#  define VAND(a,b)         _mm256_and_si256((a),(b))
+#  define VANY(v)           (_mm256_movemask_epi8(v) != 0)
+   /* Shift up by n lanes (n<8) across the two 128-bit halves           */
+#  define VSHIFT(v,n)       _mm256_alignr_epi8((v),                     \
+                               _mm256_permute2x128_si256((v),(v),0x08), \
+                               16-2*(n))
+#  define VSHIFT8(v)        _mm256_permute2x128_si256((v),(v),0x08)
+#  define VPREFIXMAX(v)     (v) = VMAX((v), VSHIFT((v),1));             \
+                            (v) = VMAX((v), VSHIFT((v),2));             \
+                            (v) = VMAX((v), VSHIFT((v),4));             \
+                            (v) = VMAX((v), VSHIFT8(v))
+#  define VADDS8(a,b)       _mm256_adds_epu8((a),(b))
+#  define VSUBS8(a,b)       _mm256_subs_epu8((a),(b))
+#  define VMAX8(a,b)        _mm256_max_epu8((a),(b))
+#  define VSET18(x)         _mm256_set1_epi8(x)
+#  define VUNPACKLO8(a,b)   _mm256_unpacklo_epi8((a),(b))
+#  define VUNPACKHI8(a,b)   _mm256_unpackhi_epi8((a),(b))
+#  define VCMPEQ8(a,b)      _mm256_cmpeq_epi8((a),(b))
+#  define VOR(a,b)          _mm256_or_si256((a),(b))
+   /* 16 bytes from each of two rows, the second in the upper half      */
+#  define VLOADROW(r,k,o)   _mm_load_si128((__m128i *)((r)[k]+(o)))
+#  define VLOADROWS(r,k,o)  _mm256_inserti128_si256(                    \
+                               _mm256_castsi128_si256(                  \
+                                  VLOADROW(r,k,o)),                     \
+                               VLOADROW(r,(k)+16,o), 1)
+#elif defined(__SSE2__)
+#  ifdef __SSE4_1__
+#     include <smmintrin.h>
+#  else
+#     include <emmintrin.h>
+#  endif
+#  define SIMD_SUPPORT
+typedef __m128i VEC;
+#  define VLANES            8
+#  define VLANES8           16
+#  define VZERO()           _mm_setzero_si128()
+#  define VSET1(x)          _mm_set1_epi16(x)
+#  define VADDS(a,b)        _mm_adds_epi16((a),(b))
+#  define VSUBS(a,b)        _mm_subs_epi16((a),(b))
+#  define VMAX(a,b)         _mm_max_epi16((a),(b))
+#  define VCMPGT(a,b)       _mm_cmpgt_epi16((a),(b))
+#  define VAND(a,b)         _mm_and_si128((a),(b))
+#  ifdef __SSE4_1__
+#     define VANY(v)        (!_mm_testz_si128((v),(v)))
+#  else
+#     define VANY(v)        (_mm_movemask_epi8(v) != 0)
+#  endif
+#  define VSHIFT(v,n)       _mm_slli_si128((v),2*(n))
+#  define VPREFIXMAX(v)     (v) = VMAX((v), VSHIFT((v),1));             \
+                            (v) = VMAX((v), VSHIFT((v),2));             \
+                            (v) = VMAX((v), VSHIFT((v),4))
+#  define VADDS8(a,b)       _mm_adds_epu8((a),(b))
+#  define VSUBS8(a,b)       _mm_subs_epu8((a),(b))
+#  define VMAX8(a,b)        _mm_max_epu8((a),(b))
+#  define VSET18(x)         _mm_set1_epi8(x)
+#  define VUNPACKLO8(a,b)   _mm_unpacklo_epi8((a),(b))
+#  define VUNPACKHI8(a,b)   _mm_unpackhi_epi8((a),(b))
+#  define VCMPEQ8(a,b)      _mm_cmpeq_epi8((a),(b))
+#  define VOR(a,b)          _mm_or_si128((a),(b))
+#  define VLOADROWS(r,k,o)  _mm_load_si128((VEC *)((r)[k]+(o)))
+#endif
+
+#define BATCHBLOCK 16        /* Probe elements transposed at a time      */
+#define ROTLANES   32        /* 16-bit lanes for the 24 orientations     */
+#define ROTVECS    (ROTLANES/VLANES) /* Vectors to hold them             */
+#define BATCHSATURATED 255   /* Possibly saturated 8-bit score           */
+
+/* The probe elements in the band for library column j are from 
+   BANDSTART() up to (but not including) BANDSTOP()
+*/
+#define BANDSTART(j, band)     ((((band) < 0) || ((j) <= (band))) ?      \
+                                0 : (j)-(band))
+#define BANDSTOP(j, band, len) ((((band) < 0) || ((j)+(band) >= (len))) ? \
+                                (len) : (j)+(band)+1)
+
+/************************************************************************/
+/* Prototypes
+*/
+#ifdef SIMD_SUPPORT
+static int StripedScore(SIMDPROFILE *profile, int rot, TOPCODE *seq2,
+                        int length2, VEC *work);
+static void BatchScores(unsigned char **rows, int start, int stop,
+                        VEC *scores);
+static BOOL RotationScores(SIMDPROFILE *profile, TOPCODE *seq2, int length2,
+                           int band, int *scores);
+static BOOL LayOutPrimaryBatch(TOPCODE **seqs, int *lengths, int nseqs,
+                               int maxlen, unsigned char *codes);
+static void PrimaryBatchScores(SIMDBATCHPROFILE *profile, VEC *work,
+                               int maxlen, int nseqs, int band,
+                               int *scores);
+#endif
+
+
+/************************************************************************/
+/*>int SIMDLanes(void)
+   -------------------
+   Returns: int     Number of 16-bit lanes in a vector (0 if there is no
+                    SIMD support)
+
+   17.10.26 Original   By: agent
+*/
+int SIMDLanes(void)
+{
+#ifdef SIMD_SUPPORT
+   return(VLANES);
+#else
+   return(0);
+#endif
+}
+
+
+/************************************************************************/
+/*>SIMDPROFILE *BuildSIMDProfile(TOPCODE *top, int length, int nrot)
+   -------------------------------------------------------------
+   Input:   TOPCODE      *top     Probe topology string
+            int          length   Length of the probe (>0)
+            int          nrot     Number of orientations to build
+   Returns: SIMDPROFILE  *        Profile (NULL if no memory or no SIMD
+                                  support)
+
+   Builds the striped score profile of a probe. For each orientation
+   and each code that may appear in a library entry, this holds the
+   score of every element of the probe against that code. Element i is
+   in lane i/segLen of vector i%segLen; positions past the end of the
+   probe score 0, which cannot change the best score.
+
+   If all NROTATIONS orientations are wanted, the rotation-parallel
+   profile is built as well. This has ROTLANES scores for each code and
+   each element of the probe, one for each orientation.
+
+   17.10.26 Original   By: agent
+   17.10.26 Added the rotation-parallel profile   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+SIMDPROFILE *BuildSIMDProfile(TOPCODE *top, int length, int nrot)
+{
+#ifdef SIMD_SUPPORT
+   SIMDPROFILE *profile;
+   short       *prof;
+   int         rot, code, seg, lane, i;
+
+   if((profile = (SIMDPROFILE *)malloc(sizeof(SIMDPROFILE)))==NULL)
+      return(NULL);
+
+   profile->length = length;
+   profile->lanes  = VLANES;
+   profile->segLen = (length + VLANES - 1) / VLANES;
+   profile->nrot   = nrot;
+   profile->rotProfile = NULL;
+
+   if((profile->profile =
+       (short *)_mm_malloc(nrot * (NCODES+1) * profile->segLen *
+                           sizeof(VEC), sizeof(VEC)))==NULL)
+   {
+      free(profile);
+      return(NULL);
+   }
+
+   if(nrot == NROTATIONS)
+   {
+      if((profile->rotProfile = 
+          (short *)_mm_malloc((NCODES+1) * length * ROTLANES * 
+                              sizeof(short), sizeof(VEC)))==NULL)
+      {
+         _mm_free(profile->profile);
+         free(profile);
+         return(NULL);
+      }
+
+      prof = profile->rotProfile;
+      for(code=0; code<=NCODES; code++)
+      {
+         for(i=0; i<length; i++)
+         {
+            for(rot=0; rot<ROTLANES; rot++)
+            {
+               *(prof++) = (short)((rot < NROTATIONS) ?
+                                   gRotMDM[rot][top[i]][code] : 0);
+            }
+         }
+      }
+   }
+
+   prof = profile->profile;
+   for(rot=0; rot<nrot; rot++)
+   {
+      for(code=0; code<=NCODES; code++)
+      {
+         for(seg=0; seg<profile->segLen; seg++)
+         {
+            for(lane=0; lane<VLANES; lane++)
+            {
+               i = lane * profile->segLen + seg;
+               *(prof++) = (short)((i < length) ?
+                                   gRotMDM[rot][top[i]][code] : 0);
+            }
+         }
+      }
+   }
+
+   return(profile);
+#else
+   return(NULL);
+#endif
+}
+
+
+/************************************************************************/
+/*>void FreeSIMDProfile(SIMDPROFILE *profile)
+   ------------------------------------------
+   I/O:     SIMDPROFILE  *profile   Profile to free
+
+   17.10.26 Original   By: agent
+*/
+void FreeSIMDProfile(SIMDPROFILE *profile)
+{
+#ifdef SIMD_SUPPORT
+   if(profile != NULL)
+   {
+      _mm_free(profile->profile);
+      if(profile->rotProfile != NULL)
+         _mm_free(profile->rotProfile);
+      free(profile);
+   }
+#endif
+}
+
+
+/************************************************************************/
+/*>BOOL SIMDAlignScores(SIMDPROFILE *profile, TOPCODE *seq2, int length2,
+                        int band, int *scores)
+   ------------------------------------------------------------------
+   Input:   SIMDPROFILE  *profile   Profile of the probe
+            TOPCODE      *seq2      Library topology string
+            int          length2    Length of seq2 (>0)
+            int          band       Band width (NOBAND for the full 
+                                    matrix)
+   Output:  int          *scores    Score for each orientation in the
+                                    profile
+   Returns: BOOL                    Success?
+
+   Scores every orientation of the probe against a library entry. Uses
+   the rotation-parallel kernel if the profile has all the orientations
+   or the striped kernel for each orientation otherwise. The striped
+   kernel cannot be banded so the band must be NOBAND unless the profile
+   has all the orientations.
+
+   17.10.26 Original   By: agent
+   17.10.26 Uses RotationScores() if possible   By: agent
+   17.10.26 Added band   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+BOOL SIMDAlignScores(SIMDPROFILE *profile, TOPCODE *seq2, int length2,
+                     int band, int *scores)
+{
+#ifdef SIMD_SUPPORT
+   VEC *work;
+   int rot;
+
+   if(profile->rotProfile != NULL)
+      return(RotationScores(profile, seq2, length2, band, scores));
+
+   if((work = (VEC *)_mm_malloc(4 * profile->segLen * sizeof(VEC),
+                                sizeof(VEC)))==NULL)
+      return(FALSE);
+
+   for(rot=0; rot<profile->nrot; rot++)
+      scores[rot] = StripedScore(profile, rot, seq2, length2, work);
+
+   _mm_free(work);
+   return(TRUE);
+#else
+   return(FALSE);
+#endif
+}
+
+
+/************************************************************************/
+/*>int SIMDBatchLanes(void)
+   ------------------------
+   Returns: int     Number of library entries aligned at once by
+                    SIMDBatchAlignScores() (0 if there is no SIMD support)
+
+   17.10.26 Original   By: agent
+*/
+int SIMDBatchLanes(void)
+{
+#ifdef SIMD_SUPPORT
+   return(VLANES8);
+#else
+   return(0);
+#endif
+}
+
+
+/************************************************************************/
+/*>SIMDBATCHPROFILE *BuildSIMDBatchProfile(TOPCODE *top, int length, 
+                                           int nrot)
+   ---------------------------------------------------------------
+   Input:   TOPCODE          *top     Probe topology string
+            int              length   Length of the probe (>0)
+            int              nrot     Number of orientations to build
+   Returns: SIMDBATCHPROFILE *        Profile (NULL if no memory or no
+                                      SIMD support)
+
+   Builds the byte profile of a probe used by SIMDBatchAlignScores().
+   For each orientation and each code that may appear in a library
+   entry, this holds the score of each element of the probe against that
+   code in probe order, padded with zeros to a whole number of blocks.
+   The scores must all fit in a byte.
+
+   For primary topology (a single orientation), also keeps vectors of
+   the probe's scores against PRIMARYSTRAND and PRIMARYHELIX for
+   PrimaryBatchScores().
+
+   17.10.26 Original   By: agent
+   17.10.26 Added the primary topology vectors   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+SIMDBATCHPROFILE *BuildSIMDBatchProfile(TOPCODE *top, int length, int nrot)
+{
+#ifdef SIMD_SUPPORT
+   SIMDBATCHPROFILE *profile;
+   unsigned char    *prof;
+   int              rot, code, i;
+
+   if((profile = (SIMDBATCHPROFILE *)malloc(sizeof(SIMDBATCHPROFILE)))
+      ==NULL)
+      return(NULL);
+
+   profile->length    = length;
+   profile->lanes     = VLANES8;
+   profile->padLength = BATCHBLOCK * ((length + BATCHBLOCK - 1) / 
+                                      BATCHBLOCK);
+   profile->nrot      = nrot;
+   profile->primary   = NULL;
+
+   if((profile->profile =
+       (unsigned char *)_mm_malloc(nrot * (NCODES+1) * 
+                                   profile->padLength, 
+                                   sizeof(VEC)))==NULL)
+   {
+      free(profile);
+      return(NULL);
+   }
+
+   if(nrot == 1)
+   {
+      VEC *pv;
+      
+      if((profile->primary = 
+          (unsigned char *)_mm_malloc(2 * length * sizeof(VEC),
+                                      sizeof(VEC)))==NULL)
+      {
+         _mm_free(profile->profile);
+         free(profile);
+         return(NULL);
+      }
+
+      pv = (VEC *)profile->primary;
+      for(i=0; i<length; i++)
+      {
+         *(pv++) = VSET18((char)gRotMDM[0][top[i]][PRIMARYSTRAND]);
+         *(pv++) = VSET18((char)gRotMDM[0][top[i]][PRIMARYHELIX]);
+      }
+   }
+
+   prof = profile->profile;
+   for(rot=0; rot<nrot; rot++)
+   {
+      for(code=0; code<=NCODES; code++)
+      {
+         for(i=0; i<profile->padLength; i++)
+         {
+            *(prof++) = (unsigned char)((i < length) ?
+                                        gRotMDM[rot][top[i]][code] : 0);
+         }
+      }
+   }
+
+   return(profile);
+#else
+   return(NULL);
+#endif
+}
+
+
+/************************************************************************/
+/*>void FreeSIMDBatchProfile(SIMDBATCHPROFILE *profile)
+   ----------------------------------------------------
+   I/O:     SIMDBATCHPROFILE  *profile   Profile to free
+
+   17.10.26 Original   By: agent
+*/
+void FreeSIMDBatchProfile(SIMDBATCHPROFILE *profile)
+{
+#ifdef SIMD_SUPPORT
+   if(profile != NULL)
+   {
+      _mm_free(profile->profile);
+      if(profile->primary != NULL)
+         _mm_free(profile->primary);
+      free(profile);
+   }
+#endif
+}
+
+
+/************************************************************************/
+/*>BOOL SIMDBatchAlignScores(SIMDBATCHPROFILE *profile, TOPCODE **seqs,
+                             int *lengths, int nseqs, int band,
+                             int *scores)
+   ----------------------------------------------------------------
+   Input:   SIMDBATCHPROFILE *profile   Byte profile of the probe
+            TOPCODE          **seqs     Library topology strings
+            int              *lengths   Their lengths
+            int              nseqs      Number of strings (up to
+                                        profile->lanes)
+            int              band       Band width (NOBAND for the 
+                                        full matrix)
+   Output:  int              *scores    Score of each string in each
+                                        orientation, indexed
+                                        [seq*nrot + rot], or
+                                        SIMDBATCH_OVERFLOW if the score
+                                        may have saturated
+   Returns: BOOL                        Success?
+
+   Aligns the probe against several library entries at once, one in each
+   lane. Works down the library entries a column at a time and down the
+   probe within each column, so the F gap term is carried in a register
+   and E and G for the previous column are kept for each probe element.
+   The entries should be of similar length since every lane runs to the
+   length of the longest. Positions past the end of an entry (and unused
+   lanes) are given code 0, which scores 0 and so cannot change the best
+   score. An empty entry therefore scores 0.
+
+   With a band, each column only runs over the probe elements in the
+   band and only the blocks of scores covering those are transposed.
+   The G carried in on the diagonal at the top of the band is the one 
+   left by the previous column.
+
+   If the profile allows, a batch of primary topology strings is laid
+   out a column at a time and handed to PrimaryBatchScores() instead.
+
+   17.10.26 Original   By: agent
+   17.10.26 Added PrimaryBatchScores()   By: agent
+   17.10.26 Added band   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+BOOL SIMDBatchAlignScores(SIMDBATCHPROFILE *profile, TOPCODE **seqs,
+                          int *lengths, int nseqs, int band,
+                          int *scores)
+{
+#ifdef SIMD_SUPPORT
+   VEC           *work, *pvE, *pvG, *pvS,
+                 vP = VSET18(GAPPEN),
+                 vZero = VZERO(),
+                 vMax, vH, vE, vF, vG, vHP, vDiag;
+   unsigned char *rows[VLANES8],
+                 best[VLANES8];
+   int           length1 = profile->length,
+                 padLength = profile->padLength,
+                 maxlen = 0,
+                 worklen,
+                 rot, lane, i, j, code, start, stop;
+
+   for(lane=0; lane<nseqs; lane++)
+   {
+      if(lengths[lane] > maxlen)
+         maxlen = lengths[lane];
+   }
+
+   /* The primary topology codes of the batch may need more room than
+      the scores of a column
+   */
+   worklen = 2*length1 + 
+             (((profile->primary != NULL) && (maxlen > padLength)) ?
+              maxlen : padLength);
+   if((work = (VEC *)_mm_malloc(worklen * sizeof(VEC),
+                                sizeof(VEC)))==NULL)
+      return(FALSE);
+   pvE = work;
+   pvG = work + length1;
+   pvS = work + 2*length1;
+
+   if((profile->primary != NULL) &&
+      LayOutPrimaryBatch(seqs, lengths, nseqs, maxlen, 
+                         (unsigned char *)pvS))
+   {
+      PrimaryBatchScores(profile, work, maxlen, nseqs, band, scores);
+      _mm_free(work);
+      return(TRUE);
+   }
+
+   for(rot=0; rot<profile->nrot; rot++)
+   {
+      for(i=0; i<length1; i++)
+      {
+         pvE[i] = vZero;
+         pvG[i] = vZero;
+      }
+      vMax = vZero;
+
+      for(j=0; j<maxlen; j++)
+      {
+         start = BANDSTART(j, band);
+         stop  = BANDSTOP(j, band, length1);
+         if(start >= stop)
+            break;
+
+         /* Look up the scores of this column for every lane            */
+         for(lane=0; lane<VLANES8; lane++)
+         {
+            code = (((lane < nseqs) && (j < lengths[lane])) ? 
+                    seqs[lane][j] : 0);
+            rows[lane] = profile->profile + 
+                         ((rot * (NCODES+1)) + code) * padLength;
+         }
+         BatchScores(rows, start - (start % BATCHBLOCK),
+                     stop + ((BATCHBLOCK - (stop % BATCHBLOCK)) % 
+                             BATCHBLOCK), 
+                     pvS);
+
+         vDiag = (start ? pvG[start-1] : vZero);
+         vF    = vZero;
+         for(i=start; i<stop; i++)
+         {
+            vH   = VADDS8(vDiag, pvS[i]);
+            vMax = VMAX8(vMax, vH);
+
+            vE   = pvE[i];
+            vG   = VMAX8(vH, vE);
+            vG   = VMAX8(vG, vF);
+            vDiag  = pvG[i];
+            pvG[i] = vG;
+
+            vHP    = VSUBS8(vH, vP);
+            pvE[i] = VMAX8(vE, vHP);
+            vF     = VMAX8(vF, vHP);
+         }
+      }
+
+      memcpy(best, &vMax, sizeof(VEC));
+      for(lane=0; lane<nseqs; lane++)
+      {
+         scores[lane*profile->nrot + rot] = 
+            ((best[lane] >= BATCHSATURATED) ? SIMDBATCH_OVERFLOW :
+             (int)best[lane]);
+      }
+   }
+
+   _mm_free(work);
+   return(TRUE);
+#else
+   return(FALSE);
+#endif
+}
+
+
+#ifdef SIMD_SUPPORT
+/************************************************************************/
+/*>static int StripedScore(SIMDPROFILE *profile, int rot, TOPCODE *seq2,
+                           int length2, VEC *work)
+   -----------------------------------------------------------------
+   Input:   SIMDPROFILE  *profile   Profile of the probe
+            int          rot        Orientation of the probe
+            TOPCODE      *seq2      Library topology string
+            int          length2    Length of seq2 (>0)
+            VEC          *work      Workspace of 4*segLen vectors
+   Returns: int                     Alignment score
+
+   The striped alignment of one orientation. Works down the library
+   entry a column at a time, keeping E, H and G for the column in the
+   workspace.
+
+   17.10.26 Original   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+static int StripedScore(SIMDPROFILE *profile, int rot, TOPCODE *seq2,
+                        int length2, VEC *work)
+{
+   VEC   *pvE      = work,
+         *pvGLoad  = work +   profile->segLen,
+         *pvGStore = work + 2*profile->segLen,
+         *pvH      = work + 3*profile->segLen,
+         *prof,
+         *tmp,
+         vP        = VSET1(GAPPEN),
+         vZero     = VZERO(),
+         vMax      = VZERO(),
+         vH, vE, vF, vG, vHP, vDiag;
+   short lanes[VLANES];
+   int   segLen    = profile->segLen,
+         seg, j,
+         score;
+
+   for(seg=0; seg<segLen; seg++)
+   {
+      pvE[seg]     = vZero;
+      pvGLoad[seg] = vZero;
+   }
+
+   for(j=0; j<length2; j++)
+   {
+      prof  = (VEC *)profile->profile +
+              ((rot * (NCODES+1)) + seq2[j]) * segLen;
+      vDiag = VSHIFT(pvGLoad[segLen-1], 1);
+      vF    = vZero;
+
+      for(seg=0; seg<segLen; seg++)
+      {
+         vH   = VADDS(vDiag, prof[seg]);
+         vMax = VMAX(vMax, vH);
+
+         vE   = pvE[seg];
+         vG   = VMAX(vH, vE);
+         vG   = VMAX(vG, vF);
+         pvGStore[seg] = vG;
+         pvH[seg]      = vH;
+
+         vHP      = VSUBS(vH, vP);
+         pvE[seg] = VMAX(vE, vHP);
+         vF       = VMAX(vF, vHP);
+
+         vDiag = pvGLoad[seg];
+      }
+
+      /* Carry F from the end of each lane into the following lanes     */
+      vF = VSHIFT(vF, 1);
+      VPREFIXMAX(vF);
+      for(seg=0; (seg<segLen) && VANY(VCMPGT(vF, vZero)); seg++)
+      {
+         pvGStore[seg] = VMAX(pvGStore[seg], vF);
+         vF = VAND(vF, VCMPGT(vF, VSUBS(pvH[seg], vP)));
+      }
+
+      tmp      = pvGLoad;
+      pvGLoad  = pvGStore;
+      pvGStore = tmp;
+   }
+
+   memcpy(lanes, &vMax, sizeof(VEC));
+   score = lanes[0];
+   for(seg=1; seg<VLANES; seg++)
+   {
+      if(lanes[seg] > score)
+         score = lanes[seg];
+   }
+
+   return(score);
+}
+
+
+/************************************************************************/
+/*>static void BatchScores(unsigned char **rows, int start, int stop,
+                           VEC *scores)
+   -------------------------------------------------------------------
+   Input:   unsigned char **rows      Profile row for the code in each
+                                      lane
+            int           start       First probe element wanted (a
+                                      multiple of BATCHBLOCK)
+            int           stop        One past the last (a multiple of
+                                      BATCHBLOCK, up to the padded
+                                      length of the probe)
+   Output:  VEC           *scores     Scores for each probe element with
+                                      one lane for each row
+
+   Transposes the profile rows for one column of the batch so that each
+   vector holds the score of one probe element in every lane. Each block
+   of 16 elements is a 16x16 byte transpose: each pass of unpacks 
+   rotates the bits of the (vector, byte) index by one, so four passes 
+   swap them. With AVX2 the two 128-bit halves are done at once, the 
+   upper half holding lanes 16-31.
+
+   17.10.26 Original   By: agent
+   17.10.26 Takes the range of probe elements rather than all of them
+            By: agent
+*/
+static void BatchScores(unsigned char **rows, int start, int stop,
+                        VEC *scores)
+{
+   VEC a[BATCHBLOCK],
+       b[BATCHBLOCK],
+       *in, *out, *tmp;
+   int block, k, pass;
+
+   for(block=start; block<stop; block+=BATCHBLOCK)
+   {
+      for(k=0; k<BATCHBLOCK; k++)
+         a[k] = VLOADROWS(rows, k, block);
+
+      in  = a;
+      out = b;
+      for(pass=0; pass<4; pass++)
+      {
+         for(k=0; k<BATCHBLOCK/2; k++)
+         {
+            out[2*k]   = VUNPACKLO8(in[k], in[k+BATCHBLOCK/2]);
+            out[2*k+1] = VUNPACKHI8(in[k], in[k+BATCHBLOCK/2]);
+         }
+         tmp = in;
+         in  = out;
+         out = tmp;
+      }
+
+      for(k=0; k<BATCHBLOCK; k++)
+         scores[block+k] = in[k];
+   }
+}
+
+
+/************************************************************************/
+/*>static BOOL RotationScores(SIMDPROFILE *profile, TOPCODE *seq2, 
+                              int length2, int band, int *scores)
+   ----------------------------------------------------------------------
+   Input:   SIMDPROFILE  *profile   Profile of the probe with all the
+                                    orientations
+            TOPCODE      *seq2      Library topology string
+            int          length2    Length of seq2 (>0)
+            int          band       Band width (NOBAND for the full 
+                                    matrix)
+   Output:  int          *scores    Score for each orientation
+   Returns: BOOL                    Success?
+
+   The rotation-parallel alignment. Works down the library entry a
+   column at a time and down the probe within each column, exactly as
+   the batch kernel does, but with the orientations in the lanes. E and
+   G for the previous column are kept for each probe element. A band 
+   is handled as in SIMDBatchAlignScores().
+
+   17.10.26 Original   By: agent
+   17.10.26 Added band   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+static BOOL RotationScores(SIMDPROFILE *profile, TOPCODE *seq2, int length2,
+                           int band, int *scores)
+{
+   VEC   *work, *pvE, *pvG, *prof,
+         vP = VSET1(GAPPEN),
+         vZero = VZERO(),
+         vMax[ROTVECS], vDiag[ROTVECS], vF[ROTVECS],
+         vH, vE, vG, vHP;
+   short best[ROTLANES];
+   int   length1 = profile->length,
+         i, j, k, rot, start, stop;
+
+   if((work = (VEC *)_mm_malloc(2 * length1 * ROTVECS * sizeof(VEC),
+                                sizeof(VEC)))==NULL)
+      return(FALSE);
+   pvE = work;
+   pvG = work + length1 * ROTVECS;
+
+   for(i=0; i<length1*ROTVECS; i++)
+   {
+      pvE[i] = vZero;
+      pvG[i] = vZero;
+   }
+   for(k=0; k<ROTVECS; k++)
+      vMax[k] = vZero;
+
+   for(j=0; j<length2; j++)
+   {
+      start = BANDSTART(j, band);
+      stop  = BANDSTOP(j, band, length1);
+      if(start >= stop)
+         break;
+
+      prof = (VEC *)profile->rotProfile + 
+             seq2[j] * length1 * ROTVECS;
+      for(k=0; k<ROTVECS; k++)
+      {
+         vDiag[k] = (start ? pvG[(start-1)*ROTVECS + k] : vZero);
+         vF[k]    = vZero;
+      }
+
+      for(i=start*ROTVECS; i<stop*ROTVECS; i+=ROTVECS)
+      {
+         for(k=0; k<ROTVECS; k++)
+         {
+            vH      = VADDS(vDiag[k], prof[i+k]);
+            vMax[k] = VMAX(vMax[k], vH);
+
+            vE       = pvE[i+k];
+            vG       = VMAX(vH, vE);
+            vG       = VMAX(vG, vF[k]);
+            vDiag[k] = pvG[i+k];
+            pvG[i+k] = vG;
+
+            vHP      = VSUBS(vH, vP);
+            pvE[i+k] = VMAX(vE, vHP);
+            vF[k]    = VMAX(vF[k], vHP);
+         }
+      }
+   }
+
+   memcpy(best, vMax, sizeof(best));
+   for(rot=0; rot<NROTATIONS; rot++)
+      scores[rot] = best[rot];
+
+   _mm_free(work);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static BOOL LayOutPrimaryBatch(TOPCODE **seqs, int *lengths, int nseqs,
+                                  int maxlen, unsigned char *codes)
+   -------------------------------------------------------------------
+   Input:   TOPCODE       **seqs     Library topology strings
+            int           *lengths   Their lengths
+            int           nseqs      Number of strings
+            int           maxlen     Longest of them
+   Output:  unsigned char *codes     [maxlen][VLANES8] codes of each
+                                     column, 0 past the end of a string
+   Returns: BOOL                     Do the strings only contain primary
+                                     topology codes (or 0)?
+
+   17.10.26 Original   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+*/
+static BOOL LayOutPrimaryBatch(TOPCODE **seqs, int *lengths, int nseqs,
+                               int maxlen, unsigned char *codes)
+{
+   int lane, j, code;
+
+   memset(codes, 0, maxlen * VLANES8);
+   for(lane=0; lane<nseqs; lane++)
+   {
+      for(j=0; j<lengths[lane]; j++)
+      {
+         code = seqs[lane][j];
+         if((code != 0) && (code != PRIMARYSTRAND) && 
+            (code != PRIMARYHELIX))
+            return(FALSE);
+         codes[j*VLANES8 + lane] = (unsigned char)code;
+      }
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static void PrimaryBatchScores(SIMDBATCHPROFILE *profile, VEC *work,
+                                  int maxlen, int nseqs, int band,
+                                  int *scores)
+   ---------------------------------------------------------------------
+   Input:   SIMDBATCHPROFILE *profile   Byte profile of the probe with
+                                        the primary topology vectors
+            VEC              *work      Space for E and G of each probe
+                                        element followed by the codes
+                                        from LayOutPrimaryBatch()
+            int              maxlen     Columns of codes
+            int              nseqs      Number of strings
+            int              band       Band width (or NOBAND)
+   Output:  int              *scores    Score of each string, or
+                                        SIMDBATCH_OVERFLOW
+
+   As SIMDBatchAlignScores() for the single orientation, but with the
+   score of each cell selected from the probe's scores against a strand
+   and a helix rather than looked up. Each column of codes is compared
+   with the two codes once, giving masks that pick out the lanes with a
+   strand and those with a helix. Code 0 matches neither and so scores 
+   0 as usual.
+
+   17.10.26 Original   By: agent
+   17.10.26 Added band   By: agent
+*/
+static void PrimaryBatchScores(SIMDBATCHPROFILE *profile, VEC *work,
+                               int maxlen, int nseqs, int band,
+                               int *scores)
+{
+   VEC           *primary = (VEC *)profile->primary,
+                 *pvE, *pvG, *pvCodes,
+                 vP       = VSET18(GAPPEN),
+                 vZero    = VZERO(),
+                 vStrand  = VSET18(PRIMARYSTRAND),
+                 vHelix   = VSET18(PRIMARYHELIX),
+                 vMax     = VZERO(),
+                 vIsStrand, vIsHelix, vS, vH, vE, vF, vG, vHP, vDiag;
+   unsigned char best[VLANES8];
+   int           length1 = profile->length,
+                 lane, i, j, start, stop;
+
+   pvE     = work;
+   pvG     = work + length1;
+   pvCodes = work + 2*length1;
+
+   for(i=0; i<length1; i++)
+   {
+      pvE[i] = vZero;
+      pvG[i] = vZero;
+   }
+
+   for(j=0; j<maxlen; j++)
+   {
+      start = BANDSTART(j, band);
+      stop  = BANDSTOP(j, band, length1);
+      if(start >= stop)
+         break;
+
+      vIsStrand = VCMPEQ8(pvCodes[j], vStrand);
+      vIsHelix  = VCMPEQ8(pvCodes[j], vHelix);
+      vDiag     = (start ? pvG[start-1] : vZero);
+      vF        = vZero;
+
+      for(i=start; i<stop; i++)
+      {
+         vS   = VOR(VAND(vIsStrand, primary[2*i]),
+                    VAND(vIsHelix,  primary[2*i+1]));
+         vH   = VADDS8(vDiag, vS);
+         vMax = VMAX8(vMax, vH);
+
+         vE   = pvE[i];
+         vG   = VMAX8(vH, vE);
+         vG   = VMAX8(vG, vF);
+         vDiag  = pvG[i];
+         pvG[i] = vG;
+
+         vHP    = VSUBS8(vH, vP);
+         pvE[i] = VMAX8(vE, vHP);
+         vF     = VMAX8(vF, vHP);
+      }
+   }
+
+   memcpy(best, &vMax, sizeof(VEC));
+   for(lane=0; lane<nseqs; lane++)
+   {
+      scores[lane] = ((best[lane] >= BATCHSATURATED) ? 
+                      SIMDBATCH_OVERFLOW : (int)best[lane]);
+   }
+}
+#endif
@@ -6,5 +6,138 @@ echo "Checking while building secstr data"
 topscan -p -b 1yqvY.pdb >1yqvY.out
 diff 1yqvY.out 1yqvY.pdb.out.ref
 
-\rm -f 1yqvY.out
+echo "Checking threaded scan against a library"
+topscan -m ../numtopmat.mat -s 1yqvY.ss test.top >1yqvY.scan1
+topscan -m ../numtopmat.mat -s -j 4 1yqvY.ss test.top >1yqvY.out
+diff 1yqvY.out 1yqvY.scan1
+
+echo "Checking a scan with the built-in matrix"
+topscan -s 1yqvY.ss test.top >1yqvY.out
+diff 1yqvY.out 1yqvY.scan1
+
+echo "Checking the library classes are reported with --stats"
+topscan -m ../numtopmat.mat --stats -s 1yqvY.ss test.top 2>1yqvY.out \
+   >/dev/null
+echo "Library: 482 entries, 384 distinct in any orientation (1.26 entries \
+each)" | diff 1yqvY.out -
+
+echo "Checking a band wider than any library entry"
+topscan -m ../numtopmat.mat -s -B 1000 1yqvY.ss test.top 2>/dev/null >1yqvY.out
+diff 1yqvY.out 1yqvY.scan1
+
+echo "Checking the library trie used by the scalar kernel"
+topscan -m ../numtopmat.mat -s --kernel=scalar 1yqvY.ss test.top >1yqvY.out
+diff 1yqvY.out 1yqvY.scan1
+
+echo "Checking a scan of a compiled library"
+topscan --compile -m ../numtopmat.mat test.top test.topb
+topscan -m ../numtopmat.mat -s 1yqvY.ss test.topb >1yqvY.out
+diff 1yqvY.out 1yqvY.scan1
+
+echo "Checking a compiled library with a bad code is refused"
+perl -e 'open(F, "+<", "test.topb") or die; binmode F; 
+   $size = -s F; read(F, $h, 32); ($namesize) = unpack("l", substr($h, 28));
+   seek(F, $size - $namesize - 1, 0); print F chr(255); close F'
+topscan -m ../numtopmat.mat -s 1yqvY.ss test.topb 2>1yqvY.out >/dev/null
+(echo "Compiled library test.topb is damaged"; \
+   echo "Unable to map compiled library test.topb") | diff 1yqvY.out -
+
+echo "Checking the best hits of a threaded scan"
+topscan -m ../numtopmat.mat -s -j 4 -k 10 1yqvY.ss test.top 2>/dev/null \
+   >1yqvY.out
+sort -s -k2,2gr 1yqvY.scan1 | head -10 | diff 1yqvY.out -
+
+echo "Checking the hits above a score with entries pruned"
+topscan -m ../numtopmat.mat -s --min-score 50 1yqvY.ss test.top 2>/dev/null \
+   >1yqvY.out
+sort -s -k2,2gr 1yqvY.scan1 | awk '$2 >= 50' | diff 1yqvY.out -
+
+echo "Checking a hierarchical scan searching every cluster"
+topscan --compile --cluster 70 -m ../numtopmat.mat test.top test.topb \
+   2>/dev/null
+topscan -m ../numtopmat.mat -s -k 10 --hierarchical 1000 1yqvY.ss \
+   test.topb 2>/dev/null >1yqvY.out
+sort -s -k2,2gr 1yqvY.scan1 | head -10 | diff 1yqvY.out -
+
+echo "Checking a list of queries scanned together"
+printf "1yqvY.ss\n1yqvY.ss\n" >1yqvY.list
+topscan -m ../numtopmat.mat -S 1yqvY.list test.top >1yqvY.out
+(echo "# 1yqvY.ss"; cat 1yqvY.scan1; echo "# 1yqvY.ss"; cat 1yqvY.scan1) | \
+   diff 1yqvY.out -
+
+echo "Checking queries sent to a server"
+topscan -m ../numtopmat.mat --serve test.sock test.top 2>/dev/null &
+server=$!
+sleep 1
+perl -MIO::Socket::UNIX -e '$s = IO::Socket::UNIX->new(Peer => "test.sock")
+   or die; print $s "1yqvY.ss\n1yqvY.ss\n"; $s->shutdown(1); print <$s>' \
+   >1yqvY.out
+kill $server
+(echo "# 1yqvY.ss"; cat 1yqvY.scan1; echo "//"; echo "# 1yqvY.ss"; \
+   cat 1yqvY.scan1; echo "//") | diff 1yqvY.out -
+
+echo "Checking a server still answers after an overlong query"
+topscan -m ../numtopmat.mat --serve test.sock test.top 2>/dev/null &
+server=$!
+sleep 1
+perl -MIO::Socket::UNIX -e '$s = IO::Socket::UNIX->new(Peer => "test.sock")
+   or die; print $s "1" x 2000, "\n1yqvY.ss\n"; $s->shutdown(1); 
+   print <$s>' | sed 1d >1yqvY.out
+kill $server
+(echo "! Query too long"; echo "//"; echo "# 1yqvY.ss"; \
+   cat 1yqvY.scan1; echo "//") | diff 1yqvY.out -
+
+echo "Checking a server answers while another client does not read"
+topscan -m ../numtopmat.mat --serve test.sock test.top 2>/dev/null &
+server=$!
+sleep 1
+perl -MIO::Socket::UNIX -e '$a = IO::Socket::UNIX->new(Peer => "test.sock")
+   or die; print $a "1yqvY.ss\n" x 200; sleep 2; 
+   $b = IO::Socket::UNIX->new(Peer => "test.sock") or die; 
+   print $b "1yqvY.ss\n"; $b->shutdown(1); alarm 20; print <$b>' \
+   >1yqvY.out
+kill $server
+(echo "# 1yqvY.ss"; cat 1yqvY.scan1; echo "//") | diff 1yqvY.out -
+
+echo "Checking queries streamed from stdin"
+topscan -b 1yqvY.ss | topscan -m ../numtopmat.mat --stream test.top \
+   2>/dev/null >1yqvY.out
+(echo "# 1yqvY.ss"; cat 1yqvY.scan1; echo "//") | diff 1yqvY.out -
+
+echo "Checking a stream goes on after an overlong code"
+(perl -e 'print "bad 1-", "1" x 600, "\n"'; topscan -b 1yqvY.ss) | \
+   topscan -m ../numtopmat.mat --stream test.top 2>/dev/null >1yqvY.out
+(echo "# bad"; echo "! Unable to read topology"; echo "//"; \
+   echo "# 1yqvY.ss"; cat 1yqvY.scan1; echo "//") | diff 1yqvY.out -
+
+echo "Checking long alignments built in linear space"
+topscan -m ../numtopmat.mat -v --stream long.top <long.query 2>/dev/null \
+   >1yqvY.out
+diff 1yqvY.out long.query.out.ref
+
+echo "Checking alignments with the built-in matrix"
+topscan -v --stream long.top <long.query 2>/dev/null >1yqvY.out
+diff 1yqvY.out long.query.out.ref
+
+echo "Checking a row of an all-vs-all matrix"
+topscan -m ../numtopmat.mat --all-vs-all test.top -o test.mat 2>/dev/null
+topscan -m ../numtopmat.mat -s -t 009-007 test.top | \
+   awk '{printf "%d\n", $2 * 100 + 0.5}' >test.row
+rows=`od -An -tu4 -j 36 -N 4 test.mat`
+od -An -v -tu2 -j `expr $rows + 2 \* 482 \* 2` -N `expr 482 \* 2` test.mat | \
+   tr -s ' ' '\n' | grep . | diff - test.row
+
+echo "Checking an LSH all-vs-all matrix only leaves cells out"
+topscan -m ../numtopmat.mat --all-vs-all --lsh 2 test.top -o test.lsh \
+   2>/dev/null
+od -An -v -tu2 -j $rows test.mat | tr -s ' ' '\n' | grep . >test.row
+od -An -v -tu2 -j $rows test.lsh | tr -s ' ' '\n' | grep . | \
+   paste - test.row | awk '$1 != 0 && $1 != $2' | diff - /dev/null
+
+echo "Checking a seeded scan only leaves entries out"
+topscan -m ../numtopmat.mat -s --seed 2 1yqvY.ss test.top 2>/dev/null | \
+   sort >1yqvY.out
+sort 1yqvY.scan1 | comm -23 1yqvY.out - | diff - /dev/null
+
+\rm -f 1yqvY.out 1yqvY.scan1 1yqvY.list test.topb test.mat test.lsh test.row
 
@@ -3,11 +3,11 @@
    Program:    topscan
    File:       topscan.c
    
-   Version:    V3.0
-   Date:       15.01.20
+   Version:    V3.25
+   Date:       17.10.26
    Function:   Compare protein topologies
    
-   Copyright:  (c) UCL, Reading, Dr. Andrew C. R. Martin 1998-2020
+   Copyright:  (c) UCL, Reading, Dr. Andrew C. R. Martin 1998-2026
    Author:     Dr. Andrew C. R. Martin
    Address:    Biomolecular Structure & Modelling Unit,
                Department of Biochemistry & Molecular Biology,
@@ -59,13 +59,98 @@
    V2.1  17.03.00 Added -L option (include loop length)
    V3.0  15.01.20 Added in the code for using stride which had been 
                   accidentally added to V1.2
+   V3.1  17.10.26 Added -j option (multi-threaded library scan). The
+                  library is now read into memory before scanning and
+                  -s now works with -t   By: agent
+   V3.2  17.10.26 The 24 orientations are now precomputed as permutation
+                  tables and rotated scoring matrices when the matrix is
+                  read rather than rotating the probe for every entry
+                  By: agent
+   V3.3  17.10.26 Orientations are scored with a linear memory score-only
+                  alignment. The alignment itself is only built for the
+                  best orientation when it is to be printed   By: agent
+   V3.4  17.10.26 Library scans score the orientations with a striped
+                  SIMD kernel (simdalign.c) when the matrix allows it
+                  By: agent
+   V3.5  17.10.26 Library scans align the probe against a batch of 
+                  library entries of similar length at once with an 
+                  8-bit SIMD kernel   By: agent
+   V3.6  17.10.26 All 24 orientations are scored in one pass with a lane
+                  for each orientation. Also used when comparing a pair
+                  By: agent
+   V3.7  17.10.26 The SIMD kernels are built for SSE4.1, AVX2 and 
+                  AVX-512BW and the best the CPU supports is picked at
+                  run time. Added --kernel=name to choose one   By: agent
+   V3.8  17.10.26 Primary topology (-1) scans select each score from the
+                  probe's strand and helix scores rather than looking
+                  it up   By: agent
+   V3.9  17.10.26 Added -B to restrict the alignments to a band and skip
+                  library entries whose length is outside it   By: agent
+   V3.10 17.10.26 Alignments of long topology strings are built in
+                  linear space by LinearSpaceAlign()   By: agent
+   V3.11 17.10.26 Scans that cannot use the SIMD kernels walk the
+                  library as a trie of reversed topology strings so 
+                  that entries ending in the same codes share the 
+                  columns of the alignment matrix   By: agent
+   V3.12 17.10.26 Added --compile to write a library in a binary form
+                  which -s maps into memory rather than reading   By: agent
+   V3.13 17.10.26 Topology strings are held as TOPCODE (byte) arrays
+                  with a length rather than int arrays terminated by -1,
+                  and the scoring matrices as signed char. Matrices must
+                  have scores from -128 to 127   By: agent
+   V3.14 17.10.26 Added -k and --min-score to print just the best hits
+                  of a scan, best first   By: agent
+   V3.15 17.10.26 With -k or --min-score, library entries whose score
+                  cannot reach the hits are not aligned. Orientations
+                  that cannot beat the best so far are skipped when
+                  entries are aligned one at a time   By: agent
+   V3.16 17.10.26 The self-score of each library entry is worked out
+                  once when the library is read and stored in a 
+                  compiled library. The probe's is worked out once per
+                  scan   By: agent
+   V3.17 17.10.26 Added -S to scan a list of queries against a library
+                  read once. The queries are scanned a tile at a time
+                  By: agent
+   V3.18 17.10.26 Added --all-vs-all to write a binary matrix of the 
+                  scores of every library entry against every other   By: agent
+   V3.19 17.10.26 Library entries with the same topology string, or the
+                  same string in another orientation, are grouped and
+                  each group is aligned just once   By: agent
+   V3.20 17.10.26 Added --seed to align only the library entries found
+                  by seeds from an index of k-mers, with --recall to
+                  measure how many of the best hits this finds   By: agent
+   V3.21 17.10.26 Added --lsh to --all-vs-all to align only the pairs
+                  whose MinHash sketches share a band, with --recall
+                  to measure how many of the high-scoring cells this
+                  fills   By: agent
+   V3.22 17.10.26 Added --cluster to --compile to store clusters of the
+                  library, and --hierarchical to scan a clustered 
+                  library a level at a time   By: agent
+   V3.23 17.10.26 Added --serve to scan queries sent to a socket against
+                  libraries read once   By: agent
+   V3.24 17.10.26 Added --stream to scan queries read from stdin as a
+                  coprocess   By: agent
+   V3.25 17.10.26 The default scoring matrix is built in rather than 
+                  read from numtopmat.mat. -m still reads a matrix file
+                  By: agent
 
 *************************************************************************/
 /* Includes
 */
+#define _POSIX_C_SOURCE 200112L      /* fdopen() and sockets with -ansi  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "bioplib/general.h"
 #include "bioplib/seq.h"
@@ -73,6 +158,8 @@
 #include "bioplib/fsscanf.h"
 #include "bioplib/MathUtil.h"
 
+#include "topscan.h"
+
 /************************************************************************/
 /* Defines and macros
 */
@@ -83,13 +170,66 @@
 #define MERGEPDBSECSTR        "mergepdbsecstr"
 #define MAXBUFF               320
 #define HUGEBUFF              1024
-#define GAPPEN                8
-#define MATFILE               "numtopmat.mat"
+#define MATFILE               "numtopmat.mat" /* Matrix file that   */
+                                     /* DefaultScore() matches           */
 #define DEFAULT_ELEN          4
 #define DEFAULT_HLEN          4
 #define MARKER                -9999.0
 #define ADJACENT_DIST         12.0
 #define BUFFCHUNK             24
+#define SCANCHUNK             8      /* Library entries taken at a time  */
+                                     /* by a scan thread                 */
+#define TRIECHUNK             256    /* Library entries taken at a time  */
+                                     /* when walking the trie            */
+#define QUERYTILE             8      /* Queries scanned together by -S   */
+#define SERVEPENDING          64     /* Queries a connection to --serve  */
+                                     /* may have waiting for answers     */
+#define HITCHUNK              64     /* Hits allocated at a time         */
+#define NOMINSCORE            (-1.0e30) /* No --min-score given          */
+#define NOMARGIN              (-1.0) /* No --hierarchical given          */
+#define NOALIGNMENT           INT_MIN /* RunAlignment() had no memory    */
+#define NOPATH                (INT_MIN/2) /* Cell with no path to the    */
+                                     /* end fixed by FollowPath()        */
+#define SEEDHITS              2      /* Seeds on a diagonal needed for   */
+                                     /* an entry to be aligned (--seed)  */
+#define SEEDCHUNK             1024   /* Seed hits allocated at a time    */
+#define LSHBANDS              16     /* Default bands of the sketches    */
+#define LSHROWS               4      /* Default rows in each band        */
+#define LSHMAXROWS            16     /* Most rows in a band              */
+
+/* Does a library entry stand for its class (see GroupLibrary())?      */
+#define REPRESENTS(library, entry) (((library)->classOf == NULL) || \
+                                    ((library)->classOf[entry] == (entry)))
+/* The entry standing for the class of a library entry                 */
+#define CLASSOF(library, entry) (((library)->classOf == NULL) ? (entry) : \
+                                 (library)->classOf[entry])
+#define MAXBATCHLANES         64     /* Most entries in a SIMD batch     */
+#define SPARSEBATCHES         16     /* Most SIMD batches in a chunk     */
+                                     /* when entries are left out        */
+#define MAXTHREADS            256
+#define SIMDMAXSCORE          32767  /* Largest score held in 16 bits    */
+#define BATCHMAXSCORE         255    /* Largest score held in 8 bits     */
+#define AUTOBAND              (-2)   /* -B auto: band from probe length  */
+#define AUTOBAND_MIN          4      /* Narrowest automatic band         */
+#define AUTOBAND_FRACTION     4      /* Automatic band is this fraction  */
+                                     /* of the probe length              */
+#ifndef TRACEBACKCELLS
+#  define TRACEBACKCELLS      40000  /* Larger alignments are built in   */
+#endif                               /* linear space                     */
+
+#define TOPB_MAGIC            "TOPB" /* Start of a compiled library      */
+#define TOPB_VERSION          4      /* Version of the compiled format   */
+#define TOPB_3_10             1      /* Flags for the options a compiled */
+#define TOPB_PRIMARY          2      /* library was built with           */
+#define TOPB_NEIGHBOUR        4
+#define TOPB_ACCESS           8
+#define TOPB_LENGTH           16
+#define TOPB_LOOPLENGTH       32
+
+#define TOPM_MAGIC            "TOPM" /* Start of an all-vs-all matrix    */
+#define TOPM_VERSION          2      /* Version of the matrix format     */
+#define TOPM_SCALE            100    /* Cells hold percentage * this     */
+#define TOPM_MAXCELL          65535  /* Largest value of a cell          */
 
 #define SECSTR_DSSP           0
 #define SECSTR_STRIDE         1
@@ -105,52 +245,474 @@
 #define HELIX_MEAN_LENGTH     12.5
 #define STRAND_MEAN_LENGTH    5.4
 #define LOOP_MEAN_LENGTH      6.9
+
+/************************************************************************/
+/* Type definitions
+*/
+typedef struct                  /* An entry in a topology library       */
+{
+   char    *name;
+   TOPCODE *top;
+   int     length,
+           selfScore;           /* Score of the entry against itself    */
+}  LIBENTRY;
+
+typedef struct                  /* Header of a compiled library. This   */
+{                               /* is followed by nentries TOPBENTRYs,  */
+   char magic[4];               /* the entries in order of length, the  */
+   int  version,                /* clusters if they are stored, the     */
+        ELen,                   /* codes and the names (each terminated */
+        HLen,                   /* by a '\0')                           */
+        flags,                  /* TOPB_ flags                          */
+        nentries,
+        ncodes,                 /* Number of codes                      */
+        namesize,               /* Size of the names in bytes           */
+        scored;                 /* Are the self-scores stored?          */
+   unsigned int matrix;         /* MatrixChecksum() when they were      */
+   int  clustered;              /* Are the clusters stored?             */
+}  TOPBHEADER;
+
+typedef struct                  /* An entry in a compiled library       */
+{
+   int  name,                   /* Offset in the names                  */
+        top,                    /* Offset in the codes                  */
+        length,
+        selfScore;              /* Score against itself (if scored)     */
+}  TOPBENTRY;
+
+typedef struct                  /* Header of an all-vs-all matrix. This */
+{                               /* is followed by nentries TOPMENTRYs,  */
+   char magic[4];               /* the names (each terminated by a '\0')*/
+   int  version,                /* and, from offset rows, a row of      */
+        nentries,               /* nentries cells for each entry in     */
+        cellsize,               /* library order                        */
+        scale,                  /* Cells hold the percentage * scale    */
+        UseBoth,                /* Percentages from both strings (-w)?  */
+        PrimaryTopology,        /* Primary topology only (-1)?          */
+        band,                   /* Band width (NOBAND, AUTOBAND or      */
+                                /* width)                               */
+        namesize,               /* Size of the names in bytes           */
+        rows,                   /* Offset of the first row in the file  */
+        lsh;                    /* K-mer length if only the pairs found */
+                                /* by --lsh were aligned (or 0)         */
+}  TOPMHEADER;
+
+typedef struct                  /* An entry in an all-vs-all matrix     */
+{
+   int  name,                   /* Offset in the names                  */
+        length;                 /* Length of the topology string        */
+}  TOPMENTRY;
+
+typedef struct                  /* Index of the k-mers of a library     */
+{                               /* from IndexLibrary(). The postings of */
+   int  *start,                 /* bucket b run from start[b] to        */
+        *entry,                 /* start[b+1]                           */
+        *pos,                   /* Library entry and position in it of  */
+                                /* each k-mer                           */
+        nbuckets,               /* A power of 2                         */
+        seedlen;                /* Length of the k-mers                 */
+   BOOL primary;                /* Built for the classes of -1          */
+}  SEEDINDEX;
+
+typedef struct                  /* A seed found by FindCandidates()     */
+{
+   int  entry,                  /* Library entry                        */
+        rotation,               /* Orientation of the probe             */
+        diagonal;               /* Position in the entry less that in   */
+}  SEEDHIT;                     /* the probe                            */
+
+typedef struct                  /* A band of the sketch of an entry     */
+{
+   unsigned int key;            /* Hash of the band                     */
+   int          pos;            /* Position of the entry in order[]     */
+}  LSHKEY;
+
+typedef struct                  /* A pair found by FindLSHPartners()    */
+{
+   int  a,                      /* Positions in order[] of the entries  */
+        b;                      /* with a < b                           */
+}  LSHPAIR;
+
+typedef struct                  /* A topology library held in memory    */
+{
+   LIBENTRY   *entries;
+   TOPBHEADER *header;          /* Mapped compiled library (or NULL)    */
+   int        *byLength,        /* Entries in order of length from a    */
+                                /* compiled library (or NULL)           */
+              *classOf,         /* Entry standing for the class of each */
+                                /* entry from GroupLibrary() (or NULL)  */
+              *nextMember,      /* Next entry of the same class (or -1) */
+              *clusterOf,       /* Entry standing for the cluster of    */
+                                /* each entry from ClusterLibrary() or  */
+                                /* a compiled library (or NULL)         */
+              nentries,
+              nclasses;         /* Number of classes (nentries if not   */
+                                /* grouped)                             */
+   size_t     mapsize;          /* Size of the mapping                  */
+   SEEDINDEX  *seeds;           /* K-mers of the classes (or NULL)      */
+   BOOL       groupPrimary;     /* Classes are for primary topology     */
+}  LIBRARY;
+
+typedef struct                  /* Result of scanning one library entry */
+{
+   int  score,
+        IDScore,
+        rotation;               /* Best orientation of the probe        */
+   BOOL skipped,                /* Length outside the band              */
+        pruned;                 /* Cannot reach the best hits           */
+}  SCANRESULT;
+
+typedef struct                  /* Best hits of a scan. A heap with the */
+{                               /* worst hit at the top                 */
+   int *hits,                   /* Library indices of the hits          */
+       nhits,
+       size,                    /* Space in hits[]                      */
+       maxhits;                 /* Most hits to keep (0 for no limit)   */
+}  HITHEAP;
+
+typedef struct                  /* Range of library entries owned by a  */
+{                               /* scan thread. Other threads may steal */
+   pthread_mutex_t mutex;       /* from the end of the range            */
+   int             next,
+                   end;
+}  WORKRANGE;
+
+typedef struct                  /* Everything shared by the scan threads*/
+{                               /* for one probe                        */
+   TOPCODE     *top1;
+   int         self1;           /* Score of top1 against itself         */
+   SIMDPROFILE *profile;        /* Striped profile of top1 (or NULL)    */
+   SIMDBATCHPROFILE *batch;     /* Batch profile of top1 (or NULL)      */
+   int         *trie,           /* Trie profile of top1 (or NULL)       */
+               *bestScores;     /* Best score of each code against top1 */
+                                /* in each orientation and in any       */
+                                /* (or NULL)                            */
+   LIBRARY     *library;
+   SCANRESULT  *results;
+   WORKRANGE   *ranges;         /* Ranges are positions in order[]      */
+   HITHEAP     *heaps;          /* Best hits found by each thread (or   */
+                                /* NULL to keep every entry)            */
+   REAL        minscore,        /* Lowest score kept in the heaps       */
+               bar;             /* Score an entry must reach to be a hit*/
+   pthread_mutex_t mutex;       /* Guards bar and the counts            */
+   int         *order,          /* Library entries sorted by length, or */
+                                /* by reversed string to walk the trie  */
+               *shared,         /* Codes at the end of each entry in    */
+                                /* order[] shared with the one before   */
+               length1,         /* Length of top1                       */
+               chunk,           /* Entries taken at a time              */
+               nthreads,
+               band,            /* Band width (or NOBAND)               */
+               first,           /* Run of order[] within the band       */
+               last,
+               ncandidates,     /* Entries in the run with enough seeds */
+                                /* (-1 if not seeded)                   */
+               npruned;         /* Entries pruned                       */
+   long        nrotskipped;     /* Orientations skipped in the entries  */
+                                /* that were aligned                    */
+   BOOL        UseBoth,
+               PrimaryTopology,
+               *Error;          /* Shared by all the probes of a scan   */
+}  SCANJOB;
+
+typedef struct                  /* Rows of the alignment matrix kept by */
+{                               /* LinearSpaceAlign() while filling     */
+   int *block,                  /* row i upwards                        */
+       *out,                    /* Row i                                */
+       *row,                    /* Row i+1                              */
+       *next,                   /* Row i+2                              */
+       *colmax,                 /* Best of each column below row i+2    */
+       *colrow,                 /* Row of that best (first if tied, -1  */
+                                /* if there are no rows below i+2)      */
+       *outlab,                 /* For each cell of these, the last     */
+       *rowlab,                 /* cell above the middle row and the    */
+       *nextlab,                /* first cell at or below it of the     */
+       *collab;                 /* path from it (4 ints a cell)         */
+}  PATHROWS;
+
+typedef struct                  /* Argument passed to each scan thread  */
+{
+   SCANJOB *jobs;               /* One for each probe. They share the   */
+   int     njobs,               /* work ranges                          */
+           me;
+}  SCANTHREAD;
+
+typedef struct _servequery      /* A query waiting to be scanned by     */
+{                               /* --serve                              */
+   struct _servequery  *next;
+   struct _serveclient *client; /* Connection that sent it              */
+   char    *name;               /* The query as sent                    */
+   char    *error;              /* Why it can't be scanned (or NULL)    */
+   TOPCODE *top;                /* NULL if it could not be read         */
+   SCANRESULT *results;         /* Results from ServeScans()            */
+   int     *hits,
+           nhits,
+           length,
+           lib;                 /* Library to scan (-1 if unknown)      */
+}  SERVEQUERY;
+
+typedef struct                  /* Everything shared by the threads of  */
+{                               /* --serve                              */
+   LIBRARY    **libraries;
+   char       **libnames;       /* Library files as given               */
+   REAL       *margins;         /* Margin for ScanClusters() for each   */
+                                /* library (or NOMARGIN)                */
+   SERVEQUERY *head,            /* Queries waiting to be scanned        */
+              *tail;
+   pthread_mutex_t mutex,       /* Guards the queues and pending counts */
+                   readMutex;   /* ReadQuery() is not thread-safe       */
+   pthread_cond_t  queued;      /* A query has been queued              */
+   int        nlibraries,
+              SecStrCalculator,
+              ELen,
+              HLen,
+              nthreads,
+              band,
+              maxhits,
+              seedlen,
+              seedhits;
+   REAL       minscore;
+   BOOL       GivenTopString,
+              CalcSecStr,
+              Do3_10,
+              PrimaryTopology,
+              DoNeighbour,
+              DoAccess,
+              DoLength,
+              DoLoopLength,
+              UseBoth;
+}  SERVER;
+
+typedef struct _serveclient     /* A connection to --serve              */
+{
+   SERVER *server;
+   FILE   *in,                  /* Queries are read from here and the   */
+          *out;                 /* results written here                 */
+   SERVEQUERY *answers,         /* Queries scanned but not yet written  */
+              *lastAnswer;      /* by ServeAnswers()                    */
+   pthread_cond_t answered;     /* A query has been scanned or written  */
+   int    pending;              /* Queries not yet written              */
+   BOOL   blocked,              /* A query was left in the queue by     */
+                                /* TakeServeTile()                      */
+          reading;              /* More queries may be sent             */
+}  SERVECLIENT;
+
 /************************************************************************/
 /* Globals
 */
 BOOL   gVerbose = FALSE;        /* Should we display alignments?        */
-char   gBest1[MAXBUFF],         /* Used to store the best alignment     */
-       gBest2[MAXBUFF];
+BOOL   gStats   = FALSE;        /* Should we report the library classes?*/
 REAL   gHelixMeanAccess  = 0.0, /* Mean accessibilities                 */
        gStrandMeanAccess = 0.0;
+signed char gMDM[NCODES+1][NCODES+1],  /* Scoring matrix indexed by  */
+                                       /* code                        */
+       gRotMDM[NROTATIONS][NCODES+1][NCODES+1]; /* Scoring matrix with  */
+                                       /* the first code rotated      */
+TOPCODE gRotation[NROTATIONS][NCODES+1];  /* Codes in each orientation */
+int    gMDMMax = 0,             /* Range of scores in gMDM              */
+       gMDMMin = 0;
+BOOL   gBuiltInMDM = FALSE;     /* gMDM is the built-in matrix, so      */
+                                /* bioplib has no matrix loaded         */
+char   *gSocketFile = NULL;     /* Socket to remove when --serve stops  */
 
 /************************************************************************/
 /* Prototypes
 */
 int main(int argc, char **argv);
-int RunAlignment(int *top1, int *top2, BOOL PrimaryTopology);
-void TurnAboutX(int *top);
-void TurnAboutY(int *top);
-void TurnAboutZ(int *top);
+int RunAlignment(TOPCODE *top1, int length1, TOPCODE *top2, int length2,
+                 SIMDPROFILE *profile, BOOL PrimaryTopology, int band,
+                 int *bounds, int *rotation);
+int NumericAlignScore(TOPCODE *seq1, int length1, TOPCODE *seq2,
+                      int length2, signed char (*mdm)[NCODES+1], 
+                      int *work);
+int BandedAlignScore(TOPCODE *seq1, int length1, TOPCODE *seq2,
+                     int length2, signed char (*mdm)[NCODES+1], int band,
+                     int *work);
+REAL BandCells(int length1, int length2, int band);
+BOOL BuildAlignment(TOPCODE *top1, int length1, TOPCODE *top2, 
+                    int length2, int rotation, char **best1, 
+                    char **best2);
+BOOL LinearSpaceAlign(TOPCODE *seq1, int length1, TOPCODE *seq2, 
+                      int length2, int *align1, int *align2, 
+                      int *align_len);
+void FollowPath(PATHROWS *rows, TOPCODE *seq1, TOPCODE *seq2, 
+                int si, int sj, int ei, int ej, BOOL fixed, int *path,
+                int *npath);
+void FillPathRow(PATHROWS *rows, TOPCODE *seq1, TOPCODE *seq2, int i, 
+                 int sj, int ei, int ej, BOOL fixed, int mid);
+void AdvancePathRows(PATHROWS *rows, int i, int ei, int width);
+void ResetPathRows(PATHROWS *rows, int width);
+PATHROWS *NewPathRows(int length2);
+void FreePathRows(PATHROWS *rows);
+void TurnAboutX(TOPCODE *top, int length);
+void TurnAboutY(TOPCODE *top, int length);
+void TurnAboutZ(TOPCODE *top, int length);
+BOOL ReadMatrix(char *matfile);
+int DefaultScore(int code1, int code2);
+int FindMatrixSize(char *matfile);
+void BuildRotationTables(void);
 BOOL ParseCmdLine(int argc, char **argv, char *infile1, char *infile2, 
                   char *matfile, int *ELen, int *HLen, BOOL *CalcSecStr,
                   BOOL *BuildOnly, BOOL *ScanMode, BOOL *UseBoth,
                   int *SecStrCalculator, BOOL *Do3_10,
                   BOOL *PrimaryTopology, BOOL *DoNeighbour,
                   BOOL *DoAccess, BOOL *GivenTopString, BOOL *DoLength,
-                  BOOL *DoLoopLength);
+                  BOOL *DoLoopLength, int *NThreads, char *kernel,
+                  int *Band, BOOL *Compile, int *MaxHits, 
+                  REAL *MinScore, BOOL *BatchMode, BOOL *AllVsAll,
+                  int *SeedLength, int *SeedHits, BOOL *Recall,
+                  int *LSHLength, int *LSHBands, int *LSHRows,
+                  int *LSHMargin, REAL *ClusterScore, REAL *Margin,
+                  BOOL *Serve, char ***LibFiles, int *NLibFiles,
+                  BOOL *Stream);
 void Usage(void);
-int *ReadTopology(FILE *fp, int ELen, int HLen, int SecStrCalculator,
-                  BOOL Do3_10, BOOL PrimaryTopology, BOOL DoNeighbour,
-                  BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength);
+void SetMeanAccess(int ELen, int HLen, BOOL Do3_10);
+void RunSecStr(char *infile, char *outfile, int SecStrCalculator);
+TOPCODE *ReadTopology(FILE *fp, int ELen, int HLen, 
+                      int SecStrCalculator, BOOL Do3_10, 
+                      BOOL PrimaryTopology, BOOL DoNeighbour,
+                      BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength,
+                      int *length);
 int CalcElement(char struc, REAL x1, REAL y1, REAL z1, 
                 REAL x2, REAL y2, REAL z2, BOOL PrimaryTopology,
                 BOOL DoNeighbour, BOOL DoAccess, REAL meanAccess,
                 int  EleLength, int LoopLength);
-int CalcIDScore(int *seq1, int *seq2, BOOL UseBoth);
-int *ReadDSSP(FILE *fp, int ELen, int HLen, BOOL Do3_10, 
-              BOOL PrimaryTopology, BOOL DoNeighbour, BOOL DoAccess,
-              BOOL DoLength, BOOL DoLoopLength);
-int *ReadStride(FILE *fp, int ELen, int HLen, BOOL Do3_10, 
-                BOOL PrimaryTopology, BOOL DoNeighbour, BOOL DoAccess,
-                BOOL DoLength, BOOL DoLoopLength);
+int CalcIDScore(TOPCODE *seq1, int length1, TOPCODE *seq2, int length2,
+                BOOL UseBoth);
+int SelfScore(TOPCODE *seq, int length);
+int CombineIDScores(int self1, int length1, int self2, int length2,
+                    BOOL UseBoth);
+int EntryIDScore(SCANJOB *job, LIBENTRY *entry);
+unsigned int MatrixChecksum(void);
+TOPCODE *ReadDSSP(FILE *fp, int ELen, int HLen, BOOL Do3_10, 
+                  BOOL PrimaryTopology, BOOL DoNeighbour, BOOL DoAccess,
+                  BOOL DoLength, BOOL DoLoopLength, int *length);
+TOPCODE *ReadStride(FILE *fp, int ELen, int HLen, BOOL Do3_10, 
+                    BOOL PrimaryTopology, BOOL DoNeighbour, 
+                    BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength,
+                    int *length);
 BOOL IsNeighbour(REAL x1, REAL y1, REAL z1,
                  REAL x2, REAL y2, REAL z2,
                  REAL prevx1, REAL prevy1, REAL prevz1,
                  REAL prevx2, REAL prevy2, REAL prevz2);
-int FindArrayLength(int *array);
-char *NumArrayToString(int *numarr);
-int MakeIntArray(int *array1, char *inarray);
+char *CodesToString(TOPCODE *codes, int length);
+int MakeCodeArray(TOPCODE *codes, char *inarray);
+LIBRARY *ReadLibrary(FILE *fp);
+void FreeLibrary(LIBRARY *library);
+int TopologyFlags(BOOL Do3_10, BOOL PrimaryTopology, BOOL DoNeighbour,
+                  BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength);
+BOOL CompileLibrary(char *libfile, char *outfile, char *matfile, 
+                    int ELen, int HLen, int flags, REAL clusterscore,
+                    int nthreads);
+BOOL ClusterLibrary(LIBRARY *library, BOOL PrimaryTopology, 
+                    REAL minscore, int nthreads);
+BOOL IsCompiledLibrary(FILE *fp);
+LIBRARY *MapLibrary(char *filename);
+LIBRARY *OpenLibrary(FILE *fp, char *filename, BOOL CheckOptions, 
+                     int ELen, int HLen, int flags);
+BOOL ScanQueryList(char *listfile, LIBRARY *library, 
+                   BOOL GivenTopString, BOOL CalcSecStr, 
+                   int SecStrCalculator, int ELen, int HLen, 
+                   BOOL Do3_10, BOOL PrimaryTopology, BOOL DoNeighbour,
+                   BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength,
+                   BOOL UseBoth, int nthreads, int band, int maxhits,
+                   REAL minscore, int seedlen, int seedhits, 
+                   REAL margin, BOOL Recall);
+BOOL StreamQueries(LIBRARY *library, BOOL UseBoth, BOOL PrimaryTopology,
+                   int nthreads, int band, int maxhits, REAL minscore, 
+                   int seedlen, int seedhits, REAL margin);
+TOPCODE *ReadQuery(char *query, BOOL GivenTopString, BOOL CalcSecStr,
+                   int SecStrCalculator, int ELen, int HLen, 
+                   BOOL Do3_10, BOOL PrimaryTopology, BOOL DoNeighbour,
+                   BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength,
+                   int *length);
+BOOL ServeLibraries(char *socketfile, char **libfiles, int nlibraries,
+                    BOOL GivenTopString, BOOL CalcSecStr, 
+                    int SecStrCalculator, int ELen, int HLen, 
+                    BOOL Do3_10, BOOL PrimaryTopology, 
+                    BOOL DoNeighbour, BOOL DoAccess, BOOL DoLength,
+                    BOOL DoLoopLength, BOOL UseBoth, int nthreads,
+                    int band, int maxhits, REAL minscore, int seedlen,
+                    int seedhits, REAL margin);
+void *ServeClient(void *arg);
+void *ServeScans(void *arg);
+void *ServeAnswers(void *arg);
+int TakeServeTile(SERVER *server, SERVEQUERY **tile);
+int FindServeLibrary(SERVER *server, char *libname);
+BOOL IsPlainFile(char *filename);
+void StopServing(int sig);
+SCANRESULT *ScanLibrary(TOPCODE *top1, int length1, LIBRARY *library,
+                        BOOL UseBoth, BOOL PrimaryTopology, int nthreads,
+                        int band, int maxhits, REAL minscore, int seedlen,
+                        int seedhits, REAL margin, int **hits, 
+                        int *nhits);
+BOOL ScanProbes(TOPCODE **tops, int *lengths, int nprobes, 
+                LIBRARY *library, BOOL UseBoth, BOOL PrimaryTopology,
+                int nthreads, int band, int maxhits, REAL minscore,
+                int seedlen, int seedhits, int *starts, 
+                int **partners, SCANRESULT **results, int **hits, 
+                int *nhits);
+BOOL ScanClusters(TOPCODE **tops, int *lengths, int nprobes, 
+                  LIBRARY *library, BOOL UseBoth, BOOL PrimaryTopology,
+                  int nthreads, int band, int maxhits, REAL minscore,
+                  REAL margin, SCANRESULT **results, int **hits, 
+                  int *nhits);
+BOOL ScanRecall(TOPCODE **tops, int *lengths, int nprobes, 
+                LIBRARY *library, BOOL UseBoth, BOOL PrimaryTopology,
+                int nthreads, int band, int maxhits, REAL minscore,
+                int **hits, int *nhits, int *nfound, int *nwanted);
+BOOL WriteAllVsAll(char *libfile, char *outfile, BOOL UseBoth, 
+                   BOOL PrimaryTopology, int nthreads, int band,
+                   int lshlen, int lshbands, int lshrows, int lshmargin,
+                   BOOL Recall, REAL minscore);
+BOOL AllVsAllTiles(LIBRARY *library, int *order, unsigned short *cells,
+                   BOOL UseBoth, BOOL PrimaryTopology, int nthreads, 
+                   int band, BOOL symmetric, int **partners, 
+                   REAL minscore, long *naligned, long *nfound, 
+                   long *nwanted);
+int **FindLSHPartners(LIBRARY *library, int *order, int norder,
+                      BOOL PrimaryTopology, BOOL symmetric, int lshlen,
+                      int nbands, int nrows, int margin, long *npairs);
+BOOL SketchEntry(LIBENTRY *entry, int lshlen, int nrot, int nhash,
+                 TOPCODE *best, unsigned int *sketch);
+unsigned int MixHash(unsigned int hash);
+BOOL AddLSHPair(LSHPAIR **pairs, long *npairs, long *maxpairs, 
+                int a, int b);
+int CompareLSHKeys(const void *key1, const void *key2);
+int CompareLSHPairs(const void *pair1, const void *pair2);
+BOOL SymmetricScores(BOOL PrimaryTopology);
+BOOL RotationInvariant(void);
+BOOL GroupLibrary(LIBRARY *library, BOOL PrimaryTopology);
+int CompareCanonical(const void *entry1, const void *entry2);
+BOOL IndexLibrary(LIBRARY *library, int seedlen);
+void FreeSeedIndex(SEEDINDEX *index);
+unsigned int SeedHash(TOPCODE *codes, int seedlen);
+int FindCandidates(SCANJOB *job, int seedhits);
+int CompareSeedHits(const void *seed1, const void *seed2);
+BOOL ShareResults(SCANJOB *job, int start, int stop);
+unsigned short PercentCell(int score, int IDScore);
+void *ScanThread(void *arg);
+BOOL ScanRange(SCANJOB *job, int me, int start, int stop);
+BOOL ScanBatch(SCANJOB *job, int start, int stop);
+BOOL ScanTrie(SCANJOB *job, int start, int stop);
+int *BuildTrieProfile(TOPCODE *top, int length, int nrot);
+BOOL GetScanWork(SCANJOB *job, int me, int *start, int *stop);
+BOOL KeepHits(SCANJOB *job, int me, int start, int stop);
+int PruneEntries(SCANJOB *job, int start, int stop);
+int *BuildBestScores(TOPCODE *top, int length, int nrot);
+int ScoreBound(SCANJOB *job, LIBENTRY *entry, int *bounds);
+REAL HitScore(SCANRESULT *result);
+BOOL BetterHit(SCANRESULT *results, int a, int b);
+BOOL OfferHit(HITHEAP *heap, SCANRESULT *results, int entry);
+void SiftHitDown(int *hits, int nhits, SCANRESULT *results, int pos);
+int *MergeHits(HITHEAP *heaps, int nheaps, int maxhits, 
+               SCANRESULT *results, int *nhits);
+int *SortByLength(LIBRARY *library);
+int *SortBySuffix(LIBRARY *library, int *shared);
+int CompareSuffixes(const void *entry1, const void *entry2);
+BOOL PrintScanResults(FILE *out, TOPCODE *top1, int length1, 
+                      LIBRARY *library, SCANRESULT *results, int *hits,
+                      int nhits);
 
 
 /************************************************************************/
@@ -164,6 +726,26 @@ int MakeIntArray(int *array1, char *inarray);
    10.03.00 Changed to use integer coded topology array
    13.03.00 Initialise fdssp1, fdssp2 only to silence warnings with -O2
    15.01.20 Added pdbsecstr support
+   17.10.26 Scan mode reads the library into memory and hands it to
+            ScanLibrary() which may use multiple threads. Fixed -s with -t
+            which never opened the library file   By: agent
+   17.10.26 Alignment only built when it is to be displayed   By: agent
+   17.10.26 Pair comparison uses a SIMD profile   By: agent
+   17.10.26 Selects the alignment kernel   By: agent
+   17.10.26 Added --compile. Scans map a compiled library   By: agent
+   17.10.26 Topologies are TOPCODE arrays with a length   By: agent
+   17.10.26 Added -k and --min-score   By: agent
+   17.10.26 Passes the matrix to CompileLibrary()   By: agent
+   17.10.26 Added -S. Moved the accessibility and secondary structure
+            code to SetMeanAccess() and RunSecStr() and the library
+            code to OpenLibrary()   By: agent
+   17.10.26 Added --all-vs-all   By: agent
+   17.10.26 Added --seed, --seed-hits and --recall   By: agent
+   17.10.26 Added --lsh   By: agent
+   17.10.26 Added --cluster and --hierarchical. Selects the kernel 
+            before compiling a library   By: agent
+   17.10.26 Added --serve   By: agent
+   17.10.26 Added --stream   By: agent
 */
 int main(int argc, char **argv)
 {
@@ -171,16 +753,32 @@ int main(int argc, char **argv)
          *fdssp2 = NULL;
    char  infile1[MAXBUFF],
          infile2[MAXBUFF],
+         kernel[MAXBUFF],
          sourcefile[MAXBUFF],
-         matfile[MAXBUFF],
-         top2str[MAXBUFF];
-   int   *top1 = NULL,
-         *top2 = NULL;
+         matfile[MAXBUFF];
+   TOPCODE *top1 = NULL,
+           *top2 = NULL;
+   SIMDPROFILE *profile = NULL;
    int   score, 
+         length1         = 0,
+         length2         = 0,
          IDScore, 
+         rotation,
          ELen            = DEFAULT_ELEN, 
          HLen            = DEFAULT_HLEN,
-         SecStrCalculator = SECSTR_PDBSECSTR;
+         SecStrCalculator = SECSTR_PDBSECSTR,
+         NThreads        = 1,
+         Band            = NOBAND,
+         MaxHits         = 0,
+         SeedLength      = 0,
+         SeedHits        = SEEDHITS,
+         LSHLength       = 0,
+         LSHBands        = LSHBANDS,
+         LSHRows         = LSHROWS,
+         LSHMargin       = 0;
+   REAL  MinScore        = NOMINSCORE,
+         ClusterScore    = 0.0,
+         Margin          = NOMARGIN;
 
    BOOL  CalcSecStr      = FALSE,
          BuildOnly       = FALSE,
@@ -192,41 +790,87 @@ int main(int argc, char **argv)
          DoAccess        = FALSE,
          DoLength        = FALSE,
          DoLoopLength    = FALSE,
-         GivenTopString  = FALSE;
+         GivenTopString  = FALSE,
+         Compile         = FALSE,
+         BatchMode       = FALSE,
+         AllVsAll        = FALSE,
+         Recall          = FALSE,
+         Serve           = FALSE,
+         Stream          = FALSE;
+   char  **LibFiles      = NULL;
+   int   NLibFiles       = 0;
 #ifdef __linux__
    __pid_t pid;
 #else
    pid_t pid;
 #endif
 
-   gBest1[0] = '\0';
-   gBest2[0] = '\0';
-   
    if(ParseCmdLine(argc, argv, infile1, infile2, matfile, &ELen, &HLen,
                    &CalcSecStr, &BuildOnly, &ScanMode, &UseBoth,
                    &SecStrCalculator,
                    &Do3_10, &PrimaryTopology, &DoNeighbour, &DoAccess,
-                   &GivenTopString, &DoLength, &DoLoopLength))
+                   &GivenTopString, &DoLength, &DoLoopLength,
+                   &NThreads, kernel, &Band, &Compile, &MaxHits,
+                   &MinScore, &BatchMode, &AllVsAll, &SeedLength,
+                   &SeedHits, &Recall, &LSHLength, &LSHBands, &LSHRows,
+                   &LSHMargin, &ClusterScore, &Margin, &Serve, 
+                   &LibFiles, &NLibFiles, &Stream))
    {
-      if(GivenTopString)
+      if(!SelectKernel(kernel))
+         return(1);
+
+      if(Compile)
+      {
+         if(!CompileLibrary(infile1, infile2, matfile, ELen, HLen,
+                            TopologyFlags(Do3_10, PrimaryTopology,
+                                          DoNeighbour, DoAccess,
+                                          DoLength, DoLoopLength),
+                            ClusterScore, NThreads))
+            return(1);
+         return(0);
+      }
+
+      if(AllVsAll || Stream)
+      {
+         /* Just the library is read, by WriteAllVsAll() or below. The
+            queries of --stream are read by StreamQueries()
+         */
+      }
+      else if(BatchMode || Serve)
+      {
+         /* The queries are read from the list in infile1 by 
+            ScanQueryList(), or from the socket by ServeLibraries()
+         */
+         if(DoAccess && !GivenTopString)
+            SetMeanAccess(ELen, HLen, Do3_10);
+      }
+      else if(GivenTopString)
       {
-         if((top1 = (int *)malloc((1+strlen(infile1)) * sizeof(int)))
-            ==NULL)
+         if((top1 = (TOPCODE *)malloc((1+strlen(infile1)) * 
+                                      sizeof(TOPCODE)))==NULL)
          {
             fprintf(stderr,"No memory for copying topology string\n");
             return(1);
          }
-         MakeIntArray(top1, infile1);
+         if((length1 = MakeCodeArray(top1, infile1)) < 0)
+         {
+            fprintf(stderr,"Invalid topology string: %s\n", infile1);
+            return(1);
+         }
          
          if(!ScanMode)
          {
-            if((top2 = (int *)malloc((1+strlen(infile2)) * sizeof(int)))
-               ==NULL)
+            if((top2 = (TOPCODE *)malloc((1+strlen(infile2)) * 
+                                         sizeof(TOPCODE)))==NULL)
             {
                fprintf(stderr,"No memory for copying topology string\n");
                return(1);
             }
-            MakeIntArray(top2, infile2);
+            if((length2 = MakeCodeArray(top2, infile2)) < 0)
+            {
+               fprintf(stderr,"Invalid topology string: %s\n", infile2);
+               return(1);
+            }
          }
       }
       else
@@ -237,37 +881,7 @@ int main(int argc, char **argv)
             accessibilities
          */
          if(DoAccess)
-         {
-            BOOL Warn = FALSE;
-            
-            if(ELen == 3)
-            {
-               gStrandMeanAccess = STRAND_MEAN_ACCESS_3;
-            }
-            else
-            {
-               gStrandMeanAccess = STRAND_MEAN_ACCESS_4;
-               if(ELen != 4) Warn = TRUE;
-            }
-            
-            if(HLen == 3)
-            {
-               gHelixMeanAccess = ((Do3_10)?HELIX_MEAN_ACCESS_3G:
-                                   HELIX_MEAN_ACCESS_3);
-            }
-            else
-            {
-               gHelixMeanAccess = ((Do3_10)?HELIX_MEAN_ACCESS_4G:
-                                   HELIX_MEAN_ACCESS_4);
-               if(ELen != 4) Warn = TRUE;
-            }
-            
-            if(Warn)
-            {
-               fprintf(stderr,"Mean accessibilities not known for \
-specified secondary structure length\nUsing values for length 4\n");
-            }
-         }
+            SetMeanAccess(ELen, HLen, Do3_10);
 
          /* Calculate secondary structure using selected program if
             required
@@ -275,28 +889,12 @@ specified secondary structure length\nUsing values for length 4\n");
          if(CalcSecStr)
          {
             char ofile1[MAXBUFF],
-               ofile2[MAXBUFF],
-               cmd[HUGEBUFF];
+                 ofile2[MAXBUFF];
             
             pid = getpid();
             
             sprintf(ofile1,"/tmp/file1.%d",pid);
-            switch(SecStrCalculator)
-            {
-            case SECSTR_STRIDE:
-               sprintf(cmd,"%s %s | %s %s > %s", STRIDE, infile1, 
-                       MERGESTRIDE, infile1, ofile1);
-               break;
-            case SECSTR_DSSP:
-               sprintf(cmd,"%s %s %s >/dev/null", DSSP, infile1, ofile1);
-               break;
-            case SECSTR_PDBSECSTR:
-            default:
-               sprintf(cmd,"%s %s | %s %s > %s", PDBSECSTR, infile1, 
-                       MERGEPDBSECSTR, infile1, ofile1);
-               break;
-            }
-            system(cmd);
+            RunSecStr(infile1, ofile1, SecStrCalculator);
             strcpy(infile1, ofile1);
             
             /* If we aren't just building and we aren't scanning then it
@@ -306,23 +904,7 @@ specified secondary structure length\nUsing values for length 4\n");
             if(!BuildOnly && !ScanMode)
             {
                sprintf(ofile2,"/tmp/file2.%d",pid);
-               switch(SecStrCalculator)
-               {
-               case SECSTR_STRIDE:
-                  sprintf(cmd,"%s %s | %s %s > %s", STRIDE, infile2, 
-                          MERGESTRIDE, infile2, ofile2);
-                  break;
-               case SECSTR_DSSP:
-                  sprintf(cmd,"%s %s %s >/dev/null", 
-                          DSSP, infile2, ofile2);
-                  break;
-               case SECSTR_PDBSECSTR:
-               default:
-                  sprintf(cmd,"%s %s | %s %s > %s", PDBSECSTR, infile2, 
-                          MERGEPDBSECSTR, infile2, ofile2);
-                  break;
-               }
-               system(cmd);
+               RunSecStr(infile2, ofile2, SecStrCalculator);
                strcpy(infile2, ofile2);
             }
          }
@@ -345,7 +927,8 @@ specified secondary structure length\nUsing values for length 4\n");
          /* Read the secondary structure files                          */
          if((top1 = ReadTopology(fdssp1, ELen, HLen, SecStrCalculator,
                                  Do3_10, PrimaryTopology, DoNeighbour,
-                                 DoAccess, DoLength, DoLoopLength))==NULL)
+                                 DoAccess, DoLength, DoLoopLength,
+                                 &length1))==NULL)
          {
             fprintf(stderr,"Unable to read topology from %s\n",infile1);
             return(1);
@@ -356,7 +939,7 @@ specified secondary structure length\nUsing values for length 4\n");
          */
          if(BuildOnly)
          {
-            char *ts = NumArrayToString(top1);
+            char *ts = CodesToString(top1, length1);
             if(ts==NULL)
             {
                fprintf(stderr,"No memory to create topology string from \
@@ -372,65 +955,140 @@ numeric array\n");
       if(!BuildOnly)
       {
          /* Read the Matrix file                                        */
-         if(!blNumericReadMDM(matfile))
+         if(!ReadMatrix(matfile))
          {
             fprintf(stderr,"Unable to read matrix file %s\n",matfile);
             return(1);
          }
+
+         /* The band relies on cells outside it being no better than 
+            the edge of the matrix, which needs the scores to be 
+            non-negative
+         */
+         if(Band != NOBAND)
+         {
+            if(gMDMMin < 0)
+            {
+               fprintf(stderr,"Warning: -B needs a matrix with no \
+negative scores. Ignored\n");
+               Band = NOBAND;
+            }
+            else if((Band == AUTOBAND) && !BatchMode && !AllVsAll &&
+                    !Serve && !Stream)
+            {
+               Band = MAX(AUTOBAND_MIN, 
+                          length1 / AUTOBAND_FRACTION);
+            }
+         }
       
+         /* Comparing every library entry with every other              */
+         if(AllVsAll)
+         {
+            if(!WriteAllVsAll(infile1, infile2, UseBoth, PrimaryTopology,
+                              NThreads, Band, LSHLength, LSHBands,
+                              LSHRows, LSHMargin, Recall, MinScore))
+               return(1);
+            return(0);
+         }
+         
+         /* Scanning the queries sent to a socket until stopped         */
+         if(Serve)
+         {
+            if(!ServeLibraries(infile1, LibFiles, NLibFiles, 
+                               GivenTopString, CalcSecStr, 
+                               SecStrCalculator, ELen, HLen, Do3_10,
+                               PrimaryTopology, DoNeighbour, DoAccess,
+                               DoLength, DoLoopLength, UseBoth, NThreads,
+                               Band, MaxHits, MinScore, SeedLength, 
+                               SeedHits, Margin))
+               return(1);
+            return(0);
+         }
+
          /* Comparing against a library                                 */
          if(ScanMode)
          {
-            char buffer[MAXBUFF], 
-                 name[MAXBUFF],
-                 *ptr;
+            LIBRARY    *library;
+            SCANRESULT *results;
+            int        *hits,
+                       nhits;
 
-            if((top2 = (int *)malloc(MAXBUFF * sizeof(int)))==NULL)
+            if((fdssp2 == NULL) && ((fdssp2=fopen(infile2,"r"))==NULL))
             {
-               fprintf(stderr,"No memory for topology buffer\n");
+               fprintf(stderr,"Can't read %s\n",infile2);
                return(1);
             }
             
-            while(fgets(buffer,MAXBUFF,fdssp2))
+            if((library = OpenLibrary(fdssp2, infile2, !GivenTopString,
+                                      ELen, HLen,
+                                      TopologyFlags(Do3_10, 
+                                                    PrimaryTopology,
+                                                    DoNeighbour, 
+                                                    DoAccess, DoLength,
+                                                    DoLoopLength)))
+               ==NULL)
+               return(1);
+
+            if((Margin >= 0.0) && (library->clusterOf == NULL))
             {
-               TERMINATE(buffer);
-               
-               ptr = buffer;
-               while(*ptr == ' ' || *ptr == '\t')
-                  ptr++;
-               if(strlen(ptr) && (*ptr != '!') && (*ptr != '#'))
-               {
-                  char *ts;
-                  
-                  name[0]   = '\0';
-                  top2[0]   = -1;
-                  ts = NumArrayToString(top1);
-                  strcpy(gBest1, ts);
-                  free(ts);
-                  
-                  gBest2[0]  = '\0';
-                  name[0]    = '\0';
-                  top2str[0] = '\0';
-                  
-                  sscanf(ptr,"%s %s",name,top2str);
-                  MakeIntArray(top2, top2str);
+               fprintf(stderr,"Warning: library %s has no clusters \
+(see --cluster). Every entry\n         will be aligned\n", infile2);
+               Margin = NOMARGIN;
+            }
+
+            if(BatchMode)
+            {
+               if(!ScanQueryList(infile1, library, GivenTopString, 
+                                 CalcSecStr, SecStrCalculator, ELen, 
+                                 HLen, Do3_10, PrimaryTopology, 
+                                 DoNeighbour, DoAccess, DoLength, 
+                                 DoLoopLength, UseBoth, NThreads, Band,
+                                 MaxHits, MinScore, SeedLength, SeedHits,
+                                 Margin, Recall))
+                  return(1);
+               FreeLibrary(library);
+               return(0);
+            }
 
-                  IDScore = CalcIDScore(top1, top2, UseBoth);
+            if(Stream)
+            {
+               if(!StreamQueries(library, UseBoth, PrimaryTopology,
+                                 NThreads, Band, MaxHits, MinScore,
+                                 SeedLength, SeedHits, Margin))
+                  return(1);
+               FreeLibrary(library);
+               return(0);
+            }
             
-                  if((score = RunAlignment(top1, top2, 
-                                           PrimaryTopology))==(-1))
-                     return(1);
+            if((results = ScanLibrary(top1, length1, library, UseBoth, 
+                                      PrimaryTopology, NThreads, Band,
+                                      MaxHits, MinScore, SeedLength,
+                                      SeedHits, Margin, &hits, 
+                                      &nhits))==NULL)
+               return(1);
             
-                  /* Print the result                                   */
-                  if(gVerbose)
-                  {
-                     printf("! %s\n! %s\n",gBest1,gBest2);
-                  }
-                  printf("%s %f\n", name,
-                         (REAL)100.0 * (REAL)score / (REAL)IDScore);
-                  
-               }
+            if(!PrintScanResults(stdout, top1, length1, library, 
+                                 results, hits, nhits))
+               return(1);
+
+            if(Recall)
+            {
+               int nfound  = 0,
+                   nwanted = 0;
+               
+               if(!ScanRecall(&top1, &length1, 1, library, UseBoth,
+                              PrimaryTopology, NThreads, Band, MaxHits,
+                              MinScore, &hits, &nhits, &nfound, 
+                              &nwanted))
+                  return(1);
+               fprintf(stderr,"Recall: found %d of the %d hits of a \
+full scan (%.1f%%)\n", nfound, nwanted,
+                       ((nwanted > 0) ? 
+                        (REAL)100.0 * nfound / nwanted : 100.0));
             }
+            free(results);
+            FREE(hits);
+            FreeLibrary(library);
          }
          else /* Just comparing two files                               */
          {
@@ -440,7 +1098,7 @@ numeric array\n");
                                        SecStrCalculator, Do3_10,
                                        PrimaryTopology, DoNeighbour,
                                        DoAccess, DoLength,
-                                       DoLoopLength))==NULL)
+                                       DoLoopLength, &length2))==NULL)
                {
                   fprintf(stderr,"Unable to read topology from %s\n",
                           infile2);
@@ -448,15 +1106,32 @@ numeric array\n");
                }
             }
             
-            IDScore = CalcIDScore(top1, top2, UseBoth);
+            IDScore = CalcIDScore(top1, length1, top2, length2, UseBoth);
+
+            if(SIMDLanes() && (gMDMMin >= 0) && (length1 > 0))
+            {
+               profile = BuildSIMDProfile(top1, length1,
+                                          (PrimaryTopology ? 
+                                           1 : NROTATIONS));
+            }
             
-            if((score = RunAlignment(top1, top2, PrimaryTopology))==(-1))
+            if((score = RunAlignment(top1, length1, top2, length2, profile,
+                                     PrimaryTopology, Band, NULL,
+                                     &rotation))==NOALIGNMENT)
                return(1);
+            FreeSIMDProfile(profile);
             
             /* Print the result                                         */
             if(gVerbose)
             {
-               printf("%s\n%s\n",gBest1,gBest2);
+               char *best1, *best2;
+               
+               if(!BuildAlignment(top1, length1, top2, length2, rotation,
+                                  &best1, &best2))
+                  return(1);
+               printf("%s\n%s\n",best1,best2);
+               free(best1);
+               free(best2);
             }
             printf("%f\n",(REAL)100.0 * (REAL)score / (REAL)IDScore);
          }
@@ -479,443 +1154,2075 @@ numeric array\n");
 
 
 /************************************************************************/
-/*>int RunAlignment(int *top1, int *top2, BOOL PrimaryTopology)
+/*>void SetMeanAccess(int ELen, int HLen, BOOL Do3_10)
+   ---------------------------------------------------
+   Input:   int    ELen         Minimum strand length
+            int    HLen         Minimum helix length
+            BOOL   Do3_10       Merge 3_10 helix with alpha helix
+   Globals: REAL   gStrandMeanAccess  Mean strand accessibility
+            REAL   gHelixMeanAccess   Mean helix accessibility
+
+   Chooses which mean accessibilities to use for these secondary 
+   structure lengths
+
+   17.10.26 Original (code taken from main())   By: agent
+*/
+void SetMeanAccess(int ELen, int HLen, BOOL Do3_10)
+{
+   BOOL Warn = FALSE;
+   
+   if(ELen == 3)
+   {
+      gStrandMeanAccess = STRAND_MEAN_ACCESS_3;
+   }
+   else
+   {
+      gStrandMeanAccess = STRAND_MEAN_ACCESS_4;
+      if(ELen != 4) Warn = TRUE;
+   }
+   
+   if(HLen == 3)
+   {
+      gHelixMeanAccess = ((Do3_10)?HELIX_MEAN_ACCESS_3G:
+                          HELIX_MEAN_ACCESS_3);
+   }
+   else
+   {
+      gHelixMeanAccess = ((Do3_10)?HELIX_MEAN_ACCESS_4G:
+                          HELIX_MEAN_ACCESS_4);
+      if(ELen != 4) Warn = TRUE;
+   }
+   
+   if(Warn)
+   {
+      fprintf(stderr,"Mean accessibilities not known for \
+specified secondary structure length\nUsing values for length 4\n");
+   }
+}
+
+
+/************************************************************************/
+/*>void RunSecStr(char *infile, char *outfile, int SecStrCalculator)
+   -----------------------------------------------------------------
+   Input:   char   *infile      PDB file
+            char   *outfile     File for the secondary structure
+            int    SecStrCalculator  Use Stride, DSSP or pdbsecstr
+
+   Runs the selected secondary structure program on a PDB file
+
+   17.10.26 Original (code taken from main())   By: agent
+*/
+void RunSecStr(char *infile, char *outfile, int SecStrCalculator)
+{
+   char cmd[HUGEBUFF];
+   
+   switch(SecStrCalculator)
+   {
+   case SECSTR_STRIDE:
+      sprintf(cmd,"%s %s | %s %s > %s", STRIDE, infile, 
+              MERGESTRIDE, infile, outfile);
+      break;
+   case SECSTR_DSSP:
+      sprintf(cmd,"%s %s %s >/dev/null", DSSP, infile, outfile);
+      break;
+   case SECSTR_PDBSECSTR:
+   default:
+      sprintf(cmd,"%s %s | %s %s > %s", PDBSECSTR, infile, 
+              MERGEPDBSECSTR, infile, outfile);
+      break;
+   }
+   system(cmd);
+}
+
+
+/************************************************************************/
+/*>int RunAlignment(TOPCODE *top1, int length1, TOPCODE *top2, 
+                    int length2, SIMDPROFILE *profile, 
+                    BOOL PrimaryTopology, int band, int *bounds,
+                    int *rotation)
    ------------------------------------------------------------
-   Input:   int      *top1           First topology string
-            int      *top2           Second topology string
-            BOOL     PrimaryTopology Primary topology only
-   Returns: int                      Alignment score
-   Globals: char     *gBest1         Best alignment of top1 (maybe 
-                                     rotated)
-                     *gBest2         Best alignment of top2
+   Input:   TOPCODE     *top1           First topology string
+            int         length1         Length of top1
+            TOPCODE     *top2           Second topology string
+            int         length2         Length of top2
+            SIMDPROFILE *profile        Striped profile of top1 from
+                                        BuildSIMDProfile() (or NULL)
+            BOOL        PrimaryTopology Primary topology only
+            int         band            Only fill the cells with
+                                        |i-j| <= band (NOBAND for all)
+   I/O:     int         *bounds         Upper bound on the score of each
+                                        orientation from ScoreBound() 
+                                        (or NULL). See below
+   Output:  int         *rotation       The best orientation of top1
+   Returns: int                         Alignment score (NOALIGNMENT if
+                                        no memory)
 
    Does the alignment in all 24 rotations
    If both are of length 0, returns a score of 100. If only one is
    of length zero, returns 0
    If PrimaryTopology is set, then only does the raw strings since
    no directions are encoded
+   The orientations of top1 are taken from the gRotation[] tables so
+   top1 itself is not modified
+   Only the score of each orientation is calculated. The first
+   orientation giving the best score is returned in rotation; the
+   alignment itself can then be obtained with BuildAlignment()
+   When the orientations are aligned one at a time, one whose bound is
+   no better than the best score so far cannot change the result, so
+   is not aligned and has its bound set to -1
 
    13.01.98 Original   By: ACRM
    15.01.98 Added check for 0-length topology strings
    10.11.99 Added PrimaryTopology
    08.03.00 Changed calls to align() to NumericAffineAlign()
             top1 and top2 now integer arrays
+   17.10.26 Best alignments are returned in best1/best2 rather than the
+            globals so that this may be called from several threads.
+            top1 is now restored to its original orientation. Frees the
+            alignment arrays   By: agent
+   17.10.26 Orientations now taken from the precomputed gRotation[]
+            tables rather than rotating top1 in place   By: agent
+   17.10.26 Uses NumericAlignScore() rather than NumericAffineAlign()
+            and returns the best orientation rather than the alignment
+            By: agent
+   17.10.26 Added profile. If given, and the score cannot overflow 16
+            bits, the orientations are scored with SIMDAlignScores()   By: agent
+   17.10.26 Added band. The striped kernel cannot do a band so that
+            case uses BandedAlignScore()   By: agent
+   17.10.26 Takes TOPCODE strings with their lengths   By: agent
+   17.10.26 Added bounds   By: agent
+   17.10.26 Returns NOALIGNMENT rather than -1 on error since a matrix with
+            negative scores can give a score of -1   By: agent
 */
-int RunAlignment(int *top1, int *top2, BOOL PrimaryTopology)
+int RunAlignment(TOPCODE *top1, int length1, TOPCODE *top2, int length2,
+                 SIMDPROFILE *profile, BOOL PrimaryTopology, int band,
+                 int *bounds, int *rotation)
 {
-   int  length1,
-        length2,
-        score,
+   int  score,
         maxscore,
-        i, j,
-        align_len;
-   int  *align1,
-        *align2;
-   char *ts;
+        rot,
+        scores[NROTATIONS],
+        *work;
    
+   *rotation = 0;
    
-   /* Allocate memory to store the alignment and run the N&W            */
-   length1 = FindArrayLength(top1);
-   length2 = FindArrayLength(top2);
-
    /* 15.01.98 Added this check on 0-length topology strings            */
    if((length1 == 0) && (length2 == 0))
       return(100);
    if((length1 == 0) || (length2 == 0))
       return(0);
-   
-   if((align1 = (int *)malloc((length1+length2)*sizeof(int)))==NULL)
+
+   /* Vectorised scoring. Each aligned pair scores at most gMDMMax so
+      this is exact as long as that cannot saturate 16 bits
+   */
+   if((profile != NULL) &&
+      ((band == NOBAND) || (profile->rotProfile != NULL)) &&
+      ((long)gMDMMax * MIN(length1, length2) <= SIMDMAXSCORE))
    {
-      fprintf(stderr,"No memory for alignment1\n");
-      return(-1);
+      if(!SIMDAlignScores(profile, top2, length2, band, scores))
+      {
+         fprintf(stderr,"No memory for alignment\n");
+         return(NOALIGNMENT);
+      }
+
+      maxscore = scores[0];
+      for(rot=1; rot<profile->nrot; rot++)
+      {
+         if(scores[rot] > maxscore)
+         {
+            maxscore  = scores[rot];
+            *rotation = rot;
+         }
+      }
+      return(maxscore);
    }
-   if((align2 = (int *)malloc((length1+length2)*sizeof(int)))==NULL)
+   
+   if((work = (int *)malloc(3*length2*sizeof(int)))==NULL)
    {
-      fprintf(stderr,"No memory for alignment2\n");
-      return(-1);
+      fprintf(stderr,"No memory for alignment\n");
+      return(NOALIGNMENT);
    }
 
    /* Native position                                                   */
-   maxscore = blNumericAffineAlign(top1, length1, top2, length2, FALSE,
-                                   FALSE, GAPPEN, 0, align1, align2,
-                                   &align_len);
-   align1[align_len] = (-1);
-   align2[align_len] = (-1);
-
-   ts = NumArrayToString(align1);
-   strcpy(gBest1, ts);
-   free(ts);
-   
-   ts = NumArrayToString(align2);
-   strcpy(gBest2, ts);
-   free(ts);
+   if(band == NOBAND)
+      maxscore = NumericAlignScore(top1, length1, top2, length2, 
+                                   gRotMDM[0], work);
+   else
+      maxscore = BandedAlignScore(top1, length1, top2, length2, 
+                                  gRotMDM[0], band, work);
    
    /* If we aren't doing direction information then we don't need to do
       the permutations of the string for different orientations
    */
-   if(PrimaryTopology)
-      return(maxscore);
-   
-   for(i=0; i<4; i++)
+   if(!PrimaryTopology)
    {
-      TurnAboutX(top1);
-      for(j=0; j<4; j++)
+      for(rot=1; rot<NROTATIONS; rot++)
       {
-         TurnAboutZ(top1);
-         
-         score = blNumericAffineAlign(top1, length1, top2, length2, FALSE,
-                                      FALSE, GAPPEN, 0, align1, align2,
-                                      &align_len);
-         if(score > maxscore)
+         if((bounds != NULL) && (bounds[rot] <= maxscore))
          {
-            maxscore = score;
-
-            align1[align_len] = (-1);
-            align2[align_len] = (-1);
-            
-            ts = NumArrayToString(align1);
-            strcpy(gBest1, ts);
-            free(ts);
-            
-            ts = NumArrayToString(align2);
-            strcpy(gBest2, ts);
-            free(ts);
+            bounds[rot] = (-1);
+            continue;
          }
-      }
-   }
-   for(i=0; i<2; i++)
-   {
-      TurnAboutY(top1);
-      for(j=0; j<4; j++)
-      {
-         TurnAboutZ(top1);
          
-         score = blNumericAffineAlign(top1, length1, top2, length2, FALSE,
-                                      FALSE, GAPPEN, 0, align1, align2,
-                                      &align_len);
+         if(band == NOBAND)
+            score = NumericAlignScore(top1, length1, top2, length2,
+                                      gRotMDM[rot], work);
+         else
+            score = BandedAlignScore(top1, length1, top2, length2,
+                                     gRotMDM[rot], band, work);
          if(score > maxscore)
          {
-            maxscore = score;
-
-            align1[align_len] = (-1);
-            align2[align_len] = (-1);
-            
-            ts = NumArrayToString(align1);
-            strcpy(gBest1, ts);
-            free(ts);
-            
-            ts = NumArrayToString(align2);
-            strcpy(gBest2, ts);
-            free(ts);
+            maxscore  = score;
+            *rotation = rot;
          }
       }
-      if(i==0) TurnAboutY(top1);
    }
+   
+   free(work);
 
    return(maxscore);
 }
 
 
 /************************************************************************/
-/*>void TurnAboutX(int *top)
-   -------------------------
-   I/O:     int      *top    Topology string to rotate
+/*>int NumericAlignScore(TOPCODE *seq1, int length1, TOPCODE *seq2,
+                         int length2, signed char (*mdm)[NCODES+1], 
+                         int *work)
+   ---------------------------------------------------------------------
+   Input:   TOPCODE     *seq1      First topology string
+            int         length1    Length of seq1 (>0)
+            TOPCODE     *seq2      Second topology string
+            int         length2    Length of seq2 (>0)
+            signed char (*mdm)[]   Scoring matrix indexed by code (gMDM,
+                                   or one of gRotMDM to rotate seq1)
+            int         *work      Workspace of 3*length2 ints
+   Returns: int              Alignment score
 
-   Modifies the topology string by rotating about X
+   Calculates the score that blNumericAffineAlign() would give with a gap
+   penalty of GAPPEN and no extension penalty, but without building the
+   traceback and keeping only two rows of the matrix.
 
-   13.01.98 Original   By: ACRM
-   17.11.99 Added characters M-X for adjacent secondary structures
-            Modified so array is indexed by the alphabet so it no
-            longer needs to use chindex() which is painfully slow
-   23.11.99 Added lower case letters
-   10.03.00 Changed to use integer coded topology array
+   The matrix is filled from the bottom right as in 
+   blNumericAffineAlign():
+      M[i][j] = s(i,j) + max(M[i+1][j+1],
+                             max(M[k][j+1], k>i+1) - GAPPEN,
+                             max(M[i+1][l], l>j+1) - GAPPEN)
+   with the last row and column just being s(i,j), and a gap term
+   being 0 if there is nothing to look at. The column maxima are kept
+   in colmax[] a row behind and the row maximum is accumulated as we
+   move left. The score is the best value in the top row or left
+   column.
+
+   17.10.26 Original   By: agent
+   17.10.26 Takes TOPCODE strings and a signed char matrix   By: agent
 */
-void TurnAboutX(int *top)
+int NumericAlignScore(TOPCODE *seq1, int length1, TOPCODE *seq2,
+                      int length2, signed char (*mdm)[NCODES+1], 
+                      int *work)
 {
-   static int new[] = {0,5,2,6,4,3,1};
+   signed char *srow;
+   int *prev   = work,
+       *cur    = work + length2,
+       *colmax = work + 2*length2,
+       *tmp,
+       i, j,
+       dia, right, down,
+       rowmax = 0,
+       score;
+
+   /* Last row                                                          */
+   srow = mdm[seq1[length1-1]];
+   for(j=0; j<length2; j++)
+      cur[j] = srow[seq2[j]];
+   score = cur[0];
+   
+   for(i=length1-2; i>=0; i--)
+   {
+      /* The row we just did becomes the previous row. Rows below that
+         go into the column maxima
+      */
+      if(i == length1-2)
+      {
+         tmp  = prev;
+         prev = cur;
+         cur  = tmp;
+      }
+      else
+      {
+         for(j=0; j<length2; j++)
+         {
+            if(i == length1-3)
+               colmax[j] = prev[j];
+            else if(prev[j] > colmax[j])
+               colmax[j] = prev[j];
+         }
+         tmp  = prev;
+         prev = cur;
+         cur  = tmp;
+      }
+      
+      srow = mdm[seq1[i]];
+      cur[length2-1] = srow[seq2[length2-1]];
+      
+      for(j=length2-2; j>=0; j--)
+      {
+         dia = prev[j+1];
+         
+         if(i+2 >= length1)
+            right = 0;
+         else
+            right = colmax[j+1] - GAPPEN;
+         
+         if(j+2 >= length2)
+         {
+            down = 0;
+         }
+         else
+         {
+            if((j+2 == length2-1) || (prev[j+2] > rowmax))
+               rowmax = prev[j+2];
+            down = rowmax - GAPPEN;
+         }
+
+         if(right > dia)
+            dia = right;
+         if(down > dia)
+            dia = down;
+         
+         cur[j] = dia + srow[seq2[j]];
+      }
+
+      /* Left column                                                    */
+      if(cur[0] > score)
+         score = cur[0];
+   }
    
-   while(*top >= 0)
+   /* Top row                                                           */
+   for(j=0; j<length2; j++)
    {
-      *top = (6*(int)((*top - 1)/6)) + new[1+((*top - 1)%6)];
-      top++;
+      if(cur[j] > score)
+         score = cur[j];
    }
+
+   return(score);
 }
 
 
 /************************************************************************/
-/*>void TurnAboutY(int *top)
-   --------------------------
-   I/O:     int     *top    Topology string to rotate
+/*>int BandedAlignScore(TOPCODE *seq1, int length1, TOPCODE *seq2,
+                        int length2, signed char (*mdm)[NCODES+1], 
+                        int band, int *work)
+   ---------------------------------------------------------------------
+   Input:   TOPCODE     *seq1      First topology string
+            int         length1    Length of seq1 (>0)
+            TOPCODE     *seq2      Second topology string
+            int         length2    Length of seq2 (>0)
+            signed char (*mdm)[]   Scoring matrix indexed by code (gMDM,
+                                   or one of gRotMDM to rotate seq1)
+            int         band       Band width (>=0)
+            int         *work      Workspace of 3*length2 ints
+   Returns: int              Alignment score
 
-   Modifies the topology string by rotating about Y
+   As NumericAlignScore() but only fills the cells with |i-j| <= band.
+   The cells outside the band are taken to be 0, so they add nothing 
+   that the edge of the matrix would not; this relies on the matrix 
+   having no negative scores, in which case a band at least as wide as
+   the longer string gives the same score as NumericAlignScore().
 
-   13.01.98 Original   By: ACRM
-   17.11.99 Added characters M-X for adjacent secondary structures
-            Modified so array is indexed by the alphabet so it no
-            longer needs to use chindex() which is painfully slow
-   23.11.99 Added lower case letters
-   10.03.00 Changed to use integer coded topology array
+   Only the cells in the band of each row are touched. The row buffers
+   and column maxima are cleared to start with, and as the band moves
+   left each row buffer has the cells of the row it held before which
+   are right of the new band cleared, so that anything read outside the
+   band is 0.
+
+   17.10.26 Original   By: agent
+   17.10.26 Takes TOPCODE strings and a signed char matrix   By: agent
 */
-void TurnAboutY(int *top)
+int BandedAlignScore(TOPCODE *seq1, int length1, TOPCODE *seq2,
+                     int length2, signed char (*mdm)[NCODES+1], int band,
+                     int *work)
 {
-   static int new[] = {0,1,5,3,6,4,2};
-   
-   while(*top >= 0)
+   signed char *srow;
+   int *prev   = work,
+       *cur    = work + length2,
+       *colmax = work + 2*length2,
+       *tmp,
+       i, j,
+       start, stop,
+       dia, right, down,
+       rowmax,
+       score = 0;
+
+   for(j=0; j<3*length2; j++)
+      work[j] = 0;
+
+   for(i=length1-1; i>=0; i--)
    {
-      *top = (6*(int)((*top - 1)/6)) + new[1+((*top - 1)%6)];
-      top++;
+      start = MAX(0, i-band);
+      stop  = MIN(length2-1, i+band);
+
+      /* cur still holds row i+2 which now goes into the column maxima.
+         Its cells right of our band will not be overwritten so are 
+         cleared
+      */
+      if(i+2 < length1)
+      {
+         for(j=MAX(0, i+2-band); j<=MIN(length2-1, i+2+band); j++)
+         {
+            if(cur[j] > colmax[j])
+               colmax[j] = cur[j];
+            if(j > stop)
+               cur[j] = 0;
+         }
+      }
+
+      srow   = mdm[seq1[i]];
+      rowmax = 0;
+      for(j=stop; j>=start; j--)
+      {
+         if((i == length1-1) || (j == length2-1))
+         {
+            /* Last row or column                                       */
+            cur[j] = srow[seq2[j]];
+         }
+         else
+         {
+            dia = prev[j+1];
+
+            if(i+2 >= length1)
+               right = 0;
+            else
+               right = colmax[j+1] - GAPPEN;
+
+            if(j+2 >= length2)
+            {
+               down = 0;
+            }
+            else
+            {
+               if(prev[j+2] > rowmax)
+                  rowmax = prev[j+2];
+               down = rowmax - GAPPEN;
+            }
+
+            if(right > dia)
+               dia = right;
+            if(down > dia)
+               dia = down;
+
+            cur[j] = dia + srow[seq2[j]];
+         }
+
+         if(cur[j] > score)
+            score = cur[j];
+      }
+
+      tmp  = prev;
+      prev = cur;
+      cur  = tmp;
    }
+
+   return(score);
 }
 
 
 /************************************************************************/
-/*>void TurnAboutZ(int *top)
-   --------------------------
-   I/O:     int     *top    Topology string to rotate
+/*>REAL BandCells(int length1, int length2, int band)
+   --------------------------------------------------
+   Input:   int   length1    Length of the first string
+            int   length2    Length of the second string
+            int   band       Band width (or NOBAND)
+   Returns: REAL             Number of cells of the alignment matrix in 
+                             the band
 
-   Modifies the topology string by rotating about Z
-
-   13.01.98 Original   By: ACRM
-   17.11.99 Added characters M-X for adjacent secondary structures
-            Modified so array is indexed by the alphabet so it no
-            longer needs to use chindex() which is painfully slow
-   23.11.99 Added lower case letters
-   10.03.00 Changed to use integer coded topology array
+   17.10.26 Original   By: agent
 */
-void TurnAboutZ(int *top)
+REAL BandCells(int length1, int length2, int band)
 {
-   static int new[] = {0,2,3,4,1,5,6};
-   
-   while(*top >= 0)
+   REAL cells = 0.0;
+   int  i;
+
+   if(band == NOBAND)
+      return((REAL)length1 * (REAL)length2);
+
+   for(i=0; i<length1; i++)
    {
-      *top = (6*(int)((*top - 1)/6)) + new[1+((*top - 1)%6)];
-      top++;
+      if(i-band < length2)
+         cells += MIN(length2-1, i+band) - MAX(0, i-band) + 1;
    }
+   return(cells);
 }
 
 
 /************************************************************************/
-/*>BOOL ParseCmdLine(int argc, char **argv, char *infile1, char *infile2, 
-                     char *matfile, int *ELen, int *HLen, 
-                     BOOL *CalcSecStr, BOOL *BuildOnly, BOOL *ScanMode,
-                     BOOL *UseBoth, int *SecStrCalculator, BOOL *Do3_10,
-                     BOOL *PrimaryTopology, BOOL *DoNeighbour,
-                     BOOL *DoAccess,  BOOL *GivenTopString,
-                     BOOL *DoLength, BOOL *DoLoopLength)
-   -----------------------------------------------------------------------
-   Input:   int    argc         Argument count
-            char   **argv       Argument array
-   Output:  char   *infile1     DSSP Input file 1
-            char   *infile2     DSSP Input file 2
-            char   *matfile     Matrix file      
-            int    *ELen        Minimum strand length
-            int    *HLen        Minimum helix length
-            BOOL   *CalcSecStr  Calculate secondary structure on input
-                                files?
-            BOOL   *BuildOnly   Just create the topology string for the
-                                structure?
-            BOOL   *ScanMode    Run in scan mode?
-            BOOL   *UseBoth     Calculate the percentages wrt max score
-                                from either struc rather than just the 
-                                first
-            BOOL   *SecStrCalculator  Use Stride, DSSP or pdbsecstr
-            BOOL   *Do3_10      Merge 3_10 helix with alpha helix
-            BOOL   *PrimaryTopology Do only primary topology
-            BOOL   *DoNeighbour Add neighbour information
-            BOOL   *DoAccess    Add accessibility information
-            BOOL   *GivenTopString  Given the topology string on the 
-                                command line instead of a file
-            BOOL   *DoLength    Add length information
-            BOOL   *DoLoopLength  Add loop length information
-   Returns: BOOL                Success?
+/*>BOOL BuildAlignment(TOPCODE *top1, int length1, TOPCODE *top2, 
+                       int length2, int rotation, char **best1, 
+                       char **best2)
+   ---------------------------------------------------------------------
+   Input:   TOPCODE *top1     First topology string
+            int    length1    Length of top1
+            TOPCODE *top2     Second topology string
+            int    length2    Length of top2
+            int    rotation   Orientation of top1 (from RunAlignment())
+   Output:  char   **best1    Alignment of top1 in that orientation
+            char   **best2    Alignment of top2
+   Returns: BOOL              Success?
 
-   Parse the command line
-   
-   13.01.98 Original    By: ACRM
-   26.10.99 Added -g / Do3_10
-   10.11.99 Added -1 / PrimaryTopology
-   16.11.99 Added DoNeighbour
-   23.11.99 Added DoAccess
-   19.01.00 Added -t (GivenTopString)
-   26.01.00 Added -l (DoLength)
-   16.03.00 Added -L (DoLoopLength)
-   15.01.20 Added pdbsecstr support as the default
+   Runs blNumericAffineAlign() for just the best orientation to obtain
+   the alignment and converts it to strings. The strings are allocated
+   and must be freed by the caller. If either topology string is empty
+   there is no alignment and both are returned as empty strings.
+
+   blNumericAffineAlign() keeps the whole matrix and traceback, so when
+   these would have more than TRACEBACKCELLS cells (and the matrix has
+   no negative scores) LinearSpaceAlign() is used instead. This gives 
+   the same alignment. It is also used with the built-in matrix, which
+   blNumericAffineAlign() has no copy of.
+
+   17.10.26 Original (code taken from RunAlignment())   By: agent
+   17.10.26 Uses LinearSpaceAlign() for long strings   By: agent
+   17.10.26 Takes TOPCODE strings with their lengths. blNumericAffineAlign()
+            is given int copies   By: agent
+   17.10.26 Uses LinearSpaceAlign() with the built-in matrix   By: agent
 */
-BOOL ParseCmdLine(int argc, char **argv, char *infile1, char *infile2, 
-                  char *matfile, int *ELen, int *HLen, BOOL *CalcSecStr,
-                  BOOL *BuildOnly, BOOL *ScanMode, BOOL *UseBoth,
-                  int *SecStrCalculator, BOOL *Do3_10,
-                  BOOL *PrimaryTopology, BOOL *DoNeighbour,
-                  BOOL *DoAccess, BOOL *GivenTopString, BOOL *DoLength, 
-                  BOOL *DoLoopLength)
+BOOL BuildAlignment(TOPCODE *top1, int length1, TOPCODE *top2, 
+                    int length2, int rotation, char **best1, 
+                    char **best2)
 {
-   argc--;
-   argv++;
+   int     align_len,
+           i;
+   int     *align1 = NULL,
+           *align2 = NULL,
+           *int1   = NULL,
+           *int2   = NULL;
+   TOPCODE *rot1   = NULL,
+           *codes  = NULL;
+   BOOL    ok      = FALSE;
 
-   infile1[0] = infile2[0] = '\0';
-   strcpy(matfile,MATFILE);
+   *best1  = NULL;
+   *best2  = NULL;
 
-   if(!argc)
-      return(FALSE);
-   
-   while(argc)
+   if((length1 == 0) || (length2 == 0))
    {
-      if(argv[0][0] == '-')
+      *best1 = CodesToString(top1, 0);
+      *best2 = CodesToString(top2, 0);
+   }
+   else if(((align1 = (int *)malloc((length1+length2)*sizeof(int)))
+            !=NULL) &&
+           ((align2 = (int *)malloc((length1+length2)*sizeof(int)))
+            !=NULL) &&
+           ((codes  = (TOPCODE *)malloc((length1+length2) *
+                                        sizeof(TOPCODE)))!=NULL) &&
+           ((rot1   = (TOPCODE *)malloc(length1*sizeof(TOPCODE)))!=NULL))
+   {
+      for(i=0; i<length1; i++)
+         rot1[i] = gRotation[rotation][top1[i]];
+      
+      if((gMDMMin >= 0) && 
+         (gBuiltInMDM || ((long)length1 * length2 > TRACEBACKCELLS)))
       {
-         switch(argv[0][1])
-         {
-         case 'm':
-            argc--;
-            argv++;
-            if(argc>0)
-               strcpy(matfile,argv[0]);
-            break;
-         case 'h':
-            argc--;
-            argv++;
-            if(argc>0)
-               sscanf(argv[0],"%d",HLen);
-            break;
-         case 'e':
-            argc--;
-            argv++;
-            if(argc>0)
-               sscanf(argv[0],"%d",ELen);
-            break;
-         case 'v':
-            gVerbose = TRUE;
-            break;
-         case 'p':
-            *CalcSecStr = TRUE;
-            switch(argv[0][2])
-            {
-            case 's':
-               *SecStrCalculator = SECSTR_STRIDE;
-               break;
-            case 'p':
-               *SecStrCalculator = SECSTR_PDBSECSTR;
-               break;
-            case 'd':
-               *SecStrCalculator = SECSTR_DSSP;
-               break;
-            case '\0':
-               *SecStrCalculator = SECSTR_PDBSECSTR;
-               break;
-            default:
-               return(FALSE);
-            }
-            break;
-         case 'b':
-            *BuildOnly = TRUE;
-            break;
-         case 's':
-            *ScanMode = TRUE;
-            break;
-         case 'w':
-            *UseBoth = TRUE;
-            break;
-         case 'g':
-            *Do3_10 = TRUE;
-            break;
-         case '1':
-            *PrimaryTopology = TRUE;
-            break;
-         case 'n':
-            *DoNeighbour = TRUE;
-            break;
-         case 'a':
-            *DoAccess = TRUE;
-            break;
-         case 't':
-            *GivenTopString = TRUE;
-            break;
-         case 'l':
-            *DoLength = TRUE;
-            break;
-         case 'L':
-            *DoLoopLength = TRUE;
-            break;
-         default:
-            return(FALSE);
-            break;
-         }
+         if(!LinearSpaceAlign(rot1, length1, top2, length2, 
+                              align1, align2, &align_len))
+            align_len = (-1);
+      }
+      else if(((int1 = (int *)malloc(length1*sizeof(int)))!=NULL) &&
+              ((int2 = (int *)malloc(length2*sizeof(int)))!=NULL))
+      {
+         for(i=0; i<length1; i++)
+            int1[i] = rot1[i];
+         for(i=0; i<length2; i++)
+            int2[i] = top2[i];
+         blNumericAffineAlign(int1, length1, int2, length2, FALSE, FALSE,
+                              GAPPEN, 0, align1, align2, &align_len);
       }
       else
       {
-         /* Check that there are 2 arguments left                       */
-         if(*BuildOnly && argc != 1)
-            return(FALSE);
-         if(!(*BuildOnly) && argc != 2)
-            return(FALSE);
-         
-         /* Copy the first to infile                                    */
-         strcpy(infile1, argv[0]);
-         if(!(*BuildOnly))
-            strcpy(infile2, argv[1]);
-            
-         if(*DoAccess && (*SecStrCalculator == SECSTR_PDBSECSTR))
-         {
-            fprintf(stderr, "\n\nError! Access calculations are not \
-supported with pdbsecstr\n\n");
-            return(FALSE);
-         }
-         
-         return(TRUE);
+         align_len = (-1);
+      }
+
+      if(align_len >= 0)
+      {
+         for(i=0; i<align_len; i++)
+            codes[i] = (TOPCODE)align1[i];
+         *best1 = CodesToString(codes, align_len);
+         for(i=0; i<align_len; i++)
+            codes[i] = (TOPCODE)align2[i];
+         *best2 = CodesToString(codes, align_len);
       }
-      argc--;
-      argv++;
    }
-   
-   if(*DoAccess && (*SecStrCalculator == SECSTR_PDBSECSTR))
+
+   if((*best1 != NULL) && (*best2 != NULL))
    {
-      fprintf(stderr, "\n\nError! Access calculations are not supported \
-with pdbsecstr\n\n");
-      return(FALSE);
+      ok = TRUE;
+   }
+   else
+   {
+      fprintf(stderr,"No memory for alignment\n");
+      FREE(*best1);
+      FREE(*best2);
    }
+
+   FREE(align1);
+   FREE(align2);
+   FREE(int1);
+   FREE(int2);
+   FREE(codes);
+   FREE(rot1);
    
-   return(TRUE);
+   return(ok);
 }
 
 
 /************************************************************************/
-/*>void Usage(void)
-   ----------------
-   Prints a usage message
+/*>BOOL LinearSpaceAlign(TOPCODE *seq1, int length1, TOPCODE *seq2, 
+                         int length2, int *align1, int *align2, 
+                         int *align_len)
+   ---------------------------------------------------------------------
+   Input:   int   *seq1       First topology string (already rotated)
+            int   length1     Length of seq1 (>0)
+            int   *seq2       Second topology string
+            int   length2     Length of seq2 (>0)
+   Output:  int   *align1     Alignment of seq1 (0 for a gap)
+            int   *align2     Alignment of seq2
+            int   *align_len  Length of the alignment
+   Returns: BOOL              Success?
 
-   13.01.98 Original   By: ACRM
-   15.01.98 V1.1
-   13.03.98 V1.2
-   26.10.99 V1.3
-   10.11.99 V1.4
-   16.11.99 V1.5
-   19.11.99 V1.7
-   13.03.00 V2.0
-   17.03.00 V2.1
-   15.01.20 V3.0 Added pdbsecstr support as the default
+   Gives the same alignment as blNumericAffineAlign() with a gap penalty
+   of GAPPEN and no extension penalty, but without keeping the matrix or
+   the traceback. The matrix must have no negative scores.
+
+   blNumericAffineAlign() fills the matrix from the bottom right, then
+   starts at the best cell in the top row or left column (the first 
+   found if tied) and follows the cell each was reached from. A first
+   pass over the whole matrix gives the top row and left column to find
+   the start of the path. FollowPath() then finds the rest of it by 
+   Hirschberg's division of the rows in two.
+
+   Only a few rows of the matrix are kept, so the memory used is of 
+   order length2, and the rows are filled about twice over.
+
+   17.10.26 Original   By: agent
+   17.10.26 Takes TOPCODE strings   By: agent
+   17.10.26 Memory is of order length2 rather than 
+            length2 * log(length1)   By: agent
 */
-void Usage(void)
+BOOL LinearSpaceAlign(TOPCODE *seq1, int length1, TOPCODE *seq2, 
+                      int length2, int *align1, int *align2, 
+                      int *align_len)
 {
-   fprintf(stderr,"\ntopscan V3.0 (c) 1998-2020, Prof. Andrew C.R. \
-Martin, UCL & Reading\n");
+   PATHROWS *rows;
+   int      *path,
+            npath    = 0,
+            bi       = 0, 
+            bj       = 0, 
+            lefti    = (-1),
+            leftmax  = 0,
+            i, j, k,
+            ai       = 0;
 
-   fprintf(stderr,"\nUsage: topscan [-t] [-v] [-1] [-n] [-a] [-l] [-L] \
-[-p[s|d|p]] [-w] [-h hlen]\n"); 
-   fprintf(stderr,"               [-e elen] [-m matrix] [-g] \
-file1.{dssp|pdb} file2.{dssp|pdb}\n");
-   fprintf(stderr,"       topscan -b [-1] [-n] [-a] [-l] [-L] \
-[-p[s|d|p]] [-h hlen] [-e elen] [-g]\n");
-   fprintf(stderr,"               file1.{dssp|pdb}\n");
-   fprintf(stderr,"       topscan -s [-t] [-1] [-n] [-a] [-l] [-L] [-v] \
-[-p[s|d|p]] [-w] [-h hlen]\n");
-   fprintf(stderr,"               [-e elen] [-m matrix] [-g] \
-file1.{dssp|pdb} file2.top\n");
-   fprintf(stderr,"\n       -b Build the topology string for a file\n");
-   fprintf(stderr,"          (Don't actually run a comparison)\n");
-   fprintf(stderr,"       -s Scan a DSSP or PDB file against a library \
-of topology strings\n");
-   fprintf(stderr,"          stored in the second file\n");
-   fprintf(stderr,"       -m Specify the matrix file [Default: %s]\n",
-           MATFILE);
+   if((path = (int *)malloc(2 * (MIN(length1, length2) + 1) * 
+                            sizeof(int)))==NULL)
+      return(FALSE);
+   if((rows = NewPathRows(length2))==NULL)
+   {
+      free(path);
+      return(FALSE);
+   }
+
+   /* Fill the whole matrix keeping the best of the left column below
+      the top row (the first if tied)
+   */
+   ResetPathRows(rows, length2);
+   for(i=length1-1; i>=0; i--)
+   {
+      FillPathRow(rows, seq1, seq2, i, 0, length1-1, length2-1, FALSE,
+                  -1);
+      if((i > 0) && ((lefti < 0) || (rows->out[0] >= leftmax)))
+      {
+         leftmax = rows->out[0];
+         lefti   = i;
+      }
+      AdvancePathRows(rows, i, length1-1, length2);
+   }
+
+   /* Find the start as blNumericAffineAlign() does                     */
+   for(j=0; j<length2; j++)
+   {
+      if(rows->row[j] > rows->row[bj])
+         bj = j;
+   }
+   if((lefti > 0) && (leftmax > rows->row[bj]))
+   {
+      bi = lefti;
+      bj = 0;
+   }
+
+   /* Follow the path from there                                        */
+   FollowPath(rows, seq1, seq2, bi, bj, length1-1, length2-1, FALSE,
+              path, &npath);
+   FreePathRows(rows);
+
+   /* Build the alignment from the path                                 */
+   for(i=0; i<bi; i++)
+   {
+      align1[ai]   = seq1[i];
+      align2[ai++] = 0;
+   }
+   for(j=0; j<bj; j++)
+   {
+      align1[ai]   = 0;
+      align2[ai++] = seq2[j];
+   }
+   i = bi;
+   j = bj;
+   for(k=0; k<npath; k++)
+   {
+      /* Gaps between the previous cell and this one                    */
+      if(k)
+      {
+         for(i++; i<path[2*k]; i++)
+         {
+            align1[ai]   = seq1[i];
+            align2[ai++] = 0;
+         }
+         for(j++; j<path[2*k+1]; j++)
+         {
+            align1[ai]   = 0;
+            align2[ai++] = seq2[j];
+         }
+      }
+      align1[ai]   = seq1[i];
+      align2[ai++] = seq2[j];
+   }
+   for(i++; i<length1; i++)
+   {
+      align1[ai]   = seq1[i];
+      align2[ai++] = 0;
+   }
+   for(j++; j<length2; j++)
+   {
+      align1[ai]   = 0;
+      align2[ai++] = seq2[j];
+   }
+   *align_len = ai;
+
+   free(path);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void FollowPath(PATHROWS *rows, TOPCODE *seq1, TOPCODE *seq2, 
+                   int si, int sj, int ei, int ej, BOOL fixed, 
+                   int *path, int *npath)
+   ----------------------------------------------------------------
+   Input:   PATHROWS  *rows     Space for the rows of the matrix
+            TOPCODE   *seq1     First topology string
+            TOPCODE   *seq2     Second topology string
+            int       si        Cell of the path to start from
+            int       sj
+            int       ei        Cell the path must reach if fixed, or
+            int       ej        the last row and column
+            BOOL      fixed     Does the path end at (ei,ej)?
+   I/O:     int       *path     Cells of the path as (i,j) pairs
+            int       *npath    Number of cells in path
+
+   Adds the cells of the path from (si,sj) to path, up to but not
+   including (ei,ej) if fixed, or to the end of the path otherwise.
+
+   The rows are split at the middle and the part of the matrix below 
+   and right of (si,sj) is filled up to (si,sj) by FillPathRow(), which
+   carries with each cell above the middle the last cell of its path
+   above the middle and the first cell at or below it. The path is then
+   followed from (si,sj) to the first of these, and from the second to
+   the end, each of which has at most half the rows.
+
+   The cells of the matrix only depend on the cells below and right of
+   them, so the end of the path needs no more than that part of the
+   matrix. The part of the path leading to a fixed cell picks the same
+   cells when the matrix holds just the paths reaching that cell, as
+   any other path it could have picked scores no better.
+
+   17.10.26 Original   By: agent
+*/
+void FollowPath(PATHROWS *rows, TOPCODE *seq1, TOPCODE *seq2, 
+                int si, int sj, int ei, int ej, BOOL fixed, int *path,
+                int *npath)
+{
+   int mid,
+       i,
+       pi, pj, xi, xj;
+
+   if(fixed && (si == ei) && (sj == ej))
+      return;
+
+   /* A path at the edge ends there and one reaching a fixed cell from
+      the row or column before goes straight to it
+   */
+   if((!fixed && ((si == ei) || (sj == ej))) ||
+      (fixed && ((si+1 == ei) || (sj+1 == ej))))
+   {
+      path[2 * *npath]     = si;
+      path[2 * *npath + 1] = sj;
+      (*npath)++;
+      return;
+   }
+
+   mid = (si + ei + 1) / 2;
+   ResetPathRows(rows, ej-sj+1);
+   for(i=ei; i>=si; i--)
+   {
+      FillPathRow(rows, seq1, seq2, i, sj, ei, ej, fixed, mid);
+      AdvancePathRows(rows, i, ei, ej-sj+1);
+   }
+   pi = rows->rowlab[0];
+   pj = rows->rowlab[1];
+   xi = rows->rowlab[2];
+   xj = rows->rowlab[3];
+
+   FollowPath(rows, seq1, seq2, si, sj, pi, pj, TRUE, path, npath);
+   path[2 * *npath]     = pi;
+   path[2 * *npath + 1] = pj;
+   (*npath)++;
+   if((xi >= 0) && !(fixed && (xi == ei) && (xj == ej)))
+      FollowPath(rows, seq1, seq2, xi, xj, ei, ej, fixed, path, npath);
+}
+
+
+/************************************************************************/
+/*>void FillPathRow(PATHROWS *rows, TOPCODE *seq1, TOPCODE *seq2, int i, 
+                    int sj, int ei, int ej, BOOL fixed, int mid)
+   ----------------------------------------------------------------------
+   I/O:     PATHROWS  *rows     Rows i+1 and below. Row i is put in
+                                rows->out
+   Input:   TOPCODE   *seq1     First topology string
+            TOPCODE   *seq2     Second topology string
+            int       i         Row to fill
+            int       sj        First column of the part filled
+            int       ei        Last row and column of the part filled,
+            int       ej        or the cell the paths must reach
+            BOOL      fixed     Must the paths reach (ei,ej)?
+            int       mid       Middle row (-1 if not wanted)
+
+   Fills columns sj to ej of row i of the matrix just as 
+   blNumericAffineAlign() does, including its choice between routes 
+   that score the same: the diagonal, then a gap in seq2, then a gap in
+   seq1, and the nearest cell along a row or column. The column maxima
+   and the row maximum are the gap state. If fixed, just the paths 
+   reaching (ei,ej) are scored and other cells are NOPATH.
+
+   If i is above mid, each cell is given the last cell above mid and 
+   the first cell at or below mid of the path from it (-1 if the path 
+   ends above mid), from the cell it goes to.
+
+   17.10.26 Original (code taken from TraceRow())   By: agent
+*/
+void FillPathRow(PATHROWS *rows, TOPCODE *seq1, TOPCODE *seq2, int i, 
+                 int sj, int ei, int ej, BOOL fixed, int mid)
+{
+   signed char *srow;
+   int j, c,
+       dia, right, down,
+       rcell,
+       rowmax = 0,
+       rowcol = -1,
+       toi, toj,
+       *from,
+       *lab;
+
+   srow = gMDM[seq1[i]];
+   for(j=ej; j>=sj; j--)
+   {
+      c    = j - sj;
+      lab  = rows->outlab + 4*c;
+      from = NULL;
+      toi  = toj = (-1);
+
+      if((i == ei) || (j == ej))
+      {
+         rows->out[c] = ((!fixed || ((i == ei) && (j == ej))) ? 
+                         srow[seq2[j]] : NOPATH);
+      }
+      else
+      {
+         dia = rows->row[c+1];
+
+         rcell = i+2;
+         if(rcell > ei)
+         {
+            right = NOPATH;
+         }
+         else
+         {
+            right = rows->next[c+1];
+            if((rows->colrow[c+1] >= 0) && 
+               (rows->colmax[c+1] > right))
+            {
+               right = rows->colmax[c+1];
+               rcell = rows->colrow[c+1];
+            }
+            right -= GAPPEN;
+         }
+
+         if(j+2 > ej)
+         {
+            down = NOPATH;
+         }
+         else
+         {
+            if((rowcol < 0) || (rows->row[c+2] >= rowmax))
+            {
+               rowmax = rows->row[c+2];
+               rowcol = c+2;
+            }
+            down = rowmax - GAPPEN;
+         }
+
+         if((dia >= down) && (dia >= right))
+         {
+            toi  = i+1;
+            toj  = j+1;
+            from = rows->rowlab + 4*(c+1);
+         }
+         else if(right >= down)
+         {
+            dia  = right;
+            toi  = rcell;
+            toj  = j+1;
+            from = ((rcell == i+2) ? rows->nextlab : rows->collab) +
+                   4*(c+1);
+         }
+         else
+         {
+            dia  = down;
+            toi  = i+1;
+            toj  = sj + rowcol;
+            from = rows->rowlab + 4*rowcol;
+         }
+         rows->out[c] = ((dia > NOPATH/2) ? dia + srow[seq2[j]] : NOPATH);
+      }
+
+      /* Where the path from here crosses the middle row                */
+      if(i < mid)
+      {
+         if((toi < 0) || (toi >= mid))
+         {
+            lab[0] = i;
+            lab[1] = j;
+            lab[2] = toi;
+            lab[3] = toj;
+         }
+         else
+         {
+            memcpy(lab, from, 4*sizeof(int));
+         }
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>void AdvancePathRows(PATHROWS *rows, int i, int ei, int width)
+   --------------------------------------------------------------
+   I/O:     PATHROWS  *rows     Rows with row i in rows->out
+   Input:   int       i         Row just filled
+            int       ei        Last row of the part filled
+            int       width     Columns in the part filled
+
+   Moves the rows up after row i has been filled. Row i+2 goes into the
+   column maxima and a row of the same score nearer the top is 
+   preferred.
+
+   17.10.26 Original (code taken from AdvanceTraceState())   By: agent
+*/
+void AdvancePathRows(PATHROWS *rows, int i, int ei, int width)
+{
+   int *spare,
+       c;
+
+   if(i+2 <= ei)
+   {
+      for(c=0; c<width; c++)
+      {
+         if((rows->colrow[c] < 0) || (rows->next[c] >= rows->colmax[c]))
+         {
+            rows->colmax[c] = rows->next[c];
+            rows->colrow[c] = i+2;
+            memcpy(rows->collab + 4*c, rows->nextlab + 4*c, 
+                   4*sizeof(int));
+         }
+      }
+   }
+
+   spare      = rows->next;
+   rows->next = rows->row;
+   rows->row  = rows->out;
+   rows->out  = spare;
+
+   spare         = rows->nextlab;
+   rows->nextlab = rows->rowlab;
+   rows->rowlab  = rows->outlab;
+   rows->outlab  = spare;
+}
+
+
+/************************************************************************/
+/*>void ResetPathRows(PATHROWS *rows, int width)
+   ---------------------------------------------
+   I/O:     PATHROWS  *rows     Rows to reset
+   Input:   int       width     Columns in the part to be filled
+
+   Empties the column maxima before a part of the matrix is filled
+
+   17.10.26 Original   By: agent
+*/
+void ResetPathRows(PATHROWS *rows, int width)
+{
+   int c;
+
+   for(c=0; c<width; c++)
+      rows->colrow[c] = (-1);
+}
+
+
+/************************************************************************/
+/*>PATHROWS *NewPathRows(int length2)
+   ----------------------------------
+   Input:   int        length2    Length of seq2
+   Returns: PATHROWS   *          New rows (NULL if no memory)
+
+   Allocates the rows used to fill the matrix. The rows are held in one
+   block.
+
+   17.10.26 Original (code taken from NewTraceState())   By: agent
+*/
+PATHROWS *NewPathRows(int length2)
+{
+   PATHROWS *rows;
+   int      n = length2;
+
+   if((rows = (PATHROWS *)malloc(sizeof(PATHROWS)))==NULL)
+      return(NULL);
+   if((rows->block = (int *)malloc(21 * n * sizeof(int)))==NULL)
+   {
+      free(rows);
+      return(NULL);
+   }
+   rows->out     = rows->block;
+   rows->row     = rows->block + n;
+   rows->next    = rows->block + 2*n;
+   rows->colmax  = rows->block + 3*n;
+   rows->colrow  = rows->block + 4*n;
+   rows->outlab  = rows->block + 5*n;
+   rows->rowlab  = rows->block + 9*n;
+   rows->nextlab = rows->block + 13*n;
+   rows->collab  = rows->block + 17*n;
+
+   return(rows);
+}
+
+
+/************************************************************************/
+/*>void FreePathRows(PATHROWS *rows)
+   ---------------------------------
+   Input:   PATHROWS   *rows      Rows from NewPathRows() (or NULL)
+
+   17.10.26 Original (code taken from FreeTraceState())   By: agent
+*/
+void FreePathRows(PATHROWS *rows)
+{
+   if(rows != NULL)
+   {
+      free(rows->block);
+      free(rows);
+   }
+}
+
+
+/************************************************************************/
+/*>void TurnAboutX(TOPCODE *top, int length)
+   --------------------------------------------
+   I/O:     TOPCODE  *top    Topology string to rotate
+   Input:   int      length  Length of top
+
+   Modifies the topology string by rotating about X
+
+   13.01.98 Original   By: ACRM
+   17.11.99 Added characters M-X for adjacent secondary structures
+            Modified so array is indexed by the alphabet so it no
+            longer needs to use chindex() which is painfully slow
+   23.11.99 Added lower case letters
+   10.03.00 Changed to use integer coded topology array
+   17.10.26 Takes a TOPCODE string and its length   By: agent
+*/
+void TurnAboutX(TOPCODE *top, int length)
+{
+   static int new[] = {0,5,2,6,4,3,1};
+   int i;
+   
+   for(i=0; i<length; i++)
+      top[i] = (TOPCODE)((6*(int)((top[i] - 1)/6)) + 
+                         new[1+((top[i] - 1)%6)]);
+}
+
+
+/************************************************************************/
+/*>void TurnAboutY(TOPCODE *top, int length)
+   --------------------------------------------
+   I/O:     TOPCODE  *top    Topology string to rotate
+   Input:   int      length  Length of top
+
+   Modifies the topology string by rotating about Y
+
+   13.01.98 Original   By: ACRM
+   17.11.99 Added characters M-X for adjacent secondary structures
+            Modified so array is indexed by the alphabet so it no
+            longer needs to use chindex() which is painfully slow
+   23.11.99 Added lower case letters
+   10.03.00 Changed to use integer coded topology array
+   17.10.26 Takes a TOPCODE string and its length   By: agent
+*/
+void TurnAboutY(TOPCODE *top, int length)
+{
+   static int new[] = {0,1,5,3,6,4,2};
+   int i;
+   
+   for(i=0; i<length; i++)
+      top[i] = (TOPCODE)((6*(int)((top[i] - 1)/6)) + 
+                         new[1+((top[i] - 1)%6)]);
+}
+
+
+/************************************************************************/
+/*>void TurnAboutZ(TOPCODE *top, int length)
+   --------------------------------------------
+   I/O:     TOPCODE  *top    Topology string to rotate
+   Input:   int      length  Length of top
+
+   Modifies the topology string by rotating about Z
+
+   13.01.98 Original   By: ACRM
+   17.11.99 Added characters M-X for adjacent secondary structures
+            Modified so array is indexed by the alphabet so it no
+            longer needs to use chindex() which is painfully slow
+   23.11.99 Added lower case letters
+   10.03.00 Changed to use integer coded topology array
+   17.10.26 Takes a TOPCODE string and its length   By: agent
+*/
+void TurnAboutZ(TOPCODE *top, int length)
+{
+   static int new[] = {0,2,3,4,1,5,6};
+   int i;
+   
+   for(i=0; i<length; i++)
+      top[i] = (TOPCODE)((6*(int)((top[i] - 1)/6)) + 
+                         new[1+((top[i] - 1)%6)]);
+}
+
+
+/************************************************************************/
+/*>BOOL ReadMatrix(char *matfile)
+   ------------------------------
+   Input:   char   *matfile     Matrix file (empty for the built-in 
+                                matrix)
+   Returns: BOOL                Success?
+   Globals: signed char gMDM    Scoring matrix indexed by code
+            TOPCODE gRotation   Codes in each orientation
+            signed char gRotMDM Scoring matrix for each orientation
+            int    gMDMMax      Highest score in the matrix
+            int    gMDMMin      Lowest score in the matrix
+            BOOL   gBuiltInMDM  Is it the built-in matrix?
+
+   Reads the numeric scoring matrix with blNumericReadMDM() and copies
+   it into gMDM[][] where it can be indexed directly. Codes which are
+   not in the matrix (including 0 which is used for an element that
+   could not be assigned) score zero. Then builds the rotation tables.
+   The scores are held as signed char so must be from -128 to 127.
+
+   Without a matrix file, the scores are taken from DefaultScore() 
+   instead, so nothing need be read.
+
+   17.10.26 Original   By: agent
+   17.10.26 Records the range of scores for the SIMD code   By: agent
+   17.10.26 Rejects scores that do not fit in a signed char   By: agent
+   17.10.26 Uses the built-in matrix if matfile is empty   By: agent
+   17.10.26 Sets gBuiltInMDM   By: agent
+*/
+BOOL ReadMatrix(char *matfile)
+{
+   int  size    = NCODES,
+        i, j, score;
+   BOOL builtIn = (matfile[0] == '\0');
+   
+   if(!builtIn)
+   {
+      if(!blNumericReadMDM(matfile))
+         return(FALSE);
+   
+      if((size = FindMatrixSize(matfile)) > NCODES)
+         size = NCODES;
+   }
+
+   for(i=0; i<=NCODES; i++)
+   {
+      for(j=0; j<=NCODES; j++)
+      {
+         if((i==0) || (j==0) || (i > size) || (j > size))
+            score = 0;
+         else if(builtIn)
+            score = DefaultScore(i, j);
+         else
+            score = blNumericCalcMDMScore(i, j);
+
+         if((score < SCHAR_MIN) || (score > SCHAR_MAX))
+         {
+            fprintf(stderr,"Matrix score %d is outside the range %d to \
+%d\n", score, SCHAR_MIN, SCHAR_MAX);
+            return(FALSE);
+         }
+         gMDM[i][j] = (signed char)score;
+
+         if(score > gMDMMax)
+            gMDMMax = score;
+         if(score < gMDMMin)
+            gMDMMin = score;
+      }
+   }
+
+   gBuiltInMDM = builtIn;
+   BuildRotationTables();
+   
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>int DefaultScore(int code1, int code2)
+   --------------------------------------
+   Input:   int    code1        A topology code from CalcElement() 
+                                (1..NCODES)
+            int    code2        Another
+   Returns: int                 Score of the pair in the built-in matrix
+
+   Works out a score of the built-in scoring matrix from the rules in 
+   the comments of topmat.mat and numtopmat.mat rather than reading 
+   them from numtopmat.mat. The score depends on whether the elements 
+   are the same secondary structure and whether their directions are 
+   the same, at 90 degrees or at 180 degrees, and is cut for each of
+   the adjacency, accessibility, element length and loop length that
+   differ. The scores are those of numtopmat.mat, where the scores in
+   the comments have been scaled by .75 and then by about .75 again for
+   each difference.
+
+   17.10.26 Original   By: agent
+*/
+int DefaultScore(int code1, int code2)
+{
+   static int opposite[] = {2,3,0,1,5,4};  /* Up, Right, Down, Left, */
+                                           /* Back, Forward          */
+   /* Columns are the differences: 1 adjacency, 2 accessibility, 4 
+      element length and 8 loop length
+   */
+   static signed char scores[6][16] = 
+   {  /* Same secondary structure: same direction, 90, 180 degrees   */
+      { 7, 6, 6, 4, 6, 4, 4, 3, 5, 4, 4, 3, 4, 3, 3, 2},
+      { 6, 4, 4, 3, 4, 3, 3, 2, 4, 3, 3, 2, 3, 2, 2, 1},
+      { 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+      /* Different secondary structure                               */
+      { 2, 1, 1, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0},
+      { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+      { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+   };
+   int element1 = (code1 - 1) % 12,     /* Structure and direction    */
+       element2 = (code2 - 1) % 12,
+       dirn1    = element1 % 6,
+       dirn2    = element2 % 6,
+       rule;
+
+   if(dirn1 == dirn2)
+      rule = 0;
+   else if(opposite[dirn1] == dirn2)
+      rule = 2;
+   else
+      rule = 1;
+   
+   if((element1 / 6) != (element2 / 6))
+      rule += 3;
+
+   return(scores[rule][((code1 - 1) / 12) ^ ((code2 - 1) / 12)]);
+}
+
+
+/************************************************************************/
+/*>unsigned int MatrixChecksum(void)
+   ---------------------------------
+   Returns: unsigned int        Checksum of the scoring matrix
+   Globals: signed char gMDM    Scoring matrix indexed by code
+
+   An FNV-1a hash of the matrix read by ReadMatrix(), used to tell 
+   whether the self-scores in a compiled library were worked out with
+   the same matrix
+
+   17.10.26 Original   By: agent
+*/
+unsigned int MatrixChecksum(void)
+{
+   unsigned long hash = 2166136261UL;
+   int           i, j;
+
+   for(i=0; i<=NCODES; i++)
+   {
+      for(j=0; j<=NCODES; j++)
+      {
+         hash ^= (unsigned char)gMDM[i][j];
+         hash  = (hash * 16777619UL) & 0xFFFFFFFFUL;
+      }
+   }
+
+   return((unsigned int)hash);
+}
+
+
+/************************************************************************/
+/*>BOOL SymmetricScores(BOOL PrimaryTopology)
+   ------------------------------------------
+   Input:   BOOL   PrimaryTopology  Primary topology only
+   Returns: BOOL                    Does aligning A against B always
+                                    score the same as B against A?
+   Globals: signed char gMDM        Scoring matrix indexed by code
+            TOPCODE gRotation       Codes in each orientation
+
+   The alignment itself treats the two strings alike, so the scores are
+   the same both ways round if the matrix is symmetric. When the 
+   orientations are tried, turning A one way against B is the same as 
+   turning B the other way against A, so the matrix must also be 
+   unchanged when both codes are turned the same way.
+
+   17.10.26 Original   By: agent
+   17.10.26 Uses RotationInvariant()   By: agent
+*/
+BOOL SymmetricScores(BOOL PrimaryTopology)
+{
+   int i, j;
+
+   for(i=0; i<=NCODES; i++)
+   {
+      for(j=0; j<i; j++)
+      {
+         if(gMDM[i][j] != gMDM[j][i])
+            return(FALSE);
+      }
+   }
+
+   return(PrimaryTopology || RotationInvariant());
+}
+
+
+/************************************************************************/
+/*>BOOL RotationInvariant(void)
+   ----------------------------
+   Returns: BOOL                Is the matrix unchanged when both codes
+                                are turned the same way?
+   Globals: signed char gMDM    Scoring matrix indexed by code
+            TOPCODE gRotation   Codes in each orientation
+
+   If so, turning both strings the same way does not change the score
+   of any alignment, so the best score over the orientations of the 
+   probe is the same against a string in any of its orientations
+
+   17.10.26 Original (code taken from SymmetricScores())   By: agent
+*/
+BOOL RotationInvariant(void)
+{
+   int i, j, rot;
+
+   for(rot=1; rot<NROTATIONS; rot++)
+   {
+      for(i=0; i<=NCODES; i++)
+      {
+         for(j=0; j<=NCODES; j++)
+         {
+            if(gMDM[gRotation[rot][i]][gRotation[rot][j]] != gMDM[i][j])
+               return(FALSE);
+         }
+      }
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>int FindMatrixSize(char *matfile)
+   ---------------------------------
+   Input:   char   *matfile     Matrix file
+   Returns: int                 Number of columns in the matrix
+
+   Finds the size of a numeric matrix file by counting the values on the
+   first line which is not blank or a ! comment
+
+   17.10.26 Original   By: agent
+*/
+int FindMatrixSize(char *matfile)
+{
+   FILE *fp;
+   char buffer[HUGEBUFF*2],
+        *chp;
+   int  size = 0;
+   
+   if((fp=fopen(matfile,"r"))==NULL)
+      return(0);
+   
+   while(fgets(buffer,HUGEBUFF*2,fp))
+   {
+      TERMINATE(buffer);
+      if(buffer[0] == '!')
+         continue;
+      
+      for(chp=buffer; *chp; )
+      {
+         while(*chp == ' ' || *chp == '\t')
+            chp++;
+         if(*chp)
+         {
+            size++;
+            while(*chp && *chp != ' ' && *chp != '\t')
+               chp++;
+         }
+      }
+      if(size)
+         break;
+   }
+   fclose(fp);
+   
+   return(size);
+}
+
+
+/************************************************************************/
+/*>void BuildRotationTables(void)
+   ------------------------------
+   Globals: signed char gMDM    Scoring matrix indexed by code
+            TOPCODE gRotation   Codes in each orientation
+            signed char gRotMDM Scoring matrix for each orientation
+
+   Each of the 24 orientations of a topology string is just a fixed
+   permutation of the codes, so we build these once by applying 
+   TurnAboutX(), TurnAboutY() and TurnAboutZ() to an array of all the
+   codes. The orientations are visited in the order originally used by
+   RunAlignment() (with the repeat of the native orientation dropped) 
+   so that the first best-scoring orientation found is unchanged. 
+   Orientation 0 is the native orientation.
+
+   gRotMDM[rot][a][b] is then the score for code a in orientation rot
+   against code b.
+
+   17.10.26 Original   By: agent
+   17.10.26 Works on TOPCODE codes   By: agent
+*/
+void BuildRotationTables(void)
+{
+   TOPCODE work[NCODES+1];
+   int     nrot = 0,
+           i, j, rot, code;
+
+   for(code=0; code<=NCODES; code++)
+      work[code] = (TOPCODE)code;
+
+   /* Native orientation                                                */
+   memcpy(gRotation[nrot++], work, (NCODES+1)*sizeof(TOPCODE));
+
+   /* The other orientations in the order they were originally visited.
+      Those we have already seen are skipped
+   */
+   for(i=0; i<6; i++)
+   {
+      if(i<4)
+         TurnAboutX(work, NCODES+1);
+      else
+         TurnAboutY(work, NCODES+1);
+      
+      for(j=0; j<4; j++)
+      {
+         TurnAboutZ(work, NCODES+1);
+         for(rot=0; rot<nrot; rot++)
+         {
+            if(!memcmp(gRotation[rot], work, (NCODES+1)*sizeof(TOPCODE)))
+               break;
+         }
+         if((rot == nrot) && (nrot < NROTATIONS))
+            memcpy(gRotation[nrot++], work, (NCODES+1)*sizeof(TOPCODE));
+      }
+      
+      if(i==4)
+         TurnAboutY(work, NCODES+1);
+   }
+
+   /* Build the scoring matrix for each orientation                     */
+   for(rot=0; rot<NROTATIONS; rot++)
+   {
+      for(i=0; i<=NCODES; i++)
+      {
+         for(j=0; j<=NCODES; j++)
+            gRotMDM[rot][i][j] = gMDM[gRotation[rot][i]][j];
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>BOOL ParseCmdLine(int argc, char **argv, char *infile1, char *infile2, 
+                     char *matfile, int *ELen, int *HLen, 
+                     BOOL *CalcSecStr, BOOL *BuildOnly, BOOL *ScanMode,
+                     BOOL *UseBoth, int *SecStrCalculator, BOOL *Do3_10,
+                     BOOL *PrimaryTopology, BOOL *DoNeighbour,
+                     BOOL *DoAccess,  BOOL *GivenTopString,
+                     BOOL *DoLength, BOOL *DoLoopLength, int *NThreads,
+                     char *kernel, int *Band, BOOL *Compile,
+                     int *MaxHits, REAL *MinScore, BOOL *BatchMode,
+                     BOOL *AllVsAll, int *SeedLength, int *SeedHits,
+                     BOOL *Recall, int *LSHLength, int *LSHBands,
+                     int *LSHRows, int *LSHMargin, REAL *ClusterScore,
+                     REAL *Margin, BOOL *Serve, char ***LibFiles,
+                     int *NLibFiles, BOOL *Stream)
+   -----------------------------------------------------------------------
+   Input:   int    argc         Argument count
+            char   **argv       Argument array
+   Output:  char   *infile1     DSSP Input file 1
+            char   *infile2     DSSP Input file 2
+            char   *matfile     Matrix file (empty for the built-in
+                                matrix)
+            int    *ELen        Minimum strand length
+            int    *HLen        Minimum helix length
+            BOOL   *CalcSecStr  Calculate secondary structure on input
+                                files?
+            BOOL   *BuildOnly   Just create the topology string for the
+                                structure?
+            BOOL   *ScanMode    Run in scan mode?
+            BOOL   *UseBoth     Calculate the percentages wrt max score
+                                from either struc rather than just the 
+                                first
+            BOOL   *SecStrCalculator  Use Stride, DSSP or pdbsecstr
+            BOOL   *Do3_10      Merge 3_10 helix with alpha helix
+            BOOL   *PrimaryTopology Do only primary topology
+            BOOL   *DoNeighbour Add neighbour information
+            BOOL   *DoAccess    Add accessibility information
+            BOOL   *GivenTopString  Given the topology string on the 
+                                command line instead of a file
+            BOOL   *DoLength    Add length information
+            BOOL   *DoLoopLength  Add loop length information
+            int    *NThreads    Number of threads for scan mode
+            char   *kernel      Alignment kernel to use (blank for auto)
+            int    *Band        Band width, NOBAND or AUTOBAND
+            BOOL   *Compile     Compile the library in infile1 to 
+                                infile2?
+            int    *MaxHits     Most hits to print in scan mode (0 for
+                                all)
+            REAL   *MinScore    Lowest score to print in scan mode (or
+                                NOMINSCORE)
+            BOOL   *BatchMode   Scan a list of queries in infile1?
+            BOOL   *AllVsAll    Write the all-vs-all matrix of the 
+                                library in infile1 to infile2 (-o)?
+            int    *SeedLength  Length of the seeds for a scan (0 to
+                                align every entry)
+            int    *SeedHits    Seeds needed on a diagonal
+            BOOL   *Recall      Report the recall of the seeds, of
+                                --lsh or of --hierarchical?
+            int    *LSHLength   Length of the k-mers for --lsh (0 to
+                                align every pair)
+            int    *LSHBands    Bands of the LSH sketches
+            int    *LSHRows     Rows in each band
+            int    *LSHMargin   Rows of a band that may differ
+            REAL   *ClusterScore Score to cluster a compiled library
+                                at (0 not to cluster it)
+            REAL   *Margin      Margin for a hierarchical scan (or 
+                                NOMARGIN)
+            BOOL   *Serve       Scan the queries sent to the socket 
+                                in infile1?
+            char   ***LibFiles  Libraries for --serve (in argv)
+            int    *NLibFiles   Number of libraries for --serve
+            BOOL   *Stream      Scan the queries read from stdin?
+   Returns: BOOL                Success?
+
+   Parse the command line
+   
+   13.01.98 Original    By: ACRM
+   26.10.99 Added -g / Do3_10
+   10.11.99 Added -1 / PrimaryTopology
+   16.11.99 Added DoNeighbour
+   23.11.99 Added DoAccess
+   19.01.00 Added -t (GivenTopString)
+   26.01.00 Added -l (DoLength)
+   16.03.00 Added -L (DoLoopLength)
+   15.01.20 Added pdbsecstr support as the default
+   17.10.26 Added -j (NThreads)   By: agent
+   17.10.26 Added --kernel=   By: agent
+   17.10.26 Added -B (Band)   By: agent
+   17.10.26 Added --compile   By: agent
+   17.10.26 Added -k (MaxHits) and --min-score   By: agent
+   17.10.26 Added -S (BatchMode)   By: agent
+   17.10.26 Added --all-vs-all and -o   By: agent
+   17.10.26 Added --seed, --seed-hits and --recall   By: agent
+   17.10.26 Added --lsh   By: agent
+   17.10.26 Added --cluster and --hierarchical   By: agent
+   17.10.26 Added --serve   By: agent
+   17.10.26 Added --stream   By: agent
+   17.10.26 The matrix defaults to the built-in one   By: agent
+   17.10.26 Added --stats   By: agent
+*/
+BOOL ParseCmdLine(int argc, char **argv, char *infile1, char *infile2, 
+                  char *matfile, int *ELen, int *HLen, BOOL *CalcSecStr,
+                  BOOL *BuildOnly, BOOL *ScanMode, BOOL *UseBoth,
+                  int *SecStrCalculator, BOOL *Do3_10,
+                  BOOL *PrimaryTopology, BOOL *DoNeighbour,
+                  BOOL *DoAccess, BOOL *GivenTopString, BOOL *DoLength, 
+                  BOOL *DoLoopLength, int *NThreads, char *kernel,
+                  int *Band, BOOL *Compile, int *MaxHits, 
+                  REAL *MinScore, BOOL *BatchMode, BOOL *AllVsAll,
+                  int *SeedLength, int *SeedHits, BOOL *Recall,
+                  int *LSHLength, int *LSHBands, int *LSHRows,
+                  int *LSHMargin, REAL *ClusterScore, REAL *Margin,
+                  BOOL *Serve, char ***LibFiles, int *NLibFiles,
+                  BOOL *Stream)
+{
+   argc--;
+   argv++;
+
+   infile1[0] = infile2[0] = kernel[0] = matfile[0] = '\0';
+
+   if(!argc)
+      return(FALSE);
+   
+   while(argc)
+   {
+      if(argv[0][0] == '-')
+      {
+         switch(argv[0][1])
+         {
+         case 'm':
+            argc--;
+            argv++;
+            if(argc>0)
+               strcpy(matfile,argv[0]);
+            break;
+         case 'h':
+            argc--;
+            argv++;
+            if(argc>0)
+               sscanf(argv[0],"%d",HLen);
+            break;
+         case 'e':
+            argc--;
+            argv++;
+            if(argc>0)
+               sscanf(argv[0],"%d",ELen);
+            break;
+         case 'v':
+            gVerbose = TRUE;
+            break;
+         case 'p':
+            *CalcSecStr = TRUE;
+            switch(argv[0][2])
+            {
+            case 's':
+               *SecStrCalculator = SECSTR_STRIDE;
+               break;
+            case 'p':
+               *SecStrCalculator = SECSTR_PDBSECSTR;
+               break;
+            case 'd':
+               *SecStrCalculator = SECSTR_DSSP;
+               break;
+            case '\0':
+               *SecStrCalculator = SECSTR_PDBSECSTR;
+               break;
+            default:
+               return(FALSE);
+            }
+            break;
+         case 'b':
+            *BuildOnly = TRUE;
+            break;
+         case 's':
+            *ScanMode = TRUE;
+            break;
+         case 'S':
+            *ScanMode  = TRUE;
+            *BatchMode = TRUE;
+            break;
+         case 'w':
+            *UseBoth = TRUE;
+            break;
+         case 'g':
+            *Do3_10 = TRUE;
+            break;
+         case '1':
+            *PrimaryTopology = TRUE;
+            break;
+         case 'n':
+            *DoNeighbour = TRUE;
+            break;
+         case 'a':
+            *DoAccess = TRUE;
+            break;
+         case 't':
+            *GivenTopString = TRUE;
+            break;
+         case 'l':
+            *DoLength = TRUE;
+            break;
+         case 'L':
+            *DoLoopLength = TRUE;
+            break;
+         case 'j':
+            argc--;
+            argv++;
+            if(argc>0)
+            {
+               if(!sscanf(argv[0],"%d",NThreads) ||
+                  (*NThreads < 1) || (*NThreads > MAXTHREADS))
+                  return(FALSE);
+            }
+            break;
+         case 'B':
+            argc--;
+            argv++;
+            if(argc>0)
+            {
+               if(!strcmp(argv[0], "auto"))
+                  *Band = AUTOBAND;
+               else if(!sscanf(argv[0],"%d",Band) || (*Band < 0))
+                  return(FALSE);
+            }
+            break;
+         case 'o':
+            argc--;
+            argv++;
+            if(argc>0)
+               strcpy(infile2,argv[0]);
+            break;
+         case 'k':
+            argc--;
+            argv++;
+            if(argc>0)
+            {
+               if(!sscanf(argv[0],"%d",MaxHits) || (*MaxHits < 1))
+                  return(FALSE);
+            }
+            break;
+         case '-':
+            if(!strncmp(argv[0], "--kernel=", 9) && 
+               (strlen(argv[0]+9) < MAXBUFF))
+               strcpy(kernel, argv[0]+9);
+            else if(!strcmp(argv[0], "--compile"))
+               *Compile = TRUE;
+            else if(!strcmp(argv[0], "--all-vs-all"))
+               *AllVsAll = TRUE;
+            else if(!strcmp(argv[0], "--min-score"))
+            {
+               argc--;
+               argv++;
+               if((argc>0) && !sscanf(argv[0],"%lf",MinScore))
+                  return(FALSE);
+            }
+            else if(!strcmp(argv[0], "--seed"))
+            {
+               argc--;
+               argv++;
+               if((argc>0) && 
+                  (!sscanf(argv[0],"%d",SeedLength) || (*SeedLength < 1)))
+                  return(FALSE);
+            }
+            else if(!strcmp(argv[0], "--seed-hits"))
+            {
+               argc--;
+               argv++;
+               if((argc>0) && 
+                  (!sscanf(argv[0],"%d",SeedHits) || (*SeedHits < 1)))
+                  return(FALSE);
+            }
+            else if(!strcmp(argv[0], "--recall"))
+               *Recall = TRUE;
+            else if(!strcmp(argv[0], "--stats"))
+               gStats = TRUE;
+            else if(!strcmp(argv[0], "--lsh"))
+            {
+               argc--;
+               argv++;
+               if((argc>0) && 
+                  ((sscanf(argv[0],"%d,%d,%d,%d",LSHLength,LSHBands,
+                           LSHRows,LSHMargin) < 1) ||
+                   (*LSHLength < 1) || (*LSHBands < 1) || 
+                   (*LSHRows < 1) || (*LSHRows > LSHMAXROWS) ||
+                   (*LSHMargin < 0) || (*LSHMargin >= *LSHRows)))
+                  return(FALSE);
+            }
+            else if(!strcmp(argv[0], "--cluster"))
+            {
+               argc--;
+               argv++;
+               if((argc>0) && 
+                  (!sscanf(argv[0],"%lf",ClusterScore) || 
+                   (*ClusterScore <= 0.0)))
+                  return(FALSE);
+            }
+            else if(!strcmp(argv[0], "--hierarchical"))
+            {
+               argc--;
+               argv++;
+               if((argc>0) && 
+                  (!sscanf(argv[0],"%lf",Margin) || (*Margin < 0.0)))
+                  return(FALSE);
+            }
+            else if(!strcmp(argv[0], "--serve"))
+            {
+               argc--;
+               argv++;
+               if((argc<1) || (strlen(argv[0]) >= MAXBUFF))
+                  return(FALSE);
+               strcpy(infile1, argv[0]);
+               *Serve    = TRUE;
+               *ScanMode = TRUE;
+            }
+            else if(!strcmp(argv[0], "--stream"))
+            {
+               *Stream         = TRUE;
+               *ScanMode       = TRUE;
+               *GivenTopString = TRUE;
+            }
+            else
+               return(FALSE);
+            break;
+         default:
+            return(FALSE);
+            break;
+         }
+      }
+      else
+      {
+         /* --all-vs-all has the library and the output file, which may
+            be given with -o after the library
+         */
+         if(*AllVsAll)
+         {
+            if(*BuildOnly || *ScanMode || *Compile || *GivenTopString ||
+               *CalcSecStr || *MaxHits || *SeedLength || 
+               (*ClusterScore > 0.0) || (*Margin >= 0.0))
+               return(FALSE);
+
+            /* The recall of --lsh is measured on the cells scoring at 
+               least --min-score
+            */
+            if((*Recall || (*MinScore > NOMINSCORE)) &&
+               (!(*LSHLength) || !(*Recall) || (*MinScore <= NOMINSCORE)))
+               return(FALSE);
+            if((argc == 3) && !strcmp(argv[1], "-o"))
+               strcpy(infile2, argv[2]);
+            else if(argc != 1)
+               return(FALSE);
+            if(infile2[0] == '\0')
+               return(FALSE);
+            strcpy(infile1, argv[0]);
+            return(TRUE);
+         }
+
+         /* --serve has the socket and then one or more libraries, which
+            are taken from argv
+         */
+         if(*Serve)
+         {
+            if(*BuildOnly || *BatchMode || *Compile || *Recall ||
+               (*ClusterScore > 0.0) || *LSHLength)
+               return(FALSE);
+            if((*Margin >= 0.0) && 
+               (*SeedLength || !(*MaxHits || (*MinScore > NOMINSCORE))))
+               return(FALSE);
+            if(*DoAccess && (*SecStrCalculator == SECSTR_PDBSECSTR))
+            {
+               fprintf(stderr, "\n\nError! Access calculations are not \
+supported with pdbsecstr\n\n");
+               return(FALSE);
+            }
+            *LibFiles  = argv;
+            *NLibFiles = argc;
+            return(TRUE);
+         }
+
+         /* --stream just has the library. The queries are topology 
+            strings read from stdin
+         */
+         if(*Stream)
+         {
+            if(*BuildOnly || *BatchMode || *Serve || *Compile || 
+               *Recall || *CalcSecStr || (*ClusterScore > 0.0) || 
+               *LSHLength || (argc != 1))
+               return(FALSE);
+            if((*Margin >= 0.0) && 
+               (*SeedLength || !(*MaxHits || (*MinScore > NOMINSCORE))))
+               return(FALSE);
+            strcpy(infile2, argv[0]);
+            return(TRUE);
+         }
+
+         /* Check that there are 2 arguments left                       */
+         if(*BuildOnly && *BatchMode)
+            return(FALSE);
+
+         /* Seeds and clusters are only used by a scan, and the clusters
+            searched and the recall depend on the best hits. The 
+            clusters are made when a library is compiled
+         */
+         if((*SeedLength && !(*ScanMode)) || *LSHLength)
+            return(FALSE);
+         if((*Margin >= 0.0) && 
+            (!(*ScanMode) || *SeedLength || 
+             !(*MaxHits || (*MinScore > NOMINSCORE))))
+            return(FALSE);
+         if(*Recall && 
+            (!(*SeedLength || (*Margin >= 0.0)) || 
+             !(*MaxHits || (*MinScore > NOMINSCORE))))
+            return(FALSE);
+         if((*ClusterScore > 0.0) && !(*Compile))
+            return(FALSE);
+         if(*BuildOnly && argc != 1)
+            return(FALSE);
+         if(!(*BuildOnly) && argc != 2)
+            return(FALSE);
+         
+         /* Copy the first to infile                                    */
+         strcpy(infile1, argv[0]);
+         if(!(*BuildOnly))
+            strcpy(infile2, argv[1]);
+            
+         if(*DoAccess && (*SecStrCalculator == SECSTR_PDBSECSTR))
+         {
+            fprintf(stderr, "\n\nError! Access calculations are not \
+supported with pdbsecstr\n\n");
+            return(FALSE);
+         }
+         
+         return(TRUE);
+      }
+      argc--;
+      argv++;
+   }
+
+   /* --serve needs a library                                           */
+   if(*Serve)
+      return(FALSE);
+   
+   if(*DoAccess && (*SecStrCalculator == SECSTR_PDBSECSTR))
+   {
+      fprintf(stderr, "\n\nError! Access calculations are not supported \
+with pdbsecstr\n\n");
+      return(FALSE);
+   }
+   
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void Usage(void)
+   ----------------
+   Prints a usage message
+
+   13.01.98 Original   By: ACRM
+   15.01.98 V1.1
+   13.03.98 V1.2
+   26.10.99 V1.3
+   10.11.99 V1.4
+   16.11.99 V1.5
+   19.11.99 V1.7
+   13.03.00 V2.0
+   17.03.00 V2.1
+   15.01.20 V3.0 Added pdbsecstr support as the default
+   17.10.26 V3.1 Added -j   By: agent
+   17.10.26 V3.4   By: agent
+   17.10.26 V3.7 Added --kernel   By: agent
+   17.10.26 V3.9 Added -B   By: agent
+   17.10.26 V3.12 Added --compile   By: agent
+   17.10.26 V3.14 Added -k and --min-score   By: agent
+   17.10.26 V3.17 Added -S   By: agent
+   17.10.26 V3.18 Added --all-vs-all   By: agent
+   17.10.26 V3.20 Added --seed, --seed-hits and --recall   By: agent
+   17.10.26 V3.21 Added --lsh   By: agent
+   17.10.26 V3.22 Added --cluster and --hierarchical   By: agent
+   17.10.26 V3.23 Added --serve   By: agent
+   17.10.26 V3.24 Added --stream   By: agent
+   17.10.26 V3.25   By: agent
+*/
+void Usage(void)
+{
+   fprintf(stderr,"\ntopscan V3.25 (c) 1998-2026, Prof. Andrew C.R. \
+Martin, UCL & Reading\n");
+
+   fprintf(stderr,"\nUsage: topscan [-t] [-v] [-1] [-n] [-a] [-l] [-L] \
+[-p[s|d|p]] [-w] [-h hlen]\n"); 
+   fprintf(stderr,"               [-e elen] [-m matrix] [-g] \
+[-B width|auto] [--kernel=name]\n");
+   fprintf(stderr,"               file1.{dssp|pdb} file2.{dssp|pdb}\n");
+   fprintf(stderr,"       topscan -b [-1] [-n] [-a] [-l] [-L] \
+[-p[s|d|p]] [-h hlen] [-e elen] [-g]\n");
+   fprintf(stderr,"               file1.{dssp|pdb}\n");
+   fprintf(stderr,"       topscan -s [-t] [-1] [-n] [-a] [-l] [-L] [-v] \
+[-p[s|d|p]] [-w] [-h hlen]\n");
+   fprintf(stderr,"               [-e elen] [-m matrix] [-g] [-j nthreads] \
+[-B width|auto]\n");
+   fprintf(stderr,"               [-k nhits] [--min-score score] \
+[--kernel=name] [--stats]\n");
+   fprintf(stderr,"               [--seed k [--seed-hits n] \
+| --hierarchical margin] [--recall]\n");
+   fprintf(stderr,"               file1.{dssp|pdb} file2.{top|topb}\n");
+   fprintf(stderr,"       topscan -S [options as for -s] queries.list \
+file2.{top|topb}\n");
+   fprintf(stderr,"       topscan --serve socket [options as for -s] \
+file.{top|topb} ...\n");
+   fprintf(stderr,"       topscan --stream [options as for -s] \
+file.{top|topb} <queries.top\n");
+   fprintf(stderr,"       topscan --compile [-1] [-n] [-a] [-l] [-L] \
+[-h hlen] [-e elen] [-g]\n");
+   fprintf(stderr,"               [-m matrix] [-j nthreads] \
+[--cluster score] [--stats]\n");
+   fprintf(stderr,"               file.top file.topb\n");
+   fprintf(stderr,"       topscan --all-vs-all [-1] [-w] [-m matrix] \
+[-j nthreads] [-B width|auto]\n");
+   fprintf(stderr,"               [--kernel=name] [--stats] \
+[--lsh k[,bands[,rows[,margin]]]\n");
+   fprintf(stderr,"               [--recall --min-score score]] \
+file.{top|topb} -o matrix.bin\n");
+   fprintf(stderr,"\n       -b Build the topology string for a file\n");
+   fprintf(stderr,"          (Don't actually run a comparison)\n");
+   fprintf(stderr,"       -s Scan a DSSP or PDB file against a library \
+of topology strings\n");
+   fprintf(stderr,"          stored in the second file\n");
+   fprintf(stderr,"       -S Scan each DSSP or PDB file (or topology \
+string with -t) listed\n");
+   fprintf(stderr,"          in the first file against the library, \
+which is read just once.\n");
+   fprintf(stderr,"          The results for each query follow a line \
+'# query'\n");
+   fprintf(stderr,"       --serve Keep the libraries in memory and scan \
+the queries sent to the\n");
+   fprintf(stderr,"          Unix domain socket. Each line sent is a \
+query as in a -S list,\n");
+   fprintf(stderr,"          optionally followed by the library to scan \
+(its file name or\n");
+   fprintf(stderr,"          number) [Default: the first]. The results \
+for each query follow\n");
+   fprintf(stderr,"          a line '# query' and end with a line '//'. \
+Queries arriving\n");
+   fprintf(stderr,"          together are scanned together. Runs until \
+killed\n");
+   fprintf(stderr,"       --stream Scan each line 'name topstring' read \
+from stdin against the\n");
+   fprintf(stderr,"          library as soon as it is read. The results \
+follow a line '# name'\n");
+   fprintf(stderr,"          and end with a line '//', and are flushed \
+so topscan can be run\n");
+   fprintf(stderr,"          as a coprocess\n");
+   fprintf(stderr,"       -m Specify the matrix file [Default: built in, \
+the same as %s]\n", MATFILE);
    fprintf(stderr,"       -v Verbose mode\n");
    fprintf(stderr,"       -p Input files are PDB and the pdbsecstr \
 program will be run first\n");
@@ -942,829 +3249,6223 @@ supported with pdbsecstr!\n");
    fprintf(stderr,"       -L Add loop length information\n");
    fprintf(stderr,"       -t Command line has a topology string instead \
 of a filename\n");
+   fprintf(stderr,"       -j Number of threads to use in scan mode \
+[Default: 1]\n");
+   fprintf(stderr,"       -B Only align within width elements of the \
+diagonal, skipping library\n");
+   fprintf(stderr,"          entries whose length differs from the probe's \
+by more than that.\n");
+   fprintf(stderr,"          'auto' uses a quarter of the probe length \
+(at least %d). The DP\n", AUTOBAND_MIN);
+   fprintf(stderr,"          cells filled are reported. Alignments shown \
+with -v are not banded\n");
+   fprintf(stderr,"       -k Only print the nhits best scoring library \
+entries, best first\n");
+   fprintf(stderr,"       --min-score Only print library entries scoring \
+at least score, best\n");
+   fprintf(stderr,"          first\n");
+   fprintf(stderr,"       --seed Only align library entries with at \
+least n (--seed-hits,\n");
+   fprintf(stderr,"          default %d) exact matches of k codes to \
+the probe in some\n", SEEDHITS);
+   fprintf(stderr,"          orientation on one diagonal. Faster but may \
+miss hits. The\n");
+   fprintf(stderr,"          entries aligned are reported\n");
+   fprintf(stderr,"       --hierarchical With -k or --min-score and a \
+library compiled with\n");
+   fprintf(stderr,"          --cluster, first align the entries standing \
+for the clusters and\n");
+   fprintf(stderr,"          then just the clusters whose entry scores \
+within margin of the\n");
+   fprintf(stderr,"          worst of the best hits so far. Faster but \
+may miss hits. The\n");
+   fprintf(stderr,"          alignments avoided are reported\n");
+   fprintf(stderr,"       --recall With --seed or --hierarchical and -k \
+or --min-score, scan\n");
+   fprintf(stderr,"          again aligning every entry and report how \
+many of its hits were\n");
+   fprintf(stderr,"          found\n");
+   fprintf(stderr,"       --stats Report how many of the library entries \
+are distinct, in any\n");
+   fprintf(stderr,"          orientation that is tried. Each distinct \
+string is aligned once\n");
+   fprintf(stderr,"       --kernel=name Alignment kernel to use: auto, \
+avx512bw, avx2, sse41\n");
+   fprintf(stderr,"          or scalar [Default: auto, the best this \
+CPU supports]\n");
+   fprintf(stderr,"       --compile Write the library in file.top in a \
+binary form which\n");
+   fprintf(stderr,"          -s maps straight into memory. Give the \
+options the library was\n");
+   fprintf(stderr,"          built with and -s will warn if the probe \
+is built differently.\n");
+   fprintf(stderr,"          The self-scores used by -w are stored for \
+the matrix given\n");
+   fprintf(stderr,"       --cluster With --compile, cluster the library \
+for --hierarchical.\n");
+   fprintf(stderr,"          Each cluster is stood for by its longest \
+entry and holds the\n");
+   fprintf(stderr,"          entries scoring at least score against it, \
+with the percentage\n");
+   fprintf(stderr,"          from both strings\n");
+   fprintf(stderr,"       --all-vs-all Score every library entry as a \
+probe against every\n");
+   fprintf(stderr,"          entry and write the percentages to \
+matrix.bin as a binary matrix\n");
+   fprintf(stderr,"          with a row for each entry in library order \
+(see TOPMHEADER in\n");
+   fprintf(stderr,"          topscan.c). Each cell is an unsigned short \
+holding the percentage\n");
+   fprintf(stderr,"          times 100\n");
+   fprintf(stderr,"       --lsh With --all-vs-all, only align pairs \
+whose MinHash sketches of\n");
+   fprintf(stderr,"          the k-mers in any orientation agree on \
+all but margin rows of a\n");
+   fprintf(stderr,"          band [Default: %d bands of %d rows, \
+margin 0]. The other cells are\n", LSHBANDS, LSHROWS);
+   fprintf(stderr,"          0, so high-scoring pairs may be missed. \
+With --recall, every\n");
+   fprintf(stderr,"          pair is aligned again and the cells \
+scoring at least --min-score\n");
+   fprintf(stderr,"          that were filled are reported\n");
+
+   fprintf(stderr,"\nCondenses a protein structure into a topology \
+string by reading from\n");
+   fprintf(stderr,"a pdbsecstr, DSSP or STRIDE file. The string has a \
+12-letter alphabet for the 6\n");
+   fprintf(stderr,"orientations of sheet and helix. The comparison is \
+performed using 24\n");
+   fprintf(stderr,"orientations for one of the structures compared with \
+the other in a fixed\n");
+   fprintf(stderr,"position. Output is the best score obtained - the \
+alignment is also\n");
+   fprintf(stderr,"given if the verbose option is selected.\n");
+
+   fprintf(stderr,"\nOutput is the best score obtained. The score is \
+presented as a percentage\n");
+   fprintf(stderr,"of the score obtained by aligning the first structure \
+with itself; thus\n");
+   fprintf(stderr,"the first structure is treated as a probe being \
+tested against the \n");
+   fprintf(stderr,"second structure. If the -w option is given, the \
+maximum possible\n");
+   fprintf(stderr,"score is calculated from both topology strings. \
+If the verbose option\n");
+   fprintf(stderr,"is selected, the alignment is also given.\n");
+
+   fprintf(stderr,"\nIn scan mode (-s), the topology from the first \
+file is scanned against\n");
+   fprintf(stderr,"a library of topology strings stored in the second \
+file. Entries for \n");
+   fprintf(stderr,"the topology library file may be generated by using \
+the program in\n");
+   fprintf(stderr,"build mode (-b).\n\n");
+}
+
+
+/************************************************************************/
+/*>TOPCODE *ReadTopology(FILE *fp, int ELen, int HLen, 
+                         int SecStrCalculator, BOOL Do3_10, 
+                         BOOL PrimaryTopology, BOOL DoNeighbour, 
+                         BOOL DoAccess, BOOL DoLength, 
+                         BOOL DoLoopLength, int *length)
+   -----------------------------------------------------------------
+   Input:   FILE   *fp             DSSP file pointer
+            int    ELen            Minimum length of strand
+            int    HLen            Minimum length of helix
+            int    SecStrCalculator  Secondary Structure calculator to
+                                     use (pdbsecstr, Stride or DSSP)
+            BOOL   Do3_10          Merge 3_10 helix with alpha helix
+            BOOL   PrimaryTopology Only do primary topology
+            BOOL   DoNeighbour     Add neighbour information
+            BOOL   DoAccess        Add accessibility information
+            BOOL   DoLength        Add length information
+            BOOL   DoLoopLength    Add loop length information
+   Output:  int    *length         Length of the topology string
+   Returns: TOPCODE *              Topology string
+
+   Reads a the topology from a pdbsecstr, DSSP or Stride file, returning
+   a string representing the topology.
+
+   13.03.98 Original   By: ACRM
+   26.10.99 Added Do3_10
+   10.11.99 Added PrimaryTopology
+   16.11.99 Added DoNeighbour
+   23.11.99 Addes DoAccess
+   26.01.00 Added DoLength
+   10.03.00 Changed to use integer coded topology array
+   16.03.00 Added DoLoopLength
+   15.01.20 Added pdbsecstr support as the default
+   17.10.26 Returns a TOPCODE string and its length   By: agent
+*/
+TOPCODE *ReadTopology(FILE *fp, int ELen, int HLen, 
+                      int SecStrCalculator, BOOL Do3_10, 
+                      BOOL PrimaryTopology, BOOL DoNeighbour,
+                      BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength,
+                      int *length)
+{
+   /* If we are doing neighbours, then reset the internal neighbour
+      information
+   */
+   if(DoNeighbour)
+   {
+      CalcElement('\0', 0,0,0, 0,0,0, 0, 1, 0, 0.0, 0, 0);
+   }
+
+   switch(SecStrCalculator)
+   {
+   case SECSTR_DSSP:
+      return(ReadDSSP(fp, ELen, HLen, Do3_10, PrimaryTopology,
+                      DoNeighbour, DoAccess, DoLength, DoLoopLength,
+                      length));
+      break;
+   case SECSTR_STRIDE:
+   case SECSTR_PDBSECSTR:
+   default:
+      return(ReadStride(fp, ELen, HLen, Do3_10, PrimaryTopology,
+                        DoNeighbour, DoAccess, DoLength, DoLoopLength,
+                        length));
+      break;
+   }
+}
+
+
+/************************************************************************/
+/*>TOPCODE *ReadDSSP(FILE *fp, int ELen, int HLen, BOOL Do3_10,
+                     BOOL PrimaryTopology, BOOL DoNeighbour, 
+                     BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength,
+                     int *length)
+   --------------------------------------------------------------------
+   Input:   FILE     *fp             DSSP file pointer
+            int      ELen            Minimum length of strand
+            int      HLen            Minimum length of helix
+            BOOL     Do3_10          Merge 3_10 helix with alpha
+            BOOL     PrimaryTopology Only do primary topology
+            BOOL     DoNeighbour     Add neighbour information
+            BOOL     DoAccess        Add accessibility information
+            BOOL     DoLength        Add length information
+            BOOL     DoLoopLength    Add loop length information
+   Output:  int      *length         Length of the topology string
+   Returns: TOPCODE *                Topology string
+
+   Reads a DSSP file returning a string representing the topology.
+
+   13.01.98 Original   By: ACRM
+   26.10.99 Added Do3_10 handling
+   10.11.99 Added PrimaryTopology
+   16.11.99 Added DoNeighbour
+   23.11.99 Added DoAccess
+            Fixed bug - file ending with an SS element wasn't checking
+            element length
+   26.01.00 Added DoLength
+   10.03.00 Changed to use integer coded topology array
+   13.03.00 Initialise x1,y1,z1,xp,yp,zp only to silence warnings with -O2
+   16.03.00 Added loop length code
+   17.10.26 Returns a TOPCODE string and its length   By: agent
+*/
+TOPCODE *ReadDSSP(FILE *fp, int ELen, int HLen, BOOL Do3_10, 
+                  BOOL PrimaryTopology, BOOL DoNeighbour, BOOL DoAccess,
+                  BOOL DoLength, BOOL DoLoopLength, int *length)
+{
+   TOPCODE *top;
+   char buffer[MAXBUFF*2],
+        struc,
+        LastStruc    = ' ';
+   REAL x,  y,  z,
+        x1 = MARKER, 
+        y1 = MARKER, 
+        z1 = MARKER,
+        xp = MARKER, 
+        yp = MARKER, 
+        zp = MARKER,
+        access,
+        sumaccess    = 0.0;
+   BOOL InBody       = FALSE,
+        InElement    = FALSE,
+        DoneOne      = FALSE;
+   int  i            = 0,
+        EleLength    = 0,
+        LoopLength   = 0;
+
+#ifdef UCL
+   fprintf(stderr,"Code needs to be modified to support reading \
+accessibility from\nUCL DSSP files\n");
+#endif
+
+   
+   if((top = (TOPCODE *)malloc(MAXBUFF * sizeof(TOPCODE)))==NULL)
+      return(NULL);
+   
+   while(fgets(buffer,MAXBUFF*2,fp))
+   {
+      TERMINATE(buffer);
+      if(InBody)
+      {
+#ifdef UCL
+         fsscanf(buffer,"%16x%c%90x%7lf%7lf%7lf",&struc,&x,&y,&z);
+         access=0.0;
+#else
+         fsscanf(buffer,"%16x%c%17x%4lf%77x%7lf%7lf%7lf",
+                 &struc,&access,&x,&y,&z);
+#endif
+         if(Do3_10 && struc=='G')                  /* 26.10.99          */
+            struc = 'H';
+         if((struc=='E' || struc=='H') && (struc==LastStruc))
+         {
+            EleLength++;
+            sumaccess += access;
+         }
+
+         if(DoneOne && (struc!='E') && (struc!='H'))
+         {
+            LoopLength++;
+         }
+         
+         if((struc=='E' || struc=='H') && (struc!=LastStruc))
+         {
+            /* Start of new element                                     */
+            if(InElement)
+            {
+               if((LastStruc=='E' && EleLength>=ELen) ||
+                  (LastStruc=='H' && EleLength>=HLen))
+               {
+                  top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
+                                         PrimaryTopology, DoNeighbour,
+                                         DoAccess, sumaccess/EleLength,
+                                         (DoLength?EleLength:0),
+                                         (DoLoopLength?LoopLength:0));
+                  DoneOne = TRUE;
+                  LoopLength = 0;
+               }
+            }
+            
+            InElement = TRUE;
+            EleLength = 1;
+            sumaccess = access;
+            x1 = x;
+            y1 = y;
+            z1 = z;
+         }
+         else if(InElement && struc!='E' && struc!='H')
+         {
+            /* Just come out of an element                              */
+            if((LastStruc=='E' && EleLength>=ELen) ||
+               (LastStruc=='H' && EleLength>=HLen))
+            {
+               
+               top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
+                                      PrimaryTopology, DoNeighbour,
+                                      DoAccess, sumaccess/EleLength,
+                                      (DoLength?EleLength:0),
+                                      (DoLoopLength?LoopLength:0));
+               DoneOne = TRUE;
+               LoopLength = 0;
+            }
+            InElement = FALSE;
+         }
+            
+         LastStruc = struc;
+         xp = x;
+         yp = y;
+         zp = z;
+      }
+      else
+      {
+         if(!strncmp(buffer, "  #",3))
+         {
+            InBody = TRUE;
+         }
+      }
+   }
+
+   if(InElement)
+   {
+      /* File ended with an element                                     */
+      if((LastStruc=='E' && EleLength>=ELen) ||
+         (LastStruc=='H' && EleLength>=HLen))
+         top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
+                                PrimaryTopology, DoNeighbour,
+                                DoAccess, sumaccess/EleLength,
+                                (DoLength?EleLength:0),
+                                (DoLoopLength?LoopLength:0));
+   }
+   *length = i;
+   
+   return(top);
+}
+
+
+/************************************************************************/
+/*>int CalcElement(char struc, REAL x1, REAL y1, REAL z1, 
+                   REAL x2, REAL y2, REAL z2, BOOL PrimaryTopology,
+                   BOOL DoNeighbour, BOOL DoAccess, REAL meanAccess,
+                   int EleLength, int LoopLength)
+   -----------------------------------------------------------------
+   Input:   char  struc           DSSP structure assignment
+            REAL  x1              Coordinates of SS element start
+            REAL  y1      
+            REAL  z1      
+            REAL  x2              Coordinates of SS element end
+            REAL  y2      
+            REAL  z2      
+            BOOL  PrimaryTopology Do Primary topology only (no direction)
+            BOOL  DoNeighbour     Add neighbour information
+            BOOL  DoAccess        Add accessibility information
+            REAL  meanAccess      Mean access for element
+            int   EleLength       Element length (0 if we are ignoring
+                                  these)
+            int   LoopLength      Loop length (0 if we are ignoring
+                                  these)
+   Returns: char                  Code for element (structure & direction)
+
+   Given a structure code from DSSP (E or H) and the coordinates of the
+   ends of the element, returns a combined code of structure plus
+   direction. Also generates combined codes with neighbour, accessibility
+   and element length.
+
+   13.01.98 Original   By: ACRM
+   10.11.99 Added PrimaryTopology
+   16.11.99 Added DoNeighbour
+   23.11.99 Added DoAccess/meanAccess
+   26.01.00 Added EleLength
+   10.03.00 Changed to use integer coded topology array. i.e. returns
+            a number rather than a character
+   13.03.00 Fixed length checking
+   16.03.00 Added loop length
+*/
+int CalcElement(char struc, REAL x1, REAL y1, REAL z1, 
+                REAL x2, REAL y2, REAL z2, BOOL PrimaryTopology,
+                BOOL DoNeighbour, BOOL DoAccess, REAL meanAccess,
+                int EleLength, int LoopLength)
+{
+   int         code;
+   int         dirn,
+               buried        = 0,
+               lengthmod     = 0,
+               looplengthmod = 0;
+   REAL        dx,    dy,    dz,
+               absdx, absdy, absdz;
+   static REAL prevx1 = MARKER,
+               prevy1 = MARKER,
+               prevz1 = MARKER,
+               prevx2 = MARKER,
+               prevy2 = MARKER,
+               prevz2 = MARKER;
+   
+   /* Special condition to reset the statics                            */
+   if(DoNeighbour && struc == '\0')
+   {
+      prevx1 = MARKER;
+      prevy1 = MARKER;
+      prevz1 = MARKER;
+      prevx2 = MARKER;
+      prevy2 = MARKER;
+      prevz2 = MARKER;
+      return(0);
+   }
+
+
+#ifdef DEBUG
+   fprintf(stderr,"Length: %d\n", LoopLength);
+#endif
+
+   /* Base coding is A for sheet, G for helix                           */
+   if(PrimaryTopology)   /* We ignore the direction information         */
+   {
+      if(struc == 'E')
+         return(1);
+      else if(struc == 'H')
+         return(7);
+      else
+         return(0);
+   }
+
+   if(struc == 'E')
+      code = 1;
+   else if(struc == 'H')
+      code = 7;
+   else
+      return(0);
+
+   /* Calculate deltas along x, y and z                                 */
+   dx = x2 - x1;
+   dy = y2 - y1;
+   dz = z2 - z1;
+
+   /* Find absolute values                                              */
+   absdx = ABS(dx);
+   absdy = ABS(dy);
+   absdz = ABS(dz);
+
+   /* Find the direction modifier                                       */
+   if((dx >= absdy) && (dx >= absdz))
+      dirn = 1;
+   else if((dx <= (-absdy)) && (dx <= (-absdz)))
+      dirn = 3;
+   else if((dy >= absdx) && (dy >= absdz))
+      dirn = 0;
+   else if((dy <= (-absdx)) && (dy <= (-absdz)))
+      dirn = 2;
+   else if((dz >= absdx) && (dz >= absdy))
+      dirn = 4;
+   else if((dz <= (-absdx)) && (dz <= (-absdy)))
+      dirn = 5;
+   else
+      return(0);
+   
+   if(DoNeighbour)
+   {
+      if((prevx1 != MARKER) && (prevy1 != MARKER) && (prevz1 != MARKER) &&
+         (prevx2 != MARKER) && (prevy2 != MARKER) && (prevz2 != MARKER))
+      {
+         if(IsNeighbour(x1, y1, z1,
+                        x2, y2, z2,
+                        prevx1, prevy1, prevz1,
+                        prevx2, prevy2, prevz2))
+            dirn += 12;
+      }
+      prevx1 = x1;
+      prevy1 = y1;
+      prevz1 = z1;
+
+      prevx2 = x2;
+      prevy2 = y2;
+      prevz2 = z2;
+   }
+
+   if(DoAccess)
+   {
+      if(((struc == 'E') && (meanAccess < gStrandMeanAccess)) ||
+         ((struc == 'H') && (meanAccess < gHelixMeanAccess)))
+         buried = 24;
+   }
+
+   if(EleLength)
+   {
+      if(((struc == 'E') && (EleLength > STRAND_MEAN_LENGTH)) ||
+         ((struc == 'H') && (EleLength > HELIX_MEAN_LENGTH)))
+         lengthmod = 48;
+   }
+   
+   if(LoopLength)
+   {
+      if(LoopLength > LOOP_MEAN_LENGTH)
+         looplengthmod = 96;
+   }
+   
+   return(code + dirn + buried + lengthmod + looplengthmod);
+}
+
+
+/************************************************************************/
+/*>int CalcIDScore(TOPCODE *seq1, int length1, TOPCODE *seq2, 
+                   int length2, BOOL UseBoth)
+   ---------------------------------------------------
+   Input:   TOPCODE  *seq1   Sequence 1
+            int      length1 Length of seq1
+            TOPCODE  *seq2   Sequence 2
+            int      length2 Length of seq2
+            BOOL     UseBoth Calculate score as Max of both sequences
+   Returns: int              Max score of each sequence vs itself
+
+   Calculates the maximum possible score resulting from the identical
+   sequence
+
+   14.01.98 Original   By: ACRM
+   10.03.00 Changed to use integer coded topology array
+   17.10.26 Uses gMDM rather than calling blNumericCalcMDMScore()   By: agent
+   17.10.26 Takes TOPCODE strings with their lengths   By: agent
+   17.10.26 Split into SelfScore() and CombineIDScores()   By: agent
+*/
+int CalcIDScore(TOPCODE *seq1, int length1, TOPCODE *seq2, int length2,
+                BOOL UseBoth)
+{
+   return(CombineIDScores(SelfScore(seq1, length1), length1,
+                          (UseBoth ? SelfScore(seq2, length2) : 0), 
+                          length2, UseBoth));
+}
+
+
+/************************************************************************/
+/*>int SelfScore(TOPCODE *seq, int length)
+   ---------------------------------------
+   Input:   TOPCODE  *seq    Sequence
+            int      length  Length of seq
+   Returns: int              Score of the sequence against itself
+
+   17.10.26 Original (code taken from CalcIDScore())   By: agent
+*/
+int SelfScore(TOPCODE *seq, int length)
+{
+   int score = 0,
+       i;
+
+   for(i=0; i<length; i++)
+   {
+      if(seq[i])
+         score += gMDM[seq[i]][seq[i]];
+   }
+
+   return(score);
+}
+
+
+/************************************************************************/
+/*>int CombineIDScores(int self1, int length1, int self2, int length2,
+                       BOOL UseBoth)
+   -------------------------------------------------------------------
+   Input:   int      self1   SelfScore() of sequence 1
+            int      length1 Length of sequence 1
+            int      self2   SelfScore() of sequence 2 (only used with
+                             UseBoth)
+            int      length2 Length of sequence 2
+            BOOL     UseBoth Calculate score as Max of both sequences
+   Returns: int              Score as given by CalcIDScore()
+
+   Gives the identity score from self-scores worked out beforehand, so
+   that a scan need not work them out for every entry
+
+   17.10.26 Original (code taken from CalcIDScore())   By: agent
+*/
+int CombineIDScores(int self1, int length1, int self2, int length2,
+                    BOOL UseBoth)
+{
+   int score1 = self1;
+
+   if(UseBoth && (self2 > score1))
+      score1 = self2;
+
+   /* 15.01.98 Added check for zero length strings                      */
+   if(UseBoth)
+   {
+      if((length1==0) && (length2==0))
+         score1 = 100;
+   }
+   else
+   {
+      if(length1==0)
+         score1 = 100;
+   }
+   
+   return(score1);
+}
+
+
+/************************************************************************/
+/*>TOPCODE *ReadStride(FILE *fp, int ELen, int HLen, BOOL Do3_10, 
+                       BOOL PrimaryTopology, BOOL DoNeighbour, 
+                       BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength,
+                       int *length)
+   -----------------------------------------------------------------------
+   Input:   FILE     *fp             Stride file pointer
+            int      ELen            Minimum length of strand
+            int      HLen            Minimum length of helix
+            BOOL     Do3_10          Merge 3_10 helix with alpha
+            BOOL     PrimaryTopology Only do primary topology
+            BOOL     DoNeighbour     Add neighbour information
+            BOOL     DoAccess        Add accessibility information
+            BOOL     DoLength        Add length information
+            BOOL     DoLoopLength    Add loop length information
+   Output:  int      *length         Length of the topology string
+   Returns: TOPCODE *                Topology string
+
+   Reads a Stride file returning a string representing the topology.
+   This is actually the combined PDB/STRIDE file - the same format is
+   used for pdbsecstr
+
+   13.03.98 Original   By: ACRM
+   26.10.99 Added Do3_10 handling
+   10.11.99 Added PrimaryTopology
+   16.11.99 Added DoNeighbour
+   23.11.99 Added DoAccess
+            Fixed bug - file ending with an SS element wasn't checking
+            element length
+   26.01.00 Added DoLength
+   10.03.00 Changed to use integer coded topology array
+   13.03.00 Initialise x1,y1,z1,xp,yp,zp only to silence warnings with -O2
+   16.03.00 Added loop length
+   17.10.26 Returns a TOPCODE string and its length   By: agent
+*/
+TOPCODE *ReadStride(FILE *fp, int ELen, int HLen, BOOL Do3_10, 
+                    BOOL PrimaryTopology, BOOL DoNeighbour, 
+                    BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength,
+                    int *length)
+{
+   TOPCODE *top;
+   char buffer[MAXBUFF*2],
+        struc,
+        LastStruc    = ' ';
+   REAL x,  y,  z,
+        x1 = MARKER, 
+        y1 = MARKER, 
+        z1 = MARKER,
+        xp = MARKER, 
+        yp = MARKER, 
+        zp = MARKER,
+        access, 
+        sumaccess    = 0.0;
+   BOOL InElement    = FALSE,
+        DoneOne      = FALSE;
+   int  i            = 0,
+        EleLength    = 0,
+        LoopLength   = 0;
+
+   
+   if((top = (TOPCODE *)malloc(MAXBUFF * sizeof(TOPCODE)))==NULL)
+      return(NULL);
+   
+   while(fgets(buffer,MAXBUFF*2,fp))
+   {
+      TERMINATE(buffer);
+      fsscanf(buffer,"%15x%8lf%1x%8lf%1x%8lf%1x%c%1x%8lf",
+              &x,&y,&z,&struc,&access);
+      
+      if(Do3_10 && struc=='G')                     /* 26.10.99          */
+         struc = 'H';
+      
+      if((struc=='E' || struc=='H') && (struc==LastStruc))
+      {
+         EleLength++;
+         sumaccess += access;
+      }
+      if(DoneOne && (struc != 'E') && (struc != 'H'))
+      {
+         LoopLength++;
+      }
+      
+      if((struc=='E' || struc=='H') && (struc!=LastStruc))
+      {
+         /* Start of new element                                        */
+         if(InElement)
+         {
+            if((LastStruc=='E' && EleLength>=ELen) ||
+               (LastStruc=='H' && EleLength>=HLen))
+            {
+               top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
+                                      PrimaryTopology, DoNeighbour,
+                                      DoAccess, sumaccess/EleLength,
+                                      (DoLength?EleLength:0),
+                                      (DoLoopLength?LoopLength:0));
+               DoneOne = TRUE;
+               LoopLength = 0;
+            }
+            
+         }
+         
+         InElement = TRUE;
+         EleLength = 1;
+         sumaccess = access;
+         x1 = x;
+         y1 = y;
+         z1 = z;
+      }
+      else if(InElement && struc!='E' && struc!='H')
+      {
+         /* Just come out of an element                                 */
+         if((LastStruc=='E' && EleLength>=ELen) ||
+            (LastStruc=='H' && EleLength>=HLen))
+         {
+            top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
+                                   PrimaryTopology, DoNeighbour,
+                                   DoAccess, sumaccess/EleLength,
+                                   (DoLength?EleLength:0),
+                                   (DoLoopLength?LoopLength:0));
+            DoneOne = TRUE;
+            LoopLength = 0;
+         }
+         InElement = FALSE;
+      }
+      
+      LastStruc = struc;
+      xp = x;
+      yp = y;
+      zp = z;
+   }
+   
+   if(InElement)
+   {
+      /* File ended with an element                                     */
+      if((LastStruc=='E' && EleLength>=ELen) ||
+         (LastStruc=='H' && EleLength>=HLen))
+         top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
+                                PrimaryTopology, DoNeighbour,
+                                DoAccess, sumaccess/EleLength,
+                                (DoLength?EleLength:0),
+                                (DoLoopLength?LoopLength:0));
+   }
+   *length = i;
+   
+   return(top);
+}
+
+
+/************************************************************************/
+/*>BOOL IsNeighbour(REAL x1, REAL y1, REAL z1,
+                    REAL x2, REAL y2, REAL z2,
+                    REAL prevx1, REAL prevy1, REAL prevz1,
+                    REAL prevx2, REAL prevy2, REAL prevz2)
+   -------------------------------------------------------
+   Input:   REAL    x1       Nter of this SS element
+            REAL    y1 
+            REAL    z1
+            REAL    x2       Cter of this SS element
+            REAL    y2
+            REAL    z2
+            REAL    prevx1   Nter of previous SS element
+            REAL    prevy1
+            REAL    prevz1
+            REAL    prevx2   Cter of previous SS element
+            REAL    prevy2
+            REAL    prevz2
+   Returns: BOOL             Are they neighbours?
+
+   Determines whether the current secondary structure element is a direct
+   neighbour of the preceeding element.
+
+   17.11.99 Original   By: ACRM
+   13.03.00 Fixed parameter variable types to REAL (were BOOL!)
+*/
+BOOL IsNeighbour(REAL x1, REAL y1, REAL z1,
+                 REAL x2, REAL y2, REAL z2,
+                 REAL prevx1, REAL prevy1, REAL prevz1,
+                 REAL prevx2, REAL prevy2, REAL prevz2)
+{
+   REAL d[4], f[4],
+        mindist = 9999.0;
+   int  i;
+   
+   
+   /* Calculate distance and position of Nter end against previous
+      element
+   */
+   d[0] = blPointLineDistance(x1, y1, z1, 
+                              prevx1, prevy1, prevz1,
+                              prevx2, prevy2, prevz2,
+                              NULL, NULL, NULL,
+                              &f[0]);
+
+   /* Calculate distance and position of Cter end against previous
+      element
+   */
+   d[1] = blPointLineDistance(x2, y2, z2, 
+                              prevx1, prevy1, prevz1,
+                              prevx2, prevy2, prevz2,
+                              NULL, NULL, NULL,
+                              &f[1]);
+
+   /* Calculate distance and position of Nter end of previous element
+      against current
+   */
+   d[2] = blPointLineDistance(prevx1, prevy1, prevz1,
+                              x1, y1, z1, 
+                              x2, y2, z2,
+                              NULL, NULL, NULL,
+                              &f[2]);
+
+   /* Calculate distance and position of Cter end of previous element
+      against current
+   */
+   d[3] = blPointLineDistance(prevx2, prevy2, prevz2,
+                              x1, y1, z1, 
+                              x2, y2, z2,
+                              NULL, NULL, NULL,
+                              &f[3]);
+
+   /* See which are in line with the other element                      */
+   for(i=0; i<4; i++)
+   {
+      if((f[i] >= 0.0) && (f[i] <= 1.0))
+      {
+         if(d[i] < mindist)
+            mindist = d[i];
+      }
+   }
+#ifdef DEBUG
+   fprintf(stderr,"Minimum distance = %f\n", mindist);
+#endif
+
+   /* If the minimum distance is less than our cutoff, then we return
+      TRUE as they are adjacent
+   */
+   if(mindist < ADJACENT_DIST)
+      return(TRUE);
+   
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>int MakeCodeArray(TOPCODE *codes, char *inarray)
+   -------------------------------------------------
+   Input:   TOPCODE *codes     Code array to be filled
+            char    *inarray   Dash-delimited list of positive integers
+   Returns: int                Number of codes copied into array
+                               (-1 if a code is too long to read)
+
+   Builds a code array from a dash separated list of numbers
+   (e.g. 1-5-7-23-7-31 would go into a 6 element array containing
+   1,5,7,23,7,31). The array is not terminated so the length must be
+   kept.
+   Anything which is not a valid code is stored as 0. A code longer
+   than 15 characters makes the whole string invalid since strings
+   read from --serve and --stream are not trusted
+
+   08.03.00 Original   By: ACRM
+   17.10.26 Invalid codes stored as 0 since codes are now used to index
+            the scoring and rotation tables   By: agent
+   17.10.26 Renamed from MakeIntArray(). Fills a TOPCODE array with no
+            terminator   By: agent
+   17.10.26 Returns -1 rather than overflowing on a code of more than
+            15 characters   By: agent
+*/
+int MakeCodeArray(TOPCODE *codes, char *inarray)
+{
+   int pos = 0,
+       code;
+   char tempbuff[16],
+        *chp,
+        *buffp;
+   
+   chp = inarray;
+   
+   while(*chp)
+   {
+      buffp = tempbuff;
+      while(*chp != '-' && *chp)
+      {
+         if(buffp == tempbuff+15)
+            return(-1);
+         *buffp++ = *chp++;
+      }
+      *buffp = '\0';
+      if((sscanf(tempbuff,"%d", &code) != 1) ||
+         (code < 0) || (code > NCODES))
+         code = 0;
+      codes[pos++] = (TOPCODE)code;
+      if(*chp) chp++;
+   }
+   
+   return(pos);
+}
+
+
+/************************************************************************/
+/*>char *CodesToString(TOPCODE *codes, int length)
+   -----------------------------------------------
+   Input:   TOPCODE *codes     Array of codes
+            int     length     Number of codes
+   Returns: char    *          Pointer to allocated character string
+                               containing dash deliminated numbers
+
+   Creates a character representation of a code array. Each element
+   is printed as three characters zero-padded and separated by a dash.
+
+   08.03.00 Original   By: ACRM
+   17.10.26 Renamed from NumArrayToString(). Takes TOPCODE codes and
+            their length rather than a -1 terminated int array   By: agent
+*/
+char *CodesToString(TOPCODE *codes, int length)
+{
+   char *buff = NULL,
+        tmpbuff[16],
+        *tbp;
+   int  buffsize = BUFFCHUNK,
+        i,
+        buffused = 0,
+        strsize;
+   
+   if((buff = (char *)malloc(BUFFCHUNK * sizeof(char)))==NULL)
+      return(NULL);
+   buff[0] = '\0';
+
+   for(i=0; i<length; i++)
+   {
+      sprintf(tmpbuff,"%03d",(int)codes[i]);
+      KILLLEADSPACES(tbp,tmpbuff);
+
+      /* Check whether the number string will fit, if not increase the
+         array size
+      */
+      strsize = strlen(tbp)+1;
+      if((buffused + strsize + 1) > buffsize)
+      {
+         buffsize += BUFFCHUNK;
+         buff = (char *)realloc(buff, buffsize);
+      }
+
+      /* Add a dash if this isn't the first number added                */
+      if(i) strcat(buff, "-");
+      /* Now add the number itself                                      */
+      strcat(buff,tbp);
+      buffused = strlen(buff);
+   }
+   
+   return(buff);
+}
+
+
+
+/************************************************************************/
+/*>LIBRARY *ReadLibrary(FILE *fp)
+   ------------------------------
+   Input:   FILE     *fp       Topology library file pointer
+   Returns: LIBRARY  *         Library read into memory (NULL if no
+                               memory)
+
+   Reads a library of topology strings into memory. Each line contains
+   a name and a numeric topology string. Blank lines and lines starting
+   with a ! or # are skipped. An entry with no topology string is stored
+   as a zero-length topology. An entry whose topology string can't be
+   read is skipped with a warning. The matrix must have been read as the
+   self-score of each entry is worked out here.
+
+   17.10.26 Original (code taken from main())   By: agent
+   17.10.26 Codes are read as TOPCODE   By: agent
+   17.10.26 Works out the self-scores   By: agent
+   17.10.26 Initialises the classes   By: agent
+   17.10.26 Initialises the seed index   By: agent
+   17.10.26 Initialises the clusters   By: agent
+   17.10.26 Skips entries MakeCodeArray() can't read   By: agent
+*/
+LIBRARY *ReadLibrary(FILE *fp)
+{
+   LIBRARY  *library;
+   LIBENTRY *entry;
+   char     buffer[MAXBUFF],
+            name[MAXBUFF],
+            top2str[MAXBUFF],
+            *ptr;
+   int      maxentries = 0;
+
+   if((library = (LIBRARY *)malloc(sizeof(LIBRARY)))==NULL)
+      return(NULL);
+   library->entries      = NULL;
+   library->header       = NULL;
+   library->byLength     = NULL;
+   library->classOf      = NULL;
+   library->nextMember   = NULL;
+   library->clusterOf    = NULL;
+   library->nentries     = 0;
+   library->nclasses     = 0;
+   library->mapsize      = 0;
+   library->seeds        = NULL;
+   library->groupPrimary = FALSE;
+   
+   while(fgets(buffer,MAXBUFF,fp))
+   {
+      TERMINATE(buffer);
+      
+      ptr = buffer;
+      while(*ptr == ' ' || *ptr == '\t')
+         ptr++;
+      if(strlen(ptr) && (*ptr != '!') && (*ptr != '#'))
+      {
+         /* Grow the array of entries if needed                         */
+         if(library->nentries == maxentries)
+         {
+            LIBENTRY *entries;
+            
+            maxentries += 1024;
+            if((entries = (LIBENTRY *)realloc(library->entries,
+                                              maxentries * 
+                                              sizeof(LIBENTRY)))==NULL)
+            {
+               FreeLibrary(library);
+               return(NULL);
+            }
+            library->entries = entries;
+         }
+
+         name[0]    = '\0';
+         top2str[0] = '\0';
+         sscanf(ptr,"%s %s",name,top2str);
+
+         entry = &(library->entries[library->nentries]);
+         entry->name = (char *)malloc((1+strlen(name)) * sizeof(char));
+         entry->top  = (TOPCODE *)malloc((1+strlen(top2str)) * 
+                                         sizeof(TOPCODE));
+         if((entry->name == NULL) || (entry->top == NULL))
+         {
+            FREE(entry->name);
+            FREE(entry->top);
+            FreeLibrary(library);
+            return(NULL);
+         }
+         strcpy(entry->name, name);
+         if((entry->length = MakeCodeArray(entry->top, top2str)) < 0)
+         {
+            fprintf(stderr,"Warning: invalid topology for %s. \
+Skipped\n", name);
+            free(entry->name);
+            free(entry->top);
+            continue;
+         }
+         entry->selfScore = SelfScore(entry->top, entry->length);
+         library->nentries++;
+      }
+   }
+   library->nclasses = library->nentries;
+   
+   return(library);
+}
+
+
+/************************************************************************/
+/*>void FreeLibrary(LIBRARY *library)
+   ----------------------------------
+   I/O:     LIBRARY  *library   Library to be freed
+
+   Frees a library read by ReadLibrary() or mapped by MapLibrary()
+
+   17.10.26 Original   By: agent
+   17.10.26 Unmaps a compiled library   By: agent
+   17.10.26 Frees the classes   By: agent
+   17.10.26 Frees the seed index   By: agent
+   17.10.26 Frees the clusters   By: agent
+*/
+void FreeLibrary(LIBRARY *library)
+{
+   int i;
+   
+   if(library == NULL)
+      return;
+   
+   if(library->header != NULL)
+   {
+      munmap((void *)library->header, library->mapsize);
+   }
+   else
+   {
+      for(i=0; i<library->nentries; i++)
+      {
+         free(library->entries[i].name);
+         free(library->entries[i].top);
+      }
+      FREE(library->clusterOf);
+   }
+   FREE(library->entries);
+   FREE(library->classOf);
+   FREE(library->nextMember);
+   FreeSeedIndex(library->seeds);
+   free(library);
+}
+
+
+/************************************************************************/
+/*>int TopologyFlags(BOOL Do3_10, BOOL PrimaryTopology, BOOL DoNeighbour,
+                     BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength)
+   ----------------------------------------------------------------------
+   Input:   BOOL  Do3_10          Merge 3_10 helix with alpha helix
+            BOOL  PrimaryTopology Primary topology only
+            BOOL  DoNeighbour     Neighbour information
+            BOOL  DoAccess        Accessibility information
+            BOOL  DoLength        Element length information
+            BOOL  DoLoopLength    Loop length information
+   Returns: int                   TOPB_ flags for these options
+
+   17.10.26 Original   By: agent
+*/
+int TopologyFlags(BOOL Do3_10, BOOL PrimaryTopology, BOOL DoNeighbour,
+                  BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength)
+{
+   int flags = 0;
+   
+   if(Do3_10)          flags |= TOPB_3_10;
+   if(PrimaryTopology) flags |= TOPB_PRIMARY;
+   if(DoNeighbour)     flags |= TOPB_NEIGHBOUR;
+   if(DoAccess)        flags |= TOPB_ACCESS;
+   if(DoLength)        flags |= TOPB_LENGTH;
+   if(DoLoopLength)    flags |= TOPB_LOOPLENGTH;
+
+   return(flags);
+}
+
+
+/************************************************************************/
+/*>BOOL CompileLibrary(char *libfile, char *outfile, char *matfile, 
+                       int ELen, int HLen, int flags, REAL clusterscore,
+                       int nthreads)
+   ---------------------------------------------------------------------
+   Input:   char  *libfile      Topology library file
+            char  *outfile      Compiled library file to write
+            char  *matfile      Matrix for the self-scores (empty
+                                for the built-in matrix)
+            int   ELen          Minimum strand length the library was 
+                                built with
+            int   HLen          Minimum helix length the library was 
+                                built with
+            int   flags         TOPB_ flags for the other options the
+                                library was built with
+            REAL  clusterscore  Score for ClusterLibrary() (0 not to 
+                                cluster the library)
+            int   nthreads      Number of threads for the clustering
+   Returns: BOOL                Success?
+
+   Reads a topology library with ReadLibrary() and writes it out in the
+   compiled form read by MapLibrary(): a TOPBHEADER, a TOPBENTRY for 
+   each entry in library order, the entries in order of length, the 
+   clusters if there are any, the codes (one byte each) and the names.
+   The file is only meant to be read on the sort of machine that wrote
+   it.
+
+   The self-score of each entry against the matrix is stored along with
+   a checksum of the matrix. If the matrix cannot be read the library
+   is still written, and the self-scores are then worked out when it is
+   mapped.
+
+   Given clusterscore, the library is clustered by ClusterLibrary() 
+   and the entry standing for the cluster of each entry is stored for
+   --hierarchical. This needs the matrix. With --stats, the classes of
+   GroupLibrary() are reported.
+
+   17.10.26 Original   By: agent
+   17.10.26 Codes are written as TOPCODE bytes with no terminator   By: agent
+   17.10.26 Added matfile. Stores the self-scores   By: agent
+   17.10.26 Added clusterscore and nthreads. Stores the clusters   By: agent
+   17.10.26 Reports the classes with --stats   By: agent
+*/
+BOOL CompileLibrary(char *libfile, char *outfile, char *matfile, 
+                    int ELen, int HLen, int flags, REAL clusterscore,
+                    int nthreads)
+{
+   FILE       *fp;
+   LIBRARY    *library;
+   LIBENTRY   *entry;
+   TOPBHEADER header;
+   TOPBENTRY  topbentry;
+   int        *order = NULL,
+              i;
+   long       ncodes   = 0,
+              namesize = 0;
+   BOOL       ok,
+              scored;
+
+   if(!(scored = ReadMatrix(matfile)))
+   {
+      if(clusterscore > 0.0)
+      {
+         fprintf(stderr,"Unable to read matrix file %s\n", matfile);
+         return(FALSE);
+      }
+      fprintf(stderr,"Warning: unable to read matrix file %s. \
+Self-scores will not be\n         stored\n", matfile);
+   }
+
+   if((fp=fopen(libfile,"r"))==NULL)
+   {
+      fprintf(stderr,"Can't read %s\n",libfile);
+      return(FALSE);
+   }
+   library = ReadLibrary(fp);
+   fclose(fp);
+   if((library == NULL) || ((order = SortByLength(library))==NULL))
+   {
+      fprintf(stderr,"No memory to read library %s\n",libfile);
+      FreeLibrary(library);
+      return(FALSE);
+   }
+
+   for(i=0; i<library->nentries; i++)
+   {
+      ncodes   += library->entries[i].length;
+      namesize += strlen(library->entries[i].name) + 1;
+   }
+   if((ncodes > INT_MAX) || (namesize > INT_MAX))
+   {
+      fprintf(stderr,"Library %s is too big to compile\n",libfile);
+      free(order);
+      FreeLibrary(library);
+      return(FALSE);
+   }
+
+   if((clusterscore > 0.0) && 
+      !ClusterLibrary(library, (flags & TOPB_PRIMARY) ? TRUE : FALSE,
+                      clusterscore, nthreads))
+   {
+      fprintf(stderr,"Unable to cluster library %s\n",libfile);
+      free(order);
+      FreeLibrary(library);
+      return(FALSE);
+   }
+
+   /* Clustering groups the library, otherwise it is only grouped to be
+      reported
+   */
+   if(gStats && scored && (clusterscore <= 0.0))
+      GroupLibrary(library, (flags & TOPB_PRIMARY) ? TRUE : FALSE);
+
+   memcpy(header.magic, TOPB_MAGIC, 4);
+   header.version  = TOPB_VERSION;
+   header.ELen     = ELen;
+   header.HLen     = HLen;
+   header.flags    = flags;
+   header.nentries = library->nentries;
+   header.ncodes   = (int)ncodes;
+   header.namesize = (int)namesize;
+   header.scored   = (int)scored;
+   header.matrix   = (scored ? MatrixChecksum() : 0);
+   header.clustered = (library->clusterOf != NULL);
+
+   if((fp=fopen(outfile,"wb"))==NULL)
+   {
+      fprintf(stderr,"Can't write %s\n",outfile);
+      free(order);
+      FreeLibrary(library);
+      return(FALSE);
+   }
+   
+   ok = (fwrite(&header, sizeof(TOPBHEADER), 1, fp) == 1);
+
+   ncodes   = 0;
+   namesize = 0;
+   for(i=0; ok && (i<library->nentries); i++)
+   {
+      entry            = &(library->entries[i]);
+      topbentry.name      = (int)namesize;
+      topbentry.top       = (int)ncodes;
+      topbentry.length    = entry->length;
+      topbentry.selfScore = (scored ? entry->selfScore : 0);
+      ok = (fwrite(&topbentry, sizeof(TOPBENTRY), 1, fp) == 1);
+      ncodes   += entry->length;
+      namesize += strlen(entry->name) + 1;
+   }
+   if(ok && library->nentries)
+      ok = (fwrite(order, sizeof(int), library->nentries, fp) == 
+            (size_t)library->nentries);
+   if(ok && header.clustered && library->nentries)
+      ok = (fwrite(library->clusterOf, sizeof(int), library->nentries, 
+                   fp) == (size_t)library->nentries);
+   for(i=0; ok && (i<library->nentries); i++)
+   {
+      entry = &(library->entries[i]);
+      ok = (fwrite(entry->top, sizeof(TOPCODE), entry->length, fp) ==
+            (size_t)entry->length);
+   }
+   for(i=0; ok && (i<library->nentries); i++)
+   {
+      entry = &(library->entries[i]);
+      ok = (fwrite(entry->name, 1, strlen(entry->name) + 1, fp) ==
+            strlen(entry->name) + 1);
+   }
+   if(fclose(fp))
+      ok = FALSE;
+   
+   if(!ok)
+   {
+      fprintf(stderr,"Error writing %s\n",outfile);
+      unlink(outfile);
+   }
+
+   free(order);
+   FreeLibrary(library);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL ClusterLibrary(LIBRARY *library, BOOL PrimaryTopology, 
+                       REAL minscore, int nthreads)
+   -------------------------------------------------------------
+   I/O:     LIBRARY  *library         Library read by ReadLibrary()
+   Input:   BOOL     PrimaryTopology  Primary topology only
+            REAL     minscore         Score a member of a cluster must
+                                      reach against the entry standing
+                                      for it
+            int      nthreads         Number of threads to use
+   Returns: BOOL                      Success?
+
+   Clusters the library for --hierarchical. The classes of 
+   GroupLibrary() are taken longest first. Each one not yet in a 
+   cluster stands for a new cluster and is scanned with ScanProbes() 
+   against the shorter classes not yet in one; those scoring at least
+   minscore, with the percentage from both strings, join its cluster.
+   library->clusterOf[] gives the entry standing for the cluster of 
+   each entry. The number of clusters is reported.
+
+   17.10.26 Original   By: agent
+*/
+BOOL ClusterLibrary(LIBRARY *library, BOOL PrimaryTopology, 
+                    REAL minscore, int nthreads)
+{
+   SCANRESULT *results;
+   LIBENTRY   *entry;
+   int        *order     = NULL,
+              *rest      = NULL,
+              *hits,
+              nhits,
+              nentries   = library->nentries,
+              nclusters  = 0,
+              head, i, k, n, p;
+   BOOL       ok;
+
+   FREE(library->clusterOf);
+   GroupLibrary(library, PrimaryTopology);
+   if(((order = SortByLength(library))==NULL) ||
+      ((rest  = (int *)malloc((library->nclasses + 1) * sizeof(int)))
+       ==NULL) ||
+      ((library->clusterOf = (int *)malloc((nentries ? nentries : 1) *
+                                           sizeof(int)))==NULL))
+   {
+      FREE(order);
+      FREE(rest);
+      return(FALSE);
+   }
+   for(i=0; i<nentries; i++)
+      library->clusterOf[i] = (-1);
+
+   ok = TRUE;
+   for(p=library->nclasses-1; ok && (p>=0); p--)
+   {
+      head = order[p];
+      if(library->clusterOf[head] >= 0)
+         continue;
+      library->clusterOf[head] = head;
+      nclusters++;
+
+      n = 0;
+      for(i=0; i<p; i++)
+      {
+         if(library->clusterOf[order[i]] < 0)
+            rest[n++] = order[i];
+      }
+      rest[n] = (-1);
+
+      entry = &(library->entries[head]);
+      if(n && 
+         (ok = ScanProbes(&(entry->top), &(entry->length), 1, library, 
+                          TRUE, PrimaryTopology, nthreads, NOBAND, 0, 
+                          minscore, 0, 0, NULL, &rest, &results, &hits,
+                          &nhits)))
+      {
+         for(k=0; k<nhits; k++)
+         {
+            if(library->clusterOf[hits[k]] < 0)
+               library->clusterOf[hits[k]] = head;
+         }
+         free(results);
+         FREE(hits);
+      }
+   }
+
+   /* The other entries of a class are in the cluster of the class     */
+   for(i=0; ok && (i<nentries); i++)
+   {
+      if(!REPRESENTS(library, i))
+         library->clusterOf[i] = 
+            library->clusterOf[library->classOf[i]];
+   }
+
+   if(ok)
+   {
+      fprintf(stderr,"Clusters: %d clusters of the %d classes scoring \
+at least %g\n", nclusters, library->nclasses, minscore);
+   }
+   else
+   {
+      FREE(library->clusterOf);
+   }
+   
+   free(order);
+   free(rest);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL IsCompiledLibrary(FILE *fp)
+   --------------------------------
+   Input:   FILE  *fp         Library file pointer
+   Returns: BOOL              Was it written by CompileLibrary()?
+
+   Looks at the start of the file and then rewinds it
+
+   17.10.26 Original   By: agent
+*/
+BOOL IsCompiledLibrary(FILE *fp)
+{
+   char magic[4];
+   BOOL compiled;
+
+   compiled = ((fread(magic, 1, 4, fp) == 4) &&
+               !memcmp(magic, TOPB_MAGIC, 4));
+   rewind(fp);
+   
+   return(compiled);
+}
+
+
+/************************************************************************/
+/*>LIBRARY *MapLibrary(char *filename)
+   -----------------------------------
+   Input:   char     *filename  Compiled library file
+   Returns: LIBRARY  *          The library (NULL on error)
+
+   Maps a library written by CompileLibrary() read-only into memory. The
+   names and topology strings of the entries point into the mapping, so
+   nothing is read or copied until it is used and several scans of the
+   same library share one copy of it. The sizes in the file are checked
+   against each other so that a damaged file cannot take us outside the
+   mapping, and the codes are checked so that they cannot take us 
+   outside the scoring and rotation tables.
+
+   The self-scores are taken from the file if they were worked out with
+   the matrix we have read, and are worked out again otherwise. Any 
+   clusters are mapped too.
+
+   17.10.26 Original   By: agent
+   17.10.26 Codes are TOPCODE bytes with no terminator   By: agent
+   17.10.26 Takes the self-scores from the file   By: agent
+   17.10.26 Initialises the classes   By: agent
+   17.10.26 Initialises the seed index   By: agent
+   17.10.26 Maps the clusters   By: agent
+   17.10.26 Checks the codes   By: agent
+*/
+LIBRARY *MapLibrary(char *filename)
+{
+   LIBRARY     *library;
+   TOPBHEADER  *header;
+   TOPBENTRY   *topbentries;
+   TOPCODE     *codes;
+   int         *order,
+               *clusters,
+               fd,
+               i;
+   char        *names,
+               *map;
+   struct stat st;
+   size_t      size;
+   BOOL        ok,
+               scored;
+
+   if((fd = open(filename, O_RDONLY)) < 0)
+      return(NULL);
+   if((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(TOPBHEADER)))
+   {
+      close(fd);
+      return(NULL);
+   }
+   size = (size_t)st.st_size;
+   map  = (char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if(map == (char *)MAP_FAILED)
+      return(NULL);
+
+   header = (TOPBHEADER *)map;
+   if((header->version != TOPB_VERSION) || (header->nentries < 0) ||
+      (header->ncodes < 0) || (header->namesize < 0) ||
+      (size != sizeof(TOPBHEADER) + 
+       (size_t)header->nentries * (sizeof(TOPBENTRY) + sizeof(int)) +
+       (header->clustered ? (size_t)header->nentries * sizeof(int) : 0) +
+       (size_t)header->ncodes * sizeof(TOPCODE) + 
+       (size_t)header->namesize) ||
+      (header->namesize && map[size-1]))
+   {
+      fprintf(stderr,"%s is not a compiled library this version of \
+topscan can read\n", filename);
+      munmap(map, size);
+      return(NULL);
+   }
+
+   topbentries = (TOPBENTRY *)(map + sizeof(TOPBHEADER));
+   order       = (int *)(topbentries + header->nentries);
+   clusters    = order + header->nentries;
+   codes       = (TOPCODE *)(clusters + 
+                             (header->clustered ? header->nentries : 0));
+   names       = (char *)(codes + header->ncodes);
+
+   if((library = (LIBRARY *)malloc(sizeof(LIBRARY)))==NULL)
+   {
+      munmap(map, size);
+      return(NULL);
+   }
+   library->header       = header;
+   library->byLength     = order;
+   library->classOf      = NULL;
+   library->nextMember   = NULL;
+   library->clusterOf    = (header->clustered ? clusters : NULL);
+   library->nentries     = header->nentries;
+   library->nclasses     = header->nentries;
+   library->mapsize      = size;
+   library->seeds        = NULL;
+   library->groupPrimary = FALSE;
+   if((library->entries = (LIBENTRY *)malloc((header->nentries ? 
+                                              header->nentries : 1) *
+                                             sizeof(LIBENTRY)))==NULL)
+   {
+      free(library);
+      munmap(map, size);
+      return(NULL);
+   }
+
+   /* The codes index the scoring and rotation tables                 */
+   ok = TRUE;
+   for(i=0; ok && (i<header->ncodes); i++)
+      ok = (codes[i] <= NCODES);
+
+   scored = (header->scored && (header->matrix == MatrixChecksum()));
+   for(i=0; ok && (i<header->nentries); i++)
+   {
+      ok = ((topbentries[i].name >= 0) && 
+            (topbentries[i].name < header->namesize) &&
+            (topbentries[i].length >= 0) && (topbentries[i].top >= 0) &&
+            (topbentries[i].top <= header->ncodes - topbentries[i].length) &&
+            (order[i] >= 0) && (order[i] < header->nentries) &&
+            (!header->clustered || 
+             ((clusters[i] >= 0) && (clusters[i] < header->nentries))));
+      
+      library->entries[i].name   = names + topbentries[i].name;
+      library->entries[i].top    = codes + topbentries[i].top;
+      library->entries[i].length = topbentries[i].length;
+      if(ok)
+      {
+         library->entries[i].selfScore = 
+            (scored ? topbentries[i].selfScore :
+             SelfScore(library->entries[i].top, 
+                       library->entries[i].length));
+      }
+   }
+   if(!ok)
+   {
+      fprintf(stderr,"Compiled library %s is damaged\n", filename);
+      FreeLibrary(library);
+      return(NULL);
+   }
+
+   return(library);
+}
+
+
+/************************************************************************/
+/*>LIBRARY *OpenLibrary(FILE *fp, char *filename, BOOL CheckOptions, 
+                        int ELen, int HLen, int flags)
+   ------------------------------------------------------------------
+   Input:   FILE     *fp           Library file pointer
+            char     *filename     Library file name
+            BOOL     CheckOptions  Warn if a compiled library was built
+                                   with other options?
+            int      ELen          Minimum strand length of the probes
+            int      HLen          Minimum helix length of the probes
+            int      flags         TOPB_ flags for the other options of
+                                   the probes
+   Returns: LIBRARY  *             The library (NULL on error)
+
+   Maps a compiled library or reads a text one into memory
+
+   17.10.26 Original (code taken from main())   By: agent
+*/
+LIBRARY *OpenLibrary(FILE *fp, char *filename, BOOL CheckOptions, 
+                     int ELen, int HLen, int flags)
+{
+   LIBRARY *library;
+   
+   if(IsCompiledLibrary(fp))
+   {
+      if((library = MapLibrary(filename))==NULL)
+      {
+         fprintf(stderr,"Unable to map compiled library %s\n", filename);
+         return(NULL);
+      }
+
+      /* The probe should be built the same way as the library was     */
+      if(CheckOptions &&
+         ((library->header->ELen != ELen) ||
+          (library->header->HLen != HLen) ||
+          (library->header->flags != flags)))
+      {
+         fprintf(stderr,"Warning: library %s was compiled with \
+different topology options\n", filename);
+      }
+   }
+   else if((library = ReadLibrary(fp))==NULL)
+   {
+      fprintf(stderr,"No memory to read library %s\n",filename);
+      return(NULL);
+   }
+
+   return(library);
+}
+
+
+/************************************************************************/
+/*>BOOL ScanQueryList(char *listfile, LIBRARY *library, 
+                      BOOL GivenTopString, BOOL CalcSecStr, 
+                      int SecStrCalculator, int ELen, int HLen, 
+                      BOOL Do3_10, BOOL PrimaryTopology, 
+                      BOOL DoNeighbour, BOOL DoAccess, BOOL DoLength,
+                      BOOL DoLoopLength, BOOL UseBoth, int nthreads,
+                      int band, int maxhits, REAL minscore, 
+                      int seedlen, int seedhits, REAL margin, 
+                      BOOL Recall)
+   ---------------------------------------------------------------------
+   Input:   char     *listfile        File listing the queries
+            LIBRARY  *library         Library to scan
+            BOOL     GivenTopString   Queries are topology strings
+            BOOL     CalcSecStr       Queries are PDB files
+            int      SecStrCalculator Use Stride, DSSP or pdbsecstr
+            int      ELen             Minimum strand length
+            int      HLen             Minimum helix length
+            BOOL     Do3_10           Merge 3_10 helix with alpha helix
+            BOOL     PrimaryTopology  Primary topology only
+            BOOL     DoNeighbour      Add neighbour information
+            BOOL     DoAccess         Add accessibility information
+            BOOL     DoLength         Add element length information
+            BOOL     DoLoopLength     Add loop length information
+            BOOL     UseBoth          Percentages from both strings
+            int      nthreads         Number of threads to use
+            int      band             Band width (NOBAND or AUTOBAND)
+            int      maxhits          Most hits to print (0 for all)
+            REAL     minscore         Lowest score to print (or 
+                                      NOMINSCORE)
+            int      seedlen          Length of the seeds (0 to align
+                                      every entry)
+            int      seedhits         Seeds needed on a diagonal
+            REAL     margin           Margin for ScanClusters() (or 
+                                      NOMARGIN to scan the library 
+                                      flat)
+            BOOL     Recall           Report the recall of the seeds
+                                      or the clusters
+   Returns: BOOL                      Success?
+
+   Scans each query in a list against the library (-S). The list has a
+   query on each line: a secondary structure or PDB file or, with -t,
+   a topology string. Blank lines and lines starting with a ! or # are
+   skipped. The queries are read QUERYTILE at a time and scanned
+   together by ScanProbes() (or ScanClusters() given a margin), so each
+   few library entries are aligned
+   against all the queries of the tile while they are in the cache. 
+   The results for each query are printed as for -s after a line
+   giving the query:
+      # query
+   A query that cannot be read is skipped with a warning.
+
+   With Recall, each tile is scanned again without seeds or clusters
+   and the recall over all the queries is reported at the end.
+
+   17.10.26 Original   By: agent
+   17.10.26 Added seedlen, seedhits and Recall   By: agent
+   17.10.26 Added margin   By: agent
+*/
+BOOL ScanQueryList(char *listfile, LIBRARY *library, 
+                   BOOL GivenTopString, BOOL CalcSecStr, 
+                   int SecStrCalculator, int ELen, int HLen, 
+                   BOOL Do3_10, BOOL PrimaryTopology, BOOL DoNeighbour,
+                   BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength,
+                   BOOL UseBoth, int nthreads, int band, int maxhits,
+                   REAL minscore, int seedlen, int seedhits, 
+                   REAL margin, BOOL Recall)
+{
+   FILE       *fp;
+   TOPCODE    *tops[QUERYTILE];
+   SCANRESULT *results[QUERYTILE];
+   char       buffer[MAXBUFF],
+              query[MAXBUFF],
+              *names[QUERYTILE];
+   int        lengths[QUERYTILE],
+              *hits[QUERYTILE],
+              nhits[QUERYTILE],
+              nqueries,
+              nfound  = 0,
+              nwanted = 0,
+              q;
+   BOOL       ok   = TRUE,
+              more = TRUE;
+
+   if((fp=fopen(listfile,"r"))==NULL)
+   {
+      fprintf(stderr,"Can't read %s\n",listfile);
+      return(FALSE);
+   }
+   
+   while(ok && more)
+   {
+      /* Read the next tile of queries                                  */
+      nqueries = 0;
+      while((nqueries < QUERYTILE) && 
+            (more = (fgets(buffer,MAXBUFF,fp) != NULL)))
+      {
+         TERMINATE(buffer);
+         query[0] = '\0';
+         sscanf(buffer,"%s",query);
+         if(!query[0] || (query[0] == '!') || (query[0] == '#'))
+            continue;
+
+         if((names[nqueries] = (char *)malloc((1+strlen(query)) *
+                                              sizeof(char)))==NULL)
+         {
+            fprintf(stderr,"No memory for query %s\n", query);
+            ok = FALSE;
+            break;
+         }
+         strcpy(names[nqueries], query);
+         
+         if((tops[nqueries] = ReadQuery(query, GivenTopString, 
+                                        CalcSecStr, SecStrCalculator,
+                                        ELen, HLen, Do3_10,
+                                        PrimaryTopology, DoNeighbour,
+                                        DoAccess, DoLength, DoLoopLength,
+                                        &(lengths[nqueries])))==NULL)
+         {
+            fprintf(stderr,"Warning: unable to read topology from %s. \
+Skipped\n", query);
+            free(names[nqueries]);
+            continue;
+         }
+         nqueries++;
+      }
+
+      if(ok && nqueries && 
+         !((margin >= 0.0) ?
+           ScanClusters(tops, lengths, nqueries, library, UseBoth,
+                        PrimaryTopology, nthreads, band, maxhits, 
+                        minscore, margin, results, hits, nhits) :
+           ScanProbes(tops, lengths, nqueries, library, UseBoth,
+                      PrimaryTopology, nthreads, band, maxhits, minscore,
+                      seedlen, seedhits, NULL, NULL, results, hits, 
+                      nhits)))
+         ok = FALSE;
+      if(ok && nqueries && Recall &&
+         !ScanRecall(tops, lengths, nqueries, library, UseBoth,
+                     PrimaryTopology, nthreads, band, maxhits, minscore,
+                     hits, nhits, &nfound, &nwanted))
+         ok = FALSE;
+
+      for(q=0; q<nqueries; q++)
+      {
+         if(ok)
+         {
+            printf("# %s\n", names[q]);
+            ok = PrintScanResults(stdout, tops[q], lengths[q], library,
+                                  results[q], hits[q], nhits[q]);
+            free(results[q]);
+            FREE(hits[q]);
+         }
+         free(tops[q]);
+         free(names[q]);
+      }
+   }
+
+   if(ok && Recall)
+   {
+      fprintf(stderr,"Recall: found %d of the %d hits of a full scan \
+(%.1f%%)\n", nfound, nwanted,
+              ((nwanted > 0) ? (REAL)100.0 * nfound / nwanted : 100.0));
+   }
+
+   fclose(fp);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL StreamQueries(LIBRARY *library, BOOL UseBoth, 
+                      BOOL PrimaryTopology, int nthreads, int band,
+                      int maxhits, REAL minscore, int seedlen, 
+                      int seedhits, REAL margin)
+   ---------------------------------------------------------------------
+   Input:   LIBRARY  *library         Library to scan
+            BOOL     UseBoth          Percentages from both strings
+            BOOL     PrimaryTopology  Primary topology only
+            int      nthreads         Number of threads to use
+            int      band             Band width (NOBAND or AUTOBAND)
+            int      maxhits          Most hits to print (0 for all)
+            REAL     minscore         Lowest score to print (or 
+                                      NOMINSCORE)
+            int      seedlen          Length of the seeds (0 to align
+                                      every entry)
+            int      seedhits         Seeds needed on a diagonal
+            REAL     margin           Margin for ScanClusters() (or 
+                                      NOMARGIN to scan the library 
+                                      flat)
+   Returns: BOOL                      Success?
+
+   Scans queries read from stdin against the library until the end of
+   stdin (--stream), so a script can keep topscan open as a coprocess
+   and send it one query at a time. Each line is a query in the form of
+   a library line: a name and a topology string. Blank lines and lines 
+   starting with a ! or # are skipped. Each query is scanned as soon 
+   as it is read and its results are printed as for -S, after a line 
+   '# name', followed by a line:
+      //
+   stdout is then flushed so the caller can read the results before it
+   sends the next query.
+   A query whose topology string can't be read (see MakeCodeArray()),
+   or whose line is too long for the buffer, is skipped with a warning.
+   So that the caller is not left waiting, it is still answered, with a
+   line '! Unable to read topology' in place of the results.
+
+   17.10.26 Original   By: agent
+   17.10.26 Skips queries that can't be read   By: agent
+*/
+BOOL StreamQueries(LIBRARY *library, BOOL UseBoth, BOOL PrimaryTopology,
+                   int nthreads, int band, int maxhits, REAL minscore, 
+                   int seedlen, int seedhits, REAL margin)
+{
+   TOPCODE    *top;
+   SCANRESULT *results;
+   char       buffer[HUGEBUFF],
+              name[HUGEBUFF],
+              topstr[HUGEBUFF],
+              *ptr;
+   int        length,
+              *hits,
+              nhits,
+              c;
+   BOOL       ok = TRUE,
+              tooLong;
+
+   while(ok && (fgets(buffer,HUGEBUFF,stdin) != NULL))
+   {
+      /* Throw away the rest of a line that didn't fit                  */
+      tooLong = FALSE;
+      if((strchr(buffer,'\n') == NULL) && !feof(stdin))
+      {
+         tooLong = TRUE;
+         while(((c = getc(stdin)) != EOF) && (c != '\n'))
+            continue;
+      }
+
+      TERMINATE(buffer);
+
+      ptr = buffer;
+      while(*ptr == ' ' || *ptr == '\t')
+         ptr++;
+      if(!strlen(ptr) || (*ptr == '!') || (*ptr == '#'))
+         continue;
+
+      name[0]   = '\0';
+      topstr[0] = '\0';
+      sscanf(ptr,"%s %s",name,topstr);
+
+      if((top = (TOPCODE *)malloc((1+strlen(topstr)) * sizeof(TOPCODE)))
+         ==NULL)
+      {
+         fprintf(stderr,"No memory for query %s\n", name);
+         return(FALSE);
+      }
+      if(tooLong || ((length = MakeCodeArray(top, topstr)) < 0))
+      {
+         fprintf(stderr,"Warning: unable to read topology from %s. \
+Skipped\n", name);
+         printf("# %s\n! Unable to read topology\n//\n", name);
+         fflush(stdout);
+      }
+      else if(!((margin >= 0.0) ?
+                ScanClusters(&top, &length, 1, library, UseBoth, 
+                             PrimaryTopology, nthreads, band, maxhits,
+                             minscore, margin, &results, &hits, 
+                             &nhits) :
+                ScanProbes(&top, &length, 1, library, UseBoth,
+                           PrimaryTopology, nthreads, band, maxhits,
+                           minscore, seedlen, seedhits, NULL, NULL,
+                           &results, &hits, &nhits)))
+      {
+         ok = FALSE;
+      }
+      else
+      {
+         printf("# %s\n", name);
+         ok = PrintScanResults(stdout, top, length, library, results, 
+                               hits, nhits);
+         printf("//\n");
+         fflush(stdout);
+         free(results);
+         FREE(hits);
+      }
+      free(top);
+   }
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>TOPCODE *ReadQuery(char *query, BOOL GivenTopString, BOOL CalcSecStr,
+                      int SecStrCalculator, int ELen, int HLen, 
+                      BOOL Do3_10, BOOL PrimaryTopology, 
+                      BOOL DoNeighbour, BOOL DoAccess, BOOL DoLength,
+                      BOOL DoLoopLength, int *length)
+   ---------------------------------------------------------------------
+   Input:   char     *query           Topology string or file name
+            BOOL     GivenTopString   query is a topology string
+            BOOL     CalcSecStr       query is a PDB file
+            int      SecStrCalculator Use Stride, DSSP or pdbsecstr
+            int      ELen             Minimum strand length
+            int      HLen             Minimum helix length
+            BOOL     Do3_10           Merge 3_10 helix with alpha helix
+            BOOL     PrimaryTopology  Primary topology only
+            BOOL     DoNeighbour      Add neighbour information
+            BOOL     DoAccess         Add accessibility information
+            BOOL     DoLength         Add element length information
+            BOOL     DoLoopLength     Add loop length information
+   Output:  int      *length          Length of the topology string
+   Returns: TOPCODE  *                Topology string (NULL on error)
+
+   Builds the topology string for a query in a -S list just as main()
+   does for the probe of -s
+
+   17.10.26 Original   By: agent
+*/
+TOPCODE *ReadQuery(char *query, BOOL GivenTopString, BOOL CalcSecStr,
+                   int SecStrCalculator, int ELen, int HLen, 
+                   BOOL Do3_10, BOOL PrimaryTopology, BOOL DoNeighbour,
+                   BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength,
+                   int *length)
+{
+   FILE    *fp;
+   TOPCODE *top;
+   char    infile[MAXBUFF];
+   
+   if(GivenTopString)
+   {
+      if((top = (TOPCODE *)malloc((1+strlen(query)) * sizeof(TOPCODE)))
+         ==NULL)
+         return(NULL);
+      if((*length = MakeCodeArray(top, query)) < 0)
+      {
+         free(top);
+         return(NULL);
+      }
+      return(top);
+   }
+
+   if(strlen(query) >= MAXBUFF)
+      return(NULL);
+   strcpy(infile, query);
+   if(CalcSecStr)
+   {
+      sprintf(infile,"/tmp/file1.%d",(int)getpid());
+      RunSecStr(query, infile, SecStrCalculator);
+   }
+
+   top = NULL;
+   if((fp=fopen(infile,"r"))!=NULL)
+   {
+      top = ReadTopology(fp, ELen, HLen, SecStrCalculator, Do3_10,
+                         PrimaryTopology, DoNeighbour, DoAccess, 
+                         DoLength, DoLoopLength, length);
+      fclose(fp);
+   }
+   
+   if(CalcSecStr)
+      unlink(infile);
+   
+   return(top);
+}
+
+
+/************************************************************************/
+/*>BOOL ServeLibraries(char *socketfile, char **libfiles, 
+                       int nlibraries, BOOL GivenTopString, 
+                       BOOL CalcSecStr, int SecStrCalculator, int ELen,
+                       int HLen, BOOL Do3_10, BOOL PrimaryTopology, 
+                       BOOL DoNeighbour, BOOL DoAccess, BOOL DoLength,
+                       BOOL DoLoopLength, BOOL UseBoth, int nthreads,
+                       int band, int maxhits, REAL minscore, 
+                       int seedlen, int seedhits, REAL margin)
+   ---------------------------------------------------------------------
+   Input:   char     *socketfile      Unix domain socket to listen on
+            char     **libfiles       Libraries to scan
+            int      nlibraries       Number of libraries
+            BOOL     GivenTopString   Queries are topology strings
+            BOOL     CalcSecStr       Queries are PDB files
+            int      SecStrCalculator Use Stride, DSSP or pdbsecstr
+            int      ELen             Minimum strand length
+            int      HLen             Minimum helix length
+            BOOL     Do3_10           Merge 3_10 helix with alpha helix
+            BOOL     PrimaryTopology  Primary topology only
+            BOOL     DoNeighbour      Add neighbour information
+            BOOL     DoAccess         Add accessibility information
+            BOOL     DoLength         Add element length information
+            BOOL     DoLoopLength     Add loop length information
+            BOOL     UseBoth          Percentages from both strings
+            int      nthreads         Number of threads to use
+            int      band             Band width (NOBAND or AUTOBAND)
+            int      maxhits          Most hits to print (0 for all)
+            REAL     minscore         Lowest score to print (or 
+                                      NOMINSCORE)
+            int      seedlen          Length of the seeds (0 to align
+                                      every entry)
+            int      seedhits         Seeds needed on a diagonal
+            REAL     margin           Margin for ScanClusters() (or 
+                                      NOMARGIN to scan the libraries 
+                                      flat)
+   Returns: BOOL                      FALSE if the libraries or the 
+                                      socket could not be set up, or 
+                                      connections can no longer be 
+                                      accepted
+
+   Scans queries sent to a Unix domain socket against libraries that 
+   are read just once (--serve), so the matrix and the libraries stay in
+   memory between queries. This does not return unless there is an 
+   error; SIGINT or SIGTERM removes the socket and exits.
+
+   Each connection is read by a thread of its own (ServeClient()) which
+   builds the topology string of each query and queues it. A single
+   thread (ServeScans()) takes the queries from the queue a tile at a
+   time, so queries arriving together, from the same connection or from
+   different ones, are scanned together by ScanProbes() just as -S 
+   scans a list. The scan itself uses nthreads threads. The answers are
+   written by a further thread for each connection (ServeAnswers()), so
+   a client that is slow to read its answers holds up only itself.
+
+   17.10.26 Original   By: agent
+   17.10.26 Each connection has a thread writing its answers   By: agent
+*/
+BOOL ServeLibraries(char *socketfile, char **libfiles, int nlibraries,
+                    BOOL GivenTopString, BOOL CalcSecStr, 
+                    int SecStrCalculator, int ELen, int HLen, 
+                    BOOL Do3_10, BOOL PrimaryTopology, 
+                    BOOL DoNeighbour, BOOL DoAccess, BOOL DoLength,
+                    BOOL DoLoopLength, BOOL UseBoth, int nthreads,
+                    int band, int maxhits, REAL minscore, int seedlen,
+                    int seedhits, REAL margin)
+{
+   SERVER             server;
+   SERVECLIENT        *client;
+   FILE               *fp;
+   struct sockaddr_un address;
+   struct stat        info;
+   pthread_t          thread;
+   pthread_attr_t     attr;
+   int                sock,
+                      fd,
+                      lib,
+                      flags = TopologyFlags(Do3_10, PrimaryTopology,
+                                            DoNeighbour, DoAccess, 
+                                            DoLength, DoLoopLength);
+   BOOL               ok    = TRUE;
+
+   if(strlen(socketfile) >= sizeof(address.sun_path))
+   {
+      fprintf(stderr,"Socket name %s is too long\n", socketfile);
+      return(FALSE);
+   }
+
+   server.libraries        = (LIBRARY **)malloc(nlibraries * 
+                                                sizeof(LIBRARY *));
+   server.margins          = (REAL *)malloc(nlibraries * sizeof(REAL));
+   server.libnames         = libfiles;
+   server.nlibraries       = nlibraries;
+   server.head             = NULL;
+   server.tail             = NULL;
+   server.GivenTopString   = GivenTopString;
+   server.CalcSecStr       = CalcSecStr;
+   server.SecStrCalculator = SecStrCalculator;
+   server.ELen             = ELen;
+   server.HLen             = HLen;
+   server.Do3_10           = Do3_10;
+   server.PrimaryTopology  = PrimaryTopology;
+   server.DoNeighbour      = DoNeighbour;
+   server.DoAccess         = DoAccess;
+   server.DoLength         = DoLength;
+   server.DoLoopLength     = DoLoopLength;
+   server.UseBoth          = UseBoth;
+   server.nthreads         = nthreads;
+   server.band             = band;
+   server.maxhits          = maxhits;
+   server.minscore         = minscore;
+   server.seedlen          = seedlen;
+   server.seedhits         = seedhits;
+   if((server.libraries == NULL) || (server.margins == NULL))
+   {
+      fprintf(stderr,"No memory for the libraries\n");
+      return(FALSE);
+   }
+
+   /* Read the libraries                                                */
+   for(lib=0; ok && (lib<nlibraries); lib++)
+   {
+      if((fp=fopen(libfiles[lib],"r"))==NULL)
+      {
+         fprintf(stderr,"Can't read %s\n",libfiles[lib]);
+         ok = FALSE;
+      }
+      else
+      {
+         if((server.libraries[lib] = 
+             OpenLibrary(fp, libfiles[lib], !GivenTopString, ELen, HLen,
+                         flags))==NULL)
+            ok = FALSE;
+         fclose(fp);
+      }
+
+      server.margins[lib] = margin;
+      if(ok && (margin >= 0.0) && 
+         (server.libraries[lib]->clusterOf == NULL))
+      {
+         fprintf(stderr,"Warning: library %s has no clusters \
+(see --cluster). Every entry\n         will be aligned\n", 
+                 libfiles[lib]);
+         server.margins[lib] = NOMARGIN;
+      }
+   }
+   if(!ok)
+      return(FALSE);
+
+   /* Listen on the socket, replacing one left by an earlier server     */
+   if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+   {
+      perror("topscan: socket");
+      return(FALSE);
+   }
+   if(!stat(socketfile, &info) && S_ISSOCK(info.st_mode))
+      unlink(socketfile);
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   strcpy(address.sun_path, socketfile);
+   if(bind(sock, (struct sockaddr *)&address, sizeof(address)) ||
+      listen(sock, SOMAXCONN))
+   {
+      perror("topscan: bind");
+      close(sock);
+      return(FALSE);
+   }
+
+   /* A client hanging up must not kill the server, and the socket is
+      removed when the server is stopped
+   */
+   gSocketFile = socketfile;
+   signal(SIGPIPE, SIG_IGN);
+   signal(SIGINT,  StopServing);
+   signal(SIGTERM, StopServing);
+
+   pthread_mutex_init(&(server.mutex), NULL);
+   pthread_mutex_init(&(server.readMutex), NULL);
+   pthread_cond_init(&(server.queued), NULL);
+   pthread_attr_init(&attr);
+   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+   if(pthread_create(&thread, &attr, ServeScans, (void *)&server))
+   {
+      fprintf(stderr,"Unable to start the scan thread\n");
+      ok = FALSE;
+   }
+   else
+   {
+      fprintf(stderr,"Serving %d %s on %s\n", nlibraries,
+              ((nlibraries == 1) ? "library" : "libraries"), socketfile);
+   }
+
+   /* Give each connection a thread to read its queries                 */
+   while(ok)
+   {
+      if((fd = accept(sock, NULL, NULL)) < 0)
+      {
+         if((errno != EINTR) && (errno != ECONNABORTED))
+         {
+            perror("topscan: accept");
+            ok = FALSE;
+         }
+         continue;
+      }
+
+      client = NULL;
+      if(((client = (SERVECLIENT *)malloc(sizeof(SERVECLIENT)))==NULL) ||
+         ((client->in  = fdopen(fd, "r"))==NULL))
+      {
+         fprintf(stderr,"No memory for a connection\n");
+         FREE(client);
+         close(fd);
+         continue;
+      }
+      client->server     = &server;
+      client->out        = NULL;
+      client->answers    = NULL;
+      client->lastAnswer = NULL;
+      client->pending    = 0;
+      client->blocked    = FALSE;
+      client->reading    = TRUE;
+      pthread_cond_init(&(client->answered), NULL);
+      if(((fd = dup(fd)) < 0) || 
+         ((client->out = fdopen(fd, "w"))==NULL) ||
+         pthread_create(&thread, &attr, ServeClient, (void *)client))
+      {
+         fprintf(stderr,"Unable to start a thread for a connection\n");
+         if(client->out != NULL)
+            fclose(client->out);
+         else if(fd >= 0)
+            close(fd);
+         fclose(client->in);
+         pthread_cond_destroy(&(client->answered));
+         free(client);
+      }
+   }
+
+   close(sock);
+   unlink(socketfile);
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>void *ServeClient(void *arg)
+   ----------------------------
+   Input:   void   *arg      The SERVECLIENT for a connection
+   Returns: void   *         NULL
+
+   Thread reading the queries sent over a connection to --serve. Each 
+   line is a query as in a -S list (a secondary structure or PDB file 
+   or, with -t, a topology string), optionally followed by the library
+   to scan: its file name as given to --serve or its number counting 
+   from 1. The first library is scanned by default. Blank lines and 
+   lines starting with a ! or # are skipped.
+
+   With -p, a query that is not a plain file (see IsPlainFile()) is
+   refused, since its name would be passed to a shell. A line too long
+   for the buffer, or a query of MAXBUFF characters or more, is refused
+   and the rest of the line thrown away.
+
+   The topology string of each query is built (one query at a time, as
+   ReadTopology() is not thread-safe) and the query is queued for 
+   ServeScans(). The answers are written by ServeAnswers(), which is
+   started here. Reading stops while SERVEPENDING queries are waiting 
+   to be written, so a client that sends queries without reading the 
+   answers is held up rather than the answers being kept. Once the 
+   client has finished sending, the connection is closed when the last
+   of its answers has been written.
+
+   17.10.26 Original   By: agent
+   17.10.26 Queries for -p must be plain files   By: agent
+   17.10.26 Refuses overlong lines and queries   By: agent
+   17.10.26 Answers are written by ServeAnswers()   By: agent
+*/
+void *ServeClient(void *arg)
+{
+   SERVECLIENT *client = (SERVECLIENT *)arg;
+   SERVER      *server = client->server;
+   SERVEQUERY  *query;
+   pthread_t   writer;
+   char        buffer[HUGEBUFF],
+               name[HUGEBUFF],
+               libname[HUGEBUFF];
+   int         c;
+   BOOL        ok = TRUE,
+               tooLong;
+
+   if(pthread_create(&writer, NULL, ServeAnswers, (void *)client))
+   {
+      fprintf(stderr,"Unable to start a thread for a connection\n");
+      fclose(client->in);
+      fclose(client->out);
+      pthread_cond_destroy(&(client->answered));
+      free(client);
+      return(NULL);
+   }
+
+   while(ok && (fgets(buffer,HUGEBUFF,client->in) != NULL))
+   {
+      /* Throw away the rest of a line that didn't fit                  */
+      tooLong = FALSE;
+      if((strchr(buffer,'\n') == NULL) && !feof(client->in))
+      {
+         tooLong = TRUE;
+         while(((c = getc(client->in)) != EOF) && (c != '\n'))
+            continue;
+      }
+
+      TERMINATE(buffer);
+      name[0] = libname[0] = '\0';
+      sscanf(buffer,"%s %s",name,libname);
+      if(!name[0] || (name[0] == '!') || (name[0] == '#'))
+         continue;
+
+      if(((query = (SERVEQUERY *)malloc(sizeof(SERVEQUERY)))==NULL) ||
+         ((query->name = (char *)malloc((1+strlen(name)) * 
+                                        sizeof(char)))==NULL))
+      {
+         fprintf(stderr,"No memory for query %s\n", name);
+         FREE(query);
+         ok = FALSE;
+         continue;
+      }
+      strcpy(query->name, name);
+      query->next    = NULL;
+      query->client  = client;
+      query->error   = NULL;
+      query->top     = NULL;
+      query->results = NULL;
+      query->hits    = NULL;
+      query->nhits   = 0;
+      query->length  = 0;
+
+      /* The error is sent back when the query is answered. With -p the
+         query goes into a shell command, so it must be a file with a
+         plain name
+      */
+      if(tooLong || (strlen(name) >= MAXBUFF))
+      {
+         query->lib   = (-1);
+         query->error = "Query too long";
+      }
+      else if((query->lib = FindServeLibrary(server, libname)) < 0)
+      {
+         query->error = "No such library";
+      }
+      else if(server->CalcSecStr && !IsPlainFile(name))
+      {
+         fprintf(stderr,"Warning: query %s is not a plain file. \
+Skipped\n", name);
+         query->error = "Unable to read topology";
+      }
+      else
+      {
+         pthread_mutex_lock(&(server->readMutex));
+         query->top = ReadQuery(name, server->GivenTopString,
+                                server->CalcSecStr, 
+                                server->SecStrCalculator, server->ELen,
+                                server->HLen, server->Do3_10,
+                                server->PrimaryTopology,
+                                server->DoNeighbour, server->DoAccess,
+                                server->DoLength, server->DoLoopLength,
+                                &(query->length));
+         pthread_mutex_unlock(&(server->readMutex));
+         if(query->top == NULL)
+            query->error = "Unable to read topology";
+      }
+
+      pthread_mutex_lock(&(server->mutex));
+      while(client->pending >= SERVEPENDING)
+         pthread_cond_wait(&(client->answered), &(server->mutex));
+      if(server->tail == NULL)
+         server->head = query;
+      else
+         server->tail->next = query;
+      server->tail = query;
+      client->pending++;
+      pthread_cond_signal(&(server->queued));
+      pthread_mutex_unlock(&(server->mutex));
+   }
+
+   /* Wait for the answers to be written before hanging up              */
+   pthread_mutex_lock(&(server->mutex));
+   client->reading = FALSE;
+   pthread_cond_broadcast(&(client->answered));
+   pthread_mutex_unlock(&(server->mutex));
+   pthread_join(writer, NULL);
+
+   fclose(client->in);
+   fclose(client->out);
+   pthread_cond_destroy(&(client->answered));
+   free(client);
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>void *ServeScans(void *arg)
+   ---------------------------
+   Input:   void   *arg      The SERVER
+   Returns: void   *         NULL (never returns)
+
+   Thread scanning the queries queued by ServeClient(). The queries are
+   taken from the queue a tile at a time by TakeServeTile() and scanned 
+   together with ScanProbes(), or ScanClusters() given a margin. Each
+   query is then passed with its results to the ServeAnswers() thread 
+   of its connection, so the scans never wait for a client to read.
+
+   17.10.26 Original   By: agent
+   17.10.26 Sends the error set by ServeClient()   By: agent
+   17.10.26 Answers are written by ServeAnswers()   By: agent
+*/
+void *ServeScans(void *arg)
+{
+   SERVER     *server = (SERVER *)arg;
+   SERVEQUERY *tile[QUERYTILE];
+   TOPCODE    *tops[QUERYTILE];
+   SCANRESULT *results[QUERYTILE];
+   SERVECLIENT *client;
+   LIBRARY    *library;
+   int        lengths[QUERYTILE],
+              *hits[QUERYTILE],
+              nhits[QUERYTILE],
+              probe[QUERYTILE],         /* Probe of each query (or -1)  */
+              ntile,
+              nprobes,
+              lib,
+              q;
+   BOOL       ok;
+
+   for(;;)
+   {
+      pthread_mutex_lock(&(server->mutex));
+      while(server->head == NULL)
+         pthread_cond_wait(&(server->queued), &(server->mutex));
+      ntile = TakeServeTile(server, tile);
+      pthread_mutex_unlock(&(server->mutex));
+
+      /* The queries of a tile that can be scanned are all for the same
+         library
+      */
+      nprobes = 0;
+      lib     = (-1);
+      for(q=0; q<ntile; q++)
+      {
+         probe[q] = (-1);
+         if(tile[q]->top != NULL)
+         {
+            lib              = tile[q]->lib;
+            probe[q]         = nprobes;
+            tops[nprobes]    = tile[q]->top;
+            lengths[nprobes] = tile[q]->length;
+            nprobes++;
+         }
+      }
+
+      ok = TRUE;
+      if(nprobes)
+      {
+         library = server->libraries[lib];
+         ok = ((server->margins[lib] >= 0.0) ?
+               ScanClusters(tops, lengths, nprobes, library,
+                            server->UseBoth, server->PrimaryTopology,
+                            server->nthreads, server->band, 
+                            server->maxhits, server->minscore,
+                            server->margins[lib], results, hits, 
+                            nhits) :
+               ScanProbes(tops, lengths, nprobes, library, 
+                          server->UseBoth, server->PrimaryTopology,
+                          server->nthreads, server->band, 
+                          server->maxhits, server->minscore,
+                          server->seedlen, server->seedhits, NULL, NULL,
+                          results, hits, nhits));
+      }
+
+      for(q=0; q<ntile; q++)
+      {
+         if(probe[q] < 0)
+            continue;
+         if(ok)
+         {
+            tile[q]->results = results[probe[q]];
+            tile[q]->hits    = hits[probe[q]];
+            tile[q]->nhits   = nhits[probe[q]];
+         }
+         else
+         {
+            tile[q]->error = "No memory to scan the library";
+            FREE(results[probe[q]]);
+            FREE(hits[probe[q]]);
+         }
+      }
+
+      /* Hand the answers to the connections, in order                  */
+      pthread_mutex_lock(&(server->mutex));
+      for(q=0; q<ntile; q++)
+      {
+         client = tile[q]->client;
+         tile[q]->next = NULL;
+         if(client->lastAnswer == NULL)
+            client->answers = tile[q];
+         else
+            client->lastAnswer->next = tile[q];
+         client->lastAnswer = tile[q];
+         pthread_cond_broadcast(&(client->answered));
+      }
+      pthread_mutex_unlock(&(server->mutex));
+   }
+
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>void *ServeAnswers(void *arg)
+   -----------------------------
+   Input:   void   *arg      The SERVECLIENT for a connection
+   Returns: void   *         NULL
+
+   Thread writing the answers that ServeScans() passes to a connection
+   to --serve. The results for each query are written as for -S, after
+   a line '# query', and end with a line:
+      //
+   A query that could not be read, or asks for an unknown library, is
+   answered with a line starting '! ' saying so in place of the results.
+   The alignments for -v are built here rather than by ServeScans().
+
+   Returns once ServeClient() has read the last query and every answer
+   has been written.
+
+   17.10.26 Original (code taken from ServeScans())   By: agent
+*/
+void *ServeAnswers(void *arg)
+{
+   SERVECLIENT *client = (SERVECLIENT *)arg;
+   SERVER      *server = client->server;
+   SERVEQUERY  *query,
+               *next;
+   FILE        *out    = client->out;
+   int         nwritten;
+
+   for(;;)
+   {
+      pthread_mutex_lock(&(server->mutex));
+      while((client->answers == NULL) && 
+            (client->reading || client->pending))
+         pthread_cond_wait(&(client->answered), &(server->mutex));
+      query              = client->answers;
+      client->answers    = NULL;
+      client->lastAnswer = NULL;
+      pthread_mutex_unlock(&(server->mutex));
+
+      if(query == NULL)
+         break;
+
+      for(nwritten=0; query!=NULL; query=next, nwritten++)
+      {
+         next = query->next;
+         fprintf(out,"# %s\n", query->name);
+         if(query->error != NULL)
+            fprintf(out,"! %s\n", query->error);
+         else if(!PrintScanResults(out, query->top, query->length,
+                                   server->libraries[query->lib],
+                                   query->results, query->hits,
+                                   query->nhits))
+            fprintf(out,"! No memory to scan the library\n");
+         fprintf(out,"//\n");
+         fflush(out);
+
+         FREE(query->results);
+         FREE(query->hits);
+         FREE(query->top);
+         free(query->name);
+         free(query);
+      }
+
+      /* Let ServeClient() read more queries or hang up                 */
+      pthread_mutex_lock(&(server->mutex));
+      client->pending -= nwritten;
+      pthread_cond_broadcast(&(client->answered));
+      pthread_mutex_unlock(&(server->mutex));
+   }
+
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>int TakeServeTile(SERVER *server, SERVEQUERY **tile)
+   ----------------------------------------------------
+   I/O:     SERVER     *server    The server whose queue is taken from
+   Output:  SERVEQUERY **tile     The queries taken (QUERYTILE long)
+   Returns: int                   Number of queries taken
+
+   Takes up to QUERYTILE queries from the queue of --serve for 
+   ServeScans() to answer together. The queries to be scanned must all
+   be for the same library: that of the first such query in the queue.
+   Queries that cannot be scanned are taken with them. A query is left
+   in the queue if it is for another library, as is every later query 
+   from the same connection so that each connection gets its answers in
+   the order it sent the queries. The server's mutex must be held.
+
+   17.10.26 Original   By: agent
+*/
+int TakeServeTile(SERVER *server, SERVEQUERY **tile)
+{
+   SERVEQUERY *query,
+              *next,
+              *prev  = NULL;
+   int        ntile  = 0,
+              lib    = (-1);
+
+   for(query=server->head; (query!=NULL) && (ntile<QUERYTILE);
+       query=next)
+   {
+      next = query->next;
+      if(!query->client->blocked &&
+         ((query->top == NULL) || (lib < 0) || (query->lib == lib)))
+      {
+         if(query->top != NULL)
+            lib = query->lib;
+         
+         if(prev == NULL)
+            server->head = next;
+         else
+            prev->next = next;
+         if(server->tail == query)
+            server->tail = prev;
+         tile[ntile++] = query;
+      }
+      else
+      {
+         query->client->blocked = TRUE;
+         prev = query;
+      }
+   }
+
+   for(query=server->head; query!=NULL; query=query->next)
+      query->client->blocked = FALSE;
+
+   return(ntile);
+}
+
+
+/************************************************************************/
+/*>int FindServeLibrary(SERVER *server, char *libname)
+   ---------------------------------------------------
+   Input:   SERVER  *server    The server
+            char    *libname   A library file as given to --serve, its
+                               number counting from 1, or empty for the
+                               first
+   Returns: int                Index of the library (-1 if there is no
+                               such library)
+
+   Finds the library a query sent to --serve asks for
+
+   17.10.26 Original   By: agent
+*/
+int FindServeLibrary(SERVER *server, char *libname)
+{
+   int  lib;
+   char junk;
+   
+   if(libname[0] == '\0')
+      return(0);
+   
+   for(lib=0; lib<server->nlibraries; lib++)
+   {
+      if(!strcmp(libname, server->libnames[lib]))
+         return(lib);
+   }
+
+   if((sscanf(libname,"%d%c",&lib,&junk) == 1) && 
+      (lib >= 1) && (lib <= server->nlibraries))
+      return(lib-1);
+   
+   return(-1);
+}
+
+
+/************************************************************************/
+/*>BOOL IsPlainFile(char *filename)
+   --------------------------------
+   Input:   char   *filename    File name sent to --serve
+   Returns: BOOL                Is it an existing regular file whose 
+                                name is safe to give to a shell?
+
+   Checks a query sent to --serve before RunSecStr() puts it in a 
+   command for system(). The name may only hold letters, digits and
+   the characters / . _ - + and may not start with a -
+
+   17.10.26 Original   By: agent
+*/
+BOOL IsPlainFile(char *filename)
+{
+   struct stat info;
+   char        *chp;
+
+   if((filename[0] == '\0') || (filename[0] == '-'))
+      return(FALSE);
+   
+   for(chp=filename; *chp; chp++)
+   {
+      if(!isalnum((int)(unsigned char)*chp) && 
+         (strchr("/._-+", *chp) == NULL))
+         return(FALSE);
+   }
+
+   return(!stat(filename, &info) && S_ISREG(info.st_mode));
+}
+
+
+/************************************************************************/
+/*>void StopServing(int sig)
+   -------------------------
+   Input:   int    sig           The signal caught
+   Globals: char   *gSocketFile  Socket --serve is listening on
+
+   Signal handler stopping --serve. Removes the socket and exits
+
+   17.10.26 Original   By: agent
+*/
+void StopServing(int sig)
+{
+   if(gSocketFile != NULL)
+      unlink(gSocketFile);
+   _exit(0);
+}
+
+
+/************************************************************************/
+/*>BOOL WriteAllVsAll(char *libfile, char *outfile, BOOL UseBoth, 
+                      BOOL PrimaryTopology, int nthreads, int band,
+                      int lshlen, int lshbands, int lshrows, 
+                      int lshmargin, BOOL Recall, REAL minscore)
+   ---------------------------------------------------------------------
+   Input:   char  *libfile         Topology library
+            char  *outfile         All-vs-all matrix file to write
+            BOOL  UseBoth          Percentages from both strings
+            BOOL  PrimaryTopology  Primary topology only
+            int   nthreads         Number of threads to use
+            int   band             Band width (NOBAND or AUTOBAND)
+            int   lshlen           Length of the k-mers for --lsh (0 to
+                                   align every pair)
+            int   lshbands         Bands of the LSH sketches
+            int   lshrows          Rows in each band
+            int   lshmargin        Rows of a band that may differ
+            BOOL  Recall           Report the recall of --lsh
+            REAL  minscore         Lowest score counted for the recall
+   Returns: BOOL                   Success?
+
+   Scores every entry of a library (text or compiled) against every
+   other and writes the percentages as a binary matrix: a TOPMHEADER, a
+   TOPMENTRY for each entry in library order, the names and then, from
+   header->rows, a row of nentries cells for each entry in library 
+   order. Cell j of row i is the score of entry i as the probe against
+   entry j, as -s would print it, times TOPM_SCALE. Cells are unsigned
+   shorts, so a row can be read by seeking to rows + i * nentries * 2
+   without reading the rest. Entries skipped by a band score 0. Like a
+   compiled library, the file is only meant to be read on the sort of
+   machine that wrote it.
+
+   The entries are taken QUERYTILE at a time in order of length as the
+   probes of ScanProbes(), so each few entries of the library are 
+   aligned against the whole tile while they are in the cache and the
+   threads share out the library as they do for -s.
+
+   If SymmetricScores() says that the alignment score of a pair is the
+   same both ways round, each tile is only aligned against the entries
+   from its first probe on in the order of length: one triangle of the
+   matrix plus the tile itself. Each score then fills both cells of the
+   pair, the percentage of the reverse cell being worked out with the
+   entries swapped. With -B auto, the band of a pair is then that of 
+   the shorter entry. Otherwise every pair is aligned both ways.
+
+   The library is grouped by GroupLibrary() and only the entry standing
+   for each class is used as a probe. The best score over the 
+   orientations of the probe is the same for any entry of its class, so
+   its row is copied to the other entries of the class.
+
+   The file is mapped into memory as it is written since the cells for
+   an entry are filled as it is reached both as a probe and as a 
+   library entry. The alignments are done by AllVsAllTiles().
+
+   Given lshlen, only the pairs found by FindLSHPartners() are aligned
+   and the other cells are left as 0. This is a heuristic for 
+   clustering; pairs that would score well may be missed. The number of
+   pairs found is reported and, with Recall, every pair is then aligned
+   again to count how many of the cells scoring at least minscore were
+   filled.
+
+   17.10.26 Original   By: agent
+   17.10.26 Only uses one entry of each class as a probe   By: agent
+   17.10.26 Added --lsh and Recall. Moved the alignments to 
+            AllVsAllTiles()   By: agent
+*/
+BOOL WriteAllVsAll(char *libfile, char *outfile, BOOL UseBoth, 
+                   BOOL PrimaryTopology, int nthreads, int band,
+                   int lshlen, int lshbands, int lshrows, int lshmargin,
+                   BOOL Recall, REAL minscore)
+{
+   FILE           *fp;
+   LIBRARY        *library;
+   TOPMHEADER     *header;
+   TOPMENTRY      *topmentries;
+   unsigned short *cells;
+   char           *map,
+                  *names;
+   int            **partners = NULL,
+                  *order,
+                  nentries,
+                  norder,
+                  i, fd;
+   long           namesize = 0,
+                  naligned = 0,
+                  npairs   = 0,
+                  nfound   = 0,
+                  nwanted  = 0;
+   size_t         rows,
+                  size;
+   BOOL           symmetric,
+                  ok       = TRUE;
+
+   if((fp=fopen(libfile,"r"))==NULL)
+   {
+      fprintf(stderr,"Can't read %s\n",libfile);
+      return(FALSE);
+   }
+   library = OpenLibrary(fp, libfile, FALSE, 0, 0, 0);
+   fclose(fp);
+   if(library == NULL)
+      return(FALSE);
+   
+   nentries = library->nentries;
+   GroupLibrary(library, PrimaryTopology);
+   norder   = library->nclasses;
+   if((order = SortByLength(library))==NULL)
+   {
+      fprintf(stderr,"No memory to sort library %s\n",libfile);
+      FreeLibrary(library);
+      return(FALSE);
+   }
+
+   /* The rows start on an 8 byte boundary after the names              */
+   for(i=0; i<nentries; i++)
+      namesize += strlen(library->entries[i].name) + 1;
+   rows = sizeof(TOPMHEADER) + (size_t)nentries * sizeof(TOPMENTRY) +
+          (size_t)namesize;
+   rows = (rows + 7) & ~((size_t)7);
+   if((namesize > INT_MAX) || (rows > INT_MAX) ||
+      (nentries && ((size_t)nentries > 
+                    (((size_t)-1) - rows) / sizeof(unsigned short) /
+                    (size_t)nentries)))
+   {
+      fprintf(stderr,"Library %s is too big for an all-vs-all \
+matrix\n", libfile);
+      free(order);
+      FreeLibrary(library);
+      return(FALSE);
+   }
+   size = rows + (size_t)nentries * (size_t)nentries * 
+                 sizeof(unsigned short);
+
+   /* Make the file full size and map it. The cells start as 0          */
+   map = (char *)MAP_FAILED;
+   if((fd = open(outfile, O_RDWR | O_CREAT | O_TRUNC, 0666)) >= 0)
+   {
+      if((lseek(fd, (off_t)(size-1), SEEK_SET) == (off_t)(size-1)) &&
+         (write(fd, "", 1) == 1))
+         map = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, 
+                            MAP_SHARED, fd, 0);
+      close(fd);
+   }
+   if(map == (char *)MAP_FAILED)
+   {
+      fprintf(stderr,"Can't write %s\n",outfile);
+      if(fd >= 0)
+         unlink(outfile);
+      free(order);
+      FreeLibrary(library);
+      return(FALSE);
+   }
+
+   header      = (TOPMHEADER *)map;
+   topmentries = (TOPMENTRY *)(map + sizeof(TOPMHEADER));
+   names       = (char *)(topmentries + nentries);
+   cells       = (unsigned short *)(map + rows);
+
+   memcpy(header->magic, TOPM_MAGIC, 4);
+   header->version         = TOPM_VERSION;
+   header->nentries        = nentries;
+   header->cellsize        = (int)sizeof(unsigned short);
+   header->scale           = TOPM_SCALE;
+   header->UseBoth         = (int)UseBoth;
+   header->PrimaryTopology = (int)PrimaryTopology;
+   header->band            = band;
+   header->namesize        = (int)namesize;
+   header->rows            = (int)rows;
+   header->lsh             = lshlen;
+
+   namesize = 0;
+   for(i=0; i<nentries; i++)
+   {
+      topmentries[i].name   = (int)namesize;
+      topmentries[i].length = library->entries[i].length;
+      strcpy(names + namesize, library->entries[i].name);
+      namesize += strlen(library->entries[i].name) + 1;
+   }
+
+   if(!(symmetric = SymmetricScores(PrimaryTopology)))
+   {
+      fprintf(stderr,"Warning: the matrix does not score pairs the \
+same both ways round so\n         every pair will be aligned both \
+ways\n");
+   }
+
+   if(lshlen > 0)
+   {
+      if((partners = FindLSHPartners(library, order, norder, 
+                                     PrimaryTopology, symmetric, lshlen,
+                                     lshbands, lshrows, lshmargin, 
+                                     &npairs))==NULL)
+      {
+         fprintf(stderr,"No memory for the LSH pairs\n");
+         ok = FALSE;
+      }
+      else
+      {
+         fprintf(stderr,"LSH: found %ld of the %ld pairs of different \
+classes (%.1f%%)\n", npairs, (long)norder * (long)(norder - 1) / 2,
+                 ((norder > 1) ? 
+                  (REAL)200.0 * npairs / ((REAL)norder * (norder-1)) :
+                  0.0));
+      }
+   }
+
+   if(ok)
+      ok = AllVsAllTiles(library, order, cells, UseBoth, 
+                         PrimaryTopology, nthreads, band, symmetric, 
+                         partners, minscore, &naligned, NULL, NULL);
+   if(ok && Recall)
+   {
+      long nexact;
+      
+      if((ok = AllVsAllTiles(library, order, cells, UseBoth, 
+                             PrimaryTopology, nthreads, band, symmetric,
+                             NULL, minscore, &nexact, &nfound, 
+                             &nwanted)))
+      {
+         fprintf(stderr,"Recall: filled %ld of the %ld cells scoring at \
+least %g (%.1f%%) aligning %ld of %ld pairs\n", nfound, nwanted, minscore,
+                 ((nwanted > 0) ? (REAL)100.0 * nfound / nwanted : 100.0),
+                 naligned, nexact);
+      }
+   }
+   if(partners != NULL)
+   {
+      free(partners[0]);
+      free(partners);
+   }
+
+   if(munmap(map, size))
+      ok = FALSE;
+   if(ok)
+   {
+      fprintf(stderr,"Aligned %ld pairs for the %ld cells of the \
+matrix\n", naligned, (long)nentries * (long)nentries);
+   }
+   else
+   {
+      fprintf(stderr,"Error writing %s\n",outfile);
+      unlink(outfile);
+   }
+
+   free(order);
+   FreeLibrary(library);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL AllVsAllTiles(LIBRARY *library, int *order, 
+                      unsigned short *cells, BOOL UseBoth, 
+                      BOOL PrimaryTopology, int nthreads, int band,
+                      BOOL symmetric, int **partners, REAL minscore,
+                      long *naligned, long *nfound, long *nwanted)
+   ---------------------------------------------------------------------
+   Input:   LIBRARY        *library        Library to compare with itself
+            int            *order          Entries in order of length 
+                                           from SortByLength()
+            BOOL           UseBoth         Percentages from both strings
+            BOOL           PrimaryTopology Primary topology only
+            int            nthreads        Number of threads to use
+            int            band            Band width (NOBAND or 
+                                           AUTOBAND)
+            BOOL           symmetric       Align each pair one way round
+            int            **partners      For each position in order[],
+                                           the entries to align it 
+                                           against from 
+                                           FindLSHPartners() (or NULL 
+                                           for all of them)
+            REAL           minscore        Lowest score counted by 
+                                           nfound and nwanted
+   I/O:     unsigned short *cells          The cells of the matrix
+   Output:  long           *naligned       Pairs aligned
+            long           *nfound         With nwanted, the cells of
+                                           at least minscore that hold
+                                           the right score (or NULL)
+            long           *nwanted        Cells of other entries of at
+                                           least minscore (or NULL to 
+                                           fill the cells)
+   Returns: BOOL                           Success?
+
+   Does the alignments of WriteAllVsAll(), taking the entries 
+   QUERYTILE at a time as the probes of ScanProbes(). If symmetric, 
+   each tile is only aligned against the entries from its first probe
+   on and each score fills both cells of the pair. Each score is copied
+   to the cells of the other entries of the two classes.
+
+   Given nwanted, the cells are not filled. Instead each cell of 
+   different entries scoring at least minscore is counted, in nfound 
+   as well if the cell already holds its score. This measures the 
+   recall of the pairs from --lsh. Each cell is only counted once, 
+   although the pairs within a tile are aligned both ways round.
+
+   17.10.26 Original (code taken from WriteAllVsAll())   By: agent
+*/
+BOOL AllVsAllTiles(LIBRARY *library, int *order, unsigned short *cells,
+                   BOOL UseBoth, BOOL PrimaryTopology, int nthreads, 
+                   int band, BOOL symmetric, int **partners, 
+                   REAL minscore, long *naligned, long *nfound, 
+                   long *nwanted)
+{
+   LIBENTRY       *entry1,
+                  *entry2;
+   TOPCODE        *tops[QUERYTILE];
+   SCANRESULT     *results[QUERYTILE],
+                  *result;
+   unsigned short cell;
+   int            lengths[QUERYTILE],
+                  starts[QUERYTILE],
+                  *tilePartners[QUERYTILE],
+                  *hits[QUERYTILE],
+                  nhits[QUERYTILE],
+                  nentries = library->nentries,
+                  norder   = library->nclasses,
+                  nprobes,
+                  first, pos, q, i, j;
+   size_t         cellij, cellji;
+
+   *naligned = 0;
+   for(first=0; first<norder; first+=QUERYTILE)
+   {
+      nprobes = MIN(QUERYTILE, norder - first);
+      for(q=0; q<nprobes; q++)
+      {
+         entry1          = &(library->entries[order[first+q]]);
+         tops[q]         = entry1->top;
+         lengths[q]      = entry1->length;
+         starts[q]       = (symmetric ? first : 0);
+         tilePartners[q] = ((partners != NULL) ? 
+                            partners[first+q] : NULL);
+      }
+
+      if(!ScanProbes(tops, lengths, nprobes, library, UseBoth, 
+                     PrimaryTopology, nthreads, band, 0, NOMINSCORE,
+                     0, 0, starts, ((partners != NULL) ? 
+                                    tilePartners : NULL),
+                     results, hits, nhits))
+         return(FALSE);
+
+      for(q=0; q<nprobes; q++)
+      {
+         for(pos=starts[q]; pos<norder; pos++)
+         {
+            if(results[q][order[pos]].skipped)
+               continue;
+            (*naligned)++;
+
+            /* Each entry of the probe's class against each entry of 
+               this one's
+            */
+            for(i=order[first+q]; i>=0; 
+                i=((library->nextMember != NULL) ? 
+                   library->nextMember[i] : (-1)))
+            {
+               entry1 = &(library->entries[i]);
+               for(j=order[pos]; j>=0; 
+                   j=((library->nextMember != NULL) ? 
+                      library->nextMember[j] : (-1)))
+               {
+                  result = &(results[q][j]);
+                  cellij = (size_t)i * nentries + j;
+                  cellji = (size_t)j * nentries + i;
+                  cell   = PercentCell(result->score, result->IDScore);
+                  if(nwanted == NULL)
+                     cells[cellij] = cell;
+                  else if((i != j) && 
+                          (!symmetric || (pos >= first+q)) &&
+                          ((REAL)cell >= minscore * TOPM_SCALE))
+                  {
+                     (*nwanted)++;
+                     if(cells[cellij] == cell)
+                        (*nfound)++;
+                  }
+                  
+                  if(symmetric)
+                  {
+                     entry2 = &(library->entries[j]);
+                     cell   = PercentCell(result->score,
+                                          CombineIDScores(
+                                             entry2->selfScore, 
+                                             entry2->length,
+                                             entry1->selfScore,
+                                             entry1->length, 
+                                             UseBoth));
+                     if(nwanted == NULL)
+                        cells[cellji] = cell;
+                     else if((i != j) && (pos > first+q) &&
+                             ((REAL)cell >= minscore * TOPM_SCALE))
+                     {
+                        (*nwanted)++;
+                        if(cells[cellji] == cell)
+                           (*nfound)++;
+                     }
+                  }
+               }
+            }
+         }
+         free(results[q]);
+      }
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>int **FindLSHPartners(LIBRARY *library, int *order, int norder,
+                         BOOL PrimaryTopology, BOOL symmetric, 
+                         int lshlen, int nbands, int nrows, int margin,
+                         long *npairs)
+   ---------------------------------------------------------------------
+   Input:   LIBRARY  *library         Library to compare with itself
+            int      *order           Entries in order of length from
+                                      SortByLength()
+            int      norder           Number of entries in order[]
+            BOOL     PrimaryTopology  Primary topology only
+            BOOL     symmetric        Pairs are aligned one way round
+            int      lshlen           Length of the k-mers
+            int      nbands           Bands of the sketches
+            int      nrows            Rows in each band
+            int      margin           Rows of a band that may differ
+   Output:  long     *npairs          Number of pairs found
+   Returns: int      **               For each position in order[], the
+                                      library entries to align it 
+                                      against, ending with -1. The lists
+                                      are in one block from [0] (NULL if
+                                      no memory)
+
+   Locality sensitive hashing for --all-vs-all --lsh. Each entry is 
+   sketched by SketchEntry() as nbands * nrows MinHash values of its set
+   of k-mers. The sketches are cut into nbands bands of nrows values and
+   two entries are a candidate pair if any band is the same in both, 
+   which happens with probability 1 - (1 - J^nrows)^nbands for a 
+   Jaccard similarity J of their k-mer sets. 
+
+   The margin lets up to that many rows of a band differ: each band is 
+   hashed once for each way of leaving out margin of its rows and a pair
+   is found if any of these match. An entry too short to have any 
+   k-mers is paired with every entry.
+
+   Each entry's list starts with the entry itself. If the scores are 
+   symmetric, a pair is only listed for the entry that comes first in
+   order[], so the lists suit the triangle that WriteAllVsAll() aligns.
+
+   17.10.26 Original   By: agent
+*/
+int **FindLSHPartners(LIBRARY *library, int *order, int norder,
+                      BOOL PrimaryTopology, BOOL symmetric, int lshlen,
+                      int nbands, int nrows, int margin, long *npairs)
+{
+   unsigned int *sketches = NULL,
+                *sketch,
+                key;
+   LSHKEY       *keys     = NULL;
+   LSHPAIR      *pairs    = NULL;
+   TOPCODE      *best     = NULL;
+   BOOL         *sketched = NULL;
+   int          **partners = NULL,
+                *count    = NULL,
+                *block,
+                nhash     = nbands * nrows,
+                nrot      = (PrimaryTopology ? 1 : NROTATIONS),
+                nkeys,
+                mask, band,
+                first, a, b, k, n, p, r;
+   long         maxpairs  = 0,
+                nfound    = 0,
+                total;
+   BOOL         ok        = FALSE;
+
+   *npairs = 0;
+   if(((sketches = (unsigned int *)malloc(((norder ? norder : 1) * 
+                                           nhash) *
+                                          sizeof(unsigned int)))!=NULL) &&
+      ((sketched = (BOOL *)malloc((norder ? norder : 1) * sizeof(BOOL)))
+       !=NULL) &&
+      ((keys     = (LSHKEY *)malloc((norder ? norder : 1) * 
+                                    sizeof(LSHKEY)))!=NULL) &&
+      ((count    = (int *)calloc((norder ? norder : 1), sizeof(int)))
+       !=NULL) &&
+      ((best     = (TOPCODE *)malloc(lshlen * sizeof(TOPCODE)))!=NULL))
+      ok = TRUE;
+
+   for(p=0; ok && (p<norder); p++)
+   {
+      sketched[p] = SketchEntry(&(library->entries[order[p]]), lshlen, 
+                                nrot, nhash, best, sketches + p*nhash);
+   }
+
+   /* Find the pairs sharing a band. Each band is keyed once for each
+      mask of margin rows to leave out
+   */
+   for(band=0; ok && (band<nbands); band++)
+   {
+      for(mask=0; ok && (mask<(1<<nrows)); mask++)
+      {
+         n = 0;
+         for(r=0; r<nrows; r++)
+         {
+            if(mask & (1<<r))
+               n++;
+         }
+         if(n != margin)
+            continue;
+
+         nkeys = 0;
+         for(p=0; p<norder; p++)
+         {
+            if(!sketched[p])
+               continue;
+            sketch = sketches + p*nhash + band*nrows;
+            key    = 2166136261U;
+            for(r=0; r<nrows; r++)
+            {
+               if(!(mask & (1<<r)))
+               {
+                  key ^= sketch[r];
+                  key *= 16777619U;
+               }
+            }
+            keys[nkeys].key = key;
+            keys[nkeys].pos = p;
+            nkeys++;
+         }
+         qsort(keys, nkeys, sizeof(LSHKEY), CompareLSHKeys);
+
+         /* Every pair in a run of the same key                         */
+         for(first=0; ok && (first<nkeys); first=k)
+         {
+            k = first + 1;
+            while((k < nkeys) && (keys[k].key == keys[first].key))
+               k++;
+            for(a=first; ok && (a<k); a++)
+            {
+               for(b=a+1; ok && (b<k); b++)
+                  ok = AddLSHPair(&pairs, &nfound, &maxpairs, 
+                                  keys[a].pos, keys[b].pos);
+            }
+         }
+      }
+   }
+
+   /* Entries with no k-mers are paired with everything                 */
+   for(p=0; ok && (p<norder); p++)
+   {
+      if(sketched[p])
+         continue;
+      for(n=0; ok && (n<norder); n++)
+      {
+         if((n != p) && (sketched[n] || (n > p)))
+            ok = AddLSHPair(&pairs, &nfound, &maxpairs, MIN(n, p), 
+                            MAX(n, p));
+      }
+   }
+
+   if(ok)
+   {
+      /* Drop the pairs found more than once                            */
+      if(nfound)
+         qsort(pairs, nfound, sizeof(LSHPAIR), CompareLSHPairs);
+      total = 0;
+      for(k=0; k<nfound; k++)
+      {
+         if((total == 0) || (pairs[k].a != pairs[total-1].a) || 
+            (pairs[k].b != pairs[total-1].b))
+            pairs[total++] = pairs[k];
+      }
+      nfound = total;
+
+      /* Room for the lists: the entry itself, its partners and -1      */
+      total = 2 * (long)norder;
+      for(k=0; k<nfound; k++)
+      {
+         count[pairs[k].a]++;
+         if(!symmetric)
+            count[pairs[k].b]++;
+         total += (symmetric ? 1 : 2);
+      }
+      if((total > INT_MAX) ||
+         ((partners = (int **)malloc((norder ? norder : 1) * 
+                                     sizeof(int *)))==NULL) ||
+         ((block = (int *)malloc((total ? total : 1) * sizeof(int)))
+          ==NULL))
+      {
+         FREE(partners);
+         ok = FALSE;
+      }
+   }
+
+   if(ok)
+   {
+      for(p=0; p<norder; p++)
+      {
+         partners[p]    = block;
+         block         += count[p] + 2;
+         partners[p][0] = order[p];
+         count[p]       = 1;
+      }
+      for(k=0; k<nfound; k++)
+      {
+         a = pairs[k].a;
+         b = pairs[k].b;
+         partners[a][count[a]++] = order[b];
+         if(!symmetric)
+            partners[b][count[b]++] = order[a];
+      }
+      for(p=0; p<norder; p++)
+         partners[p][count[p]] = (-1);
+      *npairs = nfound;
+   }
+
+   FREE(sketches);
+   FREE(sketched);
+   FREE(keys);
+   FREE(pairs);
+   FREE(count);
+   FREE(best);
+   return(ok ? partners : NULL);
+}
+
+
+/************************************************************************/
+/*>BOOL SketchEntry(LIBENTRY *entry, int lshlen, int nrot, int nhash,
+                    TOPCODE *best, unsigned int *sketch)
+   ------------------------------------------------------------------
+   Input:   LIBENTRY     *entry   Library entry
+            int          lshlen   Length of the k-mers
+            int          nrot     Orientations to consider
+            int          nhash    Number of MinHash values
+            TOPCODE      *best    Workspace of lshlen codes
+   Output:  unsigned int *sketch  The nhash MinHash values
+   Returns: BOOL                  Does the entry have any k-mers?
+
+   Builds the MinHash sketch of the set of k-mers of an entry for 
+   FindLSHPartners(). Each k-mer is taken in its canonical orientation,
+   the lowest of its nrot orientations as in GroupLibrary(), so that 
+   the set does not depend on how the structure is oriented. Value h of
+   the sketch is the lowest over the k-mers of the k-mer's SeedHash()
+   mixed by MixHash() with a constant for h.
+
+   17.10.26 Original   By: agent
+*/
+BOOL SketchEntry(LIBENTRY *entry, int lshlen, int nrot, int nhash,
+                 TOPCODE *best, unsigned int *sketch)
+{
+   TOPCODE      *top;
+   unsigned int hash,
+                value;
+   int          h, j, k, rot;
+
+   for(h=0; h<nhash; h++)
+      sketch[h] = UINT_MAX;
+   if(entry->length < lshlen)
+      return(FALSE);
+
+   for(j=0; j+lshlen<=entry->length; j++)
+   {
+      top = entry->top + j;
+      memcpy(best, top, lshlen * sizeof(TOPCODE));
+      for(rot=1; rot<nrot; rot++)
+      {
+         k = 0;
+         while((k < lshlen) && (gRotation[rot][top[k]] == best[k]))
+            k++;
+         if((k < lshlen) && (gRotation[rot][top[k]] < best[k]))
+         {
+            for(; k<lshlen; k++)
+               best[k] = gRotation[rot][top[k]];
+         }
+      }
+
+      hash = SeedHash(best, lshlen);
+      for(h=0; h<nhash; h++)
+      {
+         value = MixHash(hash ^ ((unsigned int)(h+1) * 2654435769U));
+         if(value < sketch[h])
+            sketch[h] = value;
+      }
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>unsigned int MixHash(unsigned int hash)
+   ---------------------------------------
+   Input:   unsigned int hash     A 32-bit value
+   Returns: unsigned int          The value with its bits mixed
+
+   The finalizer of MurmurHash3, used to make each value of a MinHash 
+   sketch a different hash of the k-mers
+
+   17.10.26 Original   By: agent
+*/
+unsigned int MixHash(unsigned int hash)
+{
+   hash ^= hash >> 16;
+   hash *= 0x85EBCA6BU;
+   hash ^= hash >> 13;
+   hash *= 0xC2B2AE35U;
+   hash ^= hash >> 16;
+   
+   return(hash);
+}
+
+
+/************************************************************************/
+/*>BOOL AddLSHPair(LSHPAIR **pairs, long *npairs, long *maxpairs, 
+                   int a, int b)
+   --------------------------------------------------------------
+   I/O:     LSHPAIR  **pairs      Pairs found so far
+            long     *npairs      Number of pairs
+            long     *maxpairs    Space in pairs[]
+   Input:   int      a            Position of the first entry
+            int      b            Position of the second
+   Returns: BOOL                  Success?
+
+   Adds a pair to those found by FindLSHPartners(), doubling the space
+   as needed
+
+   17.10.26 Original   By: agent
+*/
+BOOL AddLSHPair(LSHPAIR **pairs, long *npairs, long *maxpairs, 
+                int a, int b)
+{
+   LSHPAIR *more;
+   
+   if(*npairs == *maxpairs)
+   {
+      *maxpairs = (*maxpairs ? 2 * *maxpairs : SEEDCHUNK);
+      if((more = (LSHPAIR *)realloc(*pairs, *maxpairs * sizeof(LSHPAIR)))
+         ==NULL)
+         return(FALSE);
+      *pairs = more;
+   }
+   (*pairs)[*npairs].a = a;
+   (*pairs)[*npairs].b = b;
+   (*npairs)++;
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>int CompareLSHKeys(const void *key1, const void *key2)
+   ------------------------------------------------------
+   Input:   const void  *key1     Pointer to an LSHKEY
+            const void  *key2     Pointer to an LSHKEY
+   Returns: int                   -1, 0 or 1 as the first key sorts 
+                                  before, the same as, or after the 
+                                  second
+
+   qsort() comparison for FindLSHPartners(). Sorts on the key and then
+   on the position so that each pair found has the earlier position 
+   first.
+
+   17.10.26 Original   By: agent
+*/
+int CompareLSHKeys(const void *key1, const void *key2)
+{
+   LSHKEY *k1 = (LSHKEY *)key1,
+          *k2 = (LSHKEY *)key2;
+
+   if(k1->key != k2->key)
+      return((k1->key < k2->key) ? -1 : 1);
+   if(k1->pos != k2->pos)
+      return((k1->pos < k2->pos) ? -1 : 1);
+   return(0);
+}
+
+
+/************************************************************************/
+/*>int CompareLSHPairs(const void *pair1, const void *pair2)
+   ---------------------------------------------------------
+   Input:   const void  *pair1    Pointer to an LSHPAIR
+            const void  *pair2    Pointer to an LSHPAIR
+   Returns: int                   -1, 0 or 1 as the first pair sorts 
+                                  before, the same as, or after the 
+                                  second
+
+   qsort() comparison for FindLSHPartners(). Sorts on the first entry
+   and then the second.
+
+   17.10.26 Original   By: agent
+*/
+int CompareLSHPairs(const void *pair1, const void *pair2)
+{
+   LSHPAIR *p1 = (LSHPAIR *)pair1,
+           *p2 = (LSHPAIR *)pair2;
+
+   if(p1->a != p2->a)
+      return((p1->a < p2->a) ? -1 : 1);
+   if(p1->b != p2->b)
+      return((p1->b < p2->b) ? -1 : 1);
+   return(0);
+}
+
+
+/************************************************************************/
+/*>SCANRESULT *ScanLibrary(TOPCODE *top1, int length1, LIBRARY *library,
+                           BOOL UseBoth, BOOL PrimaryTopology, 
+                           int nthreads, int band, int maxhits, 
+                           REAL minscore, int seedlen, int seedhits,
+                           REAL margin, int **hits, int *nhits)
+   ------------------------------------------------------------------
+   Input:   TOPCODE    *top1           Probe topology string
+            int        length1         Length of top1
+            LIBRARY    *library        Library to scan
+            BOOL       UseBoth         Percentages from both strings
+            BOOL       PrimaryTopology Primary topology only
+            int        nthreads        Number of threads to use
+            int        band            Band width (or NOBAND)
+            int        maxhits         Most hits to keep (0 for no 
+                                       limit)
+            REAL       minscore        Lowest score to keep (or 
+                                       NOMINSCORE)
+            int        seedlen         Length of the seeds (0 to align
+                                       every entry)
+            int        seedhits        Seeds needed on a diagonal
+            REAL       margin          Margin for ScanClusters() (or 
+                                       NOMARGIN to scan the library 
+                                       flat)
+   Output:  int        **hits          Library indices of the hits kept,
+                                       best first (NULL if every entry
+                                       is wanted)
+            int        *nhits          Number of hits
+   Returns: SCANRESULT *               Array of results, one for each
+                                       library entry in library order
+                                       (NULL on error)
+
+   Aligns the probe against every entry in the library with 
+   ScanProbes(), or a level at a time with ScanClusters() if a margin
+   is given
+
+   17.10.26 Original   By: agent
+   17.10.26 Builds the SIMD profile   By: agent
+   17.10.26 Added batches. Works through the entries in length order   By: agent
+   17.10.26 Added band   By: agent
+   17.10.26 Walks the library as a trie if there is no SIMD profile   By: agent
+   17.10.26 Takes TOPCODE strings with their lengths   By: agent
+   17.10.26 Added maxhits, minscore, hits and nhits   By: agent
+   17.10.26 Prunes entries that cannot reach the hits   By: agent
+   17.10.26 Works out the self-score of the probe   By: agent
+   17.10.26 The work is now done by ScanProbes()   By: agent
+   17.10.26 Added seedlen and seedhits   By: agent
+   17.10.26 Added margin   By: agent
+*/
+SCANRESULT *ScanLibrary(TOPCODE *top1, int length1, LIBRARY *library,
+                        BOOL UseBoth, BOOL PrimaryTopology, int nthreads,
+                        int band, int maxhits, REAL minscore, int seedlen,
+                        int seedhits, REAL margin, int **hits, 
+                        int *nhits)
+{
+   SCANRESULT *results;
+
+   if(margin >= 0.0)
+   {
+      if(!ScanClusters(&top1, &length1, 1, library, UseBoth, 
+                       PrimaryTopology, nthreads, band, maxhits, 
+                       minscore, margin, &results, hits, nhits))
+         return(NULL);
+   }
+   else if(!ScanProbes(&top1, &length1, 1, library, UseBoth, 
+                       PrimaryTopology, nthreads, band, maxhits, 
+                       minscore, seedlen, seedhits, NULL, NULL, &results,
+                       hits, nhits))
+   {
+      return(NULL);
+   }
+   
+   return(results);
+}
+
+
+/************************************************************************/
+/*>BOOL ScanClusters(TOPCODE **tops, int *lengths, int nprobes, 
+                     LIBRARY *library, BOOL UseBoth, 
+                     BOOL PrimaryTopology, int nthreads, int band, 
+                     int maxhits, REAL minscore, REAL margin, 
+                     SCANRESULT **results, int **hits, int *nhits)
+   ---------------------------------------------------------------------
+   Input:   TOPCODE    **tops          Probe topology strings
+            int        *lengths        Length of each probe
+            int        nprobes         Number of probes (no more than
+                                       QUERYTILE)
+            LIBRARY    *library        Clustered library to scan
+            BOOL       UseBoth         Percentages from both strings
+            BOOL       PrimaryTopology Primary topology only
+            int        nthreads        Number of threads to use
+            int        band            Band width (NOBAND or AUTOBAND)
+            int        maxhits         Most hits to keep (0 for no 
+                                       limit)
+            REAL       minscore        Lowest score to keep (or 
+                                       NOMINSCORE)
+            REAL       margin          How far below the worst hit the
+                                       entry standing for a cluster may
+                                       score for the cluster to be 
+                                       searched
+   Output:  SCANRESULT **results       As for ScanProbes()
+            int        **hits          As for ScanProbes()
+            int        *nhits          As for ScanProbes()
+   Returns: BOOL                       Success?
+
+   Scans a library clustered by ClusterLibrary() a level at a time 
+   (--hierarchical). The probes are first scanned with ScanProbes() 
+   against just the entries standing for the clusters. Of these, the 
+   worst of the best maxhits that reach minscore is a bar (minscore 
+   if there are fewer). Only the clusters whose entry scores within 
+   margin of the bar, or is outside the band, are searched: the probe
+   is then scanned against the rest of their entries and the hits of 
+   the two scans are merged. This is a heuristic, as a member of a 
+   cluster may score better against the probe than the entry standing
+   for it. The clusters searched and the alignments avoided are 
+   reported for each probe.
+
+   17.10.26 Original   By: agent
+*/
+BOOL ScanClusters(TOPCODE **tops, int *lengths, int nprobes, 
+                  LIBRARY *library, BOOL UseBoth, BOOL PrimaryTopology,
+                  int nthreads, int band, int maxhits, REAL minscore,
+                  REAL margin, SCANRESULT **results, int **hits, 
+                  int *nhits)
+{
+   SCANRESULT *memberResults[QUERYTILE],
+              *result;
+   HITHEAP    heaps[QUERYTILE];
+   BOOL       *isHead   = NULL,
+              *searched = NULL,
+              ok        = FALSE;
+   REAL       bar;
+   int        *heads    = NULL,
+              *members  = NULL,
+              *partners[QUERYTILE],
+              *memberHits[QUERYTILE],
+              nmemberHits[QUERYTILE],
+              nmembers[QUERYTILE],
+              nsearched[QUERYTILE],
+              nentries  = library->nentries,
+              nheads    = 0,
+              head, i, n, q;
+
+   for(q=0; q<nprobes; q++)
+   {
+      results[q]      = NULL;
+      hits[q]         = NULL;
+      nhits[q]        = 0;
+      heaps[q].hits   = NULL;
+      heaps[q].nhits  = 0;
+      heaps[q].size   = 0;
+      heaps[q].maxhits = maxhits;
+   }
+
+   /* The clusters are of classes and stood for by classes             */
+   GroupLibrary(library, PrimaryTopology);
+   if(((isHead   = (BOOL *)calloc((nentries ? nentries : 1), 
+                                  sizeof(BOOL)))!=NULL) &&
+      ((searched = (BOOL *)calloc((nentries ? nentries : 1), 
+                                  sizeof(BOOL)))!=NULL) &&
+      ((heads    = (int *)malloc((library->nclasses + 1) * 
+                                 sizeof(int)))!=NULL) &&
+      ((members  = (int *)malloc(nprobes * (library->nclasses + 1) *
+                                 sizeof(int)))!=NULL))
+   {
+      for(i=0; i<nentries; i++)
+      {
+         if(REPRESENTS(library, i))
+            isHead[CLASSOF(library, library->clusterOf[i])] = TRUE;
+      }
+      for(i=0; i<nentries; i++)
+      {
+         if(isHead[i])
+            heads[nheads++] = i;
+      }
+      heads[nheads] = (-1);
+      for(q=0; q<nprobes; q++)
+         partners[q] = heads;
+
+      ok = ScanProbes(tops, lengths, nprobes, library, UseBoth, 
+                      PrimaryTopology, nthreads, band, 0, NOMINSCORE,
+                      0, 0, NULL, partners, results, memberHits, 
+                      nmemberHits);
+   }
+   else
+   {
+      fprintf(stderr,"No memory for the clusters\n");
+   }
+
+   /* Keep the best hits among the heads and search the clusters whose
+      head scores near enough the worst of them
+   */
+   for(q=0; ok && (q<nprobes); q++)
+   {
+      for(i=0; ok && (i<nentries); i++)
+      {
+         result = &(results[q][i]);
+         if(isHead[CLASSOF(library, i)] && !result->skipped &&
+            (HitScore(result) >= minscore) &&
+            !(ok = OfferHit(&(heaps[q]), results[q], i)))
+            fprintf(stderr,"No memory for scan hits\n");
+      }
+      
+      bar = minscore;
+      if((maxhits > 0) && (heaps[q].nhits == maxhits))
+         bar = MAX(bar, HitScore(&(results[q][heaps[q].hits[0]])));
+
+      nsearched[q] = 0;
+      for(n=0; n<nheads; n++)
+      {
+         result = &(results[q][heads[n]]);
+         searched[heads[n]] = (result->skipped || (bar <= NOMINSCORE) ||
+                               (HitScore(result) >= bar - margin));
+         if(searched[heads[n]])
+            nsearched[q]++;
+      }
+
+      partners[q] = members + q * (library->nclasses + 1);
+      nmembers[q] = 0;
+      for(i=0; i<nentries; i++)
+      {
+         if(REPRESENTS(library, i) && !isHead[i])
+         {
+            head = CLASSOF(library, library->clusterOf[i]);
+            if(searched[head])
+               partners[q][nmembers[q]++] = i;
+         }
+      }
+      partners[q][nmembers[q]] = (-1);
+   }
+   
+   if(ok && 
+      ScanProbes(tops, lengths, nprobes, library, UseBoth, 
+                 PrimaryTopology, nthreads, band, maxhits, minscore, 0,
+                 0, NULL, partners, memberResults, memberHits, 
+                 nmemberHits))
+   {
+      /* Merge the results and hits of the members with those of the 
+         heads
+      */
+      for(q=0; q<nprobes; q++)
+      {
+         for(i=0; ok && (i<nentries); i++)
+         {
+            if(!isHead[CLASSOF(library, i)])
+               results[q][i] = memberResults[q][i];
+         }
+         for(n=0; ok && (n<nmemberHits[q]); n++)
+            ok = OfferHit(&(heaps[q]), results[q], memberHits[q][n]);
+         if(ok && 
+            ((hits[q] = MergeHits(&(heaps[q]), 1, maxhits, results[q], 
+                                  &(nhits[q])))==NULL))
+            ok = FALSE;
+         free(memberResults[q]);
+         FREE(memberHits[q]);
+
+         if(ok)
+         {
+            n = library->nclasses - (nheads + nmembers[q]);
+            fprintf(stderr,"Clusters: searched %d of %d clusters; \
+avoided %d of %d alignments\n", nsearched[q], nheads, n, 
+                    library->nclasses);
+         }
+      }
+      if(!ok)
+         fprintf(stderr,"No memory for scan hits\n");
+   }
+   else
+   {
+      ok = FALSE;
+   }
+   
+   if(!ok)
+   {
+      for(q=0; q<nprobes; q++)
+      {
+         FREE(results[q]);
+         FREE(hits[q]);
+         nhits[q] = 0;
+      }
+   }
+   for(q=0; q<nprobes; q++)
+      FREE(heaps[q].hits);
+   FREE(isHead);
+   FREE(searched);
+   FREE(heads);
+   FREE(members);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL ScanRecall(TOPCODE **tops, int *lengths, int nprobes, 
+                   LIBRARY *library, BOOL UseBoth, BOOL PrimaryTopology,
+                   int nthreads, int band, int maxhits, REAL minscore,
+                   int **hits, int *nhits, int *nfound, int *nwanted)
+   ---------------------------------------------------------------------
+   Input:   TOPCODE    **tops          Probe topology strings
+            int        *lengths        Length of each probe
+            int        nprobes         Number of probes (no more than
+                                       QUERYTILE)
+            LIBRARY    *library        Library scanned
+            BOOL       UseBoth         Percentages from both strings
+            BOOL       PrimaryTopology Primary topology only
+            int        nthreads        Number of threads to use
+            int        band            Band width (NOBAND or AUTOBAND)
+            int        maxhits         Most hits kept (0 for no limit)
+            REAL       minscore        Lowest score kept (or 
+                                       NOMINSCORE)
+            int        **hits          For each probe, the hits found 
+                                       by a scan with seeds or clusters
+            int        *nhits          Number of hits for each probe
+   I/O:     int        *nfound         Incremented by the hits of a 
+                                       full scan that are in hits
+            int        *nwanted        Incremented by the hits of a 
+                                       full scan
+   Returns: BOOL                       Success?
+
+   Measures the recall of --seed or --hierarchical by scanning the 
+   probes again against every entry in the band and counting how many
+   of the hits of this full scan were also found
+
+   17.10.26 Original   By: agent
+   17.10.26 Also used for --hierarchical   By: agent
+*/
+BOOL ScanRecall(TOPCODE **tops, int *lengths, int nprobes, 
+                LIBRARY *library, BOOL UseBoth, BOOL PrimaryTopology,
+                int nthreads, int band, int maxhits, REAL minscore,
+                int **hits, int *nhits, int *nfound, int *nwanted)
+{
+   SCANRESULT *fullResults[QUERYTILE];
+   BOOL       *found;
+   int        *fullHits[QUERYTILE],
+              nfullHits[QUERYTILE],
+              n, q;
+
+   if(!ScanProbes(tops, lengths, nprobes, library, UseBoth,
+                  PrimaryTopology, nthreads, band, maxhits, minscore,
+                  0, 0, NULL, NULL, fullResults, fullHits, nfullHits))
+      return(FALSE);
+
+   if((found = (BOOL *)calloc((library->nentries ? library->nentries : 1),
+                              sizeof(BOOL)))==NULL)
+   {
+      fprintf(stderr,"No memory for recall\n");
+      for(q=0; q<nprobes; q++)
+      {
+         free(fullResults[q]);
+         FREE(fullHits[q]);
+      }
+      return(FALSE);
+   }
+
+   for(q=0; q<nprobes; q++)
+   {
+      for(n=0; n<nhits[q]; n++)
+         found[hits[q][n]] = TRUE;
+      for(n=0; n<nfullHits[q]; n++)
+      {
+         if(found[fullHits[q][n]])
+            (*nfound)++;
+      }
+      *nwanted += nfullHits[q];
+      for(n=0; n<nhits[q]; n++)
+         found[hits[q][n]] = FALSE;
+
+      free(fullResults[q]);
+      FREE(fullHits[q]);
+   }
+
+   free(found);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL ScanProbes(TOPCODE **tops, int *lengths, int nprobes, 
+                   LIBRARY *library, BOOL UseBoth, BOOL PrimaryTopology,
+                   int nthreads, int band, int maxhits, REAL minscore,
+                   int seedlen, int seedhits, int *starts, 
+                   int **partners, SCANRESULT **results, int **hits, 
+                   int *nhits)
+   ---------------------------------------------------------------------
+   Input:   TOPCODE    **tops          Probe topology strings
+            int        *lengths        Length of each probe
+            int        nprobes         Number of probes
+            LIBRARY    *library        Library to scan
+            BOOL       UseBoth         Percentages from both strings
+            BOOL       PrimaryTopology Primary topology only
+            int        nthreads        Number of threads to use
+            int        band            Band width (NOBAND or AUTOBAND
+                                       for a band from each probe's
+                                       length)
+            int        maxhits         Most hits to keep (0 for no 
+                                       limit)
+            REAL       minscore        Lowest score to keep (or 
+                                       NOMINSCORE)
+            int        seedlen         Length of the seeds (0 to align
+                                       every entry)
+            int        seedhits        Seeds needed on a diagonal
+            int        *starts         For each probe, the first entry
+                                       in the SortByLength() order to 
+                                       align it against (or NULL for 
+                                       all of them)
+            int        **partners      For each probe, the library 
+                                       entries to align it against, 
+                                       ending with -1 (or NULL for all
+                                       of them)
+   Output:  SCANRESULT **results       For each probe, an array of 
+                                       results, one for each library
+                                       entry in library order
+            int        **hits          For each probe, the library 
+                                       indices of the hits kept, best
+                                       first (NULL if every entry is
+                                       wanted)
+            int        *nhits          Number of hits for each probe
+   Returns: BOOL                       Success?
+
+   Aligns each probe against every entry in the library. The library is
+   split into one contiguous range for each thread. A thread works
+   through its own range a few entries at a time and, when it runs out,
+   steals the second half of whichever range has most left so that a
+   few very long entries do not leave the other threads idle. Each few
+   entries are aligned against all the probes in turn while they are in
+   the cache. Results are stored by library index so the order is not 
+   affected by the threading.
+
+   If the machine has SIMD support and the matrix has no negative scores
+   (which the striped scoring relies on), a striped profile of each 
+   probe is built once here and shared by all the threads. If the 
+   scores also fit in a byte, a batch profile is built too and the 
+   entries are aligned a batch at a time with ScanBatch(). The entries
+   are worked through in order of length so that a batch has entries of
+   similar length.
+
+   Without the SIMD profiles, and if there is no band, the entries are
+   put in the order of a depth-first walk of a trie of their reversed
+   topology strings (see SortBySuffix()) and aligned a run at a time
+   with ScanTrie(). Entries ending in the same codes then share the 
+   columns of the alignment matrix for those codes. A thread starts each
+   run afresh, so a run is a large chunk of the walk.
+
+   With a band, entries whose length differs from the probe's by more
+   than the band are skipped. Since the entries are sorted by length,
+   the ones that are left are a single run of the sorted order and only
+   the runs of the probes are shared out. The number of DP cells filled
+   is reported against the number a full scan would fill.
+
+   If maxhits or minscore is given, only the best hits are wanted. Each
+   thread keeps those it finds in a heap of its own (see KeepHits()) so
+   that no lock is needed, and the heaps are merged once the threads 
+   have finished.
+
+   Those heaps also let a thread skip entries that cannot make the best
+   hits. An entry cannot score more than its codes would if each were 
+   paired with the element of the probe it suits best (see 
+   ScoreBound()), so if that bound is below minscore, or below the 
+   worst hit in any thread's full heap, the entry is not aligned. The
+   number of entries and orientations skipped is reported.
+
+   Given starts, each probe is only aligned against the entries from
+   its start in the order of length, the rest being skipped as if they
+   were outside the band. This lets WriteAllVsAll() do one triangle of
+   the library against itself. The order of a trie walk cannot be used
+   then, and the band and pruning are not reported since they are for
+   just part of the library.
+
+   The library is grouped by GroupLibrary() and just the entry standing
+   for each class is put in the order and aligned. ShareResults() 
+   copies its result to the rest of the class, so the results and hits
+   cover every entry. The band and pruning reports count classes.
+
+   Given seedlen, the library is indexed by IndexLibrary() and only the
+   entries that FindCandidates() finds enough seeds for are aligned, 
+   the rest being skipped as if they were outside the band. This is a
+   heuristic: an entry that would score well may have too few seeds. 
+   If there is no memory for the index, every entry is aligned. The 
+   number of entries aligned is reported.
+
+   Given partners, each probe is only aligned against the entries 
+   listed for it, which must stand for their classes. The others are
+   skipped as if they were outside the band. This is used for the pairs
+   found by FindLSHPartners() and the levels of ScanClusters(). The 
+   band and pruning are not reported then either.
+
+   17.10.26 Original (code taken from ScanLibrary())   By: agent
+   17.10.26 Added starts   By: agent
+   17.10.26 Only aligns one entry of each class of the library   By: agent
+   17.10.26 Added seedlen and seedhits   By: agent
+   17.10.26 Added partners   By: agent
+   17.10.26 Chunks are several batches long when entries are left out
+            By: agent
+*/
+BOOL ScanProbes(TOPCODE **tops, int *lengths, int nprobes, 
+                LIBRARY *library, BOOL UseBoth, BOOL PrimaryTopology,
+                int nthreads, int band, int maxhits, REAL minscore,
+                int seedlen, int seedhits, int *starts, 
+                int **partners, SCANRESULT **results, int **hits, 
+                int *nhits)
+{
+   SCANJOB    *jobs       = NULL,
+              *job;
+   SCANTHREAD *threadargs = NULL;
+   WORKRANGE  *ranges     = NULL;
+   pthread_t  *threads    = NULL;
+   int        *order      = NULL,
+              *shared     = NULL,
+              i, q,
+              nstarted    = 0,
+              nunits,
+              chunk,
+              lanes       = 0,
+              first, last,
+              nentries    = library->nentries,
+              norder,
+              nrot        = (PrimaryTopology ? 1 : NROTATIONS),
+              nscored,
+              length2;
+   long       nspan       = 0,
+              nkept       = 0;
+   REAL       cells, allCells;
+   BOOL       Error       = FALSE,
+              useTrie;
+
+   /* Entries in the same class score the same, so only the one standing
+      for each class need be aligned. This is only an optimization so if
+      there is no memory for the classes, we just carry on without
+   */
+   GroupLibrary(library, PrimaryTopology);
+   norder = library->nclasses;
+
+   if((seedlen > 0) && !IndexLibrary(library, seedlen))
+      fprintf(stderr,"Warning: No memory for the seed index. Every \
+entry will be aligned\n");
+
+   if(nthreads < 1)
+      nthreads = 1;
+   if(nthreads > norder)
+      nthreads = (norder ? norder : 1);
+
+   for(q=0; q<nprobes; q++)
+   {
+      results[q] = NULL;
+      hits[q]    = NULL;
+      nhits[q]   = 0;
+   }
+
+   if(((jobs       = (SCANJOB *)calloc(nprobes, sizeof(SCANJOB)))
+       ==NULL) ||
+      ((ranges     = (WORKRANGE *)malloc(nthreads * sizeof(WORKRANGE)))
+       ==NULL) ||
+      ((threads    = (pthread_t *)malloc(nthreads * sizeof(pthread_t)))
+       ==NULL) ||
+      ((threadargs = (SCANTHREAD *)malloc(nthreads * sizeof(SCANTHREAD)))
+       ==NULL) ||
+      ((order      = SortByLength(library))==NULL))
+   {
+      fprintf(stderr,"No memory for scan threads\n");
+      FREE(jobs);
+      FREE(ranges);
+      FREE(threads);
+      FREE(threadargs);
+      FREE(order);
+      return(FALSE);
+   }
+
+   /* Without the SIMD kernels (and with no band, which depends on where
+      a column is in the entry) the entries are aligned by walking a 
+      trie of the library. The entries are put in the order of the walk
+   */
+   useTrie = ((band == NOBAND) && (starts == NULL) &&
+              !(SIMDLanes() && (gMDMMin >= 0)));
+   if(useTrie)
+   {
+      int *trieOrder = NULL;
+      
+      if(((shared    = (int *)malloc((nentries ? nentries : 1) *
+                                     sizeof(int)))!=NULL) &&
+         ((trieOrder = SortBySuffix(library, shared))!=NULL))
+      {
+         free(order);
+         order = trieOrder;
+      }
+      else
+      {
+         FREE(shared);
+         useTrie = FALSE;
+      }
+   }
+   chunk = (useTrie ? TRIECHUNK : SCANCHUNK);
+
+   first = norder;
+   last  = 0;
+   for(q=0; q<nprobes; q++)
+   {
+      job = &(jobs[q]);
+      pthread_mutex_init(&(job->mutex), NULL);
+      if(Error)
+         continue;
+      
+      job->top1            = tops[q];
+      job->length1         = lengths[q];
+      job->self1           = SelfScore(tops[q], lengths[q]);
+      job->library         = library;
+      job->order           = order;
+      job->shared          = shared;
+      job->ranges          = ranges;
+      job->nthreads        = nthreads;
+      job->UseBoth         = UseBoth;
+      job->PrimaryTopology = PrimaryTopology;
+      job->band            = band;
+      job->minscore        = minscore;
+      job->bar             = minscore;
+      job->Error           = &Error;
+      if(band == AUTOBAND)
+         job->band = MAX(AUTOBAND_MIN, job->length1 / AUTOBAND_FRACTION);
+
+      if(((job->results = (SCANRESULT *)malloc((nentries ? nentries : 1)
+                                               * sizeof(SCANRESULT)))
+          ==NULL) ||
+         (((maxhits > 0) || (minscore > NOMINSCORE)) &&
+          ((job->heaps = (HITHEAP *)calloc(nthreads, sizeof(HITHEAP)))
+           ==NULL)))
+      {
+         fprintf(stderr,"No memory for scan results\n");
+         Error = TRUE;
+         continue;
+      }
+      if(job->heaps != NULL)
+      {
+         for(i=0; i<nthreads; i++)
+            job->heaps[i].maxhits = maxhits;
+
+         /* Without this we just align every entry                      */
+         if(job->length1 > 0)
+            job->bestScores = BuildBestScores(job->top1, job->length1,
+                                              nrot);
+      }
+
+      /* The profiles are only an optimization so if there is no memory
+         for them, we just carry on without
+      */
+      if(SIMDLanes() && (gMDMMin >= 0) && (job->length1 > 0))
+      {
+         job->profile = BuildSIMDProfile(job->top1, job->length1, nrot);
+         if((job->profile != NULL) && (gMDMMax < BATCHMAXSCORE) &&
+            (SIMDBatchLanes() <= MAXBATCHLANES))
+         {
+            job->batch = BuildSIMDBatchProfile(job->top1, job->length1,
+                                               nrot);
+            if(job->batch != NULL)
+               chunk = lanes = job->batch->lanes;
+         }
+      }
+      if(useTrie && (job->length1 > 0))
+         job->trie = BuildTrieProfile(job->top1, job->length1, nrot);
+
+      /* Find the run of entries with lengths in the band               */
+      job->first = 0;
+      job->last  = norder;
+      if(job->band != NOBAND)
+      {
+         while((job->first < norder) && 
+               (library->entries[order[job->first]].length < 
+                job->length1 - job->band))
+            job->first++;
+         job->last = job->first;
+         while((job->last < norder) && 
+               (library->entries[order[job->last]].length <= 
+                job->length1 + job->band))
+            job->last++;
+      }
+      if((starts != NULL) && (starts[q] > job->first))
+      {
+         job->first = MIN(starts[q], norder);
+         job->last  = MAX(job->last, job->first);
+      }
+
+      for(i=0; i<norder; i++)
+      {
+         job->results[order[i]].skipped = ((i < job->first) || 
+                                           (i >= job->last));
+         job->results[order[i]].pruned  = FALSE;
+      }
+
+      job->ncandidates = (-1);
+      if((seedlen > 0) && (library->seeds != NULL))
+         job->ncandidates = FindCandidates(job, seedhits);
+
+      /* Skip all but the partners, using pruned to mark them, and then
+         close the run up round them
+      */
+      if((partners != NULL) && (partners[q] != NULL))
+      {
+         for(i=job->first; i<job->last; i++)
+            job->results[order[i]].pruned = TRUE;
+         for(i=0; partners[q][i] >= 0; i++)
+            job->results[partners[q][i]].pruned = FALSE;
+         for(i=job->first; i<job->last; i++)
+         {
+            if(job->results[order[i]].pruned)
+            {
+               job->results[order[i]].skipped  = TRUE;
+               job->results[order[i]].score    = 0;
+               job->results[order[i]].rotation = 0;
+            }
+         }
+         while((job->first < job->last) &&
+               job->results[order[job->first]].skipped)
+            job->first++;
+         while((job->last > job->first) &&
+               job->results[order[job->last-1]].skipped)
+            job->last--;
+      }
+      first = MIN(first, job->first);
+      last  = MAX(last,  job->last);
+
+      /* Count the entries left to align in the run                     */
+      nspan += job->last - job->first;
+      for(i=job->first; i<job->last; i++)
+      {
+         if(!job->results[order[i]].skipped)
+            nkept++;
+      }
+      
+      for(i=0; i<nentries; i++)
+      {
+         if(!REPRESENTS(library, i))
+            job->results[i] = job->results[library->classOf[i]];
+      }
+   }
+   if(first > last)
+      first = last;
+
+   if(!Error)
+   {
+      /* When the seeds or partners leave entries out, a chunk is made 
+         several batches long so that the batches can be filled with the
+         rest
+      */
+      if(lanes && nkept)
+         chunk = lanes * MIN(SPARSEBATCHES, MAX(1, (int)(nspan / nkept)));
+      
+      /* Give each thread an equal share of the entries to start with. 
+         The shares are whole chunks so that batches stay full
+      */
+      for(q=0; q<nprobes; q++)
+         jobs[q].chunk = chunk;
+      nunits = (last - first + chunk - 1) / chunk;
+      for(i=0; i<nthreads; i++)
+      {
+         pthread_mutex_init(&(ranges[i].mutex), NULL);
+         ranges[i].next = first + chunk * 
+                          (int)(((long)nunits * i) / nthreads);
+         ranges[i].end  = MIN(last, first + chunk * 
+                              (int)(((long)nunits * (i+1)) / nthreads));
+         threadargs[i].jobs  = jobs;
+         threadargs[i].njobs = nprobes;
+         threadargs[i].me    = i;
+      }
+
+      /* Start the extra threads and then do our own share              */
+      for(i=1; i<nthreads; i++)
+      {
+         if(pthread_create(&(threads[i]), NULL, ScanThread, 
+                           (void *)&(threadargs[i])))
+         {
+            /* Couldn't start the thread. Its range will be stolen by 
+               the threads that did start
+            */
+            fprintf(stderr,"Warning: Unable to start scan thread %d\n", 
+                    i);
+            break;
+         }
+         nstarted++;
+      }
+      ScanThread((void *)&(threadargs[0]));
+      for(i=1; i<=nstarted; i++)
+         pthread_join(threads[i], NULL);
+
+      for(i=0; i<nthreads; i++)
+         pthread_mutex_destroy(&(ranges[i].mutex));
+   }
+
+   free(ranges);
+   free(threads);
+   free(threadargs);
+   FREE(shared);
+
+   for(q=0; q<nprobes; q++)
+   {
+      job = &(jobs[q]);
+      pthread_mutex_destroy(&(job->mutex));
+      FreeSIMDProfile(job->profile);
+      FreeSIMDBatchProfile(job->batch);
+      FREE(job->trie);
+      FREE(job->bestScores);
+
+      if((job->heaps != NULL) && !Error &&
+         ((hits[q] = MergeHits(job->heaps, nthreads, maxhits, 
+                               job->results, &(nhits[q])))==NULL))
+      {
+         fprintf(stderr,"No memory for scan hits\n");
+         Error = TRUE;
+      }
+      if(job->heaps != NULL)
+      {
+         for(i=0; i<nthreads; i++)
+            FREE(job->heaps[i].hits);
+         free(job->heaps);
+      }
+      results[q] = job->results;
+   }
+
+   if(Error)
+   {
+      for(q=0; q<nprobes; q++)
+      {
+         FREE(results[q]);
+         FREE(hits[q]);
+         nhits[q] = 0;
+      }
+      free(order);
+      free(jobs);
+      return(FALSE);
+   }
+
+   for(q=0; (q<nprobes) && (starts == NULL) && (partners == NULL); q++)
+   {
+      job     = &(jobs[q]);
+      nscored = job->last - job->first;
+      if(job->ncandidates >= 0)
+      {
+         fprintf(stderr,"Seeds: aligned %d of %d entries (%.1f%%)\n",
+                 job->ncandidates, nscored,
+                 ((nscored > 0) ? 
+                  (REAL)100.0 * job->ncandidates / nscored : 0.0));
+         nscored = job->ncandidates;
+      }
+      if(job->band != NOBAND)
+      {
+         cells    = 0.0;
+         allCells = 0.0;
+         for(i=0; i<norder; i++)
+         {
+            length2   = library->entries[order[i]].length;
+            allCells += BandCells(job->length1, length2, NOBAND) * nrot;
+            if((i >= job->first) && (i < job->last))
+               cells += BandCells(job->length1, length2, job->band) * 
+                        nrot;
+         }
+         
+         fprintf(stderr,"Band %d: skipped %d of %d entries; filled \
+%.0f of %.0f DP cells (%.1f%%)\n", job->band, 
+                 norder - (job->last - job->first), norder,
+                 cells, allCells, 
+                 ((allCells > 0.0) ? 
+                  (REAL)100.0 * cells / allCells : 0.0));
+      }
+      if(job->heaps != NULL)
+      {
+         long nalign = (long)nscored * nrot,
+              nskip  = (long)job->npruned * nrot + job->nrotskipped;
+         
+         fprintf(stderr,"Pruned %d of %d entries and %ld of %ld \
+orientations (%.1f%%)\n", job->npruned, nscored, nskip,
+                 nalign,
+                 ((nalign > 0) ? (REAL)100.0 * nskip / nalign : 0.0));
+      }
+   }
+
+   free(order);
+   free(jobs);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void *ScanThread(void *arg)
+   ---------------------------
+   Input:   void    *arg     SCANTHREAD for this thread
+   Returns: void *           NULL
+
+   Body of a scan thread. Takes work from GetScanWork() until there is
+   none left and hands the part of it in each probe's band to 
+   ScanRange(), so that the same few library entries are aligned 
+   against all the probes in turn.
+
+   17.10.26 Original   By: agent
+   17.10.26 Work is now positions in job->order[]. Hands whole batches
+            to ScanBatch()   By: agent
+   17.10.26 Passes on the band   By: agent
+   17.10.26 Hands runs of the trie walk to ScanTrie()   By: agent
+   17.10.26 Passes the entry lengths on   By: agent
+   17.10.26 Keeps the best hits   By: agent
+   17.10.26 Prunes entries and, when aligning one at a time, 
+            orientations that cannot make the best hits   By: agent
+   17.10.26 Uses the self-scores of the probe and entries   By: agent
+   17.10.26 Works through several probes. The work on each is done by
+            ScanRange()   By: agent
+*/
+void *ScanThread(void *arg)
+{
+   SCANTHREAD *thread = (SCANTHREAD *)arg;
+   SCANJOB    *job;
+   int        start, stop, from, to, q;
+
+   while(!*(thread->jobs->Error) && 
+         GetScanWork(thread->jobs, thread->me, &start, &stop))
+   {
+      for(q=0; (q<thread->njobs) && !*(thread->jobs->Error); q++)
+      {
+         job  = &(thread->jobs[q]);
+         from = MAX(start, job->first);
+         to   = MIN(stop,  job->last);
+         if((from < to) && !ScanRange(job, thread->me, from, to))
+            *(job->Error) = TRUE;
+      }
+   }
+   
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>BOOL ScanRange(SCANJOB *job, int me, int start, int stop)
+   ---------------------------------------------------------
+   Input:   SCANJOB  *job     The scan job for a probe
+            int      me       Number of this thread
+            int      start    First position in job->order[] to do
+            int      stop     One past the last position to do
+   Returns: BOOL              Success?
+
+   Aligns the probe against some library entries and stores the 
+   results. If only the best hits are wanted, the entries that cannot
+   make them are pruned first and the rest are then offered to the 
+   thread's heap.
+
+   17.10.26 Original (code taken from ScanThread())   By: agent
+   17.10.26 Checks for NOALIGNMENT   By: agent
+   17.10.26 Copies results to the other entries of each class   By: agent
+*/
+BOOL ScanRange(SCANJOB *job, int me, int start, int stop)
+{
+   SCANRESULT *result;
+   LIBENTRY   *entry;
+   int        bounds[NROTATIONS],
+              *bound,
+              npruned     = 0,
+              i, rot;
+   long       nrotskipped = 0;
+
+   if(job->heaps != NULL)
+      npruned = PruneEntries(job, start, stop);
+      
+   if(job->batch != NULL)
+   {
+      if(!ScanBatch(job, start, stop))
+         return(FALSE);
+   }
+   else if(job->trie != NULL)
+   {
+      if(!ScanTrie(job, start, stop))
+         return(FALSE);
+   }
+   else
+   {
+      for(i=start; i<stop; i++)
+      {
+         result = &(job->results[job->order[i]]);
+         entry  = &(job->library->entries[job->order[i]]);
+         if(result->pruned)
+            continue;
 
-   fprintf(stderr,"\nCondenses a protein structure into a topology \
-string by reading from\n");
-   fprintf(stderr,"a pdbsecstr, DSSP or STRIDE file. The string has a \
-12-letter alphabet for the 6\n");
-   fprintf(stderr,"orientations of sheet and helix. The comparison is \
-performed using 24\n");
-   fprintf(stderr,"orientations for one of the structures compared with \
-the other in a fixed\n");
-   fprintf(stderr,"position. Output is the best score obtained - the \
-alignment is also\n");
-   fprintf(stderr,"given if the verbose option is selected.\n");
+         bound = NULL;
+         if(job->bestScores != NULL)
+         {
+            ScoreBound(job, entry, bounds);
+            bound = bounds;
+         }
 
-   fprintf(stderr,"\nOutput is the best score obtained. The score is \
-presented as a percentage\n");
-   fprintf(stderr,"of the score obtained by aligning the first structure \
-with itself; thus\n");
-   fprintf(stderr,"the first structure is treated as a probe being \
-tested against the \n");
-   fprintf(stderr,"second structure. If the -w option is given, the \
-maximum possible\n");
-   fprintf(stderr,"score is calculated from both topology strings. \
-If the verbose option\n");
-   fprintf(stderr,"is selected, the alignment is also given.\n");
+         result->IDScore = EntryIDScore(job, entry);
+         if((result->score = RunAlignment(job->top1, job->length1,
+                                          entry->top, entry->length,
+                                          job->profile,
+                                          job->PrimaryTopology,
+                                          job->band, bound,
+                                          &(result->rotation)))==NOALIGNMENT)
+            return(FALSE);
 
-   fprintf(stderr,"\nIn scan mode (-s), the topology from the first \
-file is scanned against\n");
-   fprintf(stderr,"a library of topology strings stored in the second \
-file. Entries for \n");
-   fprintf(stderr,"the topology library file may be generated by using \
-the program in\n");
-   fprintf(stderr,"build mode (-b).\n\n");
+         if((bound != NULL) && !job->PrimaryTopology)
+         {
+            for(rot=1; rot<NROTATIONS; rot++)
+            {
+               if(bound[rot] == (-1))
+                  nrotskipped++;
+            }
+         }
+      }
+   }
+
+   if((job->library->classOf != NULL) && 
+      !ShareResults(job, start, stop))
+      return(FALSE);
+
+   if(job->heaps != NULL)
+   {
+      if(!KeepHits(job, me, start, stop))
+         return(FALSE);
+      
+      pthread_mutex_lock(&(job->mutex));
+      job->npruned     += npruned;
+      job->nrotskipped += nrotskipped;
+      pthread_mutex_unlock(&(job->mutex));
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL ShareResults(SCANJOB *job, int start, int stop)
+   ----------------------------------------------------
+   Input:   SCANJOB  *job     The scan job
+            int      start    First position in job->order[] done
+            int      stop     One past the last position done
+   Returns: BOOL              Success?
+
+   Copies the result of each entry just scored to the other entries of
+   its class (see GroupLibrary()). A member that is the same string in
+   another orientation scores the same, but in another orientation of
+   the probe. That is only needed for the alignment shown in verbose
+   mode, so only then is the member aligned to find it.
+
+   17.10.26 Original   By: agent
+*/
+BOOL ShareResults(SCANJOB *job, int start, int stop)
+{
+   LIBRARY    *library = job->library;
+   LIBENTRY   *entry,
+              *member;
+   SCANRESULT *result;
+   int        i, m;
+
+   for(i=start; i<stop; i++)
+   {
+      result = &(job->results[job->order[i]]);
+      entry  = &(library->entries[job->order[i]]);
+      for(m=library->nextMember[job->order[i]]; m>=0; 
+          m=library->nextMember[m])
+      {
+         member          = &(library->entries[m]);
+         job->results[m] = *result;
+         
+         if(gVerbose && !result->pruned && 
+            memcmp(member->top, entry->top, 
+                   entry->length * sizeof(TOPCODE)) &&
+            (RunAlignment(job->top1, job->length1, member->top, 
+                          member->length, job->profile, 
+                          job->PrimaryTopology, job->band, NULL,
+                          &(job->results[m].rotation))==NOALIGNMENT))
+            return(FALSE);
+      }
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL ScanBatch(SCANJOB *job, int start, int stop)
+   --------------------------------------------------
+   Input:   SCANJOB  *job     The scan job
+            int      start    First position in job->order[] to do
+            int      stop     One past the last position to do
+   Returns: BOOL              Success?
+
+   Aligns the probe against a batch of library entries at once with
+   SIMDBatchAlignScores() and picks the best orientation for each just
+   as RunAlignment() does. Any entry whose 8-bit score may have 
+   saturated is redone on its own with RunAlignment(). An empty entry
+   scores 0 in every orientation which is what RunAlignment() gives.
+   Pruned entries are left out of the batch. The run may be longer than
+   a batch, in which case the entries not pruned are aligned a full 
+   batch at a time.
+
+   17.10.26 Original   By: agent
+   17.10.26 Passes on the band   By: agent
+   17.10.26 Passes the entry lengths on   By: agent
+   17.10.26 Skips pruned entries   By: agent
+   17.10.26 Uses the self-scores of the probe and entries   By: agent
+   17.10.26 Checks for NOALIGNMENT   By: agent
+   17.10.26 Does runs of several batches   By: agent
+*/
+BOOL ScanBatch(SCANJOB *job, int start, int stop)
+{
+   SCANRESULT *result;
+   LIBENTRY   *entry;
+   TOPCODE    *seqs[MAXBATCHLANES];
+   int        lengths[MAXBATCHLANES],
+              which[MAXBATCHLANES],
+              scores[MAXBATCHLANES*NROTATIONS],
+              *score,
+              nrot   = job->batch->nrot,
+              nbatch,
+              i, n, rot;
+   
+   i = start;
+   while(i < stop)
+   {
+      for(nbatch=0; (i<stop) && (nbatch<job->batch->lanes); i++)
+      {
+         if(job->results[job->order[i]].pruned)
+            continue;
+         entry = &(job->library->entries[job->order[i]]);
+         which[nbatch]   = job->order[i];
+         seqs[nbatch]    = entry->top;
+         lengths[nbatch] = entry->length;
+         nbatch++;
+      }
+      if(nbatch == 0)
+         return(TRUE);
+
+      if(!SIMDBatchAlignScores(job->batch, seqs, lengths, nbatch, 
+                               job->band, scores))
+      {
+         fprintf(stderr,"No memory for alignment\n");
+         return(FALSE);
+      }
+
+      for(n=0; n<nbatch; n++)
+      {
+         result = &(job->results[which[n]]);
+         entry  = &(job->library->entries[which[n]]);
+         score  = scores + n*nrot;
+      
+         result->IDScore = EntryIDScore(job, entry);
+
+         for(rot=0; rot<nrot; rot++)
+         {
+            if(score[rot] == SIMDBATCH_OVERFLOW)
+               break;
+         }
+
+         if(rot < nrot)
+         {
+            if((result->score = 
+                RunAlignment(job->top1, job->length1,
+                             entry->top, entry->length,
+                             job->profile,
+                             job->PrimaryTopology,
+                             job->band, NULL,
+                             &(result->rotation)))==NOALIGNMENT)
+               return(FALSE);
+         }
+         else
+         {
+            result->score    = score[0];
+            result->rotation = 0;
+            for(rot=1; rot<nrot; rot++)
+            {
+               if(score[rot] > result->score)
+               {
+                  result->score    = score[rot];
+                  result->rotation = rot;
+               }
+            }
+         }
+      }
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL ScanTrie(SCANJOB *job, int start, int stop)
+   ------------------------------------------------
+   Input:   SCANJOB  *job     The scan job
+            int      start    First position in job->order[] to do
+            int      stop     One past the last position to do
+   Returns: BOOL              Success?
+
+   Aligns the probe against a run of library entries in the order of a
+   depth-first walk of the trie of reversed topology strings built by
+   SortBySuffix(), giving the score and orientation that RunAlignment()
+   would give.
+
+   The alignment matrix is filled from the bottom right as in 
+   NumericAlignScore(), so column j of an entry only depends on the
+   codes from j to the end of the entry. The columns are worked out
+   one at a time from the end of the entry, keeping a column for each
+   depth in the trie (the number of codes from the end). Each column
+   has the cell scores, the best cell below each row (for a gap in the
+   library entry) and the best cell in each row of the columns to the
+   right of the one before (for a gap in the probe), which is all the
+   next column needs. When we move on to the next entry, the columns
+   for the codes it has in common with the one before are kept and
+   only the rest are done.
+
+   An empty entry scores 0 in every orientation as in RunAlignment().
+   Pruned entries are passed over; the columns kept are then those the
+   next entry has in common with every entry since the last one done.
+
+   17.10.26 Original   By: agent
+   17.10.26 Passes the entry lengths on   By: agent
+   17.10.26 Skips pruned entries   By: agent
+   17.10.26 Uses the self-scores of the probe and entries   By: agent
+*/
+BOOL ScanTrie(SCANJOB *job, int start, int stop)
+{
+   SCANRESULT *result;
+   LIBENTRY   *entry;
+   int        *columns,
+              *best,
+              *topbest,
+              *prof,
+              *col, *below, *rowmax,
+              *pcol, *pbelow, *prowmax,
+              nrot    = (job->PrimaryTopology ? 1 : NROTATIONS),
+              length1 = job->length1,
+              colsize = 3 * length1,
+              maxlen  = 0,
+              valid   = 0,
+              depth, done,
+              code, score, 
+              dia, right, down,
+              i, k, rot;
+
+   for(k=start; k<stop; k++)
+   {
+      entry = &(job->library->entries[job->order[k]]);
+      if(entry->length > maxlen)
+         maxlen = entry->length;
+   }
+
+   /* A column for each depth and orientation, then the best score in 
+      the top row of the columns so far and the best score overall
+   */
+   if((columns = (int *)malloc(((maxlen+1) * nrot * (colsize + 2)) *
+                               sizeof(int)))==NULL)
+   {
+      fprintf(stderr,"No memory for alignment\n");
+      return(FALSE);
+   }
+   topbest = columns + (maxlen+1) * nrot * colsize;
+   best    = topbest + (maxlen+1) * nrot;
+
+   for(k=start; k<stop; k++)
+   {
+      result = &(job->results[job->order[k]]);
+      entry  = &(job->library->entries[job->order[k]]);
+
+      /* Columns we already have. The first entry of a run starts 
+         afresh
+      */
+      done = ((k == start) ? 0 : MIN(valid, job->shared[k]));
+      if(result->pruned)
+      {
+         valid = done;
+         continue;
+      }
+      valid = entry->length;
+      
+      result->IDScore  = EntryIDScore(job, entry);
+      result->score    = 0;
+      result->rotation = 0;
+      if(entry->length == 0)
+         continue;
+      
+      for(depth=done+1; depth<=entry->length; depth++)
+      {
+         code = entry->top[entry->length - depth];
+         
+         for(rot=0; rot<nrot; rot++)
+         {
+            prof   = job->trie + ((rot * (NCODES+1)) + code) * length1;
+            col    = columns + ((depth * nrot) + rot) * colsize;
+            below  = col + length1;
+            rowmax = col + 2*length1;
+            
+            if(depth == 1)
+            {
+               /* Last column                                           */
+               for(i=length1-1; i>=0; i--)
+               {
+                  col[i]   = prof[i];
+                  below[i] = ((i == length1-1) ? 
+                              col[i] : MAX(col[i], below[i+1]));
+               }
+               topbest[depth*nrot + rot] = col[0];
+            }
+            else
+            {
+               pcol    = columns + (((depth-1) * nrot) + rot) * colsize;
+               pbelow  = pcol + length1;
+               prowmax = pcol + 2*length1;
+               
+               for(i=length1-1; i>=0; i--)
+               {
+                  if(i == length1-1)
+                  {
+                     /* Last row                                        */
+                     col[i] = prof[i];
+                  }
+                  else
+                  {
+                     dia   = pcol[i+1];
+                     right = ((i+2 >= length1) ? 
+                              0 : pbelow[i+2] - GAPPEN);
+                     down  = ((depth == 2) ? 
+                              0 : prowmax[i+1] - GAPPEN);
+                     
+                     if(right > dia)
+                        dia = right;
+                     if(down > dia)
+                        dia = down;
+                     
+                     col[i] = dia + prof[i];
+                  }
+                  
+                  below[i]  = ((i == length1-1) ? 
+                               col[i] : MAX(col[i], below[i+1]));
+                  rowmax[i] = ((depth == 2) ? 
+                               pcol[i] : MAX(prowmax[i], pcol[i]));
+               }
+               topbest[depth*nrot + rot] = 
+                  MAX(topbest[(depth-1)*nrot + rot], col[0]);
+            }
+
+            /* Score if the entry were to end here: the best of the top
+               row and this, the left column
+            */
+            best[depth*nrot + rot] = MAX(topbest[depth*nrot + rot], 
+                                         below[0]);
+         }
+      }
+
+      /* The first orientation giving the best score                    */
+      result->score = best[entry->length * nrot];
+      for(rot=1; rot<nrot; rot++)
+      {
+         score = best[entry->length * nrot + rot];
+         if(score > result->score)
+         {
+            result->score    = score;
+            result->rotation = rot;
+         }
+      }
+   }
+
+   free(columns);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>int *BuildTrieProfile(TOPCODE *top, int length, int nrot)
+   ---------------------------------------------------------
+   Input:   TOPCODE *top     Probe topology string
+            int   length     Length of the probe
+            int   nrot       Orientations to include
+   Returns: int   *          Profile (NULL if no memory)
+
+   Builds the profile used by ScanTrie(). This has the score of each 
+   element of the probe in each orientation against each code:
+      profile[rot][code][i] = gRotMDM[rot][top[i]][code]
+   so that a column of the alignment matrix reads its scores in order.
+
+   17.10.26 Original   By: agent
+   17.10.26 Takes TOPCODE strings with their lengths   By: agent
+*/
+int *BuildTrieProfile(TOPCODE *top, int length, int nrot)
+{
+   int *profile,
+       rot, code, i;
+
+   if((profile = (int *)malloc(nrot * (NCODES+1) * length * sizeof(int)))
+      ==NULL)
+      return(NULL);
+
+   for(rot=0; rot<nrot; rot++)
+   {
+      for(code=0; code<=NCODES; code++)
+      {
+         for(i=0; i<length; i++)
+         {
+            profile[((rot * (NCODES+1)) + code) * length + i] = 
+               gRotMDM[rot][top[i]][code];
+         }
+      }
+   }
+   
+   return(profile);
+}
+
+
+/************************************************************************/
+/*>BOOL GetScanWork(SCANJOB *job, int me, int *start, int *stop)
+   -------------------------------------------------------------
+   Input:   SCANJOB  *job     The scan job
+            int      me       Index of the calling thread
+   Output:  int      *start   First library entry to do
+            int      *stop    One past the last library entry to do
+   Returns: BOOL              Was any work found?
+
+   Takes the next chunk from the front of this thread's range. If the
+   range is empty, finds the thread with most work left and steals the
+   back half of its range, keeping to whole chunks.
+
+   17.10.26 Original   By: agent
+   17.10.26 Takes job->chunk entries at a time   By: agent
+*/
+BOOL GetScanWork(SCANJOB *job, int me, int *start, int *stop)
+{
+   WORKRANGE *own = &(job->ranges[me]),
+             *victim;
+   int       i, 
+             best,
+             most,
+             left,
+             mid,
+             end;
+
+   for(;;)
+   {
+      /* See if there is anything left in our own range                 */
+      pthread_mutex_lock(&(own->mutex));
+      if(own->next < own->end)
+      {
+         *start    = own->next;
+         *stop     = MIN(own->end, own->next + job->chunk);
+         own->next = *stop;
+         pthread_mutex_unlock(&(own->mutex));
+         return(TRUE);
+      }
+      pthread_mutex_unlock(&(own->mutex));
+
+      /* Find the thread with most left to do                           */
+      best = -1;
+      most = 0;
+      for(i=0; i<job->nthreads; i++)
+      {
+         if(i != me)
+         {
+            pthread_mutex_lock(&(job->ranges[i].mutex));
+            left = job->ranges[i].end - job->ranges[i].next;
+            pthread_mutex_unlock(&(job->ranges[i].mutex));
+            if(left > most)
+            {
+               most = left;
+               best = i;
+            }
+         }
+      }
+      if(best < 0)
+         return(FALSE);
+
+      /* Steal the back half of its range. It may have shrunk since we
+         looked, in which case we just look again
+      */
+      victim = &(job->ranges[best]);
+      pthread_mutex_lock(&(victim->mutex));
+      left = victim->end - victim->next;
+      if(left <= 0)
+      {
+         pthread_mutex_unlock(&(victim->mutex));
+         continue;
+      }
+      mid         = victim->next + job->chunk * ((left/job->chunk)/2);
+      end         = victim->end;
+      victim->end = mid;
+      pthread_mutex_unlock(&(victim->mutex));
+
+      pthread_mutex_lock(&(own->mutex));
+      own->next = mid;
+      own->end  = end;
+      pthread_mutex_unlock(&(own->mutex));
+   }
+}
+
+
+/************************************************************************/
+/*>int *SortByLength(LIBRARY *library)
+   -----------------------------------
+   Input:   LIBRARY  *library   The library
+   Returns: int      *          Indexes of the entries in order of length
+                                (NULL if no memory)
+
+   Counting sort of the library entries by length. Entries of the same
+   length stay in library order. A compiled library already has this 
+   order so it is just copied. If the library has been grouped by
+   GroupLibrary(), just the library->nclasses entries standing for the
+   classes are given.
+
+   17.10.26 Original   By: agent
+   17.10.26 Copies the order from a compiled library   By: agent
+   17.10.26 Just gives one entry of each class   By: agent
+*/
+int *SortByLength(LIBRARY *library)
+{
+   int *order,
+       *count,
+       maxlen = 0,
+       i, 
+       total, 
+       n;
+
+   if(library->byLength != NULL)
+   {
+      if((order = (int *)malloc((library->nentries ? library->nentries : 1)
+                                * sizeof(int)))!=NULL)
+      {
+         for(i=0, n=0; i<library->nentries; i++)
+         {
+            if(REPRESENTS(library, library->byLength[i]))
+               order[n++] = library->byLength[i];
+         }
+      }
+      return(order);
+   }
+   
+   for(i=0; i<library->nentries; i++)
+   {
+      if(library->entries[i].length > maxlen)
+         maxlen = library->entries[i].length;
+   }
+
+   if((order = (int *)malloc((library->nentries ? library->nentries : 1) *
+                             sizeof(int)))==NULL)
+      return(NULL);
+   if((count = (int *)calloc(maxlen+1, sizeof(int)))==NULL)
+   {
+      free(order);
+      return(NULL);
+   }
+
+   for(i=0; i<library->nentries; i++)
+   {
+      if(REPRESENTS(library, i))
+         count[library->entries[i].length]++;
+   }
+   for(i=0, total=0; i<=maxlen; i++)
+   {
+      n        = count[i];
+      count[i] = total;
+      total   += n;
+   }
+   for(i=0; i<library->nentries; i++)
+   {
+      if(REPRESENTS(library, i))
+         order[count[library->entries[i].length]++] = i;
+   }
+
+   free(count);
+   return(order);
+}
+
+
+/************************************************************************/
+/*>int *SortBySuffix(LIBRARY *library, int *shared)
+   ------------------------------------------------
+   Input:   LIBRARY  *library   The library
+   Output:  int      *shared    For each entry in the returned order,
+                                the number of codes at the end of it 
+                                which are the same as the end of the
+                                entry before (0 for the first)
+   Returns: int      *          Indexes of the entries in order (NULL
+                                if no memory)
+
+   Sorts the library entries on their reversed topology strings. This
+   is the order of a depth-first walk of a trie of the reversed strings
+   and shared[] says where each entry leaves the path to the one before
+   in the trie, which is all ScanTrie() needs to know about the trie.
+   As for SortByLength(), just one entry of each class is given if the
+   library has been grouped.
+
+   17.10.26 Original   By: agent
+   17.10.26 Just gives one entry of each class   By: agent
+*/
+int *SortBySuffix(LIBRARY *library, int *shared)
+{
+   LIBENTRY **sorted,
+            *entry,
+            *prev;
+   int      *order,
+            nsorted,
+            i, n;
+
+   if((order = (int *)malloc((library->nentries ? library->nentries : 1) *
+                             sizeof(int)))==NULL)
+      return(NULL);
+   if((sorted = (LIBENTRY **)malloc((library->nentries ? 
+                                     library->nentries : 1) * 
+                                    sizeof(LIBENTRY *)))==NULL)
+   {
+      free(order);
+      return(NULL);
+   }
+
+   for(i=0, nsorted=0; i<library->nentries; i++)
+   {
+      if(REPRESENTS(library, i))
+         sorted[nsorted++] = &(library->entries[i]);
+   }
+   qsort(sorted, nsorted, sizeof(LIBENTRY *), CompareSuffixes);
+
+   for(i=0; i<nsorted; i++)
+   {
+      entry    = sorted[i];
+      order[i] = (int)(entry - library->entries);
+      n        = 0;
+      if(i)
+      {
+         prev = sorted[i-1];
+         while((n < entry->length) && (n < prev->length) &&
+               (entry->top[entry->length-n-1] == 
+                prev->top[prev->length-n-1]))
+            n++;
+      }
+      shared[i] = n;
+   }
+
+   free(sorted);
+   return(order);
 }
 
 
 /************************************************************************/
-/*>int *ReadTopology(FILE *fp, int ELen, int HLen, int SecStrCalculator,
-                     BOOL Do3_10, BOOL PrimaryTopology,
-                     BOOL DoNeighbour, BOOL DoAccess, BOOL DoLength,
-                     BOOL DoLoopLength)
-   -----------------------------------------------------------------
-   Input:   FILE   *fp             DSSP file pointer
-            int    ELen            Minimum length of strand
-            int    HLen            Minimum length of helix
-            int    SecStrCalculator  Secondary Structure calculator to
-                                     use (pdbsecstr, Stride or DSSP)
-            BOOL   Do3_10          Merge 3_10 helix with alpha helix
-            BOOL   PrimaryTopology Only do primary topology
-            BOOL   DoNeighbour     Add neighbour information
-            BOOL   DoAccess        Add accessibility information
-            BOOL   DoLength        Add length information
-            BOOL   DoLoopLength    Add loop length information
-   Returns: int *                  Topology string
+/*>int CompareSuffixes(const void *entry1, const void *entry2)
+   -----------------------------------------------------------
+   Input:   const void  *entry1   Pointer to a LIBENTRY pointer
+            const void  *entry2   Pointer to a LIBENTRY pointer
+   Returns: int                   -1, 0 or 1 as the first reversed 
+                                  topology string sorts before, the 
+                                  same as, or after the second
 
-   Reads a the topology from a pdbsecstr, DSSP or Stride file, returning
-   a string representing the topology.
+   qsort() comparison for SortBySuffix(). Compares the topology strings
+   from the end; a string which is the end of the other sorts first.
+   Ties are broken on the position in the library so the order does 
+   not depend on the qsort() implementation.
 
-   13.03.98 Original   By: ACRM
-   26.10.99 Added Do3_10
-   10.11.99 Added PrimaryTopology
-   16.11.99 Added DoNeighbour
-   23.11.99 Addes DoAccess
-   26.01.00 Added DoLength
-   10.03.00 Changed to use integer coded topology array
-   16.03.00 Added DoLoopLength
-   15.01.20 Added pdbsecstr support as the default
+   17.10.26 Original   By: agent
 */
-int *ReadTopology(FILE *fp, int ELen, int HLen, int SecStrCalculator,
-                  BOOL Do3_10, BOOL PrimaryTopology, BOOL DoNeighbour,
-                  BOOL DoAccess, BOOL DoLength, BOOL DoLoopLength)
+int CompareSuffixes(const void *entry1, const void *entry2)
 {
-   /* If we are doing neighbours, then reset the internal neighbour
-      information
-   */
-   if(DoNeighbour)
-   {
-      CalcElement('\0', 0,0,0, 0,0,0, 0, 1, 0, 0.0, 0, 0);
-   }
+   LIBENTRY *e1 = *(LIBENTRY **)entry1,
+            *e2 = *(LIBENTRY **)entry2;
+   int      i1  = e1->length - 1,
+            i2  = e2->length - 1;
 
-   switch(SecStrCalculator)
+   for(; (i1 >= 0) && (i2 >= 0); i1--, i2--)
    {
-   case SECSTR_DSSP:
-      return(ReadDSSP(fp, ELen, HLen, Do3_10, PrimaryTopology,
-                      DoNeighbour, DoAccess, DoLength, DoLoopLength));
-      break;
-   case SECSTR_STRIDE:
-   case SECSTR_PDBSECSTR:
-   default:
-      return(ReadStride(fp, ELen, HLen, Do3_10, PrimaryTopology,
-                        DoNeighbour, DoAccess, DoLength, DoLoopLength));
-      break;
+      if(e1->top[i1] != e2->top[i2])
+         return((e1->top[i1] < e2->top[i2]) ? -1 : 1);
    }
+   if(i1 != i2)
+      return((i1 < i2) ? -1 : 1);
+   if(e1 != e2)
+      return((e1 < e2) ? -1 : 1);
+   return(0);
 }
 
 
 /************************************************************************/
-/*>int *ReadDSSP(FILE *fp, int ELen, int HLen, BOOL Do3_10,
-                 BOOL PrimaryTopology, BOOL DoNeighbour, BOOL DoAccess,
-                 BOOL DoLength, BOOL DoLoopLength)
-   --------------------------------------------------------------------
-   Input:   FILE     *fp             DSSP file pointer
-            int      ELen            Minimum length of strand
-            int      HLen            Minimum length of helix
-            BOOL     Do3_10          Merge 3_10 helix with alpha
-            BOOL     PrimaryTopology Only do primary topology
-            BOOL     DoNeighbour     Add neighbour information
-            BOOL     DoAccess        Add accessibility information
-            BOOL     DoLength        Add length information
-            BOOL     DoLoopLength    Add loop length information
-   Returns: int *                    Topology string
+/*>BOOL GroupLibrary(LIBRARY *library, BOOL PrimaryTopology)
+   ---------------------------------------------------------
+   I/O:     LIBRARY  *library        The library
+   Input:   BOOL     PrimaryTopology Primary topology only
+   Returns: BOOL                     Success?
 
-   Reads a DSSP file returning a string representing the topology.
+   Groups the library entries into classes which must score the same 
+   against any probe, so that just one entry of each class (the first
+   in the library) need be aligned. Entries with the same topology 
+   string always score the same. If all the orientations are tried and
+   the matrix is RotationInvariant(), so do entries whose strings are
+   the same in some orientation; the canonical form of a string is then
+   the orientation of it that sorts first.
 
-   13.01.98 Original   By: ACRM
-   26.10.99 Added Do3_10 handling
-   10.11.99 Added PrimaryTopology
-   16.11.99 Added DoNeighbour
-   23.11.99 Added DoAccess
-            Fixed bug - file ending with an SS element wasn't checking
-            element length
-   26.01.00 Added DoLength
-   10.03.00 Changed to use integer coded topology array
-   13.03.00 Initialise x1,y1,z1,xp,yp,zp only to silence warnings with -O2
-   16.03.00 Added loop length code
+   The entries are sorted on their canonical forms and each run of the
+   same form is a class. library->classOf[] gives the entry standing 
+   for the class of each entry and library->nextMember[] links the
+   entries of a class in library order. SortByLength() and 
+   SortBySuffix() then just give the entries standing for the classes.
+   Nothing is done if the library has already been grouped the same
+   way. The number of classes is reported with --stats.
+
+   17.10.26 Original   By: agent
+   17.10.26 Only reports the classes with --stats   By: agent
 */
-int *ReadDSSP(FILE *fp, int ELen, int HLen, BOOL Do3_10, 
-              BOOL PrimaryTopology, BOOL DoNeighbour, BOOL DoAccess,
-              BOOL DoLength, BOOL DoLoopLength)
+BOOL GroupLibrary(LIBRARY *library, BOOL PrimaryTopology)
 {
-   int  *top;
-   char buffer[MAXBUFF*2],
-        struc,
-        LastStruc    = ' ';
-   REAL x,  y,  z,
-        x1 = MARKER, 
-        y1 = MARKER, 
-        z1 = MARKER,
-        xp = MARKER, 
-        yp = MARKER, 
-        zp = MARKER,
-        access,
-        sumaccess    = 0.0;
-   BOOL InBody       = FALSE,
-        InElement    = FALSE,
-        DoneOne      = FALSE;
-   int  i            = 0,
-        EleLength    = 0,
-        LoopLength   = 0;
+   LIBENTRY *canonical,
+            **sorted,
+            *entry;
+   TOPCODE  *codes,
+            *best,
+            *top;
+   int      nentries = library->nentries,
+            nrot,
+            first,
+            i, k, rot;
+   long     ncodes   = 0;
 
-#ifdef UCL
-   fprintf(stderr,"Code needs to be modified to support reading \
-accessibility from\nUCL DSSP files\n");
-#endif
+   if((library->classOf != NULL) && 
+      (library->groupPrimary == PrimaryTopology))
+      return(TRUE);
+   FREE(library->classOf);
+   FREE(library->nextMember);
+   library->nclasses = nentries;
 
-   
-   if((top = (int *)malloc(MAXBUFF * sizeof(int)))==NULL)
-      return(NULL);
-   
-   while(fgets(buffer,MAXBUFF*2,fp))
+   nrot = ((PrimaryTopology || !RotationInvariant()) ? 1 : NROTATIONS);
+
+   for(i=0; i<nentries; i++)
+      ncodes += library->entries[i].length;
+
+   canonical = NULL;
+   sorted    = NULL;
+   codes     = NULL;
+   if(((canonical = (LIBENTRY *)malloc((nentries ? nentries : 1) *
+                                       sizeof(LIBENTRY)))==NULL) ||
+      ((sorted    = (LIBENTRY **)malloc((nentries ? nentries : 1) *
+                                        sizeof(LIBENTRY *)))==NULL) ||
+      ((codes     = (TOPCODE *)malloc((ncodes ? ncodes : 1) *
+                                      sizeof(TOPCODE)))==NULL) ||
+      ((library->classOf    = (int *)malloc((nentries ? nentries : 1) *
+                                            sizeof(int)))==NULL) ||
+      ((library->nextMember = (int *)malloc((nentries ? nentries : 1) *
+                                            sizeof(int)))==NULL))
    {
-      TERMINATE(buffer);
-      if(InBody)
-      {
-#ifdef UCL
-         fsscanf(buffer,"%16x%c%90x%7lf%7lf%7lf",&struc,&x,&y,&z);
-         access=0.0;
-#else
-         fsscanf(buffer,"%16x%c%17x%4lf%77x%7lf%7lf%7lf",
-                 &struc,&access,&x,&y,&z);
-#endif
-         if(Do3_10 && struc=='G')                  /* 26.10.99          */
-            struc = 'H';
-         if((struc=='E' || struc=='H') && (struc==LastStruc))
-         {
-            EleLength++;
-            sumaccess += access;
-         }
+      FREE(canonical);
+      FREE(sorted);
+      FREE(codes);
+      FREE(library->classOf);
+      FREE(library->nextMember);
+      return(FALSE);
+   }
 
-         if(DoneOne && (struc!='E') && (struc!='H'))
-         {
-            LoopLength++;
-         }
-         
-         if((struc=='E' || struc=='H') && (struc!=LastStruc))
-         {
-            /* Start of new element                                     */
-            if(InElement)
-            {
-               if((LastStruc=='E' && EleLength>=ELen) ||
-                  (LastStruc=='H' && EleLength>=HLen))
-               {
-                  top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
-                                         PrimaryTopology, DoNeighbour,
-                                         DoAccess, sumaccess/EleLength,
-                                         (DoLength?EleLength:0),
-                                         (DoLoopLength?LoopLength:0));
-                  DoneOne = TRUE;
-                  LoopLength = 0;
-               }
-            }
-            
-            InElement = TRUE;
-            EleLength = 1;
-            sumaccess = access;
-            x1 = x;
-            y1 = y;
-            z1 = z;
-         }
-         else if(InElement && struc!='E' && struc!='H')
+   /* Find the canonical form of each string. An orientation replaces
+      the best so far from the first code where they differ if its code
+      is lower there
+   */
+   best = codes;
+   for(i=0; i<nentries; i++)
+   {
+      entry = &(library->entries[i]);
+      top   = entry->top;
+      memcpy(best, top, entry->length * sizeof(TOPCODE));
+      for(rot=1; rot<nrot; rot++)
+      {
+         k = 0;
+         while((k < entry->length) && (gRotation[rot][top[k]] == best[k]))
+            k++;
+         if((k < entry->length) && (gRotation[rot][top[k]] < best[k]))
          {
-            /* Just come out of an element                              */
-            if((LastStruc=='E' && EleLength>=ELen) ||
-               (LastStruc=='H' && EleLength>=HLen))
-            {
-               
-               top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
-                                      PrimaryTopology, DoNeighbour,
-                                      DoAccess, sumaccess/EleLength,
-                                      (DoLength?EleLength:0),
-                                      (DoLoopLength?LoopLength:0));
-               DoneOne = TRUE;
-               LoopLength = 0;
-            }
-            InElement = FALSE;
+            for(; k<entry->length; k++)
+               best[k] = gRotation[rot][top[k]];
          }
-            
-         LastStruc = struc;
-         xp = x;
-         yp = y;
-         zp = z;
       }
-      else
+      
+      canonical[i].name   = entry->name;
+      canonical[i].top    = best;
+      canonical[i].length = entry->length;
+      sorted[i]           = &(canonical[i]);
+      best               += entry->length;
+   }
+   qsort(sorted, nentries, sizeof(LIBENTRY *), CompareCanonical);
+
+   /* Each run of the same canonical form is a class                    */
+   library->nclasses = 0;
+   for(first=0; first<nentries; first=k)
+   {
+      k = first + 1;
+      while((k < nentries) && 
+            (sorted[k]->length == sorted[first]->length) &&
+            !memcmp(sorted[k]->top, sorted[first]->top, 
+                    sorted[k]->length * sizeof(TOPCODE)))
+         k++;
+      library->nclasses++;
+      for(i=first; i<k; i++)
       {
-         if(!strncmp(buffer, "  #",3))
-         {
-            InBody = TRUE;
-         }
+         library->classOf[sorted[i] - canonical] = 
+            (int)(sorted[first] - canonical);
+         library->nextMember[sorted[i] - canonical] = 
+            ((i+1 < k) ? (int)(sorted[i+1] - canonical) : (-1));
       }
    }
+   library->groupPrimary = PrimaryTopology;
 
-   if(InElement)
+   if(gStats)
    {
-      /* File ended with an element                                     */
-      if((LastStruc=='E' && EleLength>=ELen) ||
-         (LastStruc=='H' && EleLength>=HLen))
-         top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
-                                PrimaryTopology, DoNeighbour,
-                                DoAccess, sumaccess/EleLength,
-                                (DoLength?EleLength:0),
-                                (DoLoopLength?LoopLength:0));
+      fprintf(stderr,"Library: %d entries, %d distinct%s (%.2f entries \
+each)\n", nentries, library->nclasses,
+              ((nrot > 1) ? " in any orientation" : ""),
+              ((library->nclasses > 0) ? 
+               (REAL)nentries / (REAL)library->nclasses : 0.0));
    }
-   top[i] = (-1);
-   
-   return(top);
+
+   free(canonical);
+   free(sorted);
+   free(codes);
+   return(TRUE);
 }
 
 
 /************************************************************************/
-/*>int CalcElement(char struc, REAL x1, REAL y1, REAL z1, 
-                   REAL x2, REAL y2, REAL z2, BOOL PrimaryTopology,
-                   BOOL DoNeighbour, BOOL DoAccess, REAL meanAccess,
-                   int EleLength, int LoopLength)
-   -----------------------------------------------------------------
-   Input:   char  struc           DSSP structure assignment
-            REAL  x1              Coordinates of SS element start
-            REAL  y1      
-            REAL  z1      
-            REAL  x2              Coordinates of SS element end
-            REAL  y2      
-            REAL  z2      
-            BOOL  PrimaryTopology Do Primary topology only (no direction)
-            BOOL  DoNeighbour     Add neighbour information
-            BOOL  DoAccess        Add accessibility information
-            REAL  meanAccess      Mean access for element
-            int   EleLength       Element length (0 if we are ignoring
-                                  these)
-            int   LoopLength      Loop length (0 if we are ignoring
-                                  these)
-   Returns: char                  Code for element (structure & direction)
+/*>int CompareCanonical(const void *entry1, const void *entry2)
+   ------------------------------------------------------------
+   Input:   const void  *entry1   Pointer to a LIBENTRY pointer
+            const void  *entry2   Pointer to a LIBENTRY pointer
+   Returns: int                   -1, 0 or 1 as the first canonical 
+                                  form sorts before, the same as, or
+                                  after the second
 
-   Given a structure code from DSSP (E or H) and the coordinates of the
-   ends of the element, returns a combined code of structure plus
-   direction. Also generates combined codes with neighbour, accessibility
-   and element length.
+   qsort() comparison for GroupLibrary(). The LIBENTRYs hold the 
+   canonical forms. Sorts on length and then on the codes. Ties are 
+   broken on the position in the array so that the first entry of a 
+   class in the library comes first.
 
-   13.01.98 Original   By: ACRM
-   10.11.99 Added PrimaryTopology
-   16.11.99 Added DoNeighbour
-   23.11.99 Added DoAccess/meanAccess
-   26.01.00 Added EleLength
-   10.03.00 Changed to use integer coded topology array. i.e. returns
-            a number rather than a character
-   13.03.00 Fixed length checking
-   16.03.00 Added loop length
+   17.10.26 Original   By: agent
 */
-int CalcElement(char struc, REAL x1, REAL y1, REAL z1, 
-                REAL x2, REAL y2, REAL z2, BOOL PrimaryTopology,
-                BOOL DoNeighbour, BOOL DoAccess, REAL meanAccess,
-                int EleLength, int LoopLength)
+int CompareCanonical(const void *entry1, const void *entry2)
 {
-   int         code;
-   int         dirn,
-               buried        = 0,
-               lengthmod     = 0,
-               looplengthmod = 0;
-   REAL        dx,    dy,    dz,
-               absdx, absdy, absdz;
-   static REAL prevx1 = MARKER,
-               prevy1 = MARKER,
-               prevz1 = MARKER,
-               prevx2 = MARKER,
-               prevy2 = MARKER,
-               prevz2 = MARKER;
-   
-   /* Special condition to reset the statics                            */
-   if(DoNeighbour && struc == '\0')
+   LIBENTRY *e1 = *(LIBENTRY **)entry1,
+            *e2 = *(LIBENTRY **)entry2;
+   int      i;
+
+   if(e1->length != e2->length)
+      return((e1->length < e2->length) ? -1 : 1);
+   for(i=0; i<e1->length; i++)
    {
-      prevx1 = MARKER;
-      prevy1 = MARKER;
-      prevz1 = MARKER;
-      prevx2 = MARKER;
-      prevy2 = MARKER;
-      prevz2 = MARKER;
-      return(0);
+      if(e1->top[i] != e2->top[i])
+         return((e1->top[i] < e2->top[i]) ? -1 : 1);
    }
+   if(e1 != e2)
+      return((e1 < e2) ? -1 : 1);
+   return(0);
+}
+
+
+/************************************************************************/
+/*>BOOL IndexLibrary(LIBRARY *library, int seedlen)
+   ------------------------------------------------
+   I/O:     LIBRARY  *library   Library to index
+   Input:   int      seedlen    Length of the k-mers
+   Returns: BOOL                Success? (FALSE if no memory)
+
+   Builds library->seeds, an inverted index of every run of seedlen 
+   codes (k-mer) in the library entries standing for their classes 
+   (see GroupLibrary()). The k-mers are hashed by SeedHash() into a 
+   power of 2 buckets, at least as many as there are k-mers, and the 
+   entry and position of each k-mer are stored bucket by bucket.
 
+   Each k-mer is indexed just as it is in the entry. FindCandidates()
+   looks the probe up in each of its orientations, which finds the 
+   same seeds as indexing every orientation of the library would, at a
+   24th of the size. The index is kept with the library and only built
+   again if the k-mers or classes change.
 
-#ifdef DEBUG
-   fprintf(stderr,"Length: %d\n", LoopLength);
-#endif
+   17.10.26 Original   By: agent
+*/
+BOOL IndexLibrary(LIBRARY *library, int seedlen)
+{
+   SEEDINDEX *index;
+   LIBENTRY  *entry;
+   long      nkmers = 0;
+   int       i, j, b, p;
 
-   /* Base coding is A for sheet, G for helix                           */
-   if(PrimaryTopology)   /* We ignore the direction information         */
+   if((library->seeds != NULL) && (library->seeds->seedlen == seedlen) &&
+      (library->seeds->primary == library->groupPrimary))
+      return(TRUE);
+   FreeSeedIndex(library->seeds);
+   library->seeds = NULL;
+
+   for(i=0; i<library->nentries; i++)
    {
-      if(struc == 'E')
-         return(1);
-      else if(struc == 'H')
-         return(7);
-      else
-         return(0);
+      entry = &(library->entries[i]);
+      if(REPRESENTS(library, i) && (entry->length >= seedlen))
+         nkmers += entry->length - seedlen + 1;
    }
+   if(nkmers >= INT_MAX / 2)
+      return(FALSE);
 
-   if(struc == 'E')
-      code = 1;
-   else if(struc == 'H')
-      code = 7;
-   else
-      return(0);
-
-   /* Calculate deltas along x, y and z                                 */
-   dx = x2 - x1;
-   dy = y2 - y1;
-   dz = z2 - z1;
+   if((index = (SEEDINDEX *)malloc(sizeof(SEEDINDEX)))==NULL)
+      return(FALSE);
+   index->seedlen  = seedlen;
+   index->primary  = library->groupPrimary;
+   index->nbuckets = 1;
+   while(index->nbuckets < nkmers)
+      index->nbuckets *= 2;
 
-   /* Find absolute values                                              */
-   absdx = ABS(dx);
-   absdy = ABS(dy);
-   absdz = ABS(dz);
+   index->entry = NULL;
+   index->pos   = NULL;
+   if(((index->start = (int *)calloc(index->nbuckets + 1, sizeof(int)))
+       ==NULL) ||
+      ((index->entry = (int *)malloc((nkmers ? nkmers : 1) * 
+                                     sizeof(int)))==NULL) ||
+      ((index->pos   = (int *)malloc((nkmers ? nkmers : 1) * 
+                                     sizeof(int)))==NULL))
+   {
+      FreeSeedIndex(index);
+      return(FALSE);
+   }
 
-   /* Find the direction modifier                                       */
-   if((dx >= absdy) && (dx >= absdz))
-      dirn = 1;
-   else if((dx <= (-absdy)) && (dx <= (-absdz)))
-      dirn = 3;
-   else if((dy >= absdx) && (dy >= absdz))
-      dirn = 0;
-   else if((dy <= (-absdx)) && (dy <= (-absdz)))
-      dirn = 2;
-   else if((dz >= absdx) && (dz >= absdy))
-      dirn = 4;
-   else if((dz <= (-absdx)) && (dz <= (-absdy)))
-      dirn = 5;
-   else
-      return(0);
-   
-   if(DoNeighbour)
+   /* Count the k-mers in each bucket and turn the counts into the
+      start of each bucket
+   */
+   for(i=0; i<library->nentries; i++)
    {
-      if((prevx1 != MARKER) && (prevy1 != MARKER) && (prevz1 != MARKER) &&
-         (prevx2 != MARKER) && (prevy2 != MARKER) && (prevz2 != MARKER))
+      entry = &(library->entries[i]);
+      if(!REPRESENTS(library, i))
+         continue;
+      for(j=0; j+seedlen<=entry->length; j++)
       {
-         if(IsNeighbour(x1, y1, z1,
-                        x2, y2, z2,
-                        prevx1, prevy1, prevz1,
-                        prevx2, prevy2, prevz2))
-            dirn += 12;
+         b = SeedHash(entry->top + j, seedlen) & (index->nbuckets - 1);
+         index->start[b+1]++;
       }
-      prevx1 = x1;
-      prevy1 = y1;
-      prevz1 = z1;
-
-      prevx2 = x2;
-      prevy2 = y2;
-      prevz2 = z2;
    }
+   for(b=0; b<index->nbuckets; b++)
+      index->start[b+1] += index->start[b];
 
-   if(DoAccess)
+   /* Fill each bucket, moving its start on as we go, and then move the
+      starts back
+   */
+   for(i=0; i<library->nentries; i++)
    {
-      if(((struc == 'E') && (meanAccess < gStrandMeanAccess)) ||
-         ((struc == 'H') && (meanAccess < gHelixMeanAccess)))
-         buried = 24;
+      entry = &(library->entries[i]);
+      if(!REPRESENTS(library, i))
+         continue;
+      for(j=0; j+seedlen<=entry->length; j++)
+      {
+         b = SeedHash(entry->top + j, seedlen) & (index->nbuckets - 1);
+         p = index->start[b]++;
+         index->entry[p] = i;
+         index->pos[p]   = j;
+      }
    }
+   for(b=index->nbuckets; b>0; b--)
+      index->start[b] = index->start[b-1];
+   index->start[0] = 0;
 
-   if(EleLength)
-   {
-      if(((struc == 'E') && (EleLength > STRAND_MEAN_LENGTH)) ||
-         ((struc == 'H') && (EleLength > HELIX_MEAN_LENGTH)))
-         lengthmod = 48;
-   }
+   library->seeds = index;
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void FreeSeedIndex(SEEDINDEX *index)
+   ------------------------------------
+   I/O:     SEEDINDEX *index    Index to be freed (or NULL)
+
+   Frees an index built by IndexLibrary()
+
+   17.10.26 Original   By: agent
+*/
+void FreeSeedIndex(SEEDINDEX *index)
+{
+   if(index == NULL)
+      return;
    
-   if(LoopLength)
+   FREE(index->start);
+   FREE(index->entry);
+   FREE(index->pos);
+   free(index);
+}
+
+
+/************************************************************************/
+/*>unsigned int SeedHash(TOPCODE *codes, int seedlen)
+   --------------------------------------------------
+   Input:   TOPCODE  *codes     Start of a k-mer
+            int      seedlen    Length of the k-mer
+   Returns: unsigned int        Hash of the k-mer
+
+   32-bit FNV-1a hash of a k-mer for IndexLibrary()
+
+   17.10.26 Original   By: agent
+*/
+unsigned int SeedHash(TOPCODE *codes, int seedlen)
+{
+   unsigned int hash = 2166136261U;
+   int          i;
+
+   for(i=0; i<seedlen; i++)
    {
-      if(LoopLength > LOOP_MEAN_LENGTH)
-         looplengthmod = 96;
+      hash ^= (unsigned int)codes[i];
+      hash *= 16777619U;
    }
    
-   return(code + dirn + buried + lengthmod + looplengthmod);
+   return(hash);
 }
 
 
 /************************************************************************/
-/*>int CalcIDScore(int *seq1, int *seq2, BOOL UseBoth)
-   ---------------------------------------------------
-   Input:   int      *seq1   Sequence 1
-            int      *seq2   Sequence 2
-            BOOL     UseBoth Calculate score as Max of both sequences
-   Returns: int              Max score of each sequence vs itself
+/*>int FindCandidates(SCANJOB *job, int seedhits)
+   ----------------------------------------------
+   Input:   SCANJOB  *job       The scan job for a probe
+            int      seedhits   Seeds needed on a diagonal
+   Returns: int                 Number of entries in the run of the 
+                                band left to align (-1 if no memory)
 
-   Calculates the maximum possible score resulting from the identical
-   sequence
+   Seed-and-extend filter for --seed. Every k-mer of the probe, in each
+   orientation, is looked up in the index built by IndexLibrary() and 
+   each exact match in an entry in the band is a seed on the diagonal
+   given by its positions in the entry and the probe. An entry with at
+   least seedhits seeds on one diagonal in one orientation is a 
+   candidate. The seeds are gathered and sorted rather than counted in
+   place so that the work depends on the number of seeds and not on 
+   the size of the library.
 
-   14.01.98 Original   By: ACRM
-   10.03.00 Changed to use integer coded topology array
+   Entries that are not candidates are marked as skipped and pruned, 
+   scoring 0, so they are not aligned or printed. An entry, or a probe,
+   too short to hold seedhits seeds on a diagonal is always aligned.
+
+   17.10.26 Original   By: agent
 */
-int CalcIDScore(int *seq1, int *seq2, BOOL UseBoth)
+int FindCandidates(SCANJOB *job, int seedhits)
 {
-   int score1 = 0,
-       score2 = 0,
-       i,
-       seqlen1 = FindArrayLength(seq1),
-       seqlen2 = FindArrayLength(seq2);
+   LIBRARY    *library = job->library;
+   SEEDINDEX  *index   = library->seeds;
+   SEEDHIT    *seeds   = NULL,
+              *more;
+   SCANRESULT *result;
+   TOPCODE    *rtop;
+   BOOL       *candidate;
+   int        seedlen     = index->seedlen,
+              minlen      = seedlen + seedhits - 1,
+              nrot        = (job->PrimaryTopology ? 1 : NROTATIONS),
+              nseeds      = 0,
+              maxseeds    = 0,
+              ncandidates = 0,
+              first, e, i, k, p, b, rot;
+
+   if(job->length1 < minlen)
+      return(job->last - job->first);
 
-   for(i=0; i<seqlen1; i++)
+   if((rtop = (TOPCODE *)malloc(job->length1 * sizeof(TOPCODE)))==NULL)
+      return(-1);
+   if((candidate = (BOOL *)calloc((library->nentries ? 
+                                   library->nentries : 1), 
+                                  sizeof(BOOL)))==NULL)
    {
-      if(seq1[i])
-         score1 += blNumericCalcMDMScore(seq1[i], seq1[i]);
+      free(rtop);
+      return(-1);
    }
-   if(UseBoth)
+
+   /* Gather the seeds of each orientation of the probe                 */
+   for(rot=0; rot<nrot; rot++)
    {
-      for(i=0; i<seqlen2; i++)
+      for(i=0; i<job->length1; i++)
+         rtop[i] = gRotation[rot][job->top1[i]];
+
+      for(i=0; i+seedlen<=job->length1; i++)
       {
-         if(seq2[i])
-            score2 += blNumericCalcMDMScore(seq2[i], seq2[i]);
+         b = SeedHash(rtop + i, seedlen) & (index->nbuckets - 1);
+         for(p=index->start[b]; p<index->start[b+1]; p++)
+         {
+            e = index->entry[p];
+            if(!REPRESENTS(library, e) || job->results[e].skipped ||
+               memcmp(library->entries[e].top + index->pos[p], rtop + i,
+                      seedlen * sizeof(TOPCODE)))
+               continue;
+
+            if(nseeds == maxseeds)
+            {
+               maxseeds = (maxseeds ? 2 * maxseeds : SEEDCHUNK);
+               if((more = (SEEDHIT *)realloc(seeds, maxseeds *
+                                             sizeof(SEEDHIT)))==NULL)
+               {
+                  FREE(seeds);
+                  free(candidate);
+                  free(rtop);
+                  return(-1);
+               }
+               seeds = more;
+            }
+            seeds[nseeds].entry    = e;
+            seeds[nseeds].rotation = rot;
+            seeds[nseeds].diagonal = index->pos[p] - i;
+            nseeds++;
+         }
       }
-      if(score2 > score1)
-         score1 = score2;
    }
 
-   /* 15.01.98 Added check for zero length strings                      */
-   if(UseBoth)
+   /* Count the seeds on each diagonal                                  */
+   if(nseeds)
+      qsort(seeds, nseeds, sizeof(SEEDHIT), CompareSeedHits);
+   for(first=0; first<nseeds; first=k)
    {
-      if((seqlen1==0) && (seqlen2==0))
-         score1 = 100;
+      k = first + 1;
+      while((k < nseeds) && 
+            (seeds[k].entry    == seeds[first].entry) &&
+            (seeds[k].rotation == seeds[first].rotation) &&
+            (seeds[k].diagonal == seeds[first].diagonal))
+         k++;
+      if(k - first >= seedhits)
+         candidate[seeds[first].entry] = TRUE;
    }
-   else
+
+   for(i=job->first; i<job->last; i++)
    {
-      if(seqlen1==0)
-         score1 = 100;
+      e = job->order[i];
+      if(candidate[e] || (library->entries[e].length < minlen))
+      {
+         ncandidates++;
+      }
+      else
+      {
+         result           = &(job->results[e]);
+         result->skipped  = TRUE;
+         result->pruned   = TRUE;
+         result->score    = 0;
+         result->rotation = 0;
+      }
    }
-   
-   return(score1);
+
+   FREE(seeds);
+   free(candidate);
+   free(rtop);
+   return(ncandidates);
 }
 
 
 /************************************************************************/
-/*>int *ReadStride(FILE *fp, int ELen, int HLen, BOOL Do3_10, 
-                   BOOL PrimaryTopology, BOOL DoNeighbour, BOOL DoAccess,
-                   BOOL DoLength, BOOL DoLoopLength)
-   -----------------------------------------------------------------------
-   Input:   FILE     *fp             Stride file pointer
-            int      ELen            Minimum length of strand
-            int      HLen            Minimum length of helix
-            BOOL     Do3_10          Merge 3_10 helix with alpha
-            BOOL     PrimaryTopology Only do primary topology
-            BOOL     DoNeighbour     Add neighbour information
-            BOOL     DoAccess        Add accessibility information
-            BOOL     DoLength        Add length information
-            BOOL     DoLoopLength    Add loop length information
-   Returns: int *                    Topology string
+/*>int CompareSeedHits(const void *seed1, const void *seed2)
+   ---------------------------------------------------------
+   Input:   const void  *seed1    Pointer to a SEEDHIT
+            const void  *seed2    Pointer to a SEEDHIT
+   Returns: int                   -1, 0 or 1 as the first seed sorts 
+                                  before, the same as, or after the 
+                                  second
 
-   Reads a Stride file returning a string representing the topology.
-   This is actually the combined PDB/STRIDE file - the same format is
-   used for pdbsecstr
+   qsort() comparison for FindCandidates(). Sorts on the entry, the
+   orientation and then the diagonal.
 
-   13.03.98 Original   By: ACRM
-   26.10.99 Added Do3_10 handling
-   10.11.99 Added PrimaryTopology
-   16.11.99 Added DoNeighbour
-   23.11.99 Added DoAccess
-            Fixed bug - file ending with an SS element wasn't checking
-            element length
-   26.01.00 Added DoLength
-   10.03.00 Changed to use integer coded topology array
-   13.03.00 Initialise x1,y1,z1,xp,yp,zp only to silence warnings with -O2
-   16.03.00 Added loop length
+   17.10.26 Original   By: agent
 */
-int *ReadStride(FILE *fp, int ELen, int HLen, BOOL Do3_10, 
-                BOOL PrimaryTopology, BOOL DoNeighbour, BOOL DoAccess,
-                BOOL DoLength, BOOL DoLoopLength)
+int CompareSeedHits(const void *seed1, const void *seed2)
 {
-   int  *top;
-   char buffer[MAXBUFF*2],
-        struc,
-        LastStruc    = ' ';
-   REAL x,  y,  z,
-        x1 = MARKER, 
-        y1 = MARKER, 
-        z1 = MARKER,
-        xp = MARKER, 
-        yp = MARKER, 
-        zp = MARKER,
-        access, 
-        sumaccess    = 0.0;
-   BOOL InElement    = FALSE,
-        DoneOne      = FALSE;
-   int  i            = 0,
-        EleLength    = 0,
-        LoopLength   = 0;
+   SEEDHIT *s1 = (SEEDHIT *)seed1,
+           *s2 = (SEEDHIT *)seed2;
 
+   if(s1->entry != s2->entry)
+      return((s1->entry < s2->entry) ? -1 : 1);
+   if(s1->rotation != s2->rotation)
+      return((s1->rotation < s2->rotation) ? -1 : 1);
+   if(s1->diagonal != s2->diagonal)
+      return((s1->diagonal < s2->diagonal) ? -1 : 1);
+   return(0);
+}
+
+
+/************************************************************************/
+/*>BOOL KeepHits(SCANJOB *job, int me, int start, int stop)
+   --------------------------------------------------------
+   Input:   SCANJOB  *job     The scan job
+            int      me       Number of this thread
+            int      start    First position in job->order[] done
+            int      stop     One past the last position done
+   Returns: BOOL              Success?
+
+   Offers the entries just scored to this thread's heap of best hits.
+   Each thread only touches its own heap, so no lock is needed however
+   the work has been stolen.
+
+   Once the heap is full, no entry scoring less than its worst hit can
+   be one of the best hits, so that score is shared with the other 
+   threads as job->bar for PruneEntries().
+
+   17.10.26 Original   By: agent
+   17.10.26 Skips pruned entries. Raises job->bar   By: agent
+   17.10.26 Offers the other entries of each class   By: agent
+*/
+BOOL KeepHits(SCANJOB *job, int me, int start, int stop)
+{
+   HITHEAP    *heap = &(job->heaps[me]);
+   SCANRESULT *result;
+   REAL       worst;
+   int        i, m;
    
-   if((top = (int *)malloc(MAXBUFF * sizeof(int)))==NULL)
-      return(NULL);
-   
-   while(fgets(buffer,MAXBUFF*2,fp))
+   for(i=start; i<stop; i++)
    {
-      TERMINATE(buffer);
-      fsscanf(buffer,"%15x%8lf%1x%8lf%1x%8lf%1x%c%1x%8lf",
-              &x,&y,&z,&struc,&access);
-      
-      if(Do3_10 && struc=='G')                     /* 26.10.99          */
-         struc = 'H';
-      
-      if((struc=='E' || struc=='H') && (struc==LastStruc))
-      {
-         EleLength++;
-         sumaccess += access;
-      }
-      if(DoneOne && (struc != 'E') && (struc != 'H'))
-      {
-         LoopLength++;
-      }
-      
-      if((struc=='E' || struc=='H') && (struc!=LastStruc))
-      {
-         /* Start of new element                                        */
-         if(InElement)
-         {
-            if((LastStruc=='E' && EleLength>=ELen) ||
-               (LastStruc=='H' && EleLength>=HLen))
-            {
-               top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
-                                      PrimaryTopology, DoNeighbour,
-                                      DoAccess, sumaccess/EleLength,
-                                      (DoLength?EleLength:0),
-                                      (DoLoopLength?LoopLength:0));
-               DoneOne = TRUE;
-               LoopLength = 0;
-            }
-            
-         }
-         
-         InElement = TRUE;
-         EleLength = 1;
-         sumaccess = access;
-         x1 = x;
-         y1 = y;
-         z1 = z;
-      }
-      else if(InElement && struc!='E' && struc!='H')
+      result = &(job->results[job->order[i]]);
+      if(result->pruned || (HitScore(result) < job->minscore))
+         continue;
+
+      /* The other entries of the class score the same                  */
+      for(m=job->order[i]; m>=0; 
+          m=((job->library->nextMember != NULL) ?
+             job->library->nextMember[m] : (-1)))
       {
-         /* Just come out of an element                                 */
-         if((LastStruc=='E' && EleLength>=ELen) ||
-            (LastStruc=='H' && EleLength>=HLen))
-         {
-            top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
-                                   PrimaryTopology, DoNeighbour,
-                                   DoAccess, sumaccess/EleLength,
-                                   (DoLength?EleLength:0),
-                                   (DoLoopLength?LoopLength:0));
-            DoneOne = TRUE;
-            LoopLength = 0;
-         }
-         InElement = FALSE;
-      }
-      
-      LastStruc = struc;
-      xp = x;
-      yp = y;
-      zp = z;
+         if(!OfferHit(heap, job->results, m))
+            return(FALSE);
+      }
    }
-   
-   if(InElement)
+
+   if((heap->maxhits > 0) && (heap->nhits == heap->maxhits))
    {
-      /* File ended with an element                                     */
-      if((LastStruc=='E' && EleLength>=ELen) ||
-         (LastStruc=='H' && EleLength>=HLen))
-         top[i++] = CalcElement(LastStruc,x1,y1,z1,xp,yp,zp,
-                                PrimaryTopology, DoNeighbour,
-                                DoAccess, sumaccess/EleLength,
-                                (DoLength?EleLength:0),
-                                (DoLoopLength?LoopLength:0));
+      worst = HitScore(&(job->results[heap->hits[0]]));
+      pthread_mutex_lock(&(job->mutex));
+      if(worst > job->bar)
+         job->bar = worst;
+      pthread_mutex_unlock(&(job->mutex));
    }
-   top[i] = (-1);
    
-   return(top);
+   return(TRUE);
 }
 
 
 /************************************************************************/
-/*>BOOL IsNeighbour(REAL x1, REAL y1, REAL z1,
-                    REAL x2, REAL y2, REAL z2,
-                    REAL prevx1, REAL prevy1, REAL prevz1,
-                    REAL prevx2, REAL prevy2, REAL prevz2)
-   -------------------------------------------------------
-   Input:   REAL    x1       Nter of this SS element
-            REAL    y1 
-            REAL    z1
-            REAL    x2       Cter of this SS element
-            REAL    y2
-            REAL    z2
-            REAL    prevx1   Nter of previous SS element
-            REAL    prevy1
-            REAL    prevz1
-            REAL    prevx2   Cter of previous SS element
-            REAL    prevy2
-            REAL    prevz2
-   Returns: BOOL             Are they neighbours?
+/*>int PruneEntries(SCANJOB *job, int start, int stop)
+   ----------------------------------------------------
+   Input:   SCANJOB  *job     The scan job
+            int      start    First position in job->order[] to do
+            int      stop     One past the last position to do
+   Returns: int               Number of entries pruned
 
-   Determines whether the current secondary structure element is a direct
-   neighbour of the preceeding element.
+   Marks the entries that cannot make the best hits so that they are 
+   not aligned. The best an entry can score is its bound from 
+   ScoreBound(); if that is below job->bar the entry cannot be kept. 
+   Only an entry that is strictly worse is pruned since equal scores
+   are ranked by library index. A pruned entry scores 0. Entries
+   already pruned, having too few seeds, are passed over.
 
-   17.11.99 Original   By: ACRM
-   13.03.00 Fixed parameter variable types to REAL (were BOOL!)
+   17.10.26 Original   By: agent
+   17.10.26 Uses the self-scores of the probe and entries   By: agent
+   17.10.26 Passes over entries already pruned   By: agent
 */
-BOOL IsNeighbour(REAL x1, REAL y1, REAL z1,
-                 REAL x2, REAL y2, REAL z2,
-                 REAL prevx1, REAL prevy1, REAL prevz1,
-                 REAL prevx2, REAL prevy2, REAL prevz2)
+int PruneEntries(SCANJOB *job, int start, int stop)
 {
-   REAL d[4], f[4],
-        mindist = 9999.0;
-   int  i;
-   
+   SCANRESULT *result;
+   LIBENTRY   *entry;
+   REAL       threshold;
+   int        npruned   = 0,
+              bound, i;
+
+   if(job->bestScores == NULL)
+      return(0);
+
+   pthread_mutex_lock(&(job->mutex));
+   threshold = job->bar;
+   pthread_mutex_unlock(&(job->mutex));
+   if(threshold <= NOMINSCORE)
+      return(0);
+
+   for(i=start; i<stop; i++)
+   {
+      result = &(job->results[job->order[i]]);
+      entry  = &(job->library->entries[job->order[i]]);
+      if(result->pruned)
+         continue;
+
+      result->IDScore = EntryIDScore(job, entry);
+      if(result->IDScore <= 0)
+         continue;
+      
+      bound = ScoreBound(job, entry, NULL);
+      if((REAL)100.0 * (REAL)bound / (REAL)result->IDScore < threshold)
+      {
+         result->pruned   = TRUE;
+         result->score    = 0;
+         result->rotation = 0;
+         npruned++;
+      }
+   }
    
-   /* Calculate distance and position of Nter end against previous
-      element
-   */
-   d[0] = blPointLineDistance(x1, y1, z1, 
-                              prevx1, prevy1, prevz1,
-                              prevx2, prevy2, prevz2,
-                              NULL, NULL, NULL,
-                              &f[0]);
+   return(npruned);
+}
 
-   /* Calculate distance and position of Cter end against previous
-      element
-   */
-   d[1] = blPointLineDistance(x2, y2, z2, 
-                              prevx1, prevy1, prevz1,
-                              prevx2, prevy2, prevz2,
-                              NULL, NULL, NULL,
-                              &f[1]);
 
-   /* Calculate distance and position of Nter end of previous element
-      against current
-   */
-   d[2] = blPointLineDistance(prevx1, prevy1, prevz1,
-                              x1, y1, z1, 
-                              x2, y2, z2,
-                              NULL, NULL, NULL,
-                              &f[2]);
+/************************************************************************/
+/*>int ScoreBound(SCANJOB *job, LIBENTRY *entry, int *bounds)
+   ----------------------------------------------------------
+   Input:   SCANJOB  *job     The scan job
+            LIBENTRY *entry   Library entry
+   Output:  int      *bounds  Bound for each orientation of the probe
+                              (or NULL)
+   Returns: int               Bound over all the orientations
 
-   /* Calculate distance and position of Cter end of previous element
-      against current
-   */
-   d[3] = blPointLineDistance(prevx2, prevy2, prevz2,
-                              x1, y1, z1, 
-                              x2, y2, z2,
-                              NULL, NULL, NULL,
-                              &f[3]);
+   Finds an upper bound on the score of the entry against the probe in
+   each orientation. A code of the entry is paired with at most one
+   element of the probe and gaps only take away, so the score can be no
+   more than the sum over the entry of the best score of each code in
+   job->bestScores. Nor can there be more pairs than the length of the
+   shorter string, each scoring no more than the best code.
 
-   /* See which are in line with the other element                      */
-   for(i=0; i<4; i++)
+   If bounds is NULL, the best score of each code in any orientation is
+   used instead. This is a looser bound but only needs one pass.
+
+   17.10.26 Original   By: agent
+*/
+int ScoreBound(SCANJOB *job, LIBENTRY *entry, int *bounds)
+{
+   int *best,
+       nrot     = (job->PrimaryTopology ? 1 : NROTATIONS),
+       shorter  = MIN(job->length1, entry->length),
+       maxbound = 0,
+       first    = 0,
+       sum, most, rot, i;
+
+   if(bounds == NULL)
+      first = nrot;
+   else
+      nrot--;
+   
+   for(rot=first; rot<=nrot; rot++)
    {
-      if((f[i] >= 0.0) && (f[i] <= 1.0))
+      best = job->bestScores + rot * (NCODES+1);
+      sum  = 0;
+      most = 0;
+      for(i=0; i<entry->length; i++)
       {
-         if(d[i] < mindist)
-            mindist = d[i];
+         sum += best[entry->top[i]];
+         if(best[entry->top[i]] > most)
+            most = best[entry->top[i]];
       }
+
+      sum = MIN(sum, shorter * most);
+      if(bounds != NULL)
+         bounds[rot] = sum;
+      if(sum > maxbound)
+         maxbound = sum;
    }
-#ifdef DEBUG
-   fprintf(stderr,"Minimum distance = %f\n", mindist);
-#endif
 
-   /* If the minimum distance is less than our cutoff, then we return
-      TRUE as they are adjacent
-   */
-   if(mindist < ADJACENT_DIST)
-      return(TRUE);
-   
-   return(FALSE);
+   return(maxbound);
 }
 
 
 /************************************************************************/
-/*>int FindArrayLength(int *array)
-   -------------------------------
-   Input:   int   *array     Array of integers terminated with -1
-   Returns: int              Number of elements
+/*>int *BuildBestScores(TOPCODE *top, int length, int nrot)
+   --------------------------------------------------------
+   Input:   TOPCODE *top     Probe topology string
+            int     length   Length of the probe
+            int     nrot     Orientations to include
+   Returns: int     *        Table of best scores (NULL if no memory)
 
-   Takes an integer array and counts how many elements there are up to but
-   excluding the first negative number
+   Builds the table used by ScoreBound(). This has the best score of 
+   each code against any element of the probe in each orientation, or
+   0 if every score is negative:
+      best[rot][code] = MAX(0, max over i of gRotMDM[rot][top[i]][code])
+   followed by a row with the best in any orientation.
 
-   08.03.00 Original   By: ACRM
+   17.10.26 Original   By: agent
 */
-int FindArrayLength(int *array)
+int *BuildBestScores(TOPCODE *top, int length, int nrot)
 {
-   int len = 0;
-   
-   while(*array++ >= 0) len++;
+   int *best,
+       *any,
+       rot, code, i;
+
+   if((best = (int *)calloc((nrot+1) * (NCODES+1), sizeof(int)))==NULL)
+      return(NULL);
+   any = best + nrot * (NCODES+1);
+
+   for(rot=0; rot<nrot; rot++)
+   {
+      for(code=0; code<=NCODES; code++)
+      {
+         for(i=0; i<length; i++)
+         {
+            if(gRotMDM[rot][top[i]][code] > best[rot*(NCODES+1) + code])
+               best[rot*(NCODES+1) + code] = gRotMDM[rot][top[i]][code];
+         }
+         if(best[rot*(NCODES+1) + code] > any[code])
+            any[code] = best[rot*(NCODES+1) + code];
+      }
+   }
    
-   return(len);
+   return(best);
 }
 
 
 /************************************************************************/
-/*>int MakeIntArray(int *array1, char *inarray)
-   --------------------------------------------
-   Input:   int    *array1    Integer array to be filled
-            char   *inarray   Dash-delimited list of positive integers
-   Returns: int               Number of integers copied into array
+/*>int EntryIDScore(SCANJOB *job, LIBENTRY *entry)
+   -----------------------------------------------
+   Input:   SCANJOB  *job     The scan job
+            LIBENTRY *entry   Library entry
+   Returns: int               Identity score for the entry
 
-   Builds an integer array terminated with a (-1) from a dash separated 
-   list of numbers
-   (e.g. 1-5-7-23-7-31 would go into a 7 element array containing
-   1,5,7,23,7,31,-1)
+   The score given by CalcIDScore() for the probe and the entry, from
+   the self-scores worked out once for the scan and the library
 
-   08.03.00 Original   By: ACRM
+   17.10.26 Original   By: agent
 */
-int MakeIntArray(int *array1, char *inarray)
+int EntryIDScore(SCANJOB *job, LIBENTRY *entry)
 {
-   int pos = 0;
-   char tempbuff[16],
-        *chp,
-        *buffp;
+   return(CombineIDScores(job->self1, job->length1, entry->selfScore,
+                          entry->length, job->UseBoth));
+}
+
+
+/************************************************************************/
+/*>REAL HitScore(SCANRESULT *result)
+   ---------------------------------
+   Input:   SCANRESULT *result    Result for a library entry
+   Returns: REAL                  The score as printed
+
+   The percentage score that is printed for an entry and by which hits
+   are ranked. If the identity score is 0 there is no percentage, so the
+   entry ranks below any other.
+
+   17.10.26 Original   By: agent
+*/
+REAL HitScore(SCANRESULT *result)
+{
+   if(result->IDScore == 0)
+      return(NOMINSCORE);
+   return((REAL)100.0 * (REAL)result->score / (REAL)result->IDScore);
+}
+
+
+/************************************************************************/
+/*>unsigned short PercentCell(int score, int IDScore)
+   --------------------------------------------------
+   Input:   int    score      Alignment score
+            int    IDScore    Identity score it is a percentage of
+   Returns: unsigned short    The percentage as a cell of an all-vs-all
+                              matrix
+
+   The percentage times TOPM_SCALE, rounded and clipped to the range of
+   a cell. With no identity score there is no percentage and the cell
+   is 0.
+
+   17.10.26 Original   By: agent
+*/
+unsigned short PercentCell(int score, int IDScore)
+{
+   REAL cell;
+
+   if(IDScore == 0)
+      return(0);
+
+   cell = (REAL)100.0 * TOPM_SCALE * (REAL)score / (REAL)IDScore + 0.5;
+   if(cell < 1.0)
+      return(0);
+   if(cell >= (REAL)TOPM_MAXCELL)
+      return(TOPM_MAXCELL);
+   return((unsigned short)cell);
+}
+
+
+/************************************************************************/
+/*>BOOL BetterHit(SCANRESULT *results, int a, int b)
+   -------------------------------------------------
+   Input:   SCANRESULT *results   Results by library index
+            int        a          Library index of one hit
+            int        b          Library index of another
+   Returns: BOOL                  Does a rank above b?
+
+   Hits are ranked by score. Equal scores are ranked in library order
+   so that the hits kept do not depend on the threading.
+
+   17.10.26 Original   By: agent
+*/
+BOOL BetterHit(SCANRESULT *results, int a, int b)
+{
+   REAL scoreA = HitScore(&(results[a])),
+        scoreB = HitScore(&(results[b]));
    
-   chp = inarray;
+   if(scoreA != scoreB)
+      return(scoreA > scoreB);
+   return(a < b);
+}
+
+
+/************************************************************************/
+/*>BOOL OfferHit(HITHEAP *heap, SCANRESULT *results, int entry)
+   ------------------------------------------------------------
+   I/O:     HITHEAP    *heap      Heap of hits
+   Input:   SCANRESULT *results   Results by library index
+            int        entry      Library index of the hit
+   Returns: BOOL                  Success?
+
+   Adds a hit to the heap. If the heap already holds heap->maxhits hits
+   the new one replaces the worst, if it is better, so the heap never
+   grows beyond that. With no limit the heap grows HITCHUNK hits at a
+   time.
+
+   17.10.26 Original   By: agent
+*/
+BOOL OfferHit(HITHEAP *heap, SCANRESULT *results, int entry)
+{
+   int pos, parent;
    
-   while(*chp)
+   if(heap->maxhits && (heap->nhits == heap->maxhits))
    {
-      buffp = tempbuff;
-      while(*chp != '-' && *chp)
+      if(BetterHit(results, entry, heap->hits[0]))
       {
-         *buffp++ = *chp++;
+         heap->hits[0] = entry;
+         SiftHitDown(heap->hits, heap->nhits, results, 0);
       }
-      *buffp = '\0';
-      sscanf(tempbuff,"%d", &(array1[pos++]));
-      if(*chp) chp++;
+      return(TRUE);
+   }
+
+   if(heap->nhits == heap->size)
+   {
+      int *hits;
+      
+      if((hits = (int *)realloc(heap->hits, (heap->size + HITCHUNK) *
+                                sizeof(int)))==NULL)
+         return(FALSE);
+      heap->hits  = hits;
+      heap->size += HITCHUNK;
+   }
+
+   /* Move the better hits above it down until it is in place           */
+   pos = heap->nhits++;
+   while(pos > 0)
+   {
+      parent = (pos - 1) / 2;
+      if(!BetterHit(results, heap->hits[parent], entry))
+         break;
+      heap->hits[pos] = heap->hits[parent];
+      pos = parent;
    }
-   array1[pos] = (-1);
+   heap->hits[pos] = entry;
    
-   return(pos);
+   return(TRUE);
 }
 
 
 /************************************************************************/
-/*>char *NumArrayToString(int *numarr)
-   -----------------------------------
-   Input:   int    *numarray   Integer array terminated with -1
-   Returns: char   *           Pointer to allocated character string
-                               containing dash deliminated numbers
+/*>void SiftHitDown(int *hits, int nhits, SCANRESULT *results, int pos)
+   --------------------------------------------------------------------
+   I/O:     int        *hits      Heap of hits, worst at the top
+   Input:   int        nhits      Number of hits in the heap
+            SCANRESULT *results   Results by library index
+            int        pos        Position of a hit which may be better
+                                  than those below it
 
-   Creates a character representation of an integer array. Each element
-   is printed as three characters zero-padded and separated by a dash.
-   The first negative number in the array represents the end of the
-   array.
+   Moves the hit at pos down the heap, swapping it with the worse of
+   the hits below it, until nothing below it is worse.
 
-   08.03.00 Original   By: ACRM
+   17.10.26 Original   By: agent
 */
-char *NumArrayToString(int *numarr)
+void SiftHitDown(int *hits, int nhits, SCANRESULT *results, int pos)
 {
-   char *buff = NULL,
-        tmpbuff[16],
-        *tbp;
-   int  buffsize = BUFFCHUNK,
-        i,
-        buffused = 0,
-        strsize;
+   int entry = hits[pos],
+       child;
    
-   if((buff = (char *)malloc(BUFFCHUNK * sizeof(char)))==NULL)
-      return(NULL);
-   buff[0] = '\0';
-
-   for(i=0; numarr[i] >= 0; i++)
+   while((child = 2 * pos + 1) < nhits)
    {
-      sprintf(tmpbuff,"%03d",numarr[i]);
-      KILLLEADSPACES(tbp,tmpbuff);
+      if((child + 1 < nhits) && 
+         BetterHit(results, hits[child], hits[child+1]))
+         child++;
+      if(!BetterHit(results, entry, hits[child]))
+         break;
+      hits[pos] = hits[child];
+      pos       = child;
+   }
+   hits[pos] = entry;
+}
 
-      /* Check whether the number string will fit, if not increase the
-         array size
-      */
-      strsize = strlen(tbp)+1;
-      if((buffused + strsize + 1) > buffsize)
+
+/************************************************************************/
+/*>int *MergeHits(HITHEAP *heaps, int nheaps, int maxhits, 
+                  SCANRESULT *results, int *nhits)
+   -------------------------------------------------------
+   Input:   HITHEAP    *heaps     Heaps of hits from each thread
+            int        nheaps     Number of heaps
+            int        maxhits    Most hits to keep (0 for no limit)
+            SCANRESULT *results   Results by library index
+   Output:  int        *nhits     Number of hits kept
+   Returns: int        *          Library indices of the hits, best 
+                                  first (NULL if no memory)
+
+   Merges the heaps kept by the scan threads into one and sorts it by
+   repeatedly swapping the worst hit to the end.
+
+   17.10.26 Original   By: agent
+*/
+int *MergeHits(HITHEAP *heaps, int nheaps, int maxhits, 
+               SCANRESULT *results, int *nhits)
+{
+   HITHEAP merged;
+   int     i, j,
+           last,
+           entry;
+
+   merged.nhits   = 0;
+   merged.size    = HITCHUNK;
+   merged.maxhits = maxhits;
+   if((merged.hits = (int *)malloc(HITCHUNK * sizeof(int)))==NULL)
+      return(NULL);
+   
+   for(i=0; i<nheaps; i++)
+   {
+      for(j=0; j<heaps[i].nhits; j++)
       {
-         buffsize += BUFFCHUNK;
-         buff = (char *)realloc(buff, buffsize);
+         if(!OfferHit(&merged, results, heaps[i].hits[j]))
+         {
+            free(merged.hits);
+            return(NULL);
+         }
       }
+   }
 
-      /* Add a dash if this isn't the first number added                */
-      if(i) strcat(buff, "-");
-      /* Now add the number itself                                      */
-      strcat(buff,tbp);
-      buffused = strlen(buff);
+   for(last=merged.nhits-1; last>0; last--)
+   {
+      entry             = merged.hits[0];
+      merged.hits[0]    = merged.hits[last];
+      merged.hits[last] = entry;
+      SiftHitDown(merged.hits, last, results, 0);
    }
-   
-   return(buff);
+
+   *nhits = merged.nhits;
+   return(merged.hits);
 }
 
+
+/************************************************************************/
+/*>BOOL PrintScanResults(FILE *out, TOPCODE *top1, int length1, 
+                         LIBRARY *library, SCANRESULT *results, 
+                         int *hits, int nhits)
+   --------------------------------------------------------------
+   Input:   FILE       *out       Where to print the results
+            TOPCODE    *top1      The probe topology string
+            int        length1    Length of top1
+            LIBRARY    *library   The library that was scanned
+            SCANRESULT *results   Results from ScanLibrary()
+            int        *hits      Hits to print from ScanLibrary() (or
+                                  NULL for all the entries)
+            int        nhits      Number of hits
+   Returns: BOOL                  Success?
+
+   Prints the results of a library scan in library order, or just the
+   hits in the order given. In verbose mode the alignment of each entry
+   is built as it is printed. Where there is no alignment because a 
+   topology string is empty, the probe is shown instead. Entries skipped
+   by the band are left out.
+
+   17.10.26 Original (code taken from main())   By: agent
+   17.10.26 Leaves out skipped entries   By: agent
+   17.10.26 Takes TOPCODE strings with their lengths   By: agent
+   17.10.26 Added hits and nhits   By: agent
+   17.10.26 Added out   By: agent
+*/
+BOOL PrintScanResults(FILE *out, TOPCODE *top1, int length1, 
+                      LIBRARY *library, SCANRESULT *results, int *hits,
+                      int nhits)
+{
+   LIBENTRY *entry;
+   char     *best1,
+            *best2;
+   int      i, n;
+   
+   if(hits == NULL)
+      nhits = library->nentries;
+   
+   for(n=0; n<nhits; n++)
+   {
+      i     = ((hits == NULL) ? n : hits[n]);
+      entry = &(library->entries[i]);
+      if(results[i].skipped)
+         continue;
+      
+      if(gVerbose)
+      {
+         if(!BuildAlignment(top1, length1, entry->top, entry->length,
+                            results[i].rotation, &best1, &best2))
+            return(FALSE);
+
+         if((length1 == 0) || (entry->length == 0))
+         {
+            free(best1);
+            if((best1 = CodesToString(top1, length1))==NULL)
+            {
+               free(best2);
+               return(FALSE);
+            }
+         }
+         
+         fprintf(out,"! %s\n! %s\n",best1,best2);
+         free(best1);
+         free(best2);
+      }
+      fprintf(out,"%s %f\n", entry->name,
+              (REAL)100.0 * (REAL)results[i].score / 
+              (REAL)results[i].IDScore);
+   }
+
+   return(TRUE);
+}
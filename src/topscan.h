@@ -0,0 +1,129 @@
+/*************************************************************************
+
+   Program:    topscan
+   File:       topscan.h
+
+   Version:    V3.13
+   Date:       17.10.26
+   Function:   Compare protein topologies
+
+   Copyright:  (c) UCL, Reading, Dr. Andrew C. R. Martin 1998-2026
+   Author:     agent, for topscan by Dr. Andrew C. R. Martin
+   Address:    Biomolecular Structure & Modelling Unit,
+               Department of Biochemistry & Molecular Biology,
+               University College,
+               Gower Street,
+               London.
+               WC1E 6BT.
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If someone
+   else breaks this code, I don't want to be blamed for code that does not
+   work!
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   Definitions shared between topscan.c, the vectorised alignment code
+   in simdalign.c and the kernel selection in kernels.c
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.4  17.10.26 Original   By: agent
+   V3.5  17.10.26 Added the batch kernel   By: agent
+   V3.6  17.10.26 Added the rotation-parallel profile   By: agent
+   V3.7  17.10.26 Added kernel selection   By: agent
+   V3.8  17.10.26 Added the primary topology codes   By: agent
+   V3.9  17.10.26 Added band to the alignment functions   By: agent
+   V3.13 17.10.26 Topology strings are TOPCODE arrays. Scoring matrices
+                  are held as signed char   By: agent
+
+*************************************************************************/
+#ifndef _TOPSCAN_H
+#define _TOPSCAN_H
+
+/************************************************************************/
+/* Includes
+*/
+#include "bioplib/SysDefs.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define GAPPEN                8
+#define NCODES                192    /* Highest topology code            */
+#define NROTATIONS            24     /* Orientations of a topology       */
+#define SIMDBATCH_OVERFLOW    (-1)   /* Batch score needs redoing        */
+#define PRIMARYSTRAND         1      /* The only codes used for primary  */
+#define PRIMARYHELIX          7      /* topology (-1)                    */
+#define NOBAND                (-1)   /* Band width for a full alignment  */
+
+/************************************************************************/
+/* Type definitions
+*/
+typedef unsigned char TOPCODE;  /* A topology code (0..NCODES)          */
+
+typedef struct                  /* Striped score profile of a probe     */
+{
+   short *profile;              /* [nrot][NCODES+1][segLen*lanes]       */
+   short *rotProfile;           /* [NCODES+1][length][32] (or NULL)     */
+   int   length,                /* Length of the probe                  */
+         segLen,                /* Vectors needed to hold the probe     */
+         lanes,                 /* 16-bit lanes in a vector             */
+         nrot;                  /* Orientations in the profile          */
+}  SIMDPROFILE;
+
+typedef struct                  /* Byte profile of a probe for aligning */
+{                               /* several library entries at once      */
+   unsigned char *profile;      /* [nrot][NCODES+1][padLength]          */
+   unsigned char *primary;      /* Vectors of scores against            */
+                                /* PRIMARYSTRAND and PRIMARYHELIX for   */
+                                /* each probe element (nrot==1 only)    */
+   int           length,        /* Length of the probe                  */
+                 padLength,     /* Length padded to a whole block       */
+                 lanes,         /* Library entries aligned at once      */
+                 nrot;          /* Orientations in the profile          */
+}  SIMDBATCHPROFILE;
+
+/************************************************************************/
+/* Globals
+*/
+extern signed char gMDM[NCODES+1][NCODES+1],
+                   gRotMDM[NROTATIONS][NCODES+1][NCODES+1];
+
+/************************************************************************/
+/* Prototypes
+*/
+BOOL SelectKernel(char *name);
+char *KernelName(void);
+int SIMDLanes(void);
+SIMDPROFILE *BuildSIMDProfile(TOPCODE *top, int length, int nrot);
+void FreeSIMDProfile(SIMDPROFILE *profile);
+BOOL SIMDAlignScores(SIMDPROFILE *profile, TOPCODE *seq2, int length2,
+                     int band, int *scores);
+int SIMDBatchLanes(void);
+SIMDBATCHPROFILE *BuildSIMDBatchProfile(TOPCODE *top, int length, int nrot);
+void FreeSIMDBatchProfile(SIMDBATCHPROFILE *profile);
+BOOL SIMDBatchAlignScores(SIMDBATCHPROFILE *profile, TOPCODE **seqs,
+                          int *lengths, int nseqs, int band,
+                          int *scores);
+
+#endif